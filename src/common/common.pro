@@ -49,11 +49,32 @@ HEADERS += 	\
     ml_mesh_type.h \
     meshmodel.h \
     pluginmanager.h \
+    pluginmanifest.h \
     mlexception.h \
     mlapplication.h \
     meshlabdocumentxml.h \
     ml_shared_data_context.h \
     ml_selection_buffers.h \
+    ml_parallel_utils.h \
+    ml_parallel_clean.h \
+    ml_parallel_subdivision.h \
+    ml_mutualinfo.h \
+    rasterimagecache.h \
+    ml_parallel_sdf.h \
+    ml_parallel_poisson.h \
+    ml_parallel_append.h \
+    ml_parallel_ball_pivoting.h \
+    ml_parallel_curvature.h \
+    ml_parallel_remeshing.h \
+    ml_parallel_clustering.h \
+    ml_parallel_normals.h \
+    ml_parallel_knn.h \
+    ml_parallel_bvh.h \
+    ml_parallel_update.h \
+    ml_parallel_geodesic.h \
+    ml_parallel_smooth.h \
+    ml_parallel_topology.h \
+    ml_parallel_components.h \
     meshlabdocumentxml.h
 
 SOURCES += \
@@ -64,6 +85,8 @@ SOURCES += \
     GLLogStream.cpp \
     meshmodel.cpp \
     pluginmanager.cpp \
+    pluginmanifest.cpp \
+    rasterimagecache.cpp \
     mlapplication.cpp \
     searcher.cpp \
     meshlabdocumentxml.cpp \
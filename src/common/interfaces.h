@@ -91,6 +91,7 @@ public:
 
 	/// Standard stuff that usually should not be redefined.
 	void setLog(GLLogStream *log) { this->log = log; }
+	GLLogStream *getLog() const { return log; }
 
 	// This function must be used to communicate useful information collected in the parsing/saving of the files.
 	// NEVER EVER use a msgbox to say something to the user.
@@ -29,6 +29,7 @@
 #include <wrap/gl/math.h>
 #include "mlexception.h"
 #include "ml_shared_data_context.h"
+#include "ml_parallel_update.h"
 
 #include <utility>
 
@@ -352,17 +353,32 @@ void MeshModel::Clear()
     cm.Tr.SetIdentity();
     cm.sfn=0;
     cm.svn=0;
+    clearKNNGraph();
 }
 
 void MeshModel::UpdateBoxAndNormals()
 {
-    tri::UpdateBounding<CMeshO>::Box(cm);
+    clearKNNGraph();
+    tri::ParallelUpdateBounding<CMeshO>::Box(cm);
     if(cm.fn>0) {
-        tri::UpdateNormal<CMeshO>::PerFaceNormalized(cm);
-        tri::UpdateNormal<CMeshO>::PerVertexAngleWeighted(cm);
+        tri::ParallelUpdateNormal<CMeshO>::PerFaceNormalized(cm);
+        tri::ParallelUpdateNormal<CMeshO>::PerVertexAngleWeighted(cm);
     }
 }
 
+void MeshModel::clearKNNGraph(int postCondMask)
+{
+    if(postCondMask & (MM_VERTCOORD | MM_VERTNUMBER | MM_FACENUMBER | MM_UNKNOWN))
+        clearKNNGraph();
+}
+
+const vcg::tri::ParallelKNNGraph<CMeshO> &MeshModel::knnGraph(int k)
+{
+    if(!knnGraphCache.IsValidFor(cm,k))
+        knnGraphCache.Build(cm,k);
+    return knnGraphCache;
+}
+
 MeshModel::MeshModel(MeshDocument *_parent, const QString& fullFileName, const QString& labelName)
 {
     /*glw.m = &(cm);*/
@@ -437,18 +453,23 @@ int MeshModel::io2mm(int single_iobit)
 }
 
 Plane::Plane(const Plane& pl)
+    :semantic(pl.semantic),fullPathFileName(pl.fullPathFileName),buf(NULL),
+    imgSize(pl.imgSize),pinCount(0),owned(false),unreadable(pl.unreadable)
 {
-    semantic = pl.semantic;
-    fullPathFileName = pl.fullPathFileName;
-    image = QImage(pl.image);
+    // images read from the file are decoded again by the copy if needed
+    if (pl.owned)
+        setImage(pl.img);
 }
 
 Plane::Plane(const QString& pathName, const int _semantic)
+    :semantic(_semantic),fullPathFileName(pathName),buf(NULL),pinCount(0),owned(false),unreadable(false)
 {
-    semantic =_semantic;
-    fullPathFileName = pathName;
+    // the image is decoded on the first access, see RasterImageCache
+}
 
-    image = QImage(pathName);
+Plane::~Plane()
+{
+    RasterImageCache::instance().remove(this);
 }
 
 RasterModel::RasterModel(MeshDocument *parent, QString _rasterName)
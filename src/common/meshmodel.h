@@ -58,7 +58,9 @@
 #include <QAction>
 #include "GLLogStream.h"
 #include "filterscript.h"
+#include "ml_parallel_knn.h"
 #include "ml_shared_data_context.h"
+#include "rasterimagecache.h"
 
 
 /*
@@ -166,10 +168,20 @@ private:
     QString _label;
     int _id;
     bool modified;
+    vcg::tri::ParallelKNNGraph<CMeshO> knnGraphCache;
 
 public:
     void Clear();
     void UpdateBoxAndNormals(); // This is the STANDARD method that you should call after changing coords.
+
+    // k-nearest neighbour graph of the vertices, shared by the point set filters.
+    // It is built on the first request and kept until the coordinates change,
+    // that is until the next UpdateBoxAndNormals() or clearKNNGraph().
+    const vcg::tri::ParallelKNNGraph<CMeshO> &knnGraph(int k);
+    void clearKNNGraph() { knnGraphCache.Clear(); }
+    // Called after a filter with its postCondition() mask: drops the graph
+    // if the filter may have moved, added or removed vertices.
+    void clearKNNGraph(int postCondMask);
     inline int id() const {return _id;}
     
     
@@ -254,13 +266,22 @@ public:
 
     int semantic;
     QString fullPathFileName;
-    QImage image;
-    QImage thumb;
     float *buf;
 
-    bool IsInCore() { return !image.isNull(); }
-    void Load();
-    void Discard(); //discard  the loaded image freeing the mem.
+    /// The image, decoded on the first access and kept by the RasterImageCache;
+    /// pin the plane (RasterImagePin) to keep it in memory across other accesses.
+    QImage image() { return RasterImageCache::instance().acquire(this); }
+    /// Size of the image, without decoding it if possible.
+    QSize size() { return RasterImageCache::instance().size(this); }
+    /// Replace the image with one that does not come from the file; it is never discarded.
+    void setImage(const QImage &img) { RasterImageCache::instance().set(this, img); }
+
+    bool IsInCore() const { return RasterImageCache::instance().inCore(this); }
+    void Load() { RasterImageCache::instance().acquire(this); }
+    void Prefetch() { RasterImageCache::instance().prefetch(this); } //start decoding the image in background
+    void Discard() { RasterImageCache::instance().discard(this); } //discard  the loaded image freeing the mem.
+    void Pin() { RasterImageCache::instance().pin(this); }
+    void Unpin() { RasterImageCache::instance().unpin(this); }
 
     /// The whole full path name of the mesh
     const QString fullName() const {return fullPathFileName;}
@@ -269,7 +290,18 @@ public:
 
     Plane(const Plane& pl);
     Plane(const QString& pathName, const int _semantic);
+    ~Plane();
+
+private:
+    friend class RasterImageCache;
+
+    QImage img;
+    QSize imgSize;
+    int pinCount;
+    bool owned;
+    bool unreadable;
 
+    Plane &operator=(const Plane &);
 }; //end class Plane
 
 
@@ -0,0 +1,463 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_MUTUALINFO_H
+#define __ML_MUTUALINFO_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <QImage>
+#include <vcg/math/shot.h>
+#include "ml_mesh_type.h"
+#include "ml_parallel_utils.h"
+
+/*
+  Software rendering of the images compared by the mutual information
+  image-to-geometry registration.
+
+  It produces the same buffers that the registration plugins read back
+  from their GL shaders (normal map, vertex color, reflection direction,
+  their combinations and the blending of other rasters projected on the
+  mesh), without any GL context, so that several rasters can be aligned
+  at the same time by different threads, each with its own instance.
+
+  The viewport is split in square tiles, the faces are binned in the tiles
+  their bounding box overlaps and each tile is rasterized by a single
+  thread, keeping for every pixel the nearest face; the shading is then
+  done per pixel with perspective correct interpolation. When called from
+  inside a parallel region everything runs on the calling thread.
+*/
+class MLMutualInfoRaster
+{
+public:
+	// same values of AlignSet::RenderingMode
+	enum Mode { COMBINE = 0, NORMALMAP, COLOR, SPECULAR, SILHOUETTE, SPECAMB };
+
+	static const int TileSize = 32;
+
+	/// A raster projected on the mesh, with its shadow map.
+	struct Projector
+	{
+		vcg::Shotf shot;
+		QImage image;              // RGB32, w x h
+		float weight;
+		int w, h;
+		std::vector<float> invz;   // 1/depth of the nearest surface, 0 if empty
+	};
+
+	/** Render the mesh seen from shot, scaled to a w x h viewport, and store
+	 * the given color component (0..3 = r, g, b, a) of every pixel in out,
+	 * rows from the bottom as read by glReadPixels. Background is 0.
+	 */
+	void Render(const vcg::Shotf &shot, const CMeshO &m, int mode, int component, int w, int h, unsigned char *out)
+	{
+		Visibility(shot, m, w, h);
+
+		// per vertex vector interpolated for the normal-based modes, in eye space
+		const bool useNormal = mode == COMBINE || mode == NORMALMAP;
+		const bool useReflection = mode == SPECULAR || mode == SPECAMB;
+		const int vertNum = int(m.vert.size());
+		if (useNormal || useReflection)
+		{
+			const vcg::Matrix44f rot = shot.Extrinsics.Rot();
+			const vcg::Point3f vp = shot.GetViewPoint();
+			vvec.resize(vertNum);
+#pragma omp parallel for schedule(static) if (vertNum >= MLParallel::MinParallelSize)
+			for (int i = 0; i < vertNum; ++i)
+			{
+				const vcg::Point3f n = rot * vcg::Point3f::Construct(m.vert[i].cN());
+				if (useNormal)
+					vvec[i] = n;
+				else
+				{
+					// reflect(position, normalize(normal)), as the specular vertex shader
+					const vcg::Point3f e = rot * (vcg::Point3f::Construct(m.vert[i].cP()) - vp);
+					vcg::Point3f nn = n;
+					nn.Normalize();
+					vvec[i] = e - nn * (2.0f * (nn * e));
+				}
+			}
+		}
+
+#pragma omp parallel for schedule(static) if (w * h >= MLParallel::MinParallelSize)
+		for (int y = 0; y < h; ++y)
+			for (int x = 0; x < w; ++x)
+			{
+				const int k = y * w + x;
+				if (fid[k] == -1)
+				{
+					out[k] = 0;
+					continue;
+				}
+				int vi[3];
+				float l[3];
+				Weights(m, k, x, y, vi, l);
+
+				float c[4] = { 1, 1, 1, 1 };
+				if (mode == COLOR || mode == COMBINE || mode == SPECAMB)
+					for (int j = 0; j < 4; ++j)
+						c[j] = (l[0] * m.vert[vi[0]].cC()[j] + l[1] * m.vert[vi[1]].cC()[j] + l[2] * m.vert[vi[2]].cC()[j]) / 255.0f;
+				if (useNormal || useReflection)
+				{
+					vcg::Point3f v = vvec[vi[0]] * l[0] + vvec[vi[1]] * l[1] + vvec[vi[2]] * l[2];
+					v.Normalize();
+					const float nc[4] = { v[0] * 0.5f + 0.5f, v[1] * 0.5f + 0.5f, v[2] * 0.5f + 0.5f, 1.0f };
+					const float t = (mode == COMBINE || mode == SPECAMB) ? c[0] * c[0] : 1.0f;
+					for (int j = 0; j < 4; ++j)
+						c[j] = (1 - t) * c[j] + t * nc[j];
+				}
+				out[k] = ToByte(c[component]);
+			}
+	}
+
+	/** Set up p to project img, scaled to w x h, from shot; the shadow map
+	 * is rendered at the same resolution.
+	 */
+	void MakeProjector(const vcg::Shotf &shot, const CMeshO &m, const QImage &img, float weight, int w, int h, Projector &p)
+	{
+		Visibility(shot, m, w, h);
+		p.shot = shot;
+		p.weight = weight;
+		p.w = w;
+		p.h = h;
+		p.invz = invz;
+		p.image = img.scaled(w, h).convertToFormat(QImage::Format_RGB32);
+	}
+
+	/** Render the mesh seen from shot with the projectors blended on it,
+	 * each one weighted by its weight where it sees the surface and
+	 * modulated by the vertex color, as the multi image projection shader;
+	 * where no projector sees the surface the combined mode is used. out is
+	 * a w x h image, top row first as QGLFramebufferObject::toImage().
+	 */
+	void RenderProjected(const vcg::Shotf &shot, const CMeshO &m, const std::vector<Projector> &prj, int w, int h, QImage &out)
+	{
+		Visibility(shot, m, w, h);
+
+		const vcg::Matrix44f rot = shot.Extrinsics.Rot();
+		out = QImage(w, h, QImage::Format_RGB32);
+		out.fill(0);
+		uchar *bits = out.bits();
+		const int bytesPerLine = out.bytesPerLine();
+
+#pragma omp parallel for schedule(static) if (w * h >= MLParallel::MinParallelSize)
+		for (int y = 0; y < h; ++y)
+		{
+			QRgb *line = reinterpret_cast<QRgb *>(bits + size_t(h - 1 - y) * bytesPerLine);
+			for (int x = 0; x < w; ++x)
+			{
+				const int k = y * w + x;
+				if (fid[k] == -1) continue;
+				int vi[3];
+				float l[3];
+				Weights(m, k, x, y, vi, l);
+
+				float c[4];
+				for (int j = 0; j < 4; ++j)
+					c[j] = (l[0] * m.vert[vi[0]].cC()[j] + l[1] * m.vert[vi[1]].cC()[j] + l[2] * m.vert[vi[2]].cC()[j]) / 255.0f;
+				const vcg::Point3f p = vcg::Point3f::Construct(m.vert[vi[0]].cP() * l[0] + m.vert[vi[1]].cP() * l[1] + m.vert[vi[2]].cP() * l[2]);
+
+				float clr[4] = { 0, 0, 0, 0 };
+				float wsum = 0;
+				for (size_t j = 0; j < prj.size(); ++j)
+				{
+					QRgb texel;
+					if (!Sample(prj[j], p, texel)) continue;
+					clr[0] += qRed(texel) / 255.0f * prj[j].weight;
+					clr[1] += qGreen(texel) / 255.0f * prj[j].weight;
+					clr[2] += qBlue(texel) / 255.0f * prj[j].weight;
+					clr[3] += prj[j].weight;
+					wsum += prj[j].weight;
+				}
+				if (wsum > 0)
+					for (int j = 0; j < 4; ++j)
+						c[j] = c[j] * clr[j] / wsum;
+				else
+				{
+					vcg::Point3f n = rot * vcg::Point3f::Construct(m.vert[vi[0]].cN() * l[0] + m.vert[vi[1]].cN() * l[1] + m.vert[vi[2]].cN() * l[2]);
+					n.Normalize();
+					const float t = c[0] * c[0];
+					for (int j = 0; j < 3; ++j)
+						c[j] = (1 - t) * c[j] + t * (n[j] * 0.5f + 0.5f);
+				}
+				line[x] = qRgb(ToByte(c[0]), ToByte(c[1]), ToByte(c[2]));
+			}
+		}
+	}
+
+	/** Joint histogram of two w wide byte images over the window
+	 * [startx,endx) x [starty,endy), as MutualInfo::histogram: the value
+	 * of a is the column, the one of b the row, each shifted right by
+	 * shift, binBits is log2 of the bins per side, every pixel counts 2.
+	 * histo must have room for 4 histograms, the result is in the first.
+	 *
+	 * The bin indices of a row are computed first, in a loop the compiler
+	 * can vectorize, and scattered in four interleaved histograms, so that
+	 * runs of equal pixels (the background) do not serialize on a counter.
+	 */
+	static void JointHistogram(int w, const unsigned char *a, const unsigned char *b,
+	                           int startx, int endx, int starty, int endy, int shift, int binBits, unsigned int *histo)
+	{
+		const int n = 1 << (2 * binBits);
+		std::memset(histo, 0, 4 * n * sizeof(unsigned int));
+		unsigned int *h0 = histo, *h1 = histo + n, *h2 = histo + 2 * n, *h3 = histo + 3 * n;
+		const int len = endx - startx;
+		std::vector<unsigned short> idx(std::max(len, 0) + 3);
+		for (int y = starty; y < endy; ++y)
+		{
+			const unsigned char *ra = a + size_t(w) * y + startx;
+			const unsigned char *rb = b + size_t(w) * y + startx;
+			for (int x = 0; x < len; ++x)
+				idx[x] = (unsigned short)((ra[x] >> shift) + ((rb[x] >> shift) << binBits));
+			int x = 0;
+			for (; x + 4 <= len; x += 4)
+			{
+				h0[idx[x]] += 2;
+				h1[idx[x + 1]] += 2;
+				h2[idx[x + 2]] += 2;
+				h3[idx[x + 3]] += 2;
+			}
+			for (; x < len; ++x)
+				h0[idx[x]] += 2;
+		}
+		for (int i = 0; i < n; ++i)
+			h0[i] += h1[i] + h2[i] + h3[i];
+	}
+
+private:
+	std::vector<vcg::Point3f> sv;   // pixel coords and 1/z of the vertices, 1/z = 0 if unusable
+	std::vector<float> invz;
+	std::vector<int> fid;           // face of each pixel, -2-v for vertex v of a point cloud, -1 if empty
+	std::vector<vcg::Point3f> vvec;
+	std::vector<int> slot, tileOffset, tileFace;
+
+	static unsigned char ToByte(float v)
+	{
+		return (unsigned char)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	static float Edge(const vcg::Point3f &a, const vcg::Point3f &b, float x, float y)
+	{
+		return (b[0] - a[0]) * (y - a[1]) - (b[1] - a[1]) * (x - a[0]);
+	}
+
+	// vertices and perspective correct weights of pixel k
+	void Weights(const CMeshO &m, int k, int x, int y, int vi[3], float l[3]) const
+	{
+		if (fid[k] <= -2)
+		{
+			vi[0] = vi[1] = vi[2] = -2 - fid[k];
+			l[0] = 1;
+			l[1] = l[2] = 0;
+			return;
+		}
+		const CMeshO::FaceType &f = m.face[fid[k]];
+		for (int j = 0; j < 3; ++j)
+			vi[j] = int(vcg::tri::Index(m, f.cV(j)));
+		const vcg::Point3f &a = sv[vi[0]], &b = sv[vi[1]], &c = sv[vi[2]];
+		const float px = x + 0.5f, py = y + 0.5f;
+		l[0] = Edge(b, c, px, py) * a[2];
+		l[1] = Edge(c, a, px, py) * b[2];
+		l[2] = Edge(a, b, px, py) * c[2];
+		const float sum = l[0] + l[1] + l[2];
+		for (int j = 0; j < 3; ++j)
+			l[j] /= sum;
+	}
+
+	// color of the projector at the surface point p, false if p is not seen by it
+	static bool Sample(const Projector &pr, const vcg::Point3f &p, QRgb &texel)
+	{
+		const float z = pr.shot.Depth(p);
+		if (z <= 0) return false;
+		const vcg::Point2f pp = pr.shot.Project(p);
+		const int x = int(pp[0] * pr.w / pr.shot.Intrinsics.ViewportPx[0]);
+		const int y = int(pp[1] * pr.h / pr.shot.Intrinsics.ViewportPx[1]);
+		if (pp[0] < 0 || pp[1] < 0 || x >= pr.w || y >= pr.h) return false;
+		// the tolerance covers the difference between the interpolated depth and the one of the shadow map
+		const float d = pr.invz[size_t(y) * pr.w + x];
+		if (d <= 0 || z * d > 1.01f) return false;
+		texel = reinterpret_cast<const QRgb *>(pr.image.constScanLine(pr.h - 1 - y))[x];
+		return true;
+	}
+
+	// Nearest face of every pixel of the w x h viewport, in fid, and its 1/z, in invz.
+	void Visibility(const vcg::Shotf &shot, const CMeshO &m, int w, int h)
+	{
+		const int vertNum = int(m.vert.size());
+		const float sx = float(w) / shot.Intrinsics.ViewportPx[0];
+		const float sy = float(h) / shot.Intrinsics.ViewportPx[1];
+		sv.resize(vertNum);
+#pragma omp parallel for schedule(static) if (vertNum >= MLParallel::MinParallelSize)
+		for (int i = 0; i < vertNum; ++i)
+		{
+			const CMeshO::VertexType &v = m.vert[i];
+			const vcg::Point3f p = vcg::Point3f::Construct(v.cP());
+			const float z = v.IsD() ? 0 : float(shot.Depth(p));
+			if (z <= 0)
+			{
+				sv[i] = vcg::Point3f(0, 0, 0);
+				continue;
+			}
+			const vcg::Point2f pp = shot.Project(p);
+			sv[i] = vcg::Point3f(pp[0] * sx, pp[1] * sy, 1.0f / z);
+		}
+
+		invz.assign(size_t(w) * h, 0.0f);
+		fid.assign(size_t(w) * h, -1);
+		if (m.fn == 0)
+		{
+			for (int i = 0; i < vertNum; ++i)
+			{
+				const vcg::Point3f &p = sv[i];
+				if (p[2] <= 0 || p[0] < 0 || p[1] < 0 || p[0] >= w || p[1] >= h) continue;
+				const int k = int(p[1]) * w + int(p[0]);
+				if (p[2] > invz[k])
+				{
+					invz[k] = p[2];
+					fid[k] = -2 - i;
+				}
+			}
+		}
+		else
+			RasterFaces(m, w, h);
+	}
+
+	// Pixels whose center can be covered by face f, clipped to the viewport.
+	bool PixelRange(const CMeshO &m, const CMeshO::FaceType &f, int w, int h, vcg::Box2i &r) const
+	{
+		if (f.IsD()) return false;
+		vcg::Box2f bb;
+		for (int k = 0; k < 3; ++k)
+		{
+			const vcg::Point3f &p = sv[vcg::tri::Index(m, f.cV(k))];
+			if (p[2] <= 0) return false;
+			bb.Add(vcg::Point2f(p[0], p[1]));
+		}
+		r.min[0] = std::max(int(std::ceil(bb.min[0] - 0.5f)), 0);
+		r.min[1] = std::max(int(std::ceil(bb.min[1] - 0.5f)), 0);
+		r.max[0] = std::min(int(std::floor(bb.max[0] - 0.5f)), w - 1);
+		r.max[1] = std::min(int(std::floor(bb.max[1] - 0.5f)), h - 1);
+		return r.min[0] <= r.max[0] && r.min[1] <= r.max[1];
+	}
+
+	void RasterFaces(const CMeshO &m, int w, int h)
+	{
+		const int tilesX = (w + TileSize - 1) / TileSize;
+		const int tilesY = (h + TileSize - 1) / TileSize;
+		const int tileNum = tilesX * tilesY;
+		const int faceNum = int(m.face.size());
+
+		// binning: a counting sort where each chunk of faces has its own slots in every tile,
+		// so that the faces of a tile stay in index order whatever the number of chunks
+		const int chunkNum = (faceNum < MLParallel::MinParallelSize || MLParallel::InParallel()) ? 1 : MLParallel::ThreadNum();
+		const std::vector<int> bnd = MLParallel::Chunks(faceNum, chunkNum);
+		slot.assign(size_t(chunkNum) * tileNum, 0);
+#pragma omp parallel for schedule(static, 1) if (chunkNum > 1)
+		for (int c = 0; c < chunkNum; ++c)
+		{
+			int *cnt = &slot[size_t(c) * tileNum];
+			for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+			{
+				vcg::Box2i r;
+				if (!PixelRange(m, m.face[i], w, h, r)) continue;
+				for (int ty = r.min[1] / TileSize; ty <= r.max[1] / TileSize; ++ty)
+					for (int tx = r.min[0] / TileSize; tx <= r.max[0] / TileSize; ++tx)
+						++cnt[ty * tilesX + tx];
+			}
+		}
+		tileOffset.resize(tileNum + 1);
+		int total = 0;
+		for (int t = 0; t < tileNum; ++t)
+		{
+			tileOffset[t] = total;
+			for (int c = 0; c < chunkNum; ++c)
+			{
+				const int n = slot[size_t(c) * tileNum + t];
+				slot[size_t(c) * tileNum + t] = total;
+				total += n;
+			}
+		}
+		tileOffset[tileNum] = total;
+		tileFace.resize(total);
+#pragma omp parallel for schedule(static, 1) if (chunkNum > 1)
+		for (int c = 0; c < chunkNum; ++c)
+		{
+			int *cursor = &slot[size_t(c) * tileNum];
+			for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+			{
+				vcg::Box2i r;
+				if (!PixelRange(m, m.face[i], w, h, r)) continue;
+				for (int ty = r.min[1] / TileSize; ty <= r.max[1] / TileSize; ++ty)
+					for (int tx = r.min[0] / TileSize; tx <= r.max[0] / TileSize; ++tx)
+						tileFace[cursor[ty * tilesX + tx]++] = i;
+			}
+		}
+
+#pragma omp parallel for schedule(dynamic, 1) if (chunkNum > 1)
+		for (int t = 0; t < tileNum; ++t)
+		{
+			const int tx0 = (t % tilesX) * TileSize;
+			const int ty0 = (t / tilesX) * TileSize;
+			const int tx1 = std::min(tx0 + TileSize, w) - 1;
+			const int ty1 = std::min(ty0 + TileSize, h) - 1;
+			for (int k = tileOffset[t]; k < tileOffset[t + 1]; ++k)
+			{
+				const int fi = tileFace[k];
+				const CMeshO::FaceType &f = m.face[fi];
+				const vcg::Point3f &a = sv[vcg::tri::Index(m, f.cV(0))];
+				const vcg::Point3f &b = sv[vcg::tri::Index(m, f.cV(1))];
+				const vcg::Point3f &c = sv[vcg::tri::Index(m, f.cV(2))];
+				const float area = Edge(a, b, c[0], c[1]);
+				if (area == 0) continue;
+				vcg::Box2i r;
+				PixelRange(m, f, w, h, r);
+				const int x0 = std::max(r.min[0], tx0), x1 = std::min(r.max[0], tx1);
+				const int y0 = std::max(r.min[1], ty0), y1 = std::min(r.max[1], ty1);
+				for (int y = y0; y <= y1; ++y)
+				{
+					const float py = y + 0.5f;
+					for (int x = x0; x <= x1; ++x)
+					{
+						const float px = x + 0.5f;
+						// barycentric coords of the pixel center
+						const float l0 = Edge(b, c, px, py) / area;
+						const float l1 = Edge(c, a, px, py) / area;
+						const float l2 = Edge(a, b, px, py) / area;
+						if (l0 < 0 || l1 < 0 || l2 < 0) continue;
+						const float iz = l0 * a[2] + l1 * b[2] + l2 * c[2];
+						const int p = y * w + x;
+						if (iz > invz[p])
+						{
+							invz[p] = iz;
+							fid[p] = fi;
+						}
+					}
+				}
+			}
+		}
+	}
+};
+
+#endif
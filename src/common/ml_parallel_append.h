@@ -0,0 +1,259 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_APPEND_H
+#define __ML_PARALLEL_APPEND_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/update/topology.h>
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Append of many meshes at once into a single one.
+
+  Appending n meshes one after the other with Append<>::Mesh regrows the
+  destination containers and fixes up all the pointers appended so far at
+  every step. Here the number of surviving vertices and faces of all the
+  sources is computed first, the destination is allocated once and every
+  source is copied into its own disjoint range, by a single parallel loop
+  over the elements of all the sources. Each source
+  can be moved by its own matrix, exactly as UpdatePosition<>::Matrix
+  would do before the append, but the sources are left untouched.
+
+  The optional components enabled on the destination are the ones that
+  are copied, so they have to be enabled before (e.g. the union of the
+  ones of the sources). Adjacency is not copied, it is rebuilt at the end
+  if enabled on the destination.
+*/
+template <class MeshType>
+class ParallelAppend
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::FaceType       FaceType;
+	typedef Matrix44<ScalarType>              MatrixType;
+
+	/** True if Flatten can handle the sources; meshes with edges or with
+	 * user defined attributes have to go through Append<>::Mesh.
+	 */
+	static bool CanFlatten(const std::vector<MeshType *> &src)
+	{
+		for (size_t i = 0; i < src.size(); ++i)
+			if (src[i]->en > 0 || !src[i]->vert_attr.empty() || !src[i]->face_attr.empty() || !src[i]->mesh_attr.empty())
+				return false;
+		return true;
+	}
+
+	/** Append all the src meshes, each transformed by the matrix with the
+	 * same index, at the end of dest. Deleted elements are skipped and,
+	 * unless alsoUnreferenced, so are the vertices not used by any face.
+	 */
+	static void Flatten(MeshType &dest, const std::vector<MeshType *> &src, const std::vector<MatrixType> &tr,
+	                    bool alsoUnreferenced, CallBackPos *cb = 0)
+	{
+		const int srcNum = int(src.size());
+
+		// per source: its place in dest and the index of each of its
+		// elements in its own range, -1 if skipped
+		std::vector<Layer> layer(srcNum);
+		std::vector<int> vertOffset(srcNum + 1, 0), faceOffset(srcNum + 1, 0);
+		for (int l = 0; l < srcNum; ++l)
+		{
+			if (cb) cb(l * 50 / srcNum, "Merging layers...");
+			vertOffset[l] = LiveVertices(*src[l], alsoUnreferenced, layer[l].vertRemap);
+			faceOffset[l] = LiveFaces(*src[l], layer[l].faceRemap);
+			layer[l].texRemap = TextureRemap(dest, *src[l]);
+		}
+		const int vertBase = int(dest.vert.size());
+		const int faceBase = int(dest.face.size());
+		const int vertTot = MLParallel::ExclusiveScan(vertOffset);
+		const int faceTot = MLParallel::ExclusiveScan(faceOffset);
+		if (vertTot > 0) Allocator<MeshType>::AddVertices(dest, vertTot);
+		if (faceTot > 0) Allocator<MeshType>::AddFaces(dest, faceTot);
+
+		// the elements of all the sources are copied by a single loop, so that
+		// many small layers and a single big one are split among threads alike
+		std::vector<int> vertStart(srcNum + 1, 0), faceStart(srcNum + 1, 0);
+		for (int l = 0; l < srcNum; ++l)
+		{
+			Layer &ly = layer[l];
+			ly.m = src[l];
+			ly.mat = tr[l];
+			ly.nMat = NormalMatrix(tr[l]);
+			ly.vertBase = vertBase + vertOffset[l];
+			ly.faceBase = faceBase + faceOffset[l];
+			ly.vertNormal = HasPerVertexNormal(dest) && HasPerVertexNormal(*src[l]);
+			ly.vertTex = HasPerVertexTexCoord(dest) && HasPerVertexTexCoord(*src[l]);
+			ly.faceNormal = HasPerFaceNormal(dest) && HasPerFaceNormal(*src[l]);
+			ly.wedgeTex = HasPerWedgeTexCoord(dest) && HasPerWedgeTexCoord(*src[l]);
+			vertStart[l] = int(src[l]->vert.size());
+			faceStart[l] = int(src[l]->face.size());
+		}
+		const int vertAll = MLParallel::ExclusiveScan(vertStart);
+		const int faceAll = MLParallel::ExclusiveScan(faceStart);
+
+		if (cb) cb(50, "Merging layers...");
+#pragma omp parallel for schedule(static) if (vertAll >= MLParallel::MinParallelSize)
+		for (int g = 0; g < vertAll; ++g)
+		{
+			const int l = LayerOf(vertStart, g);
+			CopyVertex(dest, layer[l], g - vertStart[l]);
+		}
+		if (cb) cb(75, "Merging layers...");
+#pragma omp parallel for schedule(static) if (faceAll >= MLParallel::MinParallelSize)
+		for (int g = 0; g < faceAll; ++g)
+		{
+			const int l = LayerOf(faceStart, g);
+			CopyFace(dest, layer[l], g - faceStart[l]);
+		}
+
+		if (HasFFAdjacency(dest)) UpdateTopology<MeshType>::FaceFace(dest);
+		if (HasVFAdjacency(dest)) UpdateTopology<MeshType>::VertexFace(dest);
+	}
+
+private:
+	// what is needed to copy the elements of a source into dest
+	struct Layer
+	{
+		const MeshType *m;
+		MatrixType mat;
+		Matrix33<ScalarType> nMat;
+		int vertBase, faceBase;
+		std::vector<int> vertRemap, faceRemap, texRemap;
+		bool vertNormal, vertTex, faceNormal, wedgeTex;
+	};
+
+	// index of the source owning the element g, given the first element of each source
+	static int LayerOf(const std::vector<int> &start, int g)
+	{
+		return int(std::upper_bound(start.begin(), start.end(), g) - start.begin()) - 1;
+	}
+
+	static int LiveVertices(const MeshType &m, bool alsoUnreferenced, std::vector<int> &remap)
+	{
+		const int vertNum = int(m.vert.size());
+		remap.assign(vertNum, 0);
+		if (alsoUnreferenced)
+		{
+#pragma omp parallel for schedule(static) if (vertNum >= MLParallel::MinParallelSize)
+			for (int i = 0; i < vertNum; ++i)
+				remap[i] = m.vert[i].IsD() ? 0 : 1;
+		}
+		else
+		{
+			for (size_t i = 0; i < m.face.size(); ++i)
+				if (!m.face[i].IsD())
+					for (int j = 0; j < m.face[i].VN(); ++j)
+						remap[tri::Index(m, m.face[i].cV(j))] = 1;
+		}
+		return Compact(remap);
+	}
+
+	// deleted faces are skipped, so the faces need their own compaction
+	static int LiveFaces(const MeshType &m, std::vector<int> &remap)
+	{
+		const int faceNum = int(m.face.size());
+		remap.resize(faceNum);
+#pragma omp parallel for schedule(static) if (faceNum >= MLParallel::MinParallelSize)
+		for (int i = 0; i < faceNum; ++i)
+			remap[i] = m.face[i].IsD() ? 0 : 1;
+		return Compact(remap);
+	}
+
+	// turn a 0/1 keep flag per element into its compacted index, -1 if not kept
+	static int Compact(std::vector<int> &remap)
+	{
+		const int n = int(remap.size());
+		std::vector<int> keep(remap);
+		const int liveNum = MLParallel::ExclusiveScan(remap);
+#pragma omp parallel for schedule(static) if (n >= MLParallel::MinParallelSize)
+		for (int i = 0; i < n; ++i)
+			if (!keep[i]) remap[i] = -1;
+		return liveNum;
+	}
+
+	// index in dest.textures of each texture of m, added to dest if missing
+	static std::vector<int> TextureRemap(MeshType &dest, const MeshType &m)
+	{
+		std::vector<int> texRemap(m.textures.size());
+		for (size_t i = 0; i < m.textures.size(); ++i)
+		{
+			size_t pos = std::find(dest.textures.begin(), dest.textures.end(), m.textures[i]) - dest.textures.begin();
+			if (pos == dest.textures.size())
+				dest.textures.push_back(m.textures[i]);
+			texRemap[i] = int(pos);
+		}
+		return texRemap;
+	}
+
+	// normals are moved by the rotation part of the matrix, without the scaling
+	static Matrix33<ScalarType> NormalMatrix(const MatrixType &mat)
+	{
+		Matrix33<ScalarType> mat33(mat, 3);
+		const ScalarType scale = ScalarType(std::pow(std::fabs(double(mat33.Determinant())), 1.0 / 3.0));
+		if (scale > 0) mat33 *= ScalarType(1) / scale;
+		return mat33;
+	}
+
+	static short RemapTex(short n, const std::vector<int> &texRemap)
+	{
+		return (n >= 0 && n < short(texRemap.size())) ? short(texRemap[n]) : n;
+	}
+
+	static void CopyVertex(MeshType &dest, const Layer &ly, int i)
+	{
+		if (ly.vertRemap[i] < 0) return;
+		const VertexType &sv = ly.m->vert[i];
+		VertexType &dv = dest.vert[ly.vertBase + ly.vertRemap[i]];
+		dv.ImportData(sv);
+		dv.P() = ly.mat * sv.cP();
+		if (ly.vertNormal) dv.N() = ly.nMat * sv.cN();
+		if (ly.vertTex) dv.T().n() = RemapTex(sv.cT().n(), ly.texRemap);
+	}
+
+	static void CopyFace(MeshType &dest, const Layer &ly, int i)
+	{
+		if (ly.faceRemap[i] < 0) return;
+		const FaceType &sf = ly.m->face[i];
+		FaceType &df = dest.face[ly.faceBase + ly.faceRemap[i]];
+		df.ImportData(sf);
+		for (int j = 0; j < sf.VN(); ++j)
+		{
+			df.V(j) = &dest.vert[ly.vertBase + ly.vertRemap[tri::Index(*ly.m, sf.cV(j))]];
+			if (ly.wedgeTex) df.WT(j).n() = RemapTex(sf.cWT(j).n(), ly.texRemap);
+		}
+		if (ly.faceNormal) df.N() = ly.nMat * sf.cN();
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
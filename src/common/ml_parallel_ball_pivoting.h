@@ -0,0 +1,800 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_BALL_PIVOTING_H
+#define __ML_PARALLEL_BALL_PIVOTING_H
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Ball pivoting surface reconstruction (Bernardini et al. 1999), with the
+  same seed, pivot and clustering rules of BallPivoting<>, run on many
+  threads and for a sequence of increasing radii.
+
+  The points are sorted once on a uniform grid of cells as large as the
+  diameter of the smallest ball; all the radii use this single index. The
+  grid is split in cubic blocks of cells and each block may work on the
+  points of its own cells plus a margin of cells around them, wide enough
+  for any pivot or seed started from one of its points. Blocks are colored
+  by the parity of their coordinates: the extended regions of blocks with
+  the same color never overlap, so the fronts of all the blocks of a color
+  are grown at the same time on the shared per-point state, each block
+  keeping its new faces apart until the color is done.
+
+  A front edge whose pivot would reach beyond the region of the block that
+  produced it is handed to the block owning its first vertex. Blocks run
+  again, color after color, on the edges they were handed, which zips the
+  seams left by the previous sweep; the last few edges are pivoted on one
+  thread with no region limit. The result depends on the grid and on the
+  radii but not on the number of threads.
+*/
+template <class MeshType>
+class ParallelBallPivoting
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::FaceType       FaceType;
+	typedef typename MeshType::FaceIterator   FaceIterator;
+	typedef unsigned long long                KeyType;
+	typedef std::pair<int, int>               EdgeType;
+
+	// 21 bits for each cell coordinate, so that a key fits in 63 bits
+	static const int MaxGridSide = 1 << 21;
+	// blocks along the longest side of the grid, when the margin allows it
+	static const int BlockPerSide = 24;
+	// sweeps over the blocks before the leftover edges are done serially
+	static const int MaxSweeps = 8;
+	// serial retries of the border edges left at the end of a pass
+	static const int MaxRetries = 3;
+	// neighbours of a seed point among which the seed triangle is searched
+	static const int MaxSeedNeighbours = 16;
+
+	/// The radius guessed by BallPivoting<> when it is given a radius of 0.
+	static ScalarType GuessRadius(const MeshType &m)
+	{
+		return std::sqrt((m.bbox.Diag() * m.bbox.Diag()) / std::max(1, m.vn));
+	}
+
+	/** Pivot balls of the given increasing radii on the vertices of m, each
+	 * pass starting from the border of the faces built so far (the faces
+	 * already in m are kept and used as a starting front). clustering is
+	 * the fraction of the radius within which points close to a used one
+	 * are discarded, creaseThr (radians) the largest angle between adjacent
+	 * faces. Returns the number of faces added.
+	 */
+	static int Do(MeshType &m, const std::vector<ScalarType> &radii, ScalarType clustering, ScalarType creaseThr, CallBackPos *cb = 0)
+	{
+		if (radii.empty() || m.vn < 3) return 0;
+		ParallelBallPivoting bp;
+		bp.Load(m, radii, clustering);
+		const int startFace = bp.FaceNum();
+		for (size_t pass = 0; pass < radii.size(); ++pass)
+		{
+			bp.SetRadius(radii[pass], clustering, creaseThr);
+			bp.Pass(cb, int(pass), int(radii.size()));
+		}
+		return bp.Store(m, startFace);
+	}
+
+private:
+	enum { Free = 0, Used = 1, Clustered = 2 };
+
+	struct Block
+	{
+		Point3i lo;                    // first core cell
+		int color;
+		std::vector<EdgeType> pending; // front edges handed to this block
+	};
+
+	// Per point data, sorted by cell key.
+	std::vector<CoordType> pos;
+	std::vector<CoordType> nrm;
+	std::vector<KeyType> key;
+	std::vector<int> vid;             // index of the point in m.vert
+	std::vector<char> state;
+	std::vector<int> head;            // first corner on the point, -1 if none
+
+	// Faces as vertex triples; corner c=3f+k is linked to the next corner on
+	// the same point by cnext[c].
+	std::vector<int> tri;
+	std::vector<int> cnext;
+
+	Box3<ScalarType> box;
+	Point3<ScalarType> voxel;
+	Point3i siz;
+	int blockSide;
+	Point3i blockSiz;
+	std::vector<KeyType> blockKey;
+	std::vector<Block> blocks;
+
+	// current pass
+	ScalarType radius, minEdge, cosCrease;
+	Point3i margin;
+
+	int FaceNum() const { return int(tri.size() / 3); }
+
+	Point3i CellOf(const CoordType &p) const
+	{
+		Point3i c;
+		for (int k = 0; k < 3; ++k)
+			c[k] = std::max(0, std::min(siz[k] - 1, int(std::floor((p[k] - box.min[k]) / voxel[k]))));
+		return c;
+	}
+
+	KeyType Key(int x, int y, int z) const
+	{
+		return (KeyType(z) * KeyType(siz[1]) + KeyType(y)) * KeyType(siz[0]) + KeyType(x);
+	}
+
+	KeyType BlockKey(const Point3i &cell) const
+	{
+		const int bx = cell[0] / blockSide, by = cell[1] / blockSide, bz = cell[2] / blockSide;
+		return (KeyType(bz) * KeyType(blockSiz[1]) + KeyType(by)) * KeyType(blockSiz[0]) + KeyType(bx);
+	}
+
+	int BlockOf(int i) const
+	{
+		return int(std::lower_bound(blockKey.begin(), blockKey.end(), BlockKey(CellOf(pos[i]))) - blockKey.begin());
+	}
+
+	/// Cells overlapping the box of center p and half side r, clamped to the grid.
+	void CellRange(const CoordType &p, ScalarType r, Point3i &lo, Point3i &hi) const
+	{
+		lo = CellOf(p - CoordType(r, r, r));
+		hi = CellOf(p + CoordType(r, r, r));
+	}
+
+	/// Call f(i) on every point in the cells [lo,hi], in index order.
+	template <class F>
+	void ForEachPoint(const Point3i &lo, const Point3i &hi, F f) const
+	{
+		const int n = int(key.size());
+		for (int z = lo[2]; z <= hi[2]; ++z)
+			for (int y = lo[1]; y <= hi[1]; ++y)
+			{
+				const KeyType k1 = Key(hi[0], y, z);
+				int i = int(std::lower_bound(key.begin(), key.end(), Key(lo[0], y, z)) - key.begin());
+				for (; i < n && key[i] <= k1; ++i)
+					f(i);
+			}
+	}
+
+	/** The sphere of the current radius through p0, p1, p2 on the side of
+	 * their normal, as in BallPivoting::FindSphere: the points are rotated
+	 * so that the smallest is first, for the result not to depend on it.
+	 */
+	bool FindSphere(const CoordType &p0, const CoordType &p1, const CoordType &p2, CoordType &center) const
+	{
+		CoordType p[3];
+		if (Less(p0, p1) && Less(p0, p2)) { p[0] = p0; p[1] = p1; p[2] = p2; }
+		else if (Less(p1, p0) && Less(p1, p2)) { p[0] = p1; p[1] = p2; p[2] = p0; }
+		else { p[0] = p2; p[1] = p0; p[2] = p1; }
+
+		const CoordType q1 = p[1] - p[0];
+		const CoordType q2 = p[2] - p[0];
+		CoordType up = q1 ^ q2;
+		const ScalarType uplen = up.Norm();
+		// aligned points
+		if (uplen < ScalarType(0.001) * q1.Norm() * q2.Norm()) return false;
+		up /= uplen;
+
+		const ScalarType a11 = q1 * q1;
+		const ScalarType a12 = q1 * q2;
+		const ScalarType a22 = q2 * q2;
+		const ScalarType d = 4 * (a11 * a22 - a12 * a12);
+		const ScalarType l1 = 2 * (a11 * a22 - a22 * a12) / d;
+		const ScalarType l2 = 2 * (a11 * a22 - a12 * a11) / d;
+		center = q1 * l1 + q2 * l2;
+		const ScalarType circleR = center.Norm();
+		if (circleR > radius) return false;
+		center += p[0] + up * std::sqrt(radius * radius - circleR * circleR);
+		return true;
+	}
+
+	static bool Less(const CoordType &a, const CoordType &b)
+	{
+		if (a[0] != b[0]) return a[0] < b[0];
+		if (a[1] != b[1]) return a[1] < b[1];
+		return a[2] < b[2];
+	}
+
+	static ScalarType OrientedAngle(const CoordType &a, const CoordType &b, const CoordType &axis)
+	{
+		ScalarType angle = std::atan2((a ^ b) * axis, a * b);
+		if (angle < 0) angle += ScalarType(2 * M_PI);
+		return angle;
+	}
+
+	static ScalarType Angle(const CoordType &a, const CoordType &b)
+	{
+		return std::atan2((a ^ b).Norm(), a * b);
+	}
+
+	/*
+	  The front grown by one block. Its faces are kept apart until the end
+	  of the color: their corners are numbered -2,-3,... so that they can be
+	  linked with the shared ones in the per point lists. A point list is
+	  only ever changed at its head, so the shared corners never point to
+	  local ones. Only the points inside [lo,hi] are read or written.
+	*/
+	class Front
+	{
+	public:
+		Front(ParallelBallPivoting &e, const Point3i &l, const Point3i &h, bool b) : bp(&e), lo(l), hi(h), bounded(b) {}
+
+		std::vector<int> ltri;
+		std::vector<int> lnext;
+		std::vector<EdgeType> queue;
+		std::vector<EdgeType> deferred;
+
+		int Vert(int c) const { return c >= 0 ? bp->tri[c] : ltri[-2 - c]; }
+		int Link(int c) const { return c >= 0 ? bp->cnext[c] : lnext[-2 - c]; }
+
+		static int NextC(int c)
+		{
+			if (c >= 0) return c - c % 3 + (c + 1) % 3;
+			const int l = -2 - c;
+			return -2 - (l - l % 3 + (l + 1) % 3);
+		}
+
+		static int PrevC(int c)
+		{
+			if (c >= 0) return c - c % 3 + (c + 2) % 3;
+			const int l = -2 - c;
+			return -2 - (l - l % 3 + (l + 2) % 3);
+		}
+
+		/// Corner on a of a face with the edge a->b, -1 if none.
+		int OutCorner(int a, int b) const
+		{
+			for (int c = bp->head[a]; c != -1; c = Link(c))
+				if (Vert(NextC(c)) == b) return c;
+			return -1;
+		}
+
+		/// True if a face has the edge b->a, looking only at the faces on a.
+		bool HasEdgeTo(int a, int b) const
+		{
+			for (int c = bp->head[a]; c != -1; c = Link(c))
+				if (Vert(PrevC(c)) == b) return true;
+			return false;
+		}
+
+		/// Border edges leaving x and whether x has any border edge at all.
+		int BorderOut(int x, bool &onBorder) const
+		{
+			int cnt = 0;
+			onBorder = false;
+			for (int c = bp->head[x]; c != -1; c = Link(c))
+			{
+				if (!HasEdgeTo(x, Vert(NextC(c)))) { ++cnt; onBorder = true; }
+				if (OutCorner(x, Vert(PrevC(c))) == -1) onBorder = true;
+			}
+			return cnt;
+		}
+
+		bool Inside(const Point3i &qlo, const Point3i &qhi) const
+		{
+			if (!bounded) return true;
+			for (int k = 0; k < 3; ++k)
+				if (qlo[k] < lo[k] || qhi[k] > hi[k]) return false;
+			return true;
+		}
+
+		void AddFace(int v0, int v1, int v2)
+		{
+			const int v[3] = { v0, v1, v2 };
+			const int l = int(ltri.size());
+			for (int k = 0; k < 3; ++k)
+			{
+				ltri.push_back(v[k]);
+				lnext.push_back(bp->head[v[k]]);
+				bp->head[v[k]] = -2 - (l + k);
+			}
+			for (int k = 0; k < 3; ++k)
+				if (bp->state[v[k]] == Free)
+				{
+					bp->state[v[k]] = Used;
+					Cluster(v[k]);
+				}
+		}
+
+		/// Discard the free points closer than minEdge to v.
+		void Cluster(int v)
+		{
+			const ScalarType minEdge2 = bp->minEdge * bp->minEdge;
+			const CoordType p = bp->pos[v];
+			Point3i qlo, qhi;
+			bp->CellRange(p, bp->minEdge, qlo, qhi);
+			char *state = &bp->state[0];
+			const CoordType *pos = &bp->pos[0];
+			bp->ForEachPoint(qlo, qhi, [&](int i) {
+				if (state[i] == Free && (pos[i] - p).SquaredNorm() < minEdge2)
+					state[i] = Clustered;
+			});
+		}
+
+		/** The first point hit by the ball rotating around the front edge
+		 * a->b, away from its face (a,b,t), as in BallPivoting::Place; -1
+		 * if none, or if the new face would be too bent.
+		 */
+		int Pivot(int a, int b, int t) const
+		{
+			const ScalarType r = bp->radius;
+			const CoordType &v0 = bp->pos[a];
+			const CoordType &v1 = bp->pos[b];
+			const CoordType &v2 = bp->pos[t];
+			CoordType normal = (v1 - v0) ^ (v2 - v0);
+			if (normal.Norm() == 0) return -1;
+			normal.Normalize();
+			const CoordType middle = (v0 + v1) / 2;
+			CoordType axis = v1 - v0;
+			const ScalarType axisLen2 = axis.SquaredNorm();
+			axis.Normalize();
+			// radius of the circle of the centers of the balls through a and b
+			const ScalarType rt = std::sqrt(r * r - axisLen2 / 4);
+
+			CoordType center;
+			if (!bp->FindSphere(v0, v1, v2, center))
+			{
+				// a face wider than the ball: start with the ball above it
+				CoordType up = normal - axis * (axis * normal);
+				if (up.Norm() == 0) return -1;
+				center = middle + up.Normalize() * rt;
+			}
+			const CoordType startPivot = center - middle;
+			const ScalarType minEdge2 = bp->minEdge * bp->minEdge;
+			const ScalarType maxDist2 = (rt + r) * (rt + r);
+
+			int candidate = -1;
+			ScalarType minAngle = ScalarType(M_PI);
+			Point3i qlo, qhi;
+			bp->CellRange(middle, rt + r, qlo, qhi);
+			bp->ForEachPoint(qlo, qhi, [&](int i) {
+				if (i == a || i == b || i == t || bp->state[i] == Clustered) return;
+				const CoordType &p = bp->pos[i];
+				if ((p - middle).SquaredNorm() > maxDist2) return;
+				if (bp->state[i] == Free && ((p - v0).SquaredNorm() < minEdge2 || (p - v1).SquaredNorm() < minEdge2)) return;
+				if (bp->state[i] == Used)
+				{
+					bool onBorder;
+					BorderOut(i, onBorder);
+					if (!onBorder) return;
+				}
+				CoordType c;
+				if (!bp->FindSphere(v0, p, v1, c)) return;
+				ScalarType alpha = OrientedAngle(startPivot, c - middle, axis);
+				// alpha may be a little less than 2pi when it should be 0,
+				// e.g. pivoting on the diagonal of a square
+				if (alpha > ScalarType(2 * M_PI - 0.8))
+				{
+					const CoordType proj = p - axis * (axis * (p - middle));
+					if (alpha > Angle(proj - middle, v2 - middle)) alpha -= ScalarType(2 * M_PI);
+				}
+				if (candidate == -1 || alpha < minAngle)
+				{
+					candidate = i;
+					minAngle = alpha;
+				}
+			});
+			if (candidate == -1 || minAngle >= ScalarType(M_PI - 0.1)) return -1;
+
+			CoordType newNormal = (bp->pos[candidate] - v0) ^ (v1 - v0);
+			if (newNormal.Norm() == 0) return -1;
+			newNormal.Normalize();
+			if (normal * newNormal < bp->cosCrease) return -1;
+			if (bp->state[candidate] == Used)
+			{
+				bool onBorder;
+				if (BorderOut(candidate, onBorder) >= 2) return -1;
+			}
+			return candidate;
+		}
+
+		/// Pivot on every queued edge, and on the ones they create.
+		void Expand()
+		{
+			const ScalarType maxEdge2 = 4 * bp->radius * bp->radius;
+			const ScalarType reach = 2 * bp->radius + bp->minEdge;
+			for (size_t qi = 0; qi < queue.size(); ++qi)
+			{
+				const int a = queue[qi].first, b = queue[qi].second;
+				if ((bp->pos[b] - bp->pos[a]).SquaredNorm() > maxEdge2) continue;
+				Point3i qlo, qhi;
+				bp->CellRange((bp->pos[a] + bp->pos[b]) / 2, reach, qlo, qhi);
+				if (!Inside(qlo, qhi))
+				{
+					deferred.push_back(queue[qi]);
+					continue;
+				}
+				const int c = OutCorner(a, b);
+				if (c == -1 || HasEdgeTo(a, b)) continue;
+				const int x = Pivot(a, b, Vert(PrevC(c)));
+				if (x == -1) continue;
+				// the new face (b,a,x) must not duplicate the edges a->x, x->b
+				if (bp->state[x] == Used && (HasEdgeTo(x, a) || OutCorner(x, b) != -1)) continue;
+				AddFace(b, a, x);
+				queue.push_back(EdgeType(a, x));
+				queue.push_back(EdgeType(x, b));
+			}
+			queue.clear();
+		}
+
+		/// Try to start a new front from the free point s, as BallPivoting::Seed.
+		bool Seed(int s)
+		{
+			const ScalarType r = bp->radius;
+			const ScalarType r2 = r * r;
+			const ScalarType minEdge2 = bp->minEdge * bp->minEdge;
+			const CoordType &p0 = bp->pos[s];
+			Point3i qlo, qhi;
+			bp->CellRange(p0, 2 * r + bp->minEdge, qlo, qhi);
+			if (!Inside(qlo, qhi)) return false;
+			bp->CellRange(p0, 2 * r, qlo, qhi);
+
+			std::vector< std::pair<ScalarType, int> > cand;
+			std::vector<int> around;
+			bp->ForEachPoint(qlo, qhi, [&](int i) {
+				if (i == s || bp->state[i] == Clustered) return;
+				const ScalarType d2 = (bp->pos[i] - p0).SquaredNorm();
+				if (d2 > 4 * r2) return;
+				around.push_back(i);
+				if (bp->state[i] == Free && d2 >= minEdge2) cand.push_back(std::make_pair(d2, i));
+			});
+			std::sort(cand.begin(), cand.end());
+			const int n = std::min(int(cand.size()), MaxSeedNeighbours);
+			for (int i = 0; i < n; ++i)
+				for (int j = i + 1; j < n; ++j)
+				{
+					int v1 = cand[i].second, v2 = cand[j].second;
+					if ((bp->pos[v2] - bp->pos[v1]).SquaredNorm() < minEdge2) continue;
+					CoordType normal = (bp->pos[v1] - p0) ^ (bp->pos[v2] - p0);
+					if (normal * bp->nrm[s] < 0)
+					{
+						std::swap(v1, v2);
+						normal = -normal;
+					}
+					if (normal * bp->nrm[v1] < 0 || normal * bp->nrm[v2] < 0) continue;
+					CoordType center;
+					if (!bp->FindSphere(p0, bp->pos[v1], bp->pos[v2], center)) continue;
+					bool empty = true;
+					for (size_t k = 0; k < around.size() && empty; ++k)
+					{
+						const int o = around[k];
+						if (o != v1 && o != v2 && (bp->pos[o] - center).SquaredNorm() < r2 * ScalarType(0.999))
+							empty = false;
+					}
+					if (!empty) continue;
+					AddFace(s, v1, v2);
+					queue.push_back(EdgeType(s, v1));
+					queue.push_back(EdgeType(v1, v2));
+					queue.push_back(EdgeType(v2, s));
+					return true;
+				}
+			return false;
+		}
+
+		/// Grow the queued edges, then seed on the free points of the cells [clo,chi].
+		void Run(const Point3i *clo, const Point3i *chi)
+		{
+			Expand();
+			if (clo == NULL) return;
+			std::vector<int> core;
+			bp->ForEachPoint(*clo, *chi, [&](int i) { core.push_back(i); });
+			for (size_t k = 0; k < core.size(); ++k)
+				if (bp->state[core[k]] == Free && Seed(core[k]))
+					Expand();
+		}
+
+	private:
+		ParallelBallPivoting *bp;
+		Point3i lo, hi;
+		bool bounded;
+	};
+
+	void Load(const MeshType &m, const std::vector<ScalarType> &radii, ScalarType clustering)
+	{
+		const int vertNum = int(m.vert.size());
+		std::vector<int> live;
+		live.reserve(m.vn);
+		box.SetNull();
+		for (int i = 0; i < vertNum; ++i)
+			if (!m.vert[i].IsD())
+			{
+				live.push_back(i);
+				box.Add(m.vert[i].cP());
+			}
+		const int n = int(live.size());
+
+		// the cells are as wide as the smallest ball, the box is inflated by a cell
+		const ScalarType cellSize = 2 * radii[0];
+		box.min -= CoordType(cellSize, cellSize, cellSize);
+		box.max += CoordType(cellSize, cellSize, cellSize);
+		const CoordType dim = box.max - box.min;
+		for (int k = 0; k < 3; ++k)
+		{
+			siz[k] = std::max(1, std::min(int(std::ceil(dim[k] / cellSize)), MaxGridSide));
+			voxel[k] = dim[k] / siz[k];
+		}
+
+		std::vector< std::pair<KeyType, int> > item(n);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i)
+		{
+			const Point3i c = CellOf(m.vert[live[i]].cP());
+			item[i] = std::make_pair(Key(c[0], c[1], c[2]), live[i]);
+		}
+		MLParallel::Sort(item.begin(), item.end(), std::less< std::pair<KeyType, int> >());
+
+		pos.resize(n);
+		nrm.resize(n);
+		key.resize(n);
+		vid.resize(n);
+		state.assign(n, char(Free));
+		head.assign(n, -1);
+		std::vector<int> pointOf(vertNum, -1);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i)
+		{
+			const VertexType &v = m.vert[item[i].second];
+			key[i] = item[i].first;
+			vid[i] = item[i].second;
+			pos[i] = v.cP();
+			nrm[i] = v.cN();
+			pointOf[vid[i]] = i;
+		}
+
+		// the existing faces are the starting front
+		for (size_t f = 0; f < m.face.size(); ++f)
+		{
+			const FaceType &fc = m.face[f];
+			if (fc.IsD()) continue;
+			int v[3];
+			bool ok = true;
+			for (int k = 0; k < 3; ++k)
+			{
+				v[k] = pointOf[tri::Index(m, fc.cV(k))];
+				ok = ok && v[k] != -1;
+			}
+			if (!ok) continue;
+			for (int k = 0; k < 3; ++k)
+			{
+				const int c = int(tri.size());
+				tri.push_back(v[k]);
+				cnext.push_back(head[v[k]]);
+				head[v[k]] = c;
+				state[v[k]] = Used;
+			}
+		}
+
+		// blocks wide enough for the largest ball, and for their extended
+		// regions of the same color not to overlap
+		ScalarType maxRadius = 0;
+		for (size_t i = 0; i < radii.size(); ++i)
+			maxRadius = std::max(maxRadius, radii[i]);
+		const Point3i maxMargin = Margin(maxRadius, maxRadius * clustering);
+		blockSide = std::max(1, std::max(siz[0], std::max(siz[1], siz[2])) / BlockPerSide);
+		for (int k = 0; k < 3; ++k)
+			blockSide = std::max(blockSide, 2 * maxMargin[k] + 1);
+		for (int k = 0; k < 3; ++k)
+			blockSiz[k] = (siz[k] + blockSide - 1) / blockSide;
+
+		blockKey.clear();
+		for (int i = 0; i < n; ++i)
+			if (i == 0 || key[i] != key[i - 1])
+				blockKey.push_back(BlockKey(CellOf(pos[i])));
+		std::sort(blockKey.begin(), blockKey.end());
+		blockKey.erase(std::unique(blockKey.begin(), blockKey.end()), blockKey.end());
+		blocks.resize(blockKey.size());
+		for (size_t b = 0; b < blocks.size(); ++b)
+		{
+			KeyType k = blockKey[b];
+			const int bx = int(k % KeyType(blockSiz[0])); k /= KeyType(blockSiz[0]);
+			const int by = int(k % KeyType(blockSiz[1])); k /= KeyType(blockSiz[1]);
+			const int bz = int(k);
+			blocks[b].lo = Point3i(bx * blockSide, by * blockSide, bz * blockSide);
+			blocks[b].color = (bx & 1) | ((by & 1) << 1) | ((bz & 1) << 2);
+		}
+	}
+
+	/// Cells from a point to the farthest one read by a pivot or seed started on it.
+	/// Computed in double and clamped to the grid, that a larger ball can not read past.
+	Point3i Margin(ScalarType r, ScalarType minEdgeLen) const
+	{
+		Point3i mg;
+		for (int k = 0; k < 3; ++k)
+		{
+			const double cells = std::ceil((3.0 * double(r) + double(minEdgeLen)) / double(voxel[k])) + 1.0;
+			mg[k] = int(std::min(cells, double(siz[k])));
+		}
+		return mg;
+	}
+
+	void SetRadius(ScalarType r, ScalarType clustering, ScalarType creaseThr)
+	{
+		radius = r;
+		minEdge = r * clustering;
+		cosCrease = std::cos(creaseThr);
+		margin = Margin(radius, minEdge);
+	}
+
+	/// Add the faces and the deferred edges of the fronts to the shared state.
+	void Merge(std::vector<Front> &fronts)
+	{
+		const int frontNum = int(fronts.size());
+		std::vector<int> base(frontNum + 1, 0);
+		base[0] = int(tri.size());
+		for (int i = 0; i < frontNum; ++i)
+			base[i + 1] = base[i] + int(fronts[i].ltri.size());
+		tri.resize(base[frontNum]);
+		cnext.resize(base[frontNum]);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int i = 0; i < frontNum; ++i)
+		{
+			const Front &fr = fronts[i];
+			const int b = base[i];
+			const int cornerNum = int(fr.ltri.size());
+			for (int l = 0; l < cornerNum; ++l)
+			{
+				const int nx = fr.lnext[l];
+				tri[b + l] = fr.ltri[l];
+				cnext[b + l] = (nx >= -1) ? nx : b - 2 - nx;
+			}
+			// the fronts of a color touch disjoint points
+			for (int l = 0; l < cornerNum; ++l)
+			{
+				int &h = head[fr.ltri[l]];
+				if (h < -1) h = b - 2 - h;
+			}
+		}
+		for (int i = 0; i < frontNum; ++i)
+			for (size_t k = 0; k < fronts[i].deferred.size(); ++k)
+				blocks[BlockOf(fronts[i].deferred[k].first)].pending.push_back(fronts[i].deferred[k]);
+	}
+
+	/// The border edges of the shared faces, in face order.
+	void BorderEdges(std::vector<EdgeType> &border) const
+	{
+		const int faceNum = FaceNum();
+		const int chunkNum = (faceNum < MLParallel::MinParallelSize) ? 1 : MLParallel::ThreadNum();
+		const std::vector<int> bnd = MLParallel::Chunks(faceNum, chunkNum);
+		std::vector< std::vector<EdgeType> > chunk(chunkNum);
+		const Front reader(const_cast<ParallelBallPivoting &>(*this), Point3i(0, 0, 0), siz, false);
+#pragma omp parallel for schedule(static, 1)
+		for (int ch = 0; ch < chunkNum; ++ch)
+			for (int c = 3 * bnd[ch]; c < 3 * bnd[ch + 1]; ++c)
+			{
+				const int a = tri[c], b = tri[Front::NextC(c)];
+				if (!reader.HasEdgeTo(a, b)) chunk[ch].push_back(EdgeType(a, b));
+			}
+		border.clear();
+		for (int ch = 0; ch < chunkNum; ++ch)
+			border.insert(border.end(), chunk[ch].begin(), chunk[ch].end());
+	}
+
+	/// One radius: grow all the blocks, color after color, until no edge is left.
+	void Pass(CallBackPos *cb, int pass, int passNum)
+	{
+		// every border edge of the current mesh is a front edge
+		std::vector<EdgeType> border;
+		BorderEdges(border);
+		for (size_t k = 0; k < border.size(); ++k)
+			blocks[BlockOf(border[k].first)].pending.push_back(border[k]);
+
+		const int blockNum = int(blocks.size());
+		for (int sweep = 0; ; ++sweep)
+		{
+			size_t pendingNum = 0;
+			for (int b = 0; b < blockNum; ++b)
+				pendingNum += blocks[b].pending.size();
+			if (sweep > 0 && pendingNum == 0) break;
+			if (sweep > 0 && (sweep >= MaxSweeps || pendingNum < size_t(MLParallel::MinParallelSize)))
+			{
+				// the last seams, on a single unbounded front
+				std::vector<Front> fronts(1, Front(*this, Point3i(0, 0, 0), siz, false));
+				for (int b = 0; b < blockNum; ++b)
+				{
+					fronts[0].queue.insert(fronts[0].queue.end(), blocks[b].pending.begin(), blocks[b].pending.end());
+					std::vector<EdgeType>().swap(blocks[b].pending);
+				}
+				fronts[0].Run(NULL, NULL);
+				Merge(fronts);
+				break;
+			}
+
+			for (int color = 0; color < 8; ++color)
+			{
+				if (cb && sweep == 0) cb((100 * (8 * pass + color)) / (8 * passNum), "Ball Pivoting");
+				std::vector<int> run;
+				for (int b = 0; b < blockNum; ++b)
+					if (blocks[b].color == color && (sweep == 0 || !blocks[b].pending.empty()))
+						run.push_back(b);
+				if (run.empty()) continue;
+
+				std::vector<Front> fronts;
+				fronts.reserve(run.size());
+				for (size_t k = 0; k < run.size(); ++k)
+				{
+					const Point3i &clo = blocks[run[k]].lo;
+					fronts.push_back(Front(*this, clo - margin, clo + Point3i(blockSide - 1, blockSide - 1, blockSide - 1) + margin, true));
+					fronts.back().queue.swap(blocks[run[k]].pending);
+				}
+				const int runNum = int(run.size());
+#pragma omp parallel for schedule(dynamic, 1)
+				for (int k = 0; k < runNum; ++k)
+				{
+					const Point3i clo = blocks[run[k]].lo;
+					Point3i chi = clo + Point3i(blockSide - 1, blockSide - 1, blockSide - 1);
+					for (int j = 0; j < 3; ++j)
+						chi[j] = std::min(chi[j], siz[j] - 1);
+					if (sweep == 0)
+						fronts[k].Run(&clo, &chi);
+					else
+						fronts[k].Run(NULL, NULL);
+				}
+				Merge(fronts);
+			}
+		}
+
+		// edges that died against the front of another block may pivot
+		// now that the seams around them are closed
+		for (int retry = 0; retry < MaxRetries; ++retry)
+		{
+			std::vector<Front> fronts(1, Front(*this, Point3i(0, 0, 0), siz, false));
+			BorderEdges(fronts[0].queue);
+			fronts[0].Run(NULL, NULL);
+			if (fronts[0].ltri.empty()) break;
+			Merge(fronts);
+		}
+	}
+
+	/// Append the faces from startFace on to m; returns their number.
+	int Store(MeshType &m, int startFace) const
+	{
+		const int newNum = FaceNum() - startFace;
+		if (newNum <= 0) return 0;
+		FaceIterator fi = Allocator<MeshType>::AddFaces(m, newNum);
+		const int first = int(fi - m.face.begin());
+#pragma omp parallel for schedule(static)
+		for (int f = 0; f < newNum; ++f)
+			for (int k = 0; k < 3; ++k)
+				m.face[first + f].V(k) = &m.vert[vid[tri[3 * (startFace + f) + k]]];
+		return newNum;
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,616 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_BVH_H
+#define __ML_PARALLEL_BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Bounding volume hierarchy over the faces of a triangle mesh, for CPU ray
+  casting (visibility, ambient occlusion, thickness...) and closest point
+  queries.
+
+  The tree is built top down with the binned Surface Area Heuristic, one
+  level at a time: the nodes of a level are split in parallel, while the few
+  huge nodes of the first levels bin their faces in parallel. The result
+  does not depend on the number of threads.
+
+  The triangles of each leaf (at most LeafSize) are stored in a single packet
+  in SoA layout, so that a ray is tested against all of them at once with
+  straight line code the compiler can vectorize. The tree is a copy of the
+  geometry: it must be rebuilt (Set) if the mesh changes. All the queries are
+  const and can be issued concurrently by any number of threads.
+*/
+template <class MeshType>
+class ParallelBVH
+{
+public:
+	typedef typename MeshType::FaceType FaceType;
+
+	static const int LeafSize = 4;
+
+	struct RayHit
+	{
+		int   face;   // index of the hit face in m.face, -1 if none
+		float t;      // hit point is o + t*d
+		float u, v;   // barycentric coords of the hit wrt V(1) and V(2)
+	};
+
+	struct ClosestHit
+	{
+		int     face;  // index of the closest face in m.face, -1 if none
+		float   dist;
+		Point3f p;     // closest point on that face
+	};
+
+	ParallelBVH() {}
+	explicit ParallelBVH(MeshType &m) { Set(m); }
+
+	bool Empty() const { return nodes.empty(); }
+
+	void Clear()
+	{
+		nodes.clear();
+		packets.clear();
+	}
+
+	/// Build the tree over the not deleted faces of m.
+	void Set(MeshType &m)
+	{
+		Clear();
+		std::vector<int> faceIdx;
+		faceIdx.reserve(m.fn);
+		for (int i = 0; i < int(m.face.size()); ++i)
+			if (!m.face[i].IsD()) faceIdx.push_back(i);
+		const int n = int(faceIdx.size());
+		if (n == 0) return;
+
+		prim.resize(n);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i)
+		{
+			const FaceType &f = m.face[faceIdx[i]];
+			prim[i].box.Set(Point3f::Construct(f.cP(0)));
+			prim[i].box.Add(Point3f::Construct(f.cP(1)));
+			prim[i].box.Add(Point3f::Construct(f.cP(2)));
+			prim[i].cen = prim[i].box.Center();
+			prim[i].face = faceIdx[i];
+		}
+
+		// level by level build; leaves get their packet in creation order
+		std::vector<Task> cur(1, Task(0, 0, n, 0)), next, leaves;
+		nodes.resize(1);
+		while (!cur.empty())
+		{
+			const int taskNum = int(cur.size());
+			std::vector<int> left(taskNum), axis(taskNum);
+			std::vector<Box3f> bb(taskNum);
+			if (taskNum < MLParallel::ThreadNum())
+			{
+				for (int t = 0; t < taskNum; ++t)
+					left[t] = Split(cur[t], bb[t], axis[t], true);
+			}
+			else
+			{
+#pragma omp parallel for schedule(dynamic, 1)
+				for (int t = 0; t < taskNum; ++t)
+					left[t] = Split(cur[t], bb[t], axis[t], false);
+			}
+			next.clear();
+			for (int t = 0; t < taskNum; ++t)
+			{
+				Node &nd = nodes[cur[t].node];
+				for (int k = 0; k < 3; ++k)
+				{
+					nd.bmin[k] = bb[t].min[k];
+					nd.bmax[k] = bb[t].max[k];
+				}
+				if (left[t] < 0)
+				{
+					nd.start = int(leaves.size());
+					nd.axis = LeafFlag;
+					leaves.push_back(cur[t]);
+				}
+				else
+				{
+					nd.start = int(nodes.size());
+					nd.axis = axis[t];
+					const int mid = cur[t].begin + left[t];
+					next.push_back(Task(nd.start, cur[t].begin, mid, cur[t].depth + 1));
+					next.push_back(Task(nd.start + 1, mid, cur[t].end, cur[t].depth + 1));
+					nodes.resize(nodes.size() + 2);
+				}
+			}
+			cur.swap(next);
+		}
+
+		const int leafNum = int(leaves.size());
+		packets.resize(leafNum);
+#pragma omp parallel for schedule(static)
+		for (int l = 0; l < leafNum; ++l)
+		{
+			TriPacket &p = packets[l];
+			for (int j = 0; j < LeafSize; ++j)
+			{
+				const int k = leaves[l].begin + j;
+				if (k < leaves[l].end)
+				{
+					const FaceType &f = m.face[prim[k].face];
+					const Point3f p0 = Point3f::Construct(f.cP(0));
+					const Point3f e1 = Point3f::Construct(f.cP(1)) - p0;
+					const Point3f e2 = Point3f::Construct(f.cP(2)) - p0;
+					for (int c = 0; c < 3; ++c)
+					{
+						p.v0[c][j] = p0[c];
+						p.e1[c][j] = e1[c];
+						p.e2[c][j] = e2[c];
+					}
+					p.face[j] = prim[k].face;
+				}
+				else
+				{
+					// degenerate padding triangle, never hit
+					for (int c = 0; c < 3; ++c)
+						p.v0[c][j] = p.e1[c][j] = p.e2[c][j] = 0;
+					p.face[j] = -1;
+				}
+			}
+		}
+
+		std::vector<BuildPrim>().swap(prim);
+	}
+
+	/// Closest intersection of the ray o + t*d with t in (tMin, tMax).
+	bool Intersect(const Point3f &o, const Point3f &d, float tMin, float tMax, RayHit &hit) const
+	{
+		hit.face = -1;
+		hit.t = tMax;
+		Traverse<false>(o, d, tMin, hit);
+		return hit.face >= 0;
+	}
+
+	/// True if the ray o + t*d hits something with t in (tMin, tMax).
+	bool Occluded(const Point3f &o, const Point3f &d, float tMin, float tMax) const
+	{
+		RayHit hit;
+		hit.face = -1;
+		hit.t = tMax;
+		Traverse<true>(o, d, tMin, hit);
+		return hit.face >= 0;
+	}
+
+	/// Closest point to p on the faces nearer than maxDist.
+	bool Closest(const Point3f &p, float maxDist, ClosestHit &hit) const
+	{
+		hit.face = -1;
+		hit.dist = maxDist;
+		if (nodes.empty()) return false;
+		float best2 = maxDist * maxDist;
+
+		int stackNode[StackSize];
+		float stackDist[StackSize];
+		int sp = 0;
+		if (BoxDist2(nodes[0], p) > best2) return false;
+		int ni = 0;
+		for (;;)
+		{
+			const Node &nd = nodes[ni];
+			if (nd.axis == LeafFlag)
+				PacketClosest(packets[nd.start], p, best2, hit);
+			else
+			{
+				const float da = BoxDist2(nodes[nd.start], p);
+				const float db = BoxDist2(nodes[nd.start + 1], p);
+				const bool ha = da <= best2, hb = db <= best2;
+				if (ha && hb)
+				{
+					const bool aFirst = da <= db;
+					stackNode[sp] = aFirst ? nd.start + 1 : nd.start;
+					stackDist[sp] = aFirst ? db : da;
+					++sp;
+					ni = aFirst ? nd.start : nd.start + 1;
+					continue;
+				}
+				if (ha) { ni = nd.start; continue; }
+				if (hb) { ni = nd.start + 1; continue; }
+			}
+			do
+			{
+				if (sp == 0)
+				{
+					if (hit.face >= 0) hit.dist = std::sqrt(best2);
+					return hit.face >= 0;
+				}
+				--sp;
+			} while (stackDist[sp] > best2);
+			ni = stackNode[sp];
+		}
+	}
+
+	/// Trace a batch of rays on all the cores.
+	void IntersectBatch(const std::vector<Point3f> &orig, const std::vector<Point3f> &dir,
+	                    float tMin, float tMax, std::vector<RayHit> &hits) const
+	{
+		const int n = int(orig.size());
+		hits.resize(n);
+#pragma omp parallel for schedule(dynamic, 256)
+		for (int i = 0; i < n; ++i)
+			Intersect(orig[i], dir[i], tMin, tMax, hits[i]);
+	}
+
+	void OccludedBatch(const std::vector<Point3f> &orig, const std::vector<Point3f> &dir,
+	                   float tMin, float tMax, std::vector<char> &occluded) const
+	{
+		const int n = int(orig.size());
+		occluded.resize(n);
+#pragma omp parallel for schedule(dynamic, 256)
+		for (int i = 0; i < n; ++i)
+			occluded[i] = Occluded(orig[i], dir[i], tMin, tMax) ? 1 : 0;
+	}
+
+private:
+	static const int BinNum = 16;
+	static const int LeafFlag = 3;
+	// past this depth the faces are split at the median, bounding the depth of the tree
+	static const int MaxSAHDepth = 64;
+	static const int StackSize = 128;
+
+	struct Node
+	{
+		float bmin[3];
+		int   start;  // leaf: packet index; inner node: first child, the second one follows it
+		float bmax[3];
+		int   axis;   // split axis, LeafFlag for leaves
+	};
+
+	struct TriPacket
+	{
+		float v0[3][LeafSize];
+		float e1[3][LeafSize];
+		float e2[3][LeafSize];
+		int   face[LeafSize];
+	};
+
+	struct Task
+	{
+		int node, begin, end, depth;
+		Task() {}
+		Task(int _node, int _begin, int _end, int _depth) : node(_node), begin(_begin), end(_end), depth(_depth) {}
+	};
+
+	struct Bins
+	{
+		int   cnt[3][BinNum];
+		Box3f bb[3][BinNum];
+		Bins()
+		{
+			for (int a = 0; a < 3; ++a)
+				for (int b = 0; b < BinNum; ++b)
+				{
+					cnt[a][b] = 0;
+					bb[a][b].SetNull();
+				}
+		}
+	};
+
+	// build time only: the faces are partitioned in place, so their data is
+	// kept together to avoid scattered reads at each level
+	struct BuildPrim
+	{
+		Box3f   box;
+		Point3f cen;
+		int     face;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<TriPacket> packets;
+	std::vector<BuildPrim> prim;
+
+	static float HalfArea(const Box3f &b)
+	{
+		if (b.IsNull()) return 0;
+		const Point3f d = b.Dim();
+		return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+	}
+
+	static int BinOf(float c, float cmin, float scale)
+	{
+		return std::min(BinNum - 1, std::max(0, int((c - cmin) * scale)));
+	}
+
+	/* Bounding box of the faces of the task and best split of them.
+	 * Returns -1 for a leaf, otherwise the faces are partitioned along axis
+	 * and the size of the left part is returned.
+	 */
+	int Split(const Task &tk, Box3f &nodeBox, int &axis, bool parallel)
+	{
+		const int count = tk.end - tk.begin;
+		const int chunkNum = (parallel && count >= MLParallel::MinParallelSize) ? MLParallel::ThreadNum() : 1;
+		const std::vector<int> bnd = MLParallel::Chunks(count, chunkNum);
+
+		std::vector<Box3f> pb(chunkNum), pc(chunkNum);
+#pragma omp parallel for schedule(static, 1) if(chunkNum > 1)
+		for (int c = 0; c < chunkNum; ++c)
+		{
+			pb[c].SetNull();
+			pc[c].SetNull();
+			for (int i = tk.begin + bnd[c]; i < tk.begin + bnd[c + 1]; ++i)
+			{
+				pb[c].Add(prim[i].box);
+				pc[c].Add(prim[i].cen);
+			}
+		}
+		nodeBox.SetNull();
+		Box3f cb;
+		for (int c = 0; c < chunkNum; ++c)
+		{
+			nodeBox.Add(pb[c]);
+			cb.Add(pc[c]);
+		}
+		if (count <= LeafSize) return -1;
+
+		const Point3f ext = cb.Dim();
+		axis = ext[0] >= ext[1] ? (ext[0] >= ext[2] ? 0 : 2) : (ext[1] >= ext[2] ? 1 : 2);
+		int left = -1;
+		if (ext[axis] > 0 && tk.depth < MaxSAHDepth)
+		{
+			float scale[3];
+			for (int a = 0; a < 3; ++a)
+				scale[a] = ext[a] > 0 ? BinNum / ext[a] : 0;
+
+			std::vector<Bins> pbin(chunkNum);
+#pragma omp parallel for schedule(static, 1) if(chunkNum > 1)
+			for (int c = 0; c < chunkNum; ++c)
+				for (int i = tk.begin + bnd[c]; i < tk.begin + bnd[c + 1]; ++i)
+					for (int a = 0; a < 3; ++a)
+					{
+						const int b = BinOf(prim[i].cen[a], cb.min[a], scale[a]);
+						pbin[c].cnt[a][b]++;
+						pbin[c].bb[a][b].Add(prim[i].box);
+					}
+			Bins bins;
+			for (int c = 0; c < chunkNum; ++c)
+				for (int a = 0; a < 3; ++a)
+					for (int b = 0; b < BinNum; ++b)
+					{
+						bins.cnt[a][b] += pbin[c].cnt[a][b];
+						bins.bb[a][b].Add(pbin[c].bb[a][b]);
+					}
+
+			// sweep the bins from both sides looking for the cheapest plane
+			float bestCost = std::numeric_limits<float>::max();
+			int bestBin = -1;
+			for (int a = 0; a < 3; ++a)
+			{
+				if (ext[a] <= 0) continue;
+				float rightCost[BinNum];
+				Box3f acc;
+				int n = 0;
+				for (int b = BinNum - 1; b > 0; --b)
+				{
+					acc.Add(bins.bb[a][b]);
+					n += bins.cnt[a][b];
+					rightCost[b] = HalfArea(acc) * n;
+				}
+				acc.SetNull();
+				n = 0;
+				for (int b = 0; b < BinNum - 1; ++b)
+				{
+					acc.Add(bins.bb[a][b]);
+					n += bins.cnt[a][b];
+					if (n == 0 || n == count) continue;
+					const float cost = HalfArea(acc) * n + rightCost[b + 1];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestBin = b;
+						axis = a;
+					}
+				}
+			}
+			if (bestBin >= 0)
+			{
+				const float cmin = cb.min[axis], s = scale[axis];
+				const int a = axis;
+				left = int(std::partition(prim.begin() + tk.begin, prim.begin() + tk.end,
+				                          [&](const BuildPrim &p) { return BinOf(p.cen[a], cmin, s) <= bestBin; })
+				           - (prim.begin() + tk.begin));
+			}
+		}
+		if (left < 0)
+		{
+			// no useful plane (e.g. coincident centroids): object median
+			left = count / 2;
+			const int a = axis;
+			std::nth_element(prim.begin() + tk.begin, prim.begin() + tk.begin + left, prim.begin() + tk.end,
+			                 [&](const BuildPrim &p, const BuildPrim &q) { return p.cen[a] < q.cen[a] || (p.cen[a] == q.cen[a] && p.face < q.face); });
+		}
+		return left;
+	}
+
+	static bool BoxHit(const Node &nd, const float o[3], const float inv[3], float tMin, float tMax, float &tNear)
+	{
+		float t0 = tMin, t1 = tMax;
+		for (int k = 0; k < 3; ++k)
+		{
+			float tn = (nd.bmin[k] - o[k]) * inv[k];
+			float tf = (nd.bmax[k] - o[k]) * inv[k];
+			if (tn > tf) std::swap(tn, tf);
+			t0 = tn > t0 ? tn : t0;
+			t1 = tf < t1 ? tf : t1;
+		}
+		tNear = t0;
+		return t0 <= t1;
+	}
+
+	// Moller-Trumbore against the LeafSize triangles of a packet; updates
+	// hit if something closer than hit.t is found.
+	static bool PacketHit(const TriPacket &p, const float o[3], const float d[3], float tMin, RayHit &hit)
+	{
+		float tt[LeafSize], uu[LeafSize], vv[LeafSize];
+		bool found[LeafSize];
+		for (int j = 0; j < LeafSize; ++j)
+		{
+			const float px = d[1] * p.e2[2][j] - d[2] * p.e2[1][j];
+			const float py = d[2] * p.e2[0][j] - d[0] * p.e2[2][j];
+			const float pz = d[0] * p.e2[1][j] - d[1] * p.e2[0][j];
+			const float det = p.e1[0][j] * px + p.e1[1][j] * py + p.e1[2][j] * pz;
+			const float inv = 1.0f / det;
+			const float sx = o[0] - p.v0[0][j], sy = o[1] - p.v0[1][j], sz = o[2] - p.v0[2][j];
+			const float u = (sx * px + sy * py + sz * pz) * inv;
+			const float qx = sy * p.e1[2][j] - sz * p.e1[1][j];
+			const float qy = sz * p.e1[0][j] - sx * p.e1[2][j];
+			const float qz = sx * p.e1[1][j] - sy * p.e1[0][j];
+			const float v = (d[0] * qx + d[1] * qy + d[2] * qz) * inv;
+			const float t = (p.e2[0][j] * qx + p.e2[1][j] * qy + p.e2[2][j] * qz) * inv;
+			found[j] = det != 0 && u >= 0 && v >= 0 && u + v <= 1 && t > tMin && t < hit.t;
+			tt[j] = t;
+			uu[j] = u;
+			vv[j] = v;
+		}
+		bool any = false;
+		for (int j = 0; j < LeafSize; ++j)
+			if (found[j] && tt[j] < hit.t)
+			{
+				hit.face = p.face[j];
+				hit.t = tt[j];
+				hit.u = uu[j];
+				hit.v = vv[j];
+				any = true;
+			}
+		return any;
+	}
+
+	static float BoxDist2(const Node &nd, const Point3f &p)
+	{
+		float d2 = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			const float d = std::max(std::max(nd.bmin[k] - p[k], p[k] - nd.bmax[k]), 0.0f);
+			d2 += d * d;
+		}
+		return d2;
+	}
+
+	// Closest point of each triangle of a packet (Ericson, Real-Time Collision
+	// Detection 5.1.5); updates hit if something nearer than best2 is found.
+	static void PacketClosest(const TriPacket &pk, const Point3f &p, float &best2, ClosestHit &hit)
+	{
+		for (int j = 0; j < LeafSize; ++j)
+		{
+			if (pk.face[j] < 0) continue;
+			const Point3f a(pk.v0[0][j], pk.v0[1][j], pk.v0[2][j]);
+			const Point3f ab(pk.e1[0][j], pk.e1[1][j], pk.e1[2][j]);
+			const Point3f ac(pk.e2[0][j], pk.e2[1][j], pk.e2[2][j]);
+			const Point3f ap = p - a;
+			Point3f q;
+			const float d1 = ab * ap, d2 = ac * ap;
+			const float d3 = d1 - ab * ab, d4 = d2 - ac * ab;    // wrt b = a + ab
+			const float d5 = d1 - ab * ac, d6 = d2 - ac * ac;    // wrt c = a + ac
+			const float vc = d1 * d4 - d3 * d2;
+			const float vb = d5 * d2 - d1 * d6;
+			const float va = d3 * d6 - d5 * d4;
+			if (d1 <= 0 && d2 <= 0) q = a;
+			else if (d3 >= 0 && d4 <= d3) q = a + ab;
+			else if (vc <= 0 && d1 >= 0 && d3 <= 0) q = a + ab * (d1 / (d1 - d3));
+			else if (d6 >= 0 && d5 <= d6) q = a + ac;
+			else if (vb <= 0 && d2 >= 0 && d6 <= 0) q = a + ac * (d2 / (d2 - d6));
+			else if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) q = a + ab + (ac - ab) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+			else
+			{
+				const float den = 1.0f / (va + vb + vc);
+				q = a + ab * (vb * den) + ac * (vc * den);
+			}
+			const float dist2 = (p - q).SquaredNorm();
+			if (dist2 < best2 || (dist2 == best2 && hit.face >= 0 && pk.face[j] < hit.face))
+			{
+				best2 = dist2;
+				hit.face = pk.face[j];
+				hit.p = q;
+			}
+		}
+	}
+
+	template <bool anyHit>
+	void Traverse(const Point3f &_o, const Point3f &_d, float tMin, RayHit &hit) const
+	{
+		if (nodes.empty()) return;
+		const float o[3] = { _o[0], _o[1], _o[2] };
+		const float d[3] = { _d[0], _d[1], _d[2] };
+		const float inv[3] = { 1.0f / d[0], 1.0f / d[1], 1.0f / d[2] };
+
+		int stackNode[StackSize];
+		float stackNear[StackSize];
+		int sp = 0;
+		float tNear;
+		if (!BoxHit(nodes[0], o, inv, tMin, hit.t, tNear)) return;
+		int ni = 0;
+		for (;;)
+		{
+			const Node &nd = nodes[ni];
+			if (nd.axis == LeafFlag)
+			{
+				if (PacketHit(packets[nd.start], o, d, tMin, hit) && anyHit) return;
+			}
+			else
+			{
+				float ta, tb;
+				const bool ha = BoxHit(nodes[nd.start], o, inv, tMin, hit.t, ta);
+				const bool hb = BoxHit(nodes[nd.start + 1], o, inv, tMin, hit.t, tb);
+				if (ha && hb)
+				{
+					// visit the nearest child first and defer the other one
+					const bool aFirst = ta <= tb;
+					stackNode[sp] = aFirst ? nd.start + 1 : nd.start;
+					stackNear[sp] = aFirst ? tb : ta;
+					++sp;
+					ni = aFirst ? nd.start : nd.start + 1;
+					continue;
+				}
+				if (ha) { ni = nd.start; continue; }
+				if (hb) { ni = nd.start + 1; continue; }
+			}
+			// pop the next subtree that can still contain a closer hit
+			do
+			{
+				if (sp == 0) return;
+				--sp;
+			} while (stackNear[sp] > hit.t);
+			ni = stackNode[sp];
+		}
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
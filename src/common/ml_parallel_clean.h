@@ -0,0 +1,310 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_CLEAN_H
+#define __ML_PARALLEL_CLEAN_H
+
+#include <functional>
+#include <vector>
+#include <vcg/complex/algorithms/clean.h>
+#include <vcg/space/index/spatial_hashing.h>
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Multithreaded counterparts of some of the tri::Clean<> functions.
+  They produce exactly the same mesh of the serial versions: same deleted
+  elements, same surviving representative vertices, same counts. The only
+  difference is that the choice of the surviving face among a set of
+  duplicated ones is the one with the lowest index (the serial one depends
+  on the internals of std::sort).
+*/
+template <class MeshType>
+class ParallelClean
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::VertexPointer  VertexPointer;
+	typedef typename MeshType::FaceType       FaceType;
+	typedef typename MeshType::EdgeType       EdgeType;
+
+	/** Same as Clean<>::RemoveDuplicateVertex.
+	 * Vertices are sorted by (coord, index) with a parallel sort; in each run
+	 * of coincident vertices the first one is kept and the others are merged
+	 * onto it. As in the serial sweep a deleted vertex breaks the run.
+	 */
+	static int RemoveDuplicateVertex(MeshType &m, bool RemoveDegenerateFlag = true)
+	{
+		if (m.vert.size() == 0 || m.vn == 0) return 0;
+		const int vertNum = int(m.vert.size());
+
+		std::vector<int> perm(vertNum);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+			perm[i] = i;
+
+		MLParallel::Sort(perm.begin(), perm.end(), [&m](int a, int b) {
+			const CoordType &pa = m.vert[a].cP();
+			const CoordType &pb = m.vert[b].cP();
+			return (pa == pb) ? (a < b) : (pa < pb);
+		});
+
+		// merged[i] is true if the i-th sorted vertex collapses onto its run head
+		std::vector<char> merged(vertNum, 0);
+		int deleted = 0;
+#pragma omp parallel for schedule(static) reduction(+: deleted)
+		for (int i = 1; i < vertNum; ++i)
+		{
+			const VertexType &vc = m.vert[perm[i]];
+			const VertexType &vp = m.vert[perm[i - 1]];
+			if (!vc.IsD() && !vp.IsD() && vc.cP() == vp.cP())
+			{
+				merged[i] = 1;
+				++deleted;
+			}
+		}
+		if (deleted > 0)
+		{
+			// remap[vi] is the index of the vertex that replaces vi
+			std::vector<int> remap(vertNum);
+			const int chunkNum = MLParallel::ThreadNum();
+			const std::vector<int> bnd = MLParallel::Chunks(vertNum, chunkNum);
+#pragma omp parallel for schedule(static, 1)
+			for (int c = 0; c < chunkNum; ++c)
+			{
+				int head = bnd[c];
+				while (merged[head]) --head;
+				for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+				{
+					if (!merged[i]) head = i;
+					else m.vert[perm[i]].SetD();
+					remap[perm[i]] = perm[head];
+				}
+			}
+			m.vn -= deleted;
+
+			RemapFaceVertex(m, remap);
+
+			if (m.en > 0)
+			{
+				const int edgeNum = int(m.edge.size());
+#pragma omp parallel for schedule(static)
+				for (int i = 0; i < edgeNum; ++i)
+				{
+					EdgeType &e = m.edge[i];
+					if (!e.IsD())
+						for (int k = 0; k < 2; ++k)
+							e.V(k) = &m.vert[remap[tri::Index(m, e.V(k))]];
+				}
+			}
+		}
+
+		if (RemoveDegenerateFlag) RemoveDegenerateFace(m);
+		if (RemoveDegenerateFlag && m.en > 0)
+		{
+			Clean<MeshType>::RemoveDegenerateEdge(m);
+			Clean<MeshType>::RemoveDuplicateEdge(m);
+		}
+		return deleted;
+	}
+
+	/// Same as Clean<>::RemoveDegenerateFace: delete faces with two coincident vertex references.
+	static int RemoveDegenerateFace(MeshType &m)
+	{
+		const int faceNum = int(m.face.size());
+		int count_fd = 0;
+#pragma omp parallel for schedule(static) reduction(+: count_fd)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			FaceType &f = m.face[i];
+			if (!f.IsD() && (f.V(0) == f.V(1) || f.V(0) == f.V(2) || f.V(1) == f.V(2)))
+			{
+				f.SetD();
+				++count_fd;
+			}
+		}
+		m.fn -= count_fd;
+		return count_fd;
+	}
+
+	/** Same as Clean<>::RemoveDuplicateFace.
+	 * Two faces are equal if they reference the same set of vertices,
+	 * regardless of the order. Among equal faces the one with the lowest
+	 * index survives.
+	 */
+	static int RemoveDuplicateFace(MeshType &m)
+	{
+		const int faceNum = int(m.face.size());
+		std::vector<SortedTriple> fvec(faceNum);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			const FaceType &f = m.face[i];
+			if (f.IsD())
+				fvec[i] = SortedTriple(i);
+			else
+				fvec[i] = SortedTriple(tri::Index(m, f.cV(0)), tri::Index(m, f.cV(1)), tri::Index(m, f.cV(2)), i);
+		}
+		MLParallel::Sort(fvec.begin(), fvec.end(), std::less<SortedTriple>());
+
+		int total = 0;
+#pragma omp parallel for schedule(static) reduction(+: total)
+		for (int i = 1; i < faceNum; ++i)
+		{
+			if (!fvec[i].deleted && !fvec[i - 1].deleted && fvec[i].SameVert(fvec[i - 1]))
+			{
+				m.face[fvec[i].fi].SetD();
+				++total;
+			}
+		}
+		m.fn -= total;
+		return total;
+	}
+
+	/** Same as Clean<>::ClusterVertex.
+	 * The greedy clustering is inherently order dependent, so it is split
+	 * in blocks: for each block the (expensive) range queries over the
+	 * spatial hash are done in parallel, then the vertices of the block are
+	 * greedily clustered in the serial order using the precomputed
+	 * neighbours.
+	 */
+	static int ClusterVertex(MeshType &m, const ScalarType radius)
+	{
+		if (m.vn == 0) return 0;
+		// some spatial indexing structure does not work well with deleted vertices...
+		tri::Allocator<MeshType>::CompactVertexVector(m);
+		typedef vcg::SpatialHashTable<VertexType, ScalarType> SampleSHT;
+		SampleSHT sht;
+		sht.Set(m.vert.begin(), m.vert.end());
+		UpdateFlags<MeshType>::VertexClearV(m);
+
+		const int vertNum = int(m.vert.size());
+		const int blockSize = 1 << 16;
+		std::vector< std::vector<int> > closeVec(std::min(blockSize, vertNum));
+		const CoordType radiusVec(radius, radius, radius);
+		int mergedCnt = 0;
+		for (int blockStart = 0; blockStart < vertNum; blockStart += blockSize)
+		{
+			const int blockEnd = std::min(vertNum, blockStart + blockSize);
+#pragma omp parallel
+			{
+				tri::EmptyTMark<MeshType> markerFunctor;
+				std::vector<VertexType *> closests;
+#pragma omp for schedule(dynamic, 256)
+				for (int i = blockStart; i < blockEnd; ++i)
+				{
+					std::vector<int> &cv = closeVec[i - blockStart];
+					cv.clear();
+					const VertexType &v = m.vert[i];
+					if (v.IsD() || v.IsV()) continue;
+					const CoordType p = v.cP();
+					Box3<ScalarType> bb(p - radiusVec, p + radiusVec);
+					GridGetInBox(sht, markerFunctor, bb, closests);
+					for (size_t k = 0; k < closests.size(); ++k)
+						if (Distance(p, closests[k]->cP()) < radius)
+							cv.push_back(int(tri::Index(m, closests[k])));
+				}
+			}
+
+			for (int i = blockStart; i < blockEnd; ++i)
+			{
+				VertexType &v = m.vert[i];
+				if (v.IsD() || v.IsV()) continue;
+				v.SetV();
+				const CoordType p = v.cP();
+				const std::vector<int> &cv = closeVec[i - blockStart];
+				for (size_t k = 0; k < cv.size(); ++k)
+				{
+					VertexType &c = m.vert[cv[k]];
+					if (!c.IsV())
+					{
+						mergedCnt++;
+						c.SetV();
+						c.P() = p;
+					}
+				}
+			}
+		}
+		return mergedCnt;
+	}
+
+	/// Same as Clean<>::MergeCloseVertex.
+	static int MergeCloseVertex(MeshType &m, const ScalarType radius)
+	{
+		int mergedCnt = ClusterVertex(m, radius);
+		RemoveDuplicateVertex(m, true);
+		return mergedCnt;
+	}
+
+private:
+	class SortedTriple
+	{
+	public:
+		SortedTriple() {}
+		explicit SortedTriple(int _fi) : deleted(true), fi(_fi) { v[0] = v[1] = v[2] = 0; }
+		SortedTriple(unsigned int v0, unsigned int v1, unsigned int v2, int _fi) : deleted(false), fi(_fi)
+		{
+			v[0] = v0; v[1] = v1; v[2] = v2;
+			std::sort(v, v + 3);
+		}
+		// deleted faces go at the end, ties are broken by face index
+		bool operator < (const SortedTriple &p) const
+		{
+			if (deleted != p.deleted) return p.deleted;
+			if (v[2] != p.v[2]) return v[2] < p.v[2];
+			if (v[1] != p.v[1]) return v[1] < p.v[1];
+			if (v[0] != p.v[0]) return v[0] < p.v[0];
+			return fi < p.fi;
+		}
+		bool SameVert(const SortedTriple &s) const
+		{
+			return (v[0] == s.v[0]) && (v[1] == s.v[1]) && (v[2] == s.v[2]);
+		}
+
+		unsigned int v[3];
+		bool deleted;
+		int fi;
+	};
+
+	static void RemapFaceVertex(MeshType &m, const std::vector<int> &remap)
+	{
+		const int faceNum = int(m.face.size());
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			FaceType &f = m.face[i];
+			if (!f.IsD())
+				for (int k = 0; k < f.VN(); ++k)
+					f.V(k) = &m.vert[remap[tri::Index(m, f.V(k))]];
+		}
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,347 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_CLUSTERING_H
+#define __ML_PARALLEL_CLUSTERING_H
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <vcg/space/index/grid_util.h>
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Vertex clustering on a uniform grid, the same simplification done by
+  Clustering<MeshType, AverageColorCell<MeshType> >: every non empty cell
+  becomes a vertex in the average position (normal, color) of what fell in
+  it, and every face whose vertices fall in three different cells becomes a
+  face among those cells, duplicates removed.
+
+  Instead of filling a hash map one element at a time, the cell keys are
+  computed in parallel, the (key, element) pairs are sorted and each run of
+  equal keys is reduced to a cell. The cells are kept sorted by key, so the
+  result is the same for any number of threads.
+
+  Points can also be added in successive chunks with AddPoints(), e.g. while
+  reading a file too large to be loaded, provided that the box of the grid
+  is known in advance; only the cells are kept in memory.
+*/
+template <class MeshType>
+class ParallelClustering
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::FaceType       FaceType;
+	typedef unsigned long long                KeyType;
+	typedef std::pair<KeyType, int>           ItemType;
+
+	// 21 bits for each cell coordinate, so that a key fits in 63 bits
+	static const int MaxGridSide = 1 << 21;
+
+	struct Cell
+	{
+		KeyType key;
+		Point3d p;
+		Point3d n;
+		Point4d c;
+		int cnt;
+
+		Cell() : key(0), p(0, 0, 0), n(0, 0, 0), c(0, 0, 0, 0), cnt(0) {}
+		void Merge(const Cell &o) { p += o.p; n += o.n; c += o.c; cnt += o.cnt; }
+	};
+
+	/** Same grid as Clustering::Init: the box is inflated by a cell on each
+	 * side and, when cellSize is 0, it is split in about sampleNum cells.
+	 */
+	void Init(const Box3<ScalarType> &bbox, int sampleNum, ScalarType cellSize = 0)
+	{
+		cells.clear();
+		tris.clear();
+		const ScalarType infl = (cellSize == 0) ? bbox.Diag() / sampleNum : cellSize;
+		box = bbox;
+		box.min -= CoordType(infl, infl, infl);
+		box.max += CoordType(infl, infl, infl);
+		const CoordType dim = box.max - box.min;
+		if (cellSize == 0)
+			BestDim((long long)(sampleNum), dim, siz);
+		else
+			siz = Point3i::Construct(dim / cellSize);
+		for (int k = 0; k < 3; ++k)
+		{
+			siz[k] = std::max(1, std::min(siz[k], MaxGridSide));
+			voxel[k] = dim[k] / siz[k];
+		}
+	}
+
+	int CellNum() const { return int(cells.size()); }
+	const Point3i &GridSize() const { return siz; }
+
+	/** Add a chunk of points; nrm and col may be NULL, otherwise they have
+	 * the same size of pos. Successive chunks are accumulated on the cells.
+	 */
+	void AddPoints(const std::vector<CoordType> &pos, const std::vector<CoordType> *nrm, const std::vector<Color4b> *col)
+	{
+		const int n = int(pos.size());
+		std::vector<ItemType> item(n);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i)
+			item[i] = ItemType(Key(pos[i]), i);
+
+		std::vector<Cell> chunk;
+		Reduce(item, chunk, [&](Cell &c, int i) {
+			c.p += Point3d::Construct(pos[i]);
+			if (nrm) c.n += Point3d::Construct((*nrm)[i]);
+			if (col) c.c += Point4d((*col)[i][0], (*col)[i][1], (*col)[i][2], (*col)[i][3]);
+			++c.cnt;
+		});
+		MergeCells(cells, chunk);
+	}
+
+	/// Cluster the vertices of m, ignoring its faces.
+	void AddPointSet(const MeshType &m, bool onlySelected = false)
+	{
+		const int vertNum = int(m.vert.size());
+		const bool hasColor = HasPerVertexColor(m);
+		std::vector<ItemType> item(vertNum);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+		{
+			const VertexType &v = m.vert[i];
+			const bool used = !v.IsD() && (!onlySelected || v.IsS());
+			item[i] = ItemType(used ? Key(v.cP()) : InvalidKey(), i);
+		}
+
+		std::vector<Cell> chunk;
+		Reduce(item, chunk, [&](Cell &c, int i) {
+			const VertexType &v = m.vert[i];
+			c.p += Point3d::Construct(v.cP());
+			c.n += Point3d::Construct(v.cN());
+			if (hasColor) c.c += Point4d(v.cC()[0], v.cC()[1], v.cC()[2], v.cC()[3]);
+			++c.cnt;
+		});
+		MergeCells(cells, chunk);
+	}
+
+	/// Cluster the faces of m; vertices not referenced by any face are ignored.
+	void AddMesh(const MeshType &m)
+	{
+		const int vertNum = int(m.vert.size());
+		const int faceNum = int(m.face.size());
+		const bool hasColor = HasPerVertexColor(m);
+
+		std::vector<KeyType> vertKey(vertNum, InvalidKey());
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+			if (!m.vert[i].IsD())
+				vertKey[i] = Key(m.vert[i].cP());
+
+		// an element for each wedge, 3*f+k
+		std::vector<ItemType> item(size_t(3) * faceNum);
+		std::vector<Tri> faceTri(faceNum);
+#pragma omp parallel for schedule(static)
+		for (int f = 0; f < faceNum; ++f)
+		{
+			const FaceType &face = m.face[f];
+			Tri &t = faceTri[f];
+			for (int k = 0; k < 3; ++k)
+			{
+				t.v[k] = face.IsD() ? InvalidKey() : vertKey[Index(m, face.cV(k))];
+				item[3 * f + k] = ItemType(t.v[k], 3 * f + k);
+			}
+			std::sort(t.v, t.v + 3);
+			if (t.v[0] == t.v[1] || t.v[1] == t.v[2])
+				t.v[0] = InvalidKey();
+		}
+
+		std::vector<Cell> chunk;
+		Reduce(item, chunk, [&](Cell &c, int i) {
+			const FaceType &face = m.face[i / 3];
+			const VertexType &v = *face.cV(i % 3);
+			c.p += Point3d::Construct(v.cP());
+			c.n += Point3d::Construct(face.cN());
+			if (hasColor) c.c += Point4d(v.cC()[0], v.cC()[1], v.cC()[2], v.cC()[3]);
+			++c.cnt;
+		});
+		MergeCells(cells, chunk);
+
+		for (int f = 0; f < faceNum; ++f)
+			if (faceTri[f].v[0] != InvalidKey())
+				tris.push_back(faceTri[f]);
+	}
+
+	/// Replace the content of m with the clustered mesh, vertices in key order.
+	void ExtractMesh(MeshType &m)
+	{
+		m.Clear();
+		if (cells.empty()) return;
+
+		const int cellNum = int(cells.size());
+		const bool hasColor = HasPerVertexColor(m);
+		Allocator<MeshType>::AddVertices(m, cellNum);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < cellNum; ++i)
+		{
+			const Cell &c = cells[i];
+			VertexType &v = m.vert[i];
+			v.P() = CoordType::Construct(c.p / double(c.cnt));
+			Point3d n = c.n;
+			v.N() = CoordType::Construct(n.Normalize());
+			if (hasColor)
+			{
+				const Point4d col = c.c / double(c.cnt);
+				v.C() = Color4b((unsigned char)(col[0] + 0.5), (unsigned char)(col[1] + 0.5),
+				                (unsigned char)(col[2] + 0.5), (unsigned char)(col[3] + 0.5));
+			}
+		}
+
+		MLParallel::Sort(tris.begin(), tris.end(), std::less<Tri>());
+		tris.erase(std::unique(tris.begin(), tris.end()), tris.end());
+		const int triNum = int(tris.size());
+		if (triNum == 0) return;
+		Allocator<MeshType>::AddFaces(m, triNum);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < triNum; ++i)
+		{
+			FaceType &f = m.face[i];
+			int vi[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				vi[k] = CellIndex(tris[i].v[k]);
+				f.V(k) = &m.vert[vi[k]];
+			}
+			// the keys are sorted, so the orientation is lost; as Clustering
+			// does, flip the face only if it disagrees with all its cells
+			const Point3d nf = Point3d::Construct(vcg::Normal(f.cP(0), f.cP(1), f.cP(2)));
+			int badOrient = 0;
+			for (int k = 0; k < 3; ++k)
+				if (nf.dot(cells[vi[k]].n) < 0) ++badOrient;
+			if (badOrient > 2)
+				std::swap(f.V(0), f.V(1));
+		}
+	}
+
+private:
+	struct Tri
+	{
+		KeyType v[3];
+		bool operator<(const Tri &o) const { return std::lexicographical_compare(v, v + 3, o.v, o.v + 3); }
+		bool operator==(const Tri &o) const { return v[0] == o.v[0] && v[1] == o.v[1] && v[2] == o.v[2]; }
+	};
+
+	Box3<ScalarType> box;
+	Point3i siz;
+	CoordType voxel;
+	std::vector<Cell> cells;	// sorted by key
+	std::vector<Tri> tris;
+
+	static KeyType InvalidKey() { return ~KeyType(0); }
+
+	KeyType Key(const CoordType &p) const
+	{
+		KeyType key = 0;
+		for (int k = 2; k >= 0; --k)
+		{
+			const int c = std::max(0, std::min(int((p[k] - box.min[k]) / voxel[k]), siz[k] - 1));
+			key = (key << 21) | KeyType(c);
+		}
+		return key;
+	}
+
+	int CellIndex(KeyType key) const
+	{
+		return int(std::lower_bound(cells.begin(), cells.end(), key,
+		                            [](const Cell &c, KeyType k) { return c.key < k; }) - cells.begin());
+	}
+
+	/* Sort the (key, element) pairs and reduce each run of equal keys to a
+	 * cell, calling add(cell, element) in increasing element order. Elements
+	 * with InvalidKey() are dropped.
+	 */
+	template <class AddFn>
+	static void Reduce(std::vector<ItemType> &item, std::vector<Cell> &out, AddFn add)
+	{
+		MLParallel::Sort(item.begin(), item.end(), std::less<ItemType>());
+		while (!item.empty() && item.back().first == InvalidKey())
+			item.pop_back();
+		const int n = int(item.size());
+
+		std::vector<int> runId(n);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i)
+			runId[i] = (i == 0 || item[i].first != item[i - 1].first) ? 1 : 0;
+		std::vector<int> isStart(runId);
+		const int runNum = MLParallel::ExclusiveScan(runId);
+		std::vector<int> runBegin(runNum + 1, n);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i)
+			if (isStart[i]) runBegin[runId[i]] = i;
+
+		out.assign(runNum, Cell());
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int r = 0; r < runNum; ++r)
+		{
+			out[r].key = item[runBegin[r]].first;
+			for (int i = runBegin[r]; i < runBegin[r + 1]; ++i)
+				add(out[r], item[i].second);
+		}
+	}
+
+	// Merge two key sorted cell lists into acc; add is emptied.
+	static void MergeCells(std::vector<Cell> &acc, std::vector<Cell> &add)
+	{
+		if (acc.empty())
+		{
+			acc.swap(add);
+			return;
+		}
+		std::vector<Cell> out;
+		out.reserve(acc.size() + add.size());
+		size_t i = 0, j = 0;
+		while (i < acc.size() && j < add.size())
+		{
+			if (acc[i].key < add[j].key) out.push_back(acc[i++]);
+			else if (add[j].key < acc[i].key) out.push_back(add[j++]);
+			else
+			{
+				out.push_back(acc[i++]);
+				out.back().Merge(add[j++]);
+			}
+		}
+		out.insert(out.end(), acc.begin() + i, acc.end());
+		out.insert(out.end(), add.begin() + j, add.end());
+		acc.swap(out);
+		std::vector<Cell>().swap(add);
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,271 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_COMPONENTS_H
+#define __ML_PARALLEL_COMPONENTS_H
+
+#include <atomic>
+#include <utility>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include "ml_parallel_topology.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Parallel connected components of the faces of a mesh.
+
+  Two faces are connected if they share an edge, that is exactly the
+  connectivity followed by the FF adjacency flood fills of
+  Clean<>::ConnectedComponents and UpdateSelection<>::FaceConnectedFF,
+  but no FF topology is needed: the adjacency is discovered through a
+  CSR vertex-face table and the components are found with a lock-free
+  union-find over face indexes.
+
+  Components are numbered in the order of their lowest index face, that
+  is the same order in which Clean<>::ConnectedComponents finds them.
+*/
+template <class MeshType>
+class ParallelConnectedComponents
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::FaceType       FaceType;
+
+	class ComponentInfo
+	{
+	public:
+		ComponentInfo() : faceNum(0), seedFace(-1) {}
+		int faceNum;                ///< number of faces of the component
+		int seedFace;               ///< lowest index face of the component
+		Box3<ScalarType> bbox;
+		/// Same measure used by Clean<>::RemoveSmallConnectedComponentsDiameter
+		ScalarType Diameter() const { return bbox.Diag(); }
+	};
+
+	/** Label the faces with the index of their connected component.
+	 * faceCC is indexed as m.face, deleted faces are labeled with -1.
+	 * Returns the number of components.
+	 */
+	static int Compute(MeshType &m, std::vector<int> &faceCC)
+	{
+		const int faceNum = int(m.face.size());
+		std::vector<int> vfOffset, vfFace;
+		ParallelTopology<MeshType>::VertexFaceCSR(m, vfOffset, vfFace);
+
+		MLParallelUnionFind uf(faceNum);
+
+		// link each face with the higher index faces sharing one of its edges
+#pragma omp parallel for schedule(dynamic, 4096)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			const FaceType &f = m.face[i];
+			if (f.IsD()) continue;
+			for (int k = 0; k < f.VN(); ++k)
+			{
+				const VertexType *v0 = f.cV(k);
+				const VertexType *v1 = f.cV((k + 1) % f.VN());
+				const int vi = int(tri::Index(m, v0));
+				for (int j = vfOffset[vi]; j < vfOffset[vi + 1]; ++j)
+				{
+					const int g = vfFace[j];
+					if (g <= i) continue;
+					const FaceType &fg = m.face[g];
+					for (int h = 0; h < fg.VN(); ++h)
+					{
+						const VertexType *w0 = fg.cV(h);
+						const VertexType *w1 = fg.cV((h + 1) % fg.VN());
+						if ((w0 == v0 && w1 == v1) || (w0 == v1 && w1 == v0))
+						{
+							uf.Union(i, g);
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		// roots are the lowest index face of each component: number them in order
+		faceCC.resize(faceNum);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+			faceCC[i] = (!m.face[i].IsD() && uf.IsRoot(i)) ? 1 : 0;
+		const int ccNum = MLParallel::ExclusiveScan(faceCC);
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			if (m.face[i].IsD())
+				faceCC[i] = -1;
+			else
+			{
+				const int root = uf.Find(i);
+				if (root != i)
+					faceCC[i] = faceCC[root];   // roots have a lower index, already final
+			}
+		}
+		return ccNum;
+	}
+
+	/** As above, and also collects per component statistics:
+	 * number of faces, seed face and bounding box.
+	 */
+	static int Compute(MeshType &m, std::vector<int> &faceCC, std::vector<ComponentInfo> &info)
+	{
+		const int ccNum = Compute(m, faceCC);
+		const int faceNum = int(m.face.size());
+		info.clear();
+		info.resize(ccNum);
+
+		// group the faces by component (counting sort), then reduce each group
+		std::vector<int> ccOffset(ccNum + 1, 0);
+		std::vector< std::atomic<int> > cursor(ccNum);
+#pragma omp parallel for schedule(static)
+		for (int c = 0; c < ccNum; ++c)
+			cursor[c].store(0, std::memory_order_relaxed);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+			if (faceCC[i] >= 0)
+				cursor[faceCC[i]].fetch_add(1, std::memory_order_relaxed);
+#pragma omp parallel for schedule(static)
+		for (int c = 0; c < ccNum; ++c)
+			ccOffset[c] = cursor[c].load(std::memory_order_relaxed);
+		MLParallel::ExclusiveScan(ccOffset);
+#pragma omp parallel for schedule(static)
+		for (int c = 0; c < ccNum; ++c)
+			cursor[c].store(ccOffset[c], std::memory_order_relaxed);
+
+		std::vector<int> ccFace(ccOffset[ccNum]);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+			if (faceCC[i] >= 0)
+				ccFace[cursor[faceCC[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+
+#pragma omp parallel for schedule(dynamic, 64)
+		for (int c = 0; c < ccNum; ++c)
+		{
+			ComponentInfo &ci = info[c];
+			ci.faceNum = ccOffset[c + 1] - ccOffset[c];
+			ci.seedFace = faceNum;
+			for (int j = ccOffset[c]; j < ccOffset[c + 1]; ++j)
+			{
+				const FaceType &f = m.face[ccFace[j]];
+				ci.seedFace = std::min(ci.seedFace, ccFace[j]);
+				for (int k = 0; k < f.VN(); ++k)
+					ci.bbox.Add(f.cP(k));
+			}
+		}
+		return ccNum;
+	}
+
+	/// Same as Clean<>::RemoveSmallConnectedComponentsSize: returns (total, deleted) components.
+	static std::pair<int, int> RemoveSmallConnectedComponentsSize(MeshType &m, int maxCCSize)
+	{
+		std::vector<int> faceCC;
+		std::vector<ComponentInfo> info;
+		const int ccNum = Compute(m, faceCC, info);
+		std::vector<char> toDelete(ccNum);
+		int deletedCC = 0;
+		for (int c = 0; c < ccNum; ++c)
+			if (info[c].faceNum < maxCCSize)
+			{
+				toDelete[c] = 1;
+				++deletedCC;
+			}
+		DeleteComponents(m, faceCC, toDelete);
+		return std::make_pair(ccNum, deletedCC);
+	}
+
+	/// Same as Clean<>::RemoveSmallConnectedComponentsDiameter: returns (total, deleted) components.
+	static std::pair<int, int> RemoveSmallConnectedComponentsDiameter(MeshType &m, ScalarType maxDiameter)
+	{
+		std::vector<int> faceCC;
+		std::vector<ComponentInfo> info;
+		const int ccNum = Compute(m, faceCC, info);
+		std::vector<char> toDelete(ccNum);
+		int deletedCC = 0;
+		for (int c = 0; c < ccNum; ++c)
+			if (info[c].Diameter() < maxDiameter)
+			{
+				toDelete[c] = 1;
+				++deletedCC;
+			}
+		DeleteComponents(m, faceCC, toDelete);
+		return std::make_pair(ccNum, deletedCC);
+	}
+
+	/** Same as UpdateSelection<>::FaceConnectedFF: expand the face selection
+	 * to the whole connected components with at least a selected face.
+	 * Returns the number of newly selected faces.
+	 */
+	static size_t FaceConnected(MeshType &m)
+	{
+		std::vector<int> faceCC;
+		const int ccNum = Compute(m, faceCC);
+		const int faceNum = int(m.face.size());
+		std::vector< std::atomic<char> > ccSel(ccNum);
+#pragma omp parallel for schedule(static)
+		for (int c = 0; c < ccNum; ++c)
+			ccSel[c].store(0, std::memory_order_relaxed);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+			if (faceCC[i] >= 0 && m.face[i].IsS())
+				ccSel[faceCC[i]].store(1, std::memory_order_relaxed);
+
+		int selCnt = 0;
+#pragma omp parallel for schedule(static) reduction(+: selCnt)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			FaceType &f = m.face[i];
+			if (faceCC[i] >= 0 && !f.IsS() && ccSel[faceCC[i]].load(std::memory_order_relaxed))
+			{
+				f.SetS();
+				++selCnt;
+			}
+		}
+		return size_t(selCnt);
+	}
+
+	/// Delete all the faces whose component is marked in toDelete.
+	static int DeleteComponents(MeshType &m, const std::vector<int> &faceCC, const std::vector<char> &toDelete)
+	{
+		const int faceNum = int(m.face.size());
+		int deletedFN = 0;
+#pragma omp parallel for schedule(static) reduction(+: deletedFN)
+		for (int i = 0; i < faceNum; ++i)
+			if (faceCC[i] >= 0 && toDelete[faceCC[i]])
+			{
+				m.face[i].SetD();
+				++deletedFN;
+			}
+		m.fn -= deletedFN;
+		return deletedFN;
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,791 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_CURVATURE_H
+#define __ML_PARALLEL_CURVATURE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/stat.h>
+#include <vcg/math/matrix33.h>
+#include <Eigen/Eigenvalues>
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Per vertex curvature computed with the formulas of UpdateCurvature and
+  UpdateCurvatureFitting, over all the vertices at once.
+
+  The constructor builds, once, a flat vertex-face and face-face adjacency
+  (no FF/VF components are needed on the mesh) that is shared by all the
+  methods. The contributions of the faces are gathered per vertex in face
+  order, the same order in which the serial versions scatter them, and the
+  neighbourhoods are collected in per-thread buffers. The ball queries of
+  the PCA method go through a flat uniform grid, that unlike the vcg
+  spatial indexes needs no marks and can be queried concurrently.
+*/
+template <class MeshType>
+class ParallelCurvature
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::FaceType       FaceType;
+
+	explicit ParallelCurvature(MeshType &mesh) : m(mesh)
+	{
+		BuildTopology();
+	}
+
+	/// Number of edges shared by more than two faces (or by two badly oriented ones).
+	int NonManifoldEdgeNum() const
+	{
+		const int wedgeNum = int(tri.size());
+		int cnt = 0;
+#pragma omp parallel for schedule(static) reduction(+: cnt)
+		for (int w = 0; w < wedgeNum; ++w)
+			if (opp[w] == -2) ++cnt;
+		return cnt;
+	}
+
+	/// Mean (Kh) and gaussian (Kg) curvature, as UpdateCurvature::MeanAndGaussian (Desbrun et al.).
+	void MeanAndGaussian()
+	{
+		NormalPerVertexAreaWeighted();
+		const int vertNum = int(m.vert.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int v = 0; v < vertNum; ++v)
+		{
+			VertexType &vv = m.vert[v];
+			if (vv.IsD()) continue;
+			float area = 0;
+			CoordType contr(0, 0, 0);
+			vv.Kg() = float(2.0 * M_PI);
+			for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+			{
+				const int w = vfWedge[i];
+				const FaceType &f = m.face[w / 3];
+				const int k = w % 3;
+				const float angle0 = math::Abs(Angle(f.cP(1) - f.cP(0), f.cP(2) - f.cP(0)));
+				const float angle1 = math::Abs(Angle(f.cP(0) - f.cP(1), f.cP(2) - f.cP(1)));
+				const float angle2 = M_PI - (angle0 + angle1);
+				const float angle[3] = { angle0, angle1, angle2 };
+
+				// mixed area
+				if (angle0 < M_PI / 2 && angle1 < M_PI / 2 && angle2 < M_PI / 2)
+				{
+					const float e01 = SquaredDistance(f.cP(1), f.cP(0));
+					const float e12 = SquaredDistance(f.cP(2), f.cP(1));
+					const float e20 = SquaredDistance(f.cP(0), f.cP(2));
+					const float e[3] = { e01, e12, e20 };
+					// corner k: the edges from it, weighted by the cotangents of the opposite angles
+					const float ak = (e[(k + 2) % 3] * (1.0 / tan(angle[(k + 1) % 3])) + e[k] * (1.0 / tan(angle[(k + 2) % 3]))) / 8.0;
+					area += ak;
+				}
+				else
+				{
+					const int obtuse = (angle0 >= M_PI / 2) ? 0 : ((angle1 >= M_PI / 2) ? 1 : 2);
+					area += DoubleArea(f) / ((k == obtuse) ? 4.0 : 8.0);
+				}
+
+				// mean curvature normal and angle defect
+				if (angle0 == 0 || angle1 == 0 || angle2 == 0) continue;
+				const CoordType ev = f.cP((k + 1) % 3) - f.cP(k);             // outgoing edge
+				const CoordType pv = f.cP(k) - f.cP((k + 2) % 3);             // incoming edge
+				contr += (pv * ScalarType(1.0 / tan(angle[(k + 1) % 3])) - ev * ScalarType(1.0 / tan(angle[(k + 2) % 3]))) / ScalarType(4.0);
+				vv.Kg() -= angle[k];
+				if (opp[w] == -1)
+				{
+					// border: the angle between the two border edges of the vertex
+					const CoordType e1 = f.cP((k + 1) % 3) - f.cP(k);
+					const CoordType e2 = m.vert[OtherBorderVertex(w)].cP() - f.cP(k);
+					vv.Kg() -= math::Abs(Angle(e1, e2));
+				}
+			}
+			if (area <= std::numeric_limits<ScalarType>::epsilon())
+			{
+				vv.Kh() = 0;
+				vv.Kg() = 0;
+			}
+			else
+			{
+				vv.Kh() = ((contr.dot(vv.cN()) > 0) ? 1.0 : -1.0) * (contr / area).Norm();
+				vv.Kg() /= area;
+			}
+		}
+	}
+
+	/// Principal curvatures and directions with the Taubin approximation, as UpdateCurvature::PrincipalDirections.
+	void PrincipalDirections()
+	{
+		NormalPerVertexAngleWeighted();
+		const int vertNum = int(m.vert.size());
+#pragma omp parallel
+		{
+			std::vector<int> ringVert;
+			std::vector<float> ringArea, weights;
+			std::vector<char> ringBorder;
+#pragma omp for schedule(dynamic, 1024)
+			for (int v = 0; v < vertNum; ++v)
+			{
+				if (m.vert[v].IsD() || vfStart[v] == vfStart[v + 1]) continue;
+				if (!Ring(v, ringVert, ringArea, ringBorder)) continue;
+				TaubinVertex(m.vert[v], ringVert, ringArea, ringBorder, weights);
+			}
+		}
+	}
+
+	/// Principal curvatures and directions by fitting a quadric on the two-ring, as UpdateCurvatureFitting::computeCurvature.
+	void PrincipalDirectionsFitting()
+	{
+		NormalPerVertexAngleWeighted();
+		const int vertNum = int(m.vert.size());
+#pragma omp parallel
+		{
+			std::vector<int> ring;
+			std::vector<CoordType> pts;
+#pragma omp for schedule(dynamic, 1024)
+			for (int v = 0; v < vertNum; ++v)
+			{
+				if (m.vert[v].IsD() || vfStart[v] == vfStart[v + 1]) continue;
+				FittingVertex(v, ring, pts);
+			}
+		}
+	}
+
+	/// Principal curvatures and directions from the covariance of the vertices closer than r, as UpdateCurvature::PrincipalDirectionsPCA with point sampling.
+	void PrincipalDirectionsPCA(ScalarType r, CallBackPos *cb = 0)
+	{
+		NormalPerVertexAngleWeighted();
+		const ScalarType area = Stat<MeshType>::ComputeMeshArea(m);
+		BuildPointGrid(r);
+		const int vertNum = int(m.vert.size());
+		std::atomic<int> done(0);
+#pragma omp parallel
+		{
+			std::vector<CoordType> points;
+#pragma omp for schedule(dynamic, 256)
+			for (int v = 0; v < vertNum; ++v)
+			{
+				if (m.vert[v].IsD()) continue;
+				InSphere(m.vert[v].cP(), r, points);
+				PCAVertex(m.vert[v], points, r, area);
+				const int cnt = done.fetch_add(1, std::memory_order_relaxed);
+				if (cb && MLParallel::ThreadId() == 0 && (cnt & 1023) == 0)
+					cb(int(100.0 * cnt / vertNum), "Vertices Analysis");
+			}
+		}
+		std::vector<int>().swap(gridStart);
+		std::vector<int>().swap(gridVert);
+	}
+
+	/// Principal curvatures and directions from the normal cycle, as UpdateCurvature::PrincipalDirectionsNormalCycle (needs up to date face normals).
+	void PrincipalDirectionsNormalCycle()
+	{
+		const int vertNum = int(m.vert.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int v = 0; v < vertNum; ++v)
+		{
+			if (m.vert[v].IsD() || vfStart[v] == vfStart[v + 1]) continue;
+			NormalCycleVertex(v);
+		}
+	}
+
+private:
+	MeshType &m;
+	std::vector<int> tri;       // 3 per face, -1 for deleted faces
+	std::vector<int> opp;       // opposite wedge; -1 on borders, -2 on non manifold edges
+	std::vector<int> vfStart;   // wedges of vertex v are vfWedge[vfStart[v]] ... vfWedge[vfStart[v+1]-1], by face
+	std::vector<int> vfWedge;
+	// uniform grid of the live vertices for PrincipalDirectionsPCA: the vertices
+	// of cell c are gridVert[gridStart[c]] ... gridVert[gridStart[c+1]-1]
+	Box3<ScalarType> gridBox;
+	Point3i gridDim;
+	ScalarType gridCell;
+	std::vector<int> gridStart;
+	std::vector<int> gridVert;
+
+	static int Next(int w) { return (w % 3 == 2) ? w - 2 : w + 1; }
+	static int Prev(int w) { return (w % 3 == 0) ? w + 2 : w - 1; }
+	int Org(int w) const { return tri[w]; }
+	int Dst(int w) const { return tri[Next(w)]; }
+
+	void BuildTopology()
+	{
+		const int vertNum = int(m.vert.size());
+		const int faceNum = int(m.face.size());
+		const int wedgeNum = 3 * faceNum;
+		tri.resize(wedgeNum);
+#pragma omp parallel for schedule(static)
+		for (int f = 0; f < faceNum; ++f)
+			for (int k = 0; k < 3; ++k)
+				tri[3 * f + k] = m.face[f].IsD() ? -1 : int(Index(m, m.face[f].cV(k)));
+
+		std::vector<std::atomic<int> > cnt(vertNum + 1);
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v <= vertNum; ++v)
+			cnt[v].store(0, std::memory_order_relaxed);
+#pragma omp parallel for schedule(static)
+		for (int w = 0; w < wedgeNum; ++w)
+			if (tri[w] >= 0) cnt[tri[w]].fetch_add(1, std::memory_order_relaxed);
+		vfStart.resize(vertNum + 1);
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v <= vertNum; ++v)
+			vfStart[v] = cnt[v].load(std::memory_order_relaxed);
+		vfWedge.resize(MLParallel::ExclusiveScan(vfStart));
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v <= vertNum; ++v)
+			cnt[v].store(vfStart[v], std::memory_order_relaxed);
+#pragma omp parallel for schedule(static)
+		for (int w = 0; w < wedgeNum; ++w)
+			if (tri[w] >= 0) vfWedge[cnt[tri[w]].fetch_add(1, std::memory_order_relaxed)] = w;
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int v = 0; v < vertNum; ++v)
+			std::sort(vfWedge.begin() + vfStart[v], vfWedge.begin() + vfStart[v + 1]);
+
+		// the opposite of a->b is the only b->a, if there is no other a->b
+		opp.assign(wedgeNum, -1);
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int w = 0; w < wedgeNum; ++w)
+		{
+			if (tri[w] < 0) continue;
+			const int a = Org(w), b = Dst(w);
+			int rev = 0, same = 0, o = -1;
+			for (int i = vfStart[b]; i < vfStart[b + 1]; ++i)
+				if (Dst(vfWedge[i]) == a) { ++rev; o = vfWedge[i]; }
+			for (int i = vfStart[a]; i < vfStart[a + 1]; ++i)
+				if (vfWedge[i] != w && Dst(vfWedge[i]) == b) ++same;
+			if (rev == 1 && same == 0) opp[w] = o;
+			else if (rev + same > 0) opp[w] = -2;
+		}
+	}
+
+	/* For the border wedge w, the other end of the other border edge of its
+	 * vertex, reached turning around the vertex inside the fan of w.
+	 */
+	int OtherBorderVertex(int w) const
+	{
+		int x = w;
+		for (int steps = vfStart[Org(w) + 1] - vfStart[Org(w)]; steps > 0 && opp[Prev(x)] >= 0; --steps)
+			x = opp[Prev(x)];
+		return Org(Prev(x));
+	}
+
+	// As UpdateNormal::PerVertexNormalized.
+	void NormalPerVertexAreaWeighted()
+	{
+		const int vertNum = int(m.vert.size());
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v < vertNum; ++v)
+		{
+			if (m.vert[v].IsD()) continue;
+			typename VertexType::NormalType n(0, 0, 0);
+			for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+				n += VertexType::NormalType::Construct(TriangleNormal(m.face[vfWedge[i] / 3]));
+			m.vert[v].N() = n.Normalize();
+		}
+	}
+
+	// As UpdateNormal::PerVertexAngleWeighted followed by NormalizePerVertex.
+	void NormalPerVertexAngleWeighted()
+	{
+		typedef typename VertexType::NormalType NormalType;
+		const int vertNum = int(m.vert.size());
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v < vertNum; ++v)
+		{
+			if (m.vert[v].IsD()) continue;
+			NormalType n(0, 0, 0);
+			for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+			{
+				const FaceType &f = m.face[vfWedge[i] / 3];
+				const int k = vfWedge[i] % 3;
+				const NormalType t = NormalType::Construct(TriangleNormal(f)).Normalize();
+				const NormalType e0 = NormalType::Construct(f.cP((k + 1) % 3) - f.cP(k)).Normalize();
+				const NormalType e2 = NormalType::Construct(f.cP(k) - f.cP((k + 2) % 3)).Normalize();
+				n += t * AngleN(e0, -e2);
+			}
+			m.vert[v].N() = n.Normalize();
+		}
+	}
+
+	/* One-ring of v as walked by the JumpingPos of UpdateCurvature: starting
+	 * from the last face of v, every vertex with the double area of the face
+	 * through which it is reached; at a border the walk jumps to the other
+	 * border edge of the fan. Returns false if the ring is not a fan.
+	 */
+	bool Ring(int v, std::vector<int> &ringVert, std::vector<float> &ringArea, std::vector<char> &ringBorder) const
+	{
+		ringVert.clear();
+		ringArea.clear();
+		ringBorder.clear();
+		const int valence = vfStart[v + 1] - vfStart[v];
+		int w = vfWedge[vfStart[v + 1] - 1];
+		const int firstV = Org(Prev(w));
+		for (int steps = 0; steps <= 2 * valence; ++steps)
+		{
+			if (opp[Prev(w)] == -2) return false;
+			if (opp[Prev(w)] >= 0)
+				w = opp[Prev(w)];
+			else
+			{
+				// jump back to the first face of the fan, whose border vertex is reached first
+				for (int back = valence; back > 0 && opp[w] >= 0; --back)
+					w = Next(opp[w]);
+				if (opp[w] < -1) return false;
+				ringVert.push_back(Dst(w));
+				ringArea.push_back(DoubleArea(m.face[w / 3]));
+				ringBorder.push_back(1);
+				if (Dst(w) == firstV) return true;
+			}
+			ringVert.push_back(Org(Prev(w)));
+			ringArea.push_back(DoubleArea(m.face[w / 3]));
+			ringBorder.push_back(opp[Prev(w)] < 0 ? 1 : 0);
+			if (Org(Prev(w)) == firstV) return true;
+		}
+		return false;
+	}
+
+	void TaubinVertex(VertexType &cv, const std::vector<int> &ringVert, const std::vector<float> &ringArea,
+	                  const std::vector<char> &ringBorder, std::vector<float> &weights) const
+	{
+		float totalDoubleAreaSize = 0.0f;
+		for (size_t i = 0; i < ringArea.size(); ++i)
+			totalDoubleAreaSize += ringArea[i];
+
+		// weights of the directional curvatures
+		weights.clear();
+		for (size_t i = 0; i < ringVert.size(); ++i)
+		{
+			if (ringBorder[i])
+				weights.push_back(ringArea[i] / totalDoubleAreaSize);
+			else
+				weights.push_back(0.5f * (ringArea[i] + ringArea[(i - 1) % ringVert.size()]) / totalDoubleAreaSize);
+		}
+
+		// I-NN^t, to project the edges on the tangent plane
+		const CoordType n = CoordType::Construct(cv.cN());
+		Matrix33<ScalarType> Tp;
+		for (int i = 0; i < 3; ++i)
+			Tp[i][i] = 1.0f - powf(n[i], 2);
+		Tp[0][1] = Tp[1][0] = -1.0f * (n[0] * n[1]);
+		Tp[1][2] = Tp[2][1] = -1.0f * (n[1] * n[2]);
+		Tp[0][2] = Tp[2][0] = -1.0f * (n[0] * n[2]);
+
+		// M = sum of w_i k_i T_i T_i^t
+		Matrix33<ScalarType> tempMatrix;
+		Matrix33<ScalarType> M;
+		M.SetZero();
+		for (size_t i = 0; i < ringVert.size(); ++i)
+		{
+			const CoordType edge = cv.cP() - m.vert[ringVert[i]].cP();
+			const float curvature = (2.0f * (n.dot(edge))) / edge.SquaredNorm();
+			CoordType T = Tp * edge;
+			T.Normalize();
+			tempMatrix.ExternalProduct(T, T);
+			M += tempMatrix * weights[i] * curvature;
+		}
+
+		// Householder matrix I - 2WW^t taking the normal on the first axis
+		CoordType W;
+		const CoordType e1(1.0f, 0.0f, 0.0f);
+		if ((e1 - n).SquaredNorm() > (e1 + n).SquaredNorm())
+			W = e1 - n;
+		else
+			W = e1 + n;
+		W.Normalize();
+		Matrix33<ScalarType> Q;
+		Q.SetIdentity();
+		tempMatrix.ExternalProduct(W, W);
+		Q -= tempMatrix * 2.0f;
+
+		Matrix33<ScalarType> Qt(Q);
+		Qt.Transpose();
+		const Matrix33<ScalarType> QtMQ = Qt * M * Q;
+		const CoordType T1 = Q.GetColumn(1);
+		const CoordType T2 = Q.GetColumn(2);
+
+		// Givens rotation diagonalizing the 2x2 minor
+		const float alpha = QtMQ[1][1] - QtMQ[2][2];
+		const float beta  = QtMQ[2][1];
+		float h[2];
+		float delta = sqrtf(4.0f * powf(alpha, 2) + 16.0f * powf(beta, 2));
+		h[0] = (2.0f * alpha + delta) / (2.0f * beta);
+		h[1] = (2.0f * alpha - delta) / (2.0f * beta);
+
+		float t[2];
+		float c = 1, s = 0;
+		float min_error = std::numeric_limits<float>::infinity();
+		for (int i = 0; i < 2; i++)
+		{
+			delta = sqrtf(powf(h[i], 2) + 4.0f);
+			t[0] = (h[i] + delta) / 2.0f;
+			t[1] = (h[i] - delta) / 2.0f;
+			for (int j = 0; j < 2; j++)
+			{
+				const float squared_t = powf(t[j], 2);
+				const float denominator = 1.0f + squared_t;
+				const float sj = (2.0f * t[j]) / denominator;
+				const float cj = (1 - squared_t) / denominator;
+				const float approximation = cj * sj * alpha + (powf(cj, 2) - powf(sj, 2)) * beta;
+				const float angle_similarity = fabs(acosf(cj) / asinf(sj));
+				const float error = fabs(1.0f - angle_similarity) + fabs(approximation);
+				if (error < min_error)
+				{
+					min_error = error;
+					c = cj;
+					s = sj;
+				}
+			}
+		}
+
+		// S^t minor S, with S = [c s; -s c]
+		const float a00 = QtMQ[1][1], a01 = QtMQ[1][2], a10 = QtMQ[2][1], a11 = QtMQ[2][2];
+		const float ms00 = a00 * c - a01 * s, ms01 = a00 * s + a01 * c;
+		const float ms10 = a10 * c - a11 * s, ms11 = a10 * s + a11 * c;
+		const float StMS00 = c * ms00 - s * ms10;
+		const float StMS11 = s * ms01 + c * ms11;
+
+		cv.PD1().Import(T1 * c - T2 * s);
+		cv.PD2().Import(T1 * s + T2 * c);
+		cv.K1() = (3.0f * StMS00) - StMS11;
+		cv.K2() = (3.0f * StMS11) - StMS00;
+	}
+
+	void FittingVertex(int v, std::vector<int> &ring, std::vector<CoordType> &pts) const
+	{
+		VertexType &cv = m.vert[v];
+		const CoordType n = CoordType::Construct(cv.cN());
+
+		// reference frame: the tangent direction toward a neighbour, as in computeReferenceFrames
+		const int vp = Dst(vfWedge[vfStart[v + 1] - 1]);
+		const CoordType pp = m.vert[vp].cP();
+		CoordType ref[3];
+		ref[0] = (pp - n * ((pp - cv.cP()) * n)) - cv.cP();
+		ref[0].Normalize();
+		ref[1] = n ^ ref[0];
+		ref[1].Normalize();
+		ref[2] = n / n.Norm();
+
+		// the distinct positions of the two-ring
+		ring.clear();
+		for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+		{
+			const int u = Dst(vfWedge[i]);
+			for (int j = vfStart[u]; j < vfStart[u + 1]; ++j)
+			{
+				ring.push_back(Dst(vfWedge[j]));
+				ring.push_back(Org(Prev(vfWedge[j])));
+			}
+		}
+		pts.clear();
+		for (size_t i = 0; i < ring.size(); ++i)
+			pts.push_back(m.vert[ring[i]].cP());
+		std::sort(pts.begin(), pts.end());
+		pts.erase(std::unique(pts.begin(), pts.end()), pts.end());
+
+		// least squares quadric z = a u^2 + b uv + c v^2 + d u + e v, by the normal equations
+		double q[5] = { 1, 1, 1, 1, 1 };
+		if (pts.size() >= 5)
+		{
+			double AtA[5][6] = {};
+			for (size_t i = 0; i < pts.size(); ++i)
+			{
+				const CoordType vTang = pts[i] - cv.cP();
+				const double x = vTang * ref[0], y = vTang * ref[1], z = vTang * ref[2];
+				const double row[5] = { x * x, x * y, y * y, x, y };
+				for (int r = 0; r < 5; ++r)
+				{
+					for (int c = 0; c < 5; ++c)
+						AtA[r][c] += row[r] * row[c];
+					AtA[r][5] += row[r] * z;
+				}
+			}
+			if (!Solve5(AtA, q)) std::fill(q, q + 5, 1.0);
+		}
+
+		// shape operator from the fundamental forms at the origin
+		const double a = q[0], b = q[1], c = q[2], d = q[3], e = q[4];
+		const double E = 1.0 + d * d;
+		const double F = d * e;
+		const double G = 1.0 + e * e;
+		const double nz = 1.0 / std::sqrt(d * d + e * e + 1.0);
+		const double L = 2.0 * a * nz;
+		const double M = b * nz;
+		const double N = 2.0 * c * nz;
+		const double den = E * G - F * F;
+		const double s00 = (L * G - M * F) / den;
+		const double s01 = (M * E - L * F) / den;
+		const double s11 = (N * E - M * F) / den;
+
+		// eigenvalues (increasing) and eigenvectors of the symmetric 2x2 operator
+		const double mid = (s00 + s11) / 2.0;
+		const double rad = std::sqrt((s00 - s11) * (s00 - s11) / 4.0 + s01 * s01);
+		const double l0 = mid - rad, l1 = mid + rad;
+		double v0x, v0y;
+		if (std::abs(s01) > 0)
+		{
+			v0x = s01;
+			v0y = l0 - s00;
+		}
+		else if (s00 <= s11)
+		{
+			v0x = 1;
+			v0y = 0;
+		}
+		else
+		{
+			v0x = 0;
+			v0y = 1;
+		}
+		const double len = std::sqrt(v0x * v0x + v0y * v0y);
+		v0x /= len;
+		v0y /= len;
+
+		// curvatures are the opposite of the eigenvalues: the smaller eigenvalue gives K1
+		CoordType d1 = ref[0] * ScalarType(v0x) + ref[1] * ScalarType(v0y);
+		CoordType d2 = ref[0] * ScalarType(-v0y) + ref[1] * ScalarType(v0x);
+		d1.Normalize();
+		d2.Normalize();
+		cv.PD1().Import(d1);
+		cv.PD2().Import(d2);
+		cv.K1() = ScalarType(-l0);
+		cv.K2() = ScalarType(-l1);
+	}
+
+	Point3i GridCell(const CoordType &p) const
+	{
+		Point3i c;
+		for (int i = 0; i < 3; ++i)
+			c[i] = std::max(0, std::min(gridDim[i] - 1, int((p[i] - gridBox.min[i]) / gridCell)));
+		return c;
+	}
+
+	// cells of side at least r, and not many more cells than vertices
+	void BuildPointGrid(ScalarType r)
+	{
+		const int vertNum = int(m.vert.size());
+		gridBox.SetNull();
+		for (int v = 0; v < vertNum; ++v)
+			if (!m.vert[v].IsD()) gridBox.Add(m.vert[v].cP());
+		const CoordType dim = gridBox.Dim();
+		gridCell = std::max(r, std::numeric_limits<ScalarType>::min());
+		const double cellMax = 4.0 * std::max(vertNum, 1);
+		const double vol = std::max(double(dim[0]), double(gridCell)) * std::max(double(dim[1]), double(gridCell)) * std::max(double(dim[2]), double(gridCell));
+		if (vol / (double(gridCell) * gridCell * gridCell) > cellMax)
+			gridCell = ScalarType(std::cbrt(vol / cellMax));
+		for (int i = 0; i < 3; ++i)
+			gridDim[i] = std::max(1, int(std::ceil(dim[i] / gridCell)));
+
+		const int cellNum = gridDim[0] * gridDim[1] * gridDim[2];
+		std::vector<int> cellOf(vertNum, -1);
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v < vertNum; ++v)
+		{
+			if (m.vert[v].IsD()) continue;
+			const Point3i c = GridCell(m.vert[v].cP());
+			cellOf[v] = (c[2] * gridDim[1] + c[1]) * gridDim[0] + c[0];
+		}
+		gridStart.assign(cellNum + 1, 0);
+		for (int v = 0; v < vertNum; ++v)
+			if (cellOf[v] >= 0) ++gridStart[cellOf[v]];
+		gridVert.resize(MLParallel::ExclusiveScan(gridStart));
+		std::vector<int> pos(gridStart.begin(), gridStart.end() - 1);
+		for (int v = 0; v < vertNum; ++v)
+			if (cellOf[v] >= 0) gridVert[pos[cellOf[v]]++] = v;
+	}
+
+	// positions of the vertices within distance r from p, as GetInSphereVertex
+	void InSphere(const CoordType &p, ScalarType r, std::vector<CoordType> &points) const
+	{
+		points.clear();
+		const Point3i lo = GridCell(p - CoordType(r, r, r));
+		const Point3i hi = GridCell(p + CoordType(r, r, r));
+		const ScalarType r2 = r * r;
+		for (int z = lo[2]; z <= hi[2]; ++z)
+			for (int y = lo[1]; y <= hi[1]; ++y)
+				for (int x = lo[0]; x <= hi[0]; ++x)
+				{
+					const int c = (z * gridDim[1] + y) * gridDim[0] + x;
+					for (int i = gridStart[c]; i < gridStart[c + 1]; ++i)
+					{
+						const CoordType &q = m.vert[gridVert[i]].cP();
+						if (SquaredDistance(p, q) <= r2) points.push_back(q);
+					}
+				}
+	}
+
+	void PCAVertex(VertexType &cv, const std::vector<CoordType> &points, ScalarType r, ScalarType area) const
+	{
+		Matrix33<ScalarType> A, eigenvectors;
+		Point3<ScalarType> bp, eigenvalues;
+		A.Covariance(points, bp);
+		A *= area * area / 1000;
+
+		Eigen::Matrix3d AA;
+		A.ToEigenMatrix(AA);
+		Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eig(AA);
+		Eigen::Vector3d c_val = eig.eigenvalues();
+		Eigen::Matrix3d c_vec = eig.eigenvectors(); // eigenvectors are stored as columns
+		eigenvectors.FromEigenMatrix(c_vec);
+		eigenvalues.FromEigenVector(c_val);
+
+		// the eigenvector closest to the normal is the normal direction
+		const CoordType n = CoordType::Construct(cv.cN());
+		int best = 0;
+		ScalarType bestv = std::fabs(n.dot(eigenvectors.GetColumn(0).normalized()));
+		for (int i = 1; i < 3; ++i)
+		{
+			const ScalarType prod = std::fabs(n.dot(eigenvectors.GetColumn(i).normalized()));
+			if (prod > bestv) { bestv = prod; best = i; }
+		}
+		CoordType pd1 = eigenvectors.GetColumn((best + 1) % 3).normalized();
+		CoordType pd2 = eigenvectors.GetColumn((best + 2) % 3).normalized();
+
+		// project them on the plane identified by the normal
+		Matrix33<ScalarType> rot;
+		ScalarType angle = std::acos(pd1.dot(n));
+		rot.SetRotateRad(-(M_PI * 0.5 - angle), pd1 ^ n);
+		pd1 = rot * pd1;
+		angle = std::acos(pd2.dot(n));
+		rot.SetRotateRad(-(M_PI * 0.5 - angle), pd2 ^ n);
+		pd2 = rot * pd2;
+
+		const ScalarType r5 = r * r * r * r * r;
+		const ScalarType r6 = r * r5;
+		ScalarType k1 = (2.0 / 5.0) * (4.0 * M_PI * r5 + 15 * eigenvalues[(best + 2) % 3] - 45.0 * eigenvalues[(best + 1) % 3]) / (M_PI * r6);
+		ScalarType k2 = (2.0 / 5.0) * (4.0 * M_PI * r5 + 15 * eigenvalues[(best + 1) % 3] - 45.0 * eigenvalues[(best + 2) % 3]) / (M_PI * r6);
+		if (k1 < k2)
+		{
+			std::swap(k1, k2);
+			std::swap(pd1, pd2);
+		}
+		cv.PD1().Import(pd1);
+		cv.PD2().Import(pd2);
+		cv.K1() = k1;
+		cv.K2() = k2;
+	}
+
+	void NormalCycleVertex(int v)
+	{
+		VertexType &cv = m.vert[v];
+		Matrix33<ScalarType> m33;
+		m33.SetZero();
+		for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+		{
+			const int w = vfWedge[i];
+			if (opp[w] < 0) continue;   // border edge, the face is its own flip
+			CoordType normalized_edge = m.vert[Dst(w)].cP() - cv.cP();
+			const ScalarType edge_length = normalized_edge.Norm();
+			normalized_edge /= edge_length;
+			CoordType n1 = CoordType::Construct(m.face[w / 3].cN()); n1.Normalize();
+			CoordType n2 = CoordType::Construct(m.face[opp[w] / 3].cN()); n2.Normalize();
+			ScalarType n1n2 = (n1 ^ n2).dot(normalized_edge);
+			n1n2 = std::max(std::min(ScalarType(1.0), n1n2), ScalarType(-1.0));
+			const ScalarType beta = math::Asin(n1n2);
+			m33[0][0] += beta * edge_length * normalized_edge[0] * normalized_edge[0];
+			m33[0][1] += beta * edge_length * normalized_edge[1] * normalized_edge[0];
+			m33[1][1] += beta * edge_length * normalized_edge[1] * normalized_edge[1];
+			m33[0][2] += beta * edge_length * normalized_edge[2] * normalized_edge[0];
+			m33[1][2] += beta * edge_length * normalized_edge[2] * normalized_edge[1];
+			m33[2][2] += beta * edge_length * normalized_edge[2] * normalized_edge[2];
+		}
+		if (m33.Determinant() == 0.0)   // degenerate case
+		{
+			cv.K1() = cv.K2() = 0.0;
+			return;
+		}
+		m33[1][0] = m33[0][1];
+		m33[2][0] = m33[0][2];
+		m33[2][1] = m33[1][2];
+
+		Eigen::Matrix3d it;
+		m33.ToEigenMatrix(it);
+		Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eig(it);
+		Eigen::Vector3d c_val = eig.eigenvalues();
+		Eigen::Matrix3d c_vec = eig.eigenvectors();
+		Point3<ScalarType> lambda;
+		Matrix33<ScalarType> vect;
+		vect.FromEigenMatrix(c_vec);
+		lambda.FromEigenVector(c_val);
+
+		const CoordType n = CoordType::Construct(cv.N().Normalize());
+		ScalarType bestNormal = 0;
+		int bestNormalIndex = -1;
+		for (int i = 0; i < 3; ++i)
+		{
+			const ScalarType agreeWithNormal = std::fabs(n.dot(vect.GetColumn(i)));
+			if (agreeWithNormal > bestNormal)
+			{
+				bestNormal = agreeWithNormal;
+				bestNormalIndex = i;
+			}
+		}
+		int maxI = (bestNormalIndex + 2) % 3;
+		int minI = (bestNormalIndex + 1) % 3;
+		if (std::fabs(lambda[maxI]) < std::fabs(lambda[minI])) std::swap(maxI, minI);
+
+		cv.PD1().Import(vect.GetColumn(maxI));
+		cv.PD2().Import(vect.GetColumn(minI));
+		cv.K1() = lambda[maxI];
+		cv.K2() = lambda[minI];
+	}
+
+	// Gaussian elimination with partial pivoting of the augmented 5x6 system.
+	static bool Solve5(double A[5][6], double x[5])
+	{
+		for (int col = 0; col < 5; ++col)
+		{
+			int piv = col;
+			for (int r = col + 1; r < 5; ++r)
+				if (std::abs(A[r][col]) > std::abs(A[piv][col])) piv = r;
+			if (std::abs(A[piv][col]) < 1e-300) return false;
+			if (piv != col)
+				for (int c = 0; c < 6; ++c) std::swap(A[piv][c], A[col][c]);
+			for (int r = col + 1; r < 5; ++r)
+			{
+				const double f = A[r][col] / A[col][col];
+				for (int c = col; c < 6; ++c) A[r][c] -= f * A[col][c];
+			}
+		}
+		for (int r = 4; r >= 0; --r)
+		{
+			double s = A[r][5];
+			for (int c = r + 1; c < 5; ++c) s -= A[r][c] * x[c];
+			x[r] = s / A[r][r];
+		}
+		return true;
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
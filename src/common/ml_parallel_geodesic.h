@@ -0,0 +1,405 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_GEODESIC_H
+#define __ML_PARALLEL_GEODESIC_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/geodesic.h>
+#include "ml_parallel_topology.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Geodesic distance from a set of seed vertices, same front propagation
+  and same distance estimation of tri::Geodesic<>, but:
+   - the mesh connectivity is flattened once in a CSR table of wedges (for
+     each vertex the pairs of opposite vertices of its incident faces), so
+     no VF topology is needed and it can be reused among many calls;
+   - the front is a bucketed priority queue: only the current bucket, a few
+     edge lengths wide, is kept as a heap, farther vertices are just
+     appended to their bucket;
+   - seeds lying in different connected components do not interact, so each
+     group of seeds is propagated independently, in parallel;
+   - per vertex data are plain arrays, no temporary attribute is allocated,
+     and the propagation stops as soon as the front passes the distance
+     threshold.
+  Everything is deterministic: the result does not depend on the number of
+  threads. The distance functor must be thread safe (all the vcg ones are).
+*/
+template <class MeshType>
+class ParallelGeodesic
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::VertexPointer  VertexPointer;
+	typedef typename MeshType::FaceType       FaceType;
+	typedef typename MeshType::template PerVertexAttributeHandle<VertexPointer> PerVertexPointerHandle;
+	typedef typename MeshType::template PerFaceAttributeHandle<VertexPointer>   PerFacePointerHandle;
+
+	class Wedge
+	{
+	public:
+		int v1, v2;   ///< the two other vertices of the face, in the face order
+	};
+
+	/// The connectivity used by the propagation. It depends only on the topology of the mesh.
+	class Graph
+	{
+	public:
+		std::vector<int> offset;     ///< wedges of vertex i are wedge[offset[i]] ... wedge[offset[i+1]-1]
+		std::vector<Wedge> wedge;
+		std::vector<int> component;  ///< for each vertex the lowest vertex index of its connected component
+	};
+
+	/// Build the wedge table and the connected components of the vertices.
+	static void BuildGraph(MeshType &m, Graph &g)
+	{
+		const int vertNum = int(m.vert.size());
+		std::vector<int> vfFace;
+		ParallelTopology<MeshType>::VertexFaceCSR(m, g.offset, vfFace);
+
+		// one wedge for each corner, in face order
+		g.wedge.resize(vfFace.size());
+#pragma omp parallel for schedule(dynamic, 4096)
+		for (int vi = 0; vi < vertNum; ++vi)
+		{
+			const VertexType *vp = &m.vert[vi];
+			int out = g.offset[vi];
+			for (int k = g.offset[vi]; k < g.offset[vi + 1]; ++k)
+			{
+				if (k > g.offset[vi] && vfFace[k] == vfFace[k - 1]) continue;
+				const FaceType &f = m.face[vfFace[k]];
+				for (int z = 0; z < 3; ++z)
+					if (f.cV(z) == vp)
+					{
+						g.wedge[out].v1 = int(tri::Index(m, f.cV1(z)));
+						g.wedge[out].v2 = int(tri::Index(m, f.cV2(z)));
+						++out;
+					}
+			}
+		}
+
+		MLParallelUnionFind uf(vertNum);
+#pragma omp parallel for schedule(dynamic, 4096)
+		for (int vi = 0; vi < vertNum; ++vi)
+			for (int k = g.offset[vi]; k < g.offset[vi + 1]; ++k)
+				uf.Union(vi, g.wedge[k].v1);
+
+		g.component.resize(vertNum);
+#pragma omp parallel for schedule(static)
+		for (int vi = 0; vi < vertNum; ++vi)
+			g.component[vi] = uf.Find(vi);
+	}
+
+	/** Same as Geodesic<>::Compute: store in the vertex quality the geodesic
+	 * distance from the closest seed (max float for unreached vertices).
+	 * If sourceHandle/parentHandle are given, they receive for each reached
+	 * vertex its closest seed and its parent in the path toward it (NULL for
+	 * unreached vertices).
+	 * Returns false if there are no seeds.
+	 */
+	template <class DistanceFunctor>
+	static bool Compute(MeshType &m, const std::vector<VertexPointer> &seedVec, DistanceFunctor &distFunc,
+		ScalarType maxDistanceThr = std::numeric_limits<ScalarType>::max(),
+		PerVertexPointerHandle *sourceHandle = NULL, PerVertexPointerHandle *parentHandle = NULL)
+	{
+		Graph g;
+		BuildGraph(m, g);
+		return Compute(m, g, seedVec, distFunc, maxDistanceThr, sourceHandle, parentHandle);
+	}
+
+	/// As above, reusing an already built graph.
+	template <class DistanceFunctor>
+	static bool Compute(MeshType &m, const Graph &g, const std::vector<VertexPointer> &seedVec, DistanceFunctor &distFunc,
+		ScalarType maxDistanceThr = std::numeric_limits<ScalarType>::max(),
+		PerVertexPointerHandle *sourceHandle = NULL, PerVertexPointerHandle *parentHandle = NULL)
+	{
+		tri::RequirePerVertexQuality(m);
+		if (seedVec.empty()) return false;
+		const int vertNum = int(m.vert.size());
+
+		std::vector<ScalarType> dist(vertNum, std::numeric_limits<ScalarType>::max());
+		std::vector<int> source(vertNum, -1);
+		std::vector<int> parent(vertNum, -1);
+
+		// group the seeds by connected component: each group is an independent front
+		std::vector< std::pair<int, int> > seedComp;   // (component, seed)
+		for (size_t i = 0; i < seedVec.size(); ++i)
+		{
+			const int si = int(tri::Index(m, seedVec[i]));
+			seedComp.push_back(std::make_pair(g.component[si], si));
+		}
+		std::sort(seedComp.begin(), seedComp.end());
+		seedComp.erase(std::unique(seedComp.begin(), seedComp.end()), seedComp.end());
+		std::vector<int> groupStart;
+		for (size_t i = 0; i < seedComp.size(); ++i)
+			if (i == 0 || seedComp[i].first != seedComp[i - 1].first)
+				groupStart.push_back(int(i));
+		const int groupNum = int(groupStart.size());
+		groupStart.push_back(int(seedComp.size()));
+
+		const ScalarType bucketWidth = AverageEdge(m, g) * 2;
+#pragma omp parallel for schedule(dynamic, 1) if(groupNum > 1)
+		for (int gi = 0; gi < groupNum; ++gi)
+		{
+			std::vector<int> seeds;
+			for (int i = groupStart[gi]; i < groupStart[gi + 1]; ++i)
+				seeds.push_back(seedComp[i].second);
+			Visit(m, g, seeds, distFunc, maxDistanceThr, bucketWidth, dist, source, parent);
+		}
+
+#pragma omp parallel for schedule(static)
+		for (int vi = 0; vi < vertNum; ++vi)
+		{
+			VertexType &v = m.vert[vi];
+			if (v.IsD()) continue;
+			v.Q() = dist[vi];
+			if (sourceHandle) (*sourceHandle)[vi] = (source[vi] >= 0) ? &m.vert[source[vi]] : NULL;
+			if (parentHandle) (*parentHandle)[vi] = (parent[vi] >= 0) ? &m.vert[parent[vi]] : NULL;
+		}
+		return true;
+	}
+
+	/** Same as Geodesic<>::DistanceFromBorder: the seeds are the vertices with the border flag.
+	 * Returns false if the mesh has no border.
+	 */
+	static bool DistanceFromBorder(MeshType &m, PerVertexPointerHandle *sources = NULL)
+	{
+		std::vector<VertexPointer> fro;
+		for (size_t i = 0; i < m.vert.size(); ++i)
+			if (!m.vert[i].IsD() && m.vert[i].IsB())
+				fro.push_back(&m.vert[i]);
+		if (fro.empty()) return false;
+		EuclideanDistance<MeshType> dd;
+		return Compute(m, fro, dd, std::numeric_limits<ScalarType>::max(), sources);
+	}
+
+	/// Same as VoronoiProcessing<>::ComputePerVertexSources: fills the "sources" per vertex attribute.
+	template <class DistanceFunctor>
+	static void ComputePerVertexSources(MeshType &m, const std::vector<VertexPointer> &seedVec, DistanceFunctor &df)
+	{
+		tri::Allocator<MeshType>::DeletePerVertexAttribute(m, "sources");
+		PerVertexPointerHandle vertexSources = tri::Allocator<MeshType>::template AddPerVertexAttribute<VertexPointer>(m, "sources");
+		tri::Allocator<MeshType>::DeletePerFaceAttribute(m, "sources");
+		tri::Allocator<MeshType>::template AddPerFaceAttribute<VertexPointer>(m, "sources");
+		Compute(m, seedVec, df, std::numeric_limits<ScalarType>::max(), &vertexSources);
+	}
+
+private:
+	class VertDist
+	{
+	public:
+		VertDist() {}
+		VertDist(int _v, ScalarType _d) : v(_v), d(_d) {}
+		int v;
+		ScalarType d;
+		// reversed, so that std heaps pop the closest one; ties broken by index
+		bool operator < (const VertDist &o) const { return (d != o.d) ? (d > o.d) : (v > o.v); }
+	};
+
+	/*
+	  Monotone priority queue made of buckets of fixed width. Only the bucket
+	  being consumed is kept as a heap; since the front never moves backward
+	  (a key smaller than the current bucket goes in the current bucket) the
+	  pops are exactly in increasing distance order.
+	*/
+	class BucketQueue
+	{
+	public:
+		BucketQueue(ScalarType width) : invWidth(ScalarType(1) / width), cur(0) { bucket.resize(1); }
+
+		void Push(int v, ScalarType d)
+		{
+			size_t b = Bucket(d);
+			if (b <= cur)
+			{
+				bucket[cur].push_back(VertDist(v, d));
+				std::push_heap(bucket[cur].begin(), bucket[cur].end());
+			}
+			else
+			{
+				if (b >= bucket.size()) bucket.resize(b + 1);
+				bucket[b].push_back(VertDist(v, d));
+			}
+		}
+
+		bool Pop(int &v, ScalarType &d)
+		{
+			while (bucket[cur].empty())
+			{
+				std::vector<VertDist>().swap(bucket[cur]);
+				if (++cur == bucket.size()) return false;
+				std::make_heap(bucket[cur].begin(), bucket[cur].end());
+			}
+			std::pop_heap(bucket[cur].begin(), bucket[cur].end());
+			v = bucket[cur].back().v;
+			d = bucket[cur].back().d;
+			bucket[cur].pop_back();
+			return true;
+		}
+
+	private:
+		static const size_t MaxBucket = 1 << 20;
+
+		size_t Bucket(ScalarType d) const
+		{
+			const double b = double(d) * double(invWidth);
+			return (b < double(MaxBucket)) ? size_t(b) : MaxBucket;
+		}
+
+		ScalarType invWidth;
+		size_t cur;
+		std::vector< std::vector<VertDist> > bucket;
+	};
+
+	static ScalarType AverageEdge(MeshType &m, const Graph &g)
+	{
+		const int vertNum = int(m.vert.size());
+		double sum = 0;
+#pragma omp parallel for schedule(static) reduction(+: sum)
+		for (int vi = 0; vi < vertNum; ++vi)
+			for (int k = g.offset[vi]; k < g.offset[vi + 1]; ++k)
+				sum += Distance(m.vert[vi].cP(), m.vert[g.wedge[k].v1].cP());
+		const double wedgeNum = double(g.wedge.size());
+		if (wedgeNum == 0 || sum == 0) return ScalarType(1);
+		return ScalarType(sum / wedgeNum);
+	}
+
+	// The front propagation of Geodesic<>::Visit, for a group of seeds.
+	template <class DistanceFunctor>
+	static void Visit(MeshType &m, const Graph &g, const std::vector<int> &seeds, DistanceFunctor &distFunc,
+		ScalarType distance_threshold, ScalarType bucketWidth,
+		std::vector<ScalarType> &dist, std::vector<int> &source, std::vector<int> &parent)
+	{
+		BucketQueue frontier(bucketWidth);
+		for (size_t i = 0; i < seeds.size(); ++i)
+		{
+			dist[seeds[i]] = 0;
+			source[seeds[i]] = seeds[i];
+			parent[seeds[i]] = seeds[i];
+			frontier.Push(seeds[i], 0);
+		}
+
+		ScalarType max_distance = 0;
+		int curr;
+		ScalarType d_heap;
+		while (max_distance < distance_threshold && frontier.Pop(curr, d_heap))
+		{
+			if (dist[curr] < d_heap) // a vertex whose distance has been improved after it was inserted in the queue
+				continue;
+			const ScalarType d_curr = dist[curr];
+			const VertexType *vcurr = &m.vert[curr];
+
+			for (int w = g.offset[curr]; w < g.offset[curr + 1]; ++w)
+			{
+				for (int k = 0; k < 2; ++k)
+				{
+					const int pw = (k == 0) ? g.wedge[w].v1 : g.wedge[w].v2;
+					const int pw1 = (k == 0) ? g.wedge[w].v2 : g.wedge[w].v1;
+					const VertexType *vpw = &m.vert[pw];
+					const VertexType *vpw1 = &m.vert[pw1];
+
+					ScalarType curr_d;
+					const ScalarType d_pw1 = dist[pw1];
+					const ScalarType inter = distFunc(vcurr, vpw1);
+					const ScalarType tol = (inter + d_curr + d_pw1) * .0001f;
+					if ((source[pw1] != source[curr]) ||   // not the same source
+						(inter + d_curr < d_pw1 + tol) ||
+						(inter + d_pw1 < d_curr + tol) ||
+						(d_curr + d_pw1 < inter + tol))    // triangular inequality
+						curr_d = d_curr + distFunc(vpw, vcurr);
+					else
+						curr_d = Unfold(distFunc, vpw, vpw1, vcurr, d_pw1, d_curr);
+
+					if (dist[pw] > curr_d)
+					{
+						dist[pw] = curr_d;
+						source[pw] = source[curr];
+						parent[pw] = curr;
+						frontier.Push(pw, curr_d);
+					}
+					if (d_curr > max_distance)
+						max_distance = d_curr;
+				}
+			}
+		}
+	}
+
+	// Same distance estimation of Geodesic<>::Distance: the distance of pw is
+	// computed unfolding the triangle (pw, pw1, curr) on the plane.
+	template <class DistanceFunctor>
+	static ScalarType Unfold(DistanceFunctor &distFunc, const VertexType *pw, const VertexType *pw1, const VertexType *curr,
+		const ScalarType &d_pw1, const ScalarType &d_curr)
+	{
+		ScalarType curr_d = 0;
+
+		ScalarType ew_c = distFunc(pw, curr);
+		ScalarType ew_w1 = distFunc(pw, pw1);
+		ScalarType ec_w1 = distFunc(pw1, curr);
+		CoordType w_c = (pw->cP() - curr->cP()).Normalize() * ew_c;
+		CoordType w_w1 = (pw->cP() - pw1->cP()).Normalize() * ew_w1;
+		CoordType w1_c = (pw1->cP() - curr->cP()).Normalize() * ec_w1;
+
+		ScalarType alpha, alpha_, beta, beta_, theta, h, delta, s, a, b;
+
+		alpha = acos((w_c.dot(w1_c)) / (w_c.Norm() * w1_c.Norm()));
+		s = (d_curr + d_pw1 + ec_w1) / 2;
+		a = s / ec_w1;
+		b = a * s;
+		alpha_ = 2 * acos(std::min<ScalarType>(1.0, sqrt((b - a * d_pw1) / d_curr)));
+
+		if (alpha + alpha_ > M_PI)
+		{
+			curr_d = d_curr + ew_c;
+		}
+		else
+		{
+			beta_ = 2 * acos(std::min<ScalarType>(1.0, sqrt((b - a * d_curr) / d_pw1)));
+			beta = acos((w_w1).dot(-w1_c) / (w_w1.Norm() * w1_c.Norm()));
+
+			if (beta + beta_ > M_PI)
+				curr_d = d_pw1 + ew_w1;
+			else
+			{
+				theta = ScalarType(M_PI) - alpha - alpha_;
+				delta = cos(theta) * ew_c;
+				h = sin(theta) * ew_c;
+				curr_d = sqrt(pow(h, 2) + pow(d_curr + delta, 2));
+			}
+		}
+		return curr_d;
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
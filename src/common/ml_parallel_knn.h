@@ -0,0 +1,255 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_KNN_H
+#define __ML_PARALLEL_KNN_H
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <vcg/space/index/kdtree/kdtree.h>
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  k-nearest neighbour graph of the vertices of a mesh (usually a point cloud),
+  stored as flat CSR arrays. The neighbours of the i-th vertex are
+      nbr[offset[i]] ... nbr[offset[i+1]-1]
+  with their squared distances in dist2, sorted by increasing distance (ties
+  broken by index); the vertex itself is never among them. Deleted vertices
+  have no neighbours and are never neighbours of anything.
+
+  The graph is built with parallel queries on a single read-only kd-tree and
+  it is the same regardless of the number of threads. A graph built for k
+  neighbours can serve any smaller k, taking the first Size(i,k) entries of
+  each row.
+*/
+template <class MeshType>
+class ParallelKNNGraph
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+
+	int k;
+	std::vector<int> offset;
+	std::vector<int> nbr;
+	std::vector<ScalarType> dist2;
+
+	ParallelKNNGraph() : k(0), vertNum(0), vn(0), vertData(NULL) {}
+
+	void Clear()
+	{
+		k = 0;
+		std::vector<int>().swap(offset);
+		std::vector<int>().swap(nbr);
+		std::vector<ScalarType>().swap(dist2);
+		vertNum = vn = 0;
+		vertData = NULL;
+		bbox.SetNull();
+	}
+
+	int Size(int i, int kk) const { return std::min(kk, offset[i + 1] - offset[i]); }
+	int Begin(int i) const { return offset[i]; }
+
+	/** True if the graph has at least kk neighbours per vertex and it was
+	 * built on m as it is now. This is only a cheap sanity check (vertex
+	 * count, storage and bounding box): whoever moves the vertices has to drop
+	 * the graph anyway, see MeshModel::UpdateBoxAndNormals.
+	 */
+	bool IsValidFor(const MeshType &m, int kk) const
+	{
+		return k > 0 && kk <= k && vertNum == int(m.vert.size()) && vn == m.vn &&
+			vertData == (m.vert.empty() ? NULL : &m.vert[0]) && bbox == m.bbox;
+	}
+
+	void Build(const MeshType &m, int numOfNeighbours)
+	{
+		Clear();
+		k = numOfNeighbours;
+		vertNum = int(m.vert.size());
+		vn = m.vn;
+		vertData = m.vert.empty() ? NULL : &m.vert[0];
+		bbox = m.bbox;
+
+		// the kd-tree is built only on the live vertices; treeToVert maps back
+		std::vector<int> treeToVert;
+		treeToVert.reserve(m.vn);
+		for (int i = 0; i < vertNum; ++i)
+			if (!m.vert[i].IsD())
+				treeToVert.push_back(i);
+		const int pointNum = int(treeToVert.size());
+
+		offset.assign(vertNum + 1, 0);
+		if (pointNum < 2 || k <= 0) return;
+		std::vector<CoordType> points(pointNum);
+#pragma omp parallel for schedule(static)
+		for (int j = 0; j < pointNum; ++j)
+			points[j] = m.vert[treeToVert[j]].cP();
+		ConstDataWrapper<CoordType> dw(&points[0], pointNum);
+		KdTree<ScalarType> tree(dw);
+
+		// every live vertex gets min(k, pointNum-1) neighbours
+		const int rowSize = std::min(k, pointNum - 1);
+		for (int i = 0; i < vertNum; ++i)
+			offset[i + 1] = offset[i] + (m.vert[i].IsD() ? 0 : rowSize);
+		nbr.resize(offset[vertNum]);
+		dist2.resize(offset[vertNum]);
+
+#pragma omp parallel
+		{
+			typename KdTree<ScalarType>::PriorityQueue pq;
+			std::vector< std::pair<ScalarType, int> > row;
+#pragma omp for schedule(dynamic, 1024)
+			for (int j = 0; j < pointNum; ++j)
+			{
+				const int vi = treeToVert[j];
+				// one more, since the query point finds itself
+				tree.doQueryK(points[j], rowSize + 1, pq);
+				row.clear();
+				for (int q = 0; q < pq.getNofElements(); ++q)
+					if (pq.getIndex(q) != j)
+						row.push_back(std::make_pair(pq.getWeight(q), treeToVert[pq.getIndex(q)]));
+				std::sort(row.begin(), row.end());
+				// with coincident points the query point may be left out of the
+				// heap, then there is one extra entry
+				for (int q = 0; q < rowSize; ++q)
+				{
+					nbr[offset[vi] + q] = row[q].second;
+					dist2[offset[vi] + q] = row[q].first;
+				}
+			}
+		}
+	}
+
+private:
+	// what the graph was built on, for IsValidFor()
+	int vertNum;
+	int vn;
+	const VertexType *vertData;
+	Box3<ScalarType> bbox;
+};
+
+/*
+  Local Outlier Probabilities (Kriegel et al. 2009) computed on a k-nn graph,
+  as OutlierRemoval<>::SelectLoOPOutliers does with its own kd-tree. The
+  neighbourhood of a point is the point itself and its k-1 nearest neighbours.
+*/
+template <class MeshType>
+class ParallelOutlierRemoval
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+
+	/// For each vertex its outlier probability in [0,1]; 0 for deleted vertices.
+	static void ComputeLoOPScore(const MeshType &m, const ParallelKNNGraph<MeshType> &g, int kNearest, std::vector<ScalarType> &score)
+	{
+		const int vertNum = int(m.vert.size());
+		const int kk = std::max(kNearest - 1, 0);
+		std::vector<ScalarType> sigma(vertNum, 0);
+		std::vector<ScalarType> plof(vertNum, 0);
+		score.assign(vertNum, 0);
+
+		// probabilistic set distance
+#pragma omp parallel for schedule(dynamic, 4096)
+		for (int i = 0; i < vertNum; ++i)
+		{
+			if (m.vert[i].IsD()) continue;
+			ScalarType sum = 0;
+			const int n = g.Size(i, kk);
+			for (int q = g.Begin(i); q < g.Begin(i) + n; ++q)
+				sum += g.dist2[q];
+			sigma[i] = std::sqrt(sum / (n + 1));
+		}
+
+		// probabilistic local outlier factor, in chunks for a deterministic normalization
+		const int chunkNum = (vertNum < MLParallel::MinParallelSize) ? 1 : MLParallel::ThreadNum();
+		const std::vector<int> bnd = MLParallel::Chunks(vertNum, chunkNum);
+		std::vector<double> partial(chunkNum, 0);
+		std::vector<int> partialCnt(chunkNum, 0);
+#pragma omp parallel for schedule(static, 1)
+		for (int c = 0; c < chunkNum; ++c)
+		{
+			for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+			{
+				if (m.vert[i].IsD()) continue;
+				ScalarType sum = sigma[i];
+				const int n = g.Size(i, kk);
+				for (int q = g.Begin(i); q < g.Begin(i) + n; ++q)
+					sum += sigma[g.nbr[q]];
+				sum /= (n + 1);
+				plof[i] = (sum > 0) ? sigma[i] / sum - ScalarType(1) : ScalarType(0);
+				partial[c] += double(plof[i]) * plof[i];
+				++partialCnt[c];
+			}
+		}
+		double nplof = 0;
+		int liveNum = 0;
+		for (int c = 0; c < chunkNum; ++c)
+		{
+			nplof += partial[c];
+			liveNum += partialCnt[c];
+		}
+		if (liveNum == 0 || nplof == 0) return;
+		nplof = std::sqrt(nplof / liveNum);
+
+		// same truncated erf approximation as OutlierRemoval<>::ComputeLoOPScore,
+		// so that the scores (and the thresholds users pick on them) do not change
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+		{
+			if (m.vert[i].IsD()) continue;
+			const ScalarType value = plof[i] / (ScalarType(nplof) * std::sqrt(ScalarType(2)));
+			ScalarType dem = ScalarType(1.0 + 0.278393 * value);
+			dem += ScalarType(0.230389 * value * value);
+			dem += ScalarType(0.000972 * value * value * value);
+			dem += ScalarType(0.078108 * value * value * value * value);
+			score[i] = std::max(ScalarType(0), ScalarType(1.0 - 1.0 / dem));
+		}
+	}
+
+	/// Select the vertices whose outlier probability is above threshold; returns their number.
+	static int SelectLoOPOutliers(MeshType &m, const ParallelKNNGraph<MeshType> &g, int kNearest, float threshold)
+	{
+		std::vector<ScalarType> score;
+		ComputeLoOPScore(m, g, kNearest, score);
+		int count = 0;
+		for (size_t i = 0; i < m.vert.size(); ++i)
+			if (!m.vert[i].IsD() && score[i] > threshold)
+			{
+				m.vert[i].SetS();
+				++count;
+			}
+		return count;
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,383 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_NORMALS_H
+#define __ML_PARALLEL_NORMALS_H
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <wrap/callback.h>
+#include "ml_parallel_knn.h"
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Multithreaded replacement of PointCloudNormal<> and of
+  Smooth<>::VertexNormalPointCloud, working on a ParallelKNNGraph.
+
+  As in the vcg versions the neighbourhood of a point is the point itself and
+  its k-1 nearest neighbours. The plane fitting is done independently on each
+  point with a closed form 3x3 symmetric eigen solver (no iterations, no
+  branches in the common case). The orientation is propagated along the
+  minimum spanning tree of the Riemannian graph (arcs between coherentAdjNum
+  nearest neighbours, cost 1-|ni.nj|), that is built and sorted in parallel.
+*/
+template <class MeshType>
+class ParallelPointCloudNormal
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+
+	class Param
+	{
+	public:
+		Param() : fittingAdjNum(10), smoothingIterNum(0), coherentAdjNum(8), useViewPoint(false), viewPoint(0, 0, 0) {}
+
+		int fittingAdjNum;     /// number of points used to fit the plane
+		int smoothingIterNum;  /// number of normal smoothing iterations
+		int coherentAdjNum;    /// number of neighbours of the Riemannian graph used to propagate the orientation
+		bool useViewPoint;     /// orient the normals toward viewPoint instead of propagating the orientation
+		CoordType viewPoint;
+	};
+
+	/// Number of neighbours the knn graph must have for Compute() with these parameters.
+	static int RequiredNeighbours(const Param &p)
+	{
+		return std::max(p.fittingAdjNum - 1, p.useViewPoint ? 0 : p.coherentAdjNum);
+	}
+
+	/// Same as PointCloudNormal<>::Compute; g must have RequiredNeighbours(p) neighbours.
+	static void Compute(MeshType &m, const ParallelKNNGraph<MeshType> &g, const Param &p, vcg::CallBackPos *cb = 0)
+	{
+		tri::RequirePerVertexNormal(m);
+		if (cb) cb(1, "Fitting planes...");
+		FitNormals(m, g, p.fittingAdjNum, cb);
+		if (p.smoothingIterNum > 0)
+		{
+			if (cb) cb(50, "Smoothing normals...");
+			Smooth(m, g, p.fittingAdjNum, p.smoothingIterNum);
+		}
+		if (cb) cb(75, "Orienting normals...");
+		if (p.useViewPoint)
+			OrientTowardViewPoint(m, p.viewPoint);
+		else if (p.coherentAdjNum > 0)
+			OrientByPropagation(m, g, p.coherentAdjNum);
+	}
+
+	/// Unoriented normal of the least squares plane through each point and its k-1 nearest neighbours.
+	static void FitNormals(MeshType &m, const ParallelKNNGraph<MeshType> &g, int k, vcg::CallBackPos *cb = 0)
+	{
+		const int vertNum = int(m.vert.size());
+#pragma omp parallel for schedule(dynamic, 4096)
+		for (int i = 0; i < vertNum; ++i)
+		{
+			VertexType &v = m.vert[i];
+			if (v.IsD()) continue;
+			if (cb && (i % 1024) == 0 && MLParallel::ThreadId() == 0)
+				cb(1 + int(48.0 * i / vertNum), "Fitting planes...");
+			const int n = g.Size(i, k - 1);
+			const int b = g.Begin(i);
+
+			// covariance around the centroid, relative to the point for precision
+			const CoordType &o = v.cP();
+			double c[3] = { 0, 0, 0 };
+			for (int q = b; q < b + n; ++q)
+			{
+				const CoordType &pq = m.vert[g.nbr[q]].cP();
+				for (int d = 0; d < 3; ++d) c[d] += double(pq[d]) - double(o[d]);
+			}
+			for (int d = 0; d < 3; ++d) c[d] /= (n + 1);
+			double a[6] = { 0, 0, 0, 0, 0, 0 };   // xx yy zz xy xz yz
+			AddCov(a, -c[0], -c[1], -c[2]);
+			for (int q = b; q < b + n; ++q)
+			{
+				const CoordType &pq = m.vert[g.nbr[q]].cP();
+				AddCov(a, double(pq[0]) - o[0] - c[0], double(pq[1]) - o[1] - c[1], double(pq[2]) - o[2] - c[2]);
+			}
+			double nrm[3];
+			SmallestEigenVector(a, nrm);
+			v.N() = CoordType(ScalarType(nrm[0]), ScalarType(nrm[1]), ScalarType(nrm[2]));
+		}
+	}
+
+	/// Same as Smooth<>::VertexNormalPointCloud: each normal becomes the sign-coherent sum of its k-1 neighbours and itself.
+	static void Smooth(MeshType &m, const ParallelKNNGraph<MeshType> &g, int k, int iterNum)
+	{
+		const int vertNum = int(m.vert.size());
+		std::vector<CoordType> acc(vertNum);
+		for (int it = 0; it < iterNum; ++it)
+		{
+#pragma omp parallel for schedule(dynamic, 4096)
+			for (int i = 0; i < vertNum; ++i)
+			{
+				const VertexType &v = m.vert[i];
+				if (v.IsD()) continue;
+				CoordType sum = v.cN();
+				const int n = g.Size(i, k - 1);
+				for (int q = g.Begin(i); q < g.Begin(i) + n; ++q)
+				{
+					const CoordType &nq = m.vert[g.nbr[q]].cN();
+					if (nq * v.cN() > 0) sum += nq;
+					else sum -= nq;
+				}
+				acc[i] = sum;
+			}
+#pragma omp parallel for schedule(static)
+			for (int i = 0; i < vertNum; ++i)
+				if (!m.vert[i].IsD())
+					m.vert[i].N() = acc[i].Normalize();
+		}
+	}
+
+	/// Flip the normals that do not face viewPoint (e.g. the scanner position stored in the mesh shot).
+	static void OrientTowardViewPoint(MeshType &m, const CoordType &viewPoint)
+	{
+		const int vertNum = int(m.vert.size());
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+		{
+			VertexType &v = m.vert[i];
+			if (!v.IsD() && v.cN() * (viewPoint - v.cP()) < 0)
+				v.N() = -v.N();
+		}
+	}
+
+	/** Make the normals consistent walking the minimum spanning tree of the
+	 * Riemannian graph, as PointCloudNormal<> does. The tree is found with
+	 * Kruskal on the arcs sorted in parallel (ties broken by index, so it does
+	 * not depend on the number of threads). In each connected component the
+	 * walk starts from the highest point, whose normal is turned upward
+	 * (Hoppe et al. 1992).
+	 */
+	static void OrientByPropagation(MeshType &m, const ParallelKNNGraph<MeshType> &g, int coherentAdjNum)
+	{
+		const int vertNum = int(m.vert.size());
+
+		// arcs i-j, each one once (i<j), with their cost
+		std::vector<int> arcCnt(vertNum + 1, 0);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+		{
+			if (m.vert[i].IsD()) continue;
+			const int n = g.Size(i, coherentAdjNum);
+			for (int q = g.Begin(i); q < g.Begin(i) + n; ++q)
+				if (IsArcOwner(g, coherentAdjNum, i, g.nbr[q]))
+					++arcCnt[i];
+		}
+		const int arcNum = MLParallel::ExclusiveScan(arcCnt);
+		std::vector<Arc> arcs(arcNum);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+		{
+			if (m.vert[i].IsD()) continue;
+			int cur = arcCnt[i];
+			const int n = g.Size(i, coherentAdjNum);
+			for (int q = g.Begin(i); q < g.Begin(i) + n; ++q)
+			{
+				const int j = g.nbr[q];
+				if (!IsArcOwner(g, coherentAdjNum, i, j)) continue;
+				const ScalarType c = ScalarType(1) - std::fabs(m.vert[i].cN() * m.vert[j].cN());
+				arcs[cur++] = Arc(std::min(i, j), std::max(i, j), c);
+			}
+		}
+		MLParallel::Sort(arcs.begin(), arcs.end(), std::less<Arc>());
+
+		// Kruskal
+		std::vector<int> treeCnt(vertNum + 1, 0);
+		std::vector<char> inTree(arcNum, 0);
+		MLParallelUnionFind uf(vertNum);
+		for (int a = 0; a < arcNum; ++a)
+		{
+			const int ri = uf.Find(arcs[a].i), rj = uf.Find(arcs[a].j);
+			if (ri == rj) continue;
+			uf.Union(ri, rj);
+			inTree[a] = 1;
+			++treeCnt[arcs[a].i];
+			++treeCnt[arcs[a].j];
+		}
+		MLParallel::ExclusiveScan(treeCnt);
+		std::vector<int> treeAdj(treeCnt[vertNum]);
+		{
+			std::vector<int> cursor(treeCnt.begin(), treeCnt.end() - 1);
+			for (int a = 0; a < arcNum; ++a)
+				if (inTree[a])
+				{
+					treeAdj[cursor[arcs[a].i]++] = arcs[a].j;
+					treeAdj[cursor[arcs[a].j]++] = arcs[a].i;
+				}
+		}
+		std::vector<Arc>().swap(arcs);
+
+		// the root of each component is its highest point
+		std::vector<int> root(vertNum, -1);
+		for (int i = 0; i < vertNum; ++i)
+		{
+			if (m.vert[i].IsD()) continue;
+			int &r = root[uf.Find(i)];
+			if (r < 0 || m.vert[i].cP()[2] > m.vert[r].cP()[2]) r = i;
+		}
+
+		// walk the trees, flipping each normal to agree with its parent
+		std::vector<char> visited(vertNum, 0);
+		std::vector<int> stack;
+		for (int c = 0; c < vertNum; ++c)
+		{
+			const int r = root[c];
+			if (r < 0) continue;
+			if (m.vert[r].cN()[2] < 0) m.vert[r].N() = -m.vert[r].N();
+			visited[r] = 1;
+			stack.push_back(r);
+			while (!stack.empty())
+			{
+				const int i = stack.back();
+				stack.pop_back();
+				for (int q = treeCnt[i]; q < treeCnt[i + 1]; ++q)
+				{
+					const int j = treeAdj[q];
+					if (visited[j]) continue;
+					visited[j] = 1;
+					if (m.vert[j].cN() * m.vert[i].cN() < 0) m.vert[j].N() = -m.vert[j].N();
+					stack.push_back(j);
+				}
+			}
+		}
+	}
+
+	/** Unit eigenvector of the smallest eigenvalue of the symmetric matrix
+	 * a = (xx yy zz xy xz yz), with the trigonometric closed form of the
+	 * eigenvalues and the cross products of the rows of a - l*I.
+	 */
+	static void SmallestEigenVector(const double a[6], double v[3])
+	{
+		// scale to avoid under/overflow in the cubic
+		double s = 0;
+		for (int k = 0; k < 6; ++k) s = std::max(s, std::fabs(a[k]));
+		if (s == 0) { v[0] = 0; v[1] = 0; v[2] = 1; return; }
+		const double xx = a[0] / s, yy = a[1] / s, zz = a[2] / s;
+		const double xy = a[3] / s, xz = a[4] / s, yz = a[5] / s;
+
+		const double p1 = xy * xy + xz * xz + yz * yz;
+		const double q = (xx + yy + zz) / 3;
+		const double p2 = (xx - q) * (xx - q) + (yy - q) * (yy - q) + (zz - q) * (zz - q) + 2 * p1;
+		const double p = std::sqrt(p2 / 6);
+		double l;
+		if (p == 0)
+			l = q;   // multiple of the identity
+		else
+		{
+			const double bxx = (xx - q) / p, byy = (yy - q) / p, bzz = (zz - q) / p;
+			const double bxy = xy / p, bxz = xz / p, byz = yz / p;
+			double r = (bxx * (byy * bzz - byz * byz) - bxy * (bxy * bzz - byz * bxz) + bxz * (bxy * byz - byy * bxz)) / 2;
+			r = std::min(1.0, std::max(-1.0, r));
+			l = q + 2 * p * std::cos(std::acos(r) / 3 + 2.0943951023931957);   // + 2pi/3
+		}
+
+		// rows of a - l*I; the eigenvector is orthogonal to all of them
+		const double r0[3] = { xx - l, xy, xz };
+		const double r1[3] = { xy, yy - l, yz };
+		const double r2[3] = { xz, yz, zz - l };
+		double c[3][3];
+		Cross(r0, r1, c[0]);
+		Cross(r0, r2, c[1]);
+		Cross(r1, r2, c[2]);
+		int best = 0;
+		double bestN = Norm2(c[0]);
+		for (int k = 1; k < 3; ++k)
+		{
+			const double n = Norm2(c[k]);
+			if (n > bestN) { bestN = n; best = k; }
+		}
+		if (bestN > 1e-20)
+		{
+			const double inv = 1.0 / std::sqrt(bestN);
+			for (int d = 0; d < 3; ++d) v[d] = c[best][d] * inv;
+			return;
+		}
+
+		// double smallest eigenvalue (points on a line): any vector orthogonal to the largest row
+		const double *rows[3] = { r0, r1, r2 };
+		int big = 0;
+		for (int k = 1; k < 3; ++k)
+			if (Norm2(rows[k]) > Norm2(rows[big])) big = k;
+		const double *w = rows[big];
+		if (Norm2(w) == 0) { v[0] = 0; v[1] = 0; v[2] = 1; return; }
+		const double axis[3] = { std::fabs(w[0]) < std::fabs(w[1]) ? 1.0 : 0.0, std::fabs(w[0]) < std::fabs(w[1]) ? 0.0 : 1.0, 0.0 };
+		Cross(w, axis, v);
+		const double inv = 1.0 / std::sqrt(Norm2(v));
+		for (int d = 0; d < 3; ++d) v[d] *= inv;
+	}
+
+private:
+	class Arc
+	{
+	public:
+		Arc() {}
+		Arc(int _i, int _j, ScalarType _c) : i(_i), j(_j), c(_c) {}
+		int i, j;
+		ScalarType c;
+		bool operator < (const Arc &o) const
+		{
+			if (c != o.c) return c < o.c;
+			if (i != o.i) return i < o.i;
+			return j < o.j;
+		}
+	};
+
+	// The arc i-j is emitted by i if j is a neighbour of i and, when i is also
+	// a neighbour of j, only if i<j; so each undirected arc is emitted once.
+	static bool IsArcOwner(const ParallelKNNGraph<MeshType> &g, int k, int i, int j)
+	{
+		if (i < j) return true;
+		const int n = g.Size(j, k);
+		for (int q = g.Begin(j); q < g.Begin(j) + n; ++q)
+			if (g.nbr[q] == i) return false;
+		return true;
+	}
+
+	static void AddCov(double a[6], double x, double y, double z)
+	{
+		a[0] += x * x; a[1] += y * y; a[2] += z * z;
+		a[3] += x * y; a[4] += x * z; a[5] += y * z;
+	}
+
+	static void Cross(const double a[3], const double b[3], double c[3])
+	{
+		c[0] = a[1] * b[2] - a[2] * b[1];
+		c[1] = a[2] * b[0] - a[0] * b[2];
+		c[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	static double Norm2(const double a[3]) { return a[0] * a[0] + a[1] * a[1] + a[2] * a[2]; }
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,383 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_POISSON_H
+#define __ML_PARALLEL_POISSON_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Poisson-disk pruning of a dense (e.g. Montecarlo) point set, the same
+  task of SurfaceSampling<>::PoissonDiskPruning, done by many threads.
+
+  The points are bucketed in a grid whose cells are as large as the
+  largest disk radius, so a sample can only conflict with the samples of
+  the 27 cells around its own. The cells are split in 27 phase groups by
+  the parity modulo 3 of their coordinates: two cells of the same group
+  have no common neighbour, so all the cells of a group are pruned at the
+  same time, each by a single thread, while the groups are processed one
+  after the other.
+
+  Inside a cell the points are visited in a random order given by a hash
+  of the seed and of their index. Neither that order nor the group
+  schedule depends on the threads, so for a given seed the result is
+  always the same.
+
+  With the adaptive radius each point has its own radius, linear in its
+  quality between radius and radius*radiusVariance, and a point is
+  discarded when it falls inside the disk of an already chosen sample.
+*/
+template <class MeshType>
+class ParallelPoissonDisk
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef unsigned long long                KeyType;
+
+	// 21 bits for each cell coordinate, so that a key fits in 63 bits
+	static const int MaxGridSide = 1 << 21;
+
+	class Param
+	{
+	public:
+		Param() : radiusVariance(1), adaptiveRadiusFlag(false), invertQuality(false),
+		          bestSampleChoiceFlag(true), bestSamplePoolSize(10), seed(0), preGenMesh(0),
+		          cellNum(0), gridSize(0, 0, 0) {}
+
+		ScalarType radiusVariance;
+		bool adaptiveRadiusFlag;
+		bool invertQuality;
+		/// among the next bestSamplePoolSize valid points choose the one whose disk removes
+		/// the fewest points still available, as SurfaceSampling<>::PoissonDiskPruning does
+		bool bestSampleChoiceFlag;
+		int bestSamplePoolSize;
+		unsigned int seed;
+		/// samples that are always kept and prune the other points
+		const MeshType *preGenMesh;
+
+		// filled by Prune
+		int cellNum;
+		Point3i gridSize;
+	};
+
+	/** Choose among the vertices of montecarlo a subset where no two samples
+	 * are nearer than radius. The chosen vertices (preceded by the ones of
+	 * pp.preGenMesh, if any) are returned in samples.
+	 */
+	static void Prune(const MeshType &montecarlo, ScalarType radius, Param &pp, std::vector<const VertexType *> &samples)
+	{
+		std::vector<Point> pts;
+		Collect(pp.preGenMesh, true, pts);
+		Collect(&montecarlo, false, pts);
+		samples.clear();
+		if (pts.empty()) return;
+
+		const ScalarType maxRad = InitRadius(pts, radius, pp);
+		Box3<ScalarType> box;
+		for (size_t i = 0; i < pts.size(); ++i)
+			box.Add(pts[i].v->cP());
+		const CoordType dim = box.max - box.min;
+		const ScalarType cellSize = std::max(maxRad, dim[dim.MaxCoeff()] / ScalarType(MaxGridSide - 1));
+		for (int k = 0; k < 3; ++k)
+			pp.gridSize[k] = int(dim[k] / cellSize) + 1;
+
+		// sort by cell, then fixed points first, then in random order
+		const int ptsNum = int(pts.size());
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < ptsNum; ++i)
+		{
+			Point3i c = Point3i::Construct((pts[i].v->cP() - box.min) / cellSize);
+			for (int k = 0; k < 3; ++k)
+				c[k] = std::min(c[k], pp.gridSize[k] - 1);
+			pts[i].key = Key(c);
+			pts[i].order = pts[i].fixed ? 0 : Hash(pp.seed, i) | 1;
+		}
+		MLParallel::Sort(pts.begin(), pts.end(), [](const Point &a, const Point &b) {
+			if (a.key != b.key) return a.key < b.key;
+			if (a.order != b.order) return a.order < b.order;
+			return a.v < b.v;
+		});
+
+		// cells are the runs of equal keys; the taken samples are kept at the
+		// beginning of their run, cellTaken[c] of them
+		std::vector<int> cellStart;
+		std::vector<KeyType> cellKey;
+		for (int i = 0; i < ptsNum; ++i)
+			if (i == 0 || pts[i].key != pts[i - 1].key)
+			{
+				cellStart.push_back(i);
+				cellKey.push_back(pts[i].key);
+			}
+		const int cellNum = int(cellKey.size());
+		cellStart.push_back(ptsNum);
+		pp.cellNum = cellNum;
+
+		std::vector<int> cellTaken(cellNum, 0);
+		std::vector< std::vector<int> > phase(27);
+		for (int c = 0; c < cellNum; ++c)
+		{
+			for (int i = cellStart[c]; i < cellStart[c + 1] && pts[i].fixed; ++i)
+				++cellTaken[c];
+			const Point3i g = Coord(cellKey[c]);
+			phase[Phase(g)].push_back(c);
+		}
+
+		for (int ph = 0; ph < 27; ++ph)
+		{
+			const int phaseNum = int(phase[ph].size());
+#pragma omp parallel for schedule(dynamic, 64)
+			for (int k = 0; k < phaseNum; ++k)
+				PruneCell(phase[ph][k], pts, cellStart, cellKey, cellTaken, pp);
+		}
+
+		for (int i = 0; i < ptsNum; ++i)
+			if (pts[i].fixed) samples.push_back(pts[i].v);
+		for (int c = 0; c < cellNum; ++c)
+			for (int i = cellStart[c]; i < cellStart[c] + cellTaken[c]; ++i)
+				if (!pts[i].fixed) samples.push_back(pts[i].v);
+	}
+
+	/** Same as SurfaceSampling<>::PoissonDiskPruningByNumber: bisect the
+	 * radius, starting from [radius/10, radius*10], until the number of
+	 * samples is within tolerance of sampleNum. Returns the radius used.
+	 */
+	static ScalarType PruneByNumber(const MeshType &montecarlo, int sampleNum, ScalarType radius, Param &pp,
+	                                std::vector<const VertexType *> &samples, ScalarType tolerance = 0.04, int maxIter = 20)
+	{
+		ScalarType minRad = radius / 10, maxRad = radius * 10;
+		ScalarType midRad = radius;
+		for (int iter = 0; iter < maxIter; ++iter)
+		{
+			midRad = (minRad + maxRad) / 2;
+			Prune(montecarlo, midRad, pp, samples);
+			const int cnt = int(samples.size());
+			if (std::abs(cnt - sampleNum) <= tolerance * sampleNum) break;
+			if (cnt > sampleNum) minRad = midRad;
+			else maxRad = midRad;
+		}
+		return midRad;
+	}
+
+private:
+	struct Point
+	{
+		const VertexType *v;
+		KeyType key;
+		KeyType order;
+		ScalarType r;
+		bool fixed;
+	};
+
+	static void Collect(const MeshType *m, bool fixed, std::vector<Point> &pts)
+	{
+		if (m == 0) return;
+		for (size_t i = 0; i < m->vert.size(); ++i)
+			if (!m->vert[i].IsD())
+			{
+				Point p;
+				p.v = &m->vert[i];
+				p.key = p.order = 0;
+				p.fixed = fixed;
+				pts.push_back(p);
+			}
+	}
+
+	// per point radius; returns the largest one
+	static ScalarType InitRadius(std::vector<Point> &pts, ScalarType radius, const Param &pp)
+	{
+		const int ptsNum = int(pts.size());
+		if (!pp.adaptiveRadiusFlag)
+		{
+			for (int i = 0; i < ptsNum; ++i)
+				pts[i].r = radius;
+			return radius;
+		}
+		ScalarType minQ = std::numeric_limits<ScalarType>::max();
+		ScalarType maxQ = -std::numeric_limits<ScalarType>::max();
+		for (int i = 0; i < ptsNum; ++i)
+		{
+			minQ = std::min(minQ, ScalarType(pts[i].v->cQ()));
+			maxQ = std::max(maxQ, ScalarType(pts[i].v->cQ()));
+		}
+		const ScalarType deltaQ = (maxQ > minQ) ? maxQ - minQ : ScalarType(1);
+		const ScalarType minRad = radius;
+		const ScalarType maxRad = radius * pp.radiusVariance;
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < ptsNum; ++i)
+		{
+			const ScalarType q = ScalarType(pts[i].v->cQ());
+			const ScalarType t = (pp.invertQuality ? maxQ - q : q - minQ) / deltaQ;
+			pts[i].r = minRad + (maxRad - minRad) * t;
+		}
+		return std::max(minRad, maxRad);
+	}
+
+	static KeyType Key(const Point3i &c)
+	{
+		return (KeyType(c[0]) << 42) | (KeyType(c[1]) << 21) | KeyType(c[2]);
+	}
+
+	static Point3i Coord(KeyType k)
+	{
+		const KeyType mask = MaxGridSide - 1;
+		return Point3i(int((k >> 42) & mask), int((k >> 21) & mask), int(k & mask));
+	}
+
+	static KeyType Hash(unsigned int seed, int i)
+	{
+		// splitmix64
+		KeyType z = (KeyType(seed) << 32) + KeyType(i) + 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	/* The smallest ratio distance/radius between p and the given samples;
+	 * below 1 p falls inside the disk of one of them.
+	 */
+	static ScalarType NearestRatio(const Point &p, const std::vector<Point> &pts, const std::vector<int> &taken)
+	{
+		ScalarType best = std::numeric_limits<ScalarType>::max();
+		for (size_t j = 0; j < taken.size(); ++j)
+		{
+			const Point &s = pts[taken[j]];
+			best = std::min(best, Distance(p.v->cP(), s.v->cP()) / s.r);
+		}
+		return best;
+	}
+
+	static int Phase(const Point3i &g)
+	{
+		return (g[0] % 3) + 3 * (g[1] % 3) + 9 * (g[2] % 3);
+	}
+
+	/* Number of the given points still alive inside the disk of s */
+	static int CountInDisk(const Point &s, const std::vector<Point> &pts, const std::vector<int> &idx, const std::vector<char> &dead)
+	{
+		int cnt = 0;
+		for (size_t k = 0; k < idx.size(); ++k)
+			if (!dead[k] && Distance(pts[idx[k]].v->cP(), s.v->cP()) < s.r)
+				++cnt;
+		return cnt;
+	}
+
+	/* Mark as dead the given points inside the disk of s */
+	static void KillInDisk(const Point &s, const std::vector<Point> &pts, const std::vector<int> &idx, std::vector<char> &dead)
+	{
+		for (size_t k = 0; k < idx.size(); ++k)
+			if (!dead[k] && Distance(pts[idx[k]].v->cP(), s.v->cP()) < s.r)
+				dead[k] = 1;
+	}
+
+	static void PruneCell(int c, std::vector<Point> &pts, const std::vector<int> &cellStart, const std::vector<KeyType> &cellKey,
+	                      std::vector<int> &cellTaken, const Param &pp)
+	{
+		// the samples around, taken by the cells of the previous groups, and
+		// with the best sample choice the points of the cells still to come
+		std::vector<int> near, later;
+		const Point3i g = Coord(cellKey[c]);
+		for (int dz = -1; dz <= 1; ++dz)
+			for (int dy = -1; dy <= 1; ++dy)
+				for (int dx = -1; dx <= 1; ++dx)
+				{
+					const Point3i n(g[0] + dx, g[1] + dy, g[2] + dz);
+					if (n[0] < 0 || n[1] < 0 || n[2] < 0 || n[0] >= MaxGridSide || n[1] >= MaxGridSide || n[2] >= MaxGridSide) continue;
+					typename std::vector<KeyType>::const_iterator it = std::lower_bound(cellKey.begin(), cellKey.end(), Key(n));
+					if (it == cellKey.end() || *it != Key(n)) continue;
+					const int nc = int(it - cellKey.begin());
+					for (int i = cellStart[nc]; i < cellStart[nc] + cellTaken[nc]; ++i)
+						near.push_back(i);
+					if (pp.bestSampleChoiceFlag && nc != c && Phase(n) > Phase(g))
+						for (int i = cellStart[nc] + cellTaken[nc]; i < cellStart[nc + 1]; ++i)
+							later.push_back(i);
+				}
+
+		// the points already inside a disk are removed from the start, the
+		// others when a sample whose disk contains them is taken
+		std::vector<int> cand;
+		for (int i = cellStart[c] + cellTaken[c]; i < cellStart[c + 1]; ++i)
+			cand.push_back(i);
+		std::vector<char> dead(cand.size(), 0), laterDead(later.size(), 0);
+		for (size_t k = 0; k < cand.size(); ++k)
+			dead[k] = NearestRatio(pts[cand[k]], pts, near) < 1;
+		for (size_t k = 0; k < later.size(); ++k)
+			laterDead[k] = NearestRatio(pts[later[k]], pts, near) < 1;
+
+		std::vector<int> taken;
+		const int poolSize = pp.bestSampleChoiceFlag ? std::max(1, pp.bestSamplePoolSize) : 1;
+		for (;;)
+		{
+			int best = -1, bestCnt = 0, pool = 0;
+			for (size_t k = 0; k < cand.size() && pool < poolSize; ++k)
+			{
+				if (dead[k]) continue;
+				++pool;
+				if (poolSize == 1)
+				{
+					best = int(k);
+					break;
+				}
+				const Point &s = pts[cand[k]];
+				// the candidate itself is among the points of its disk
+				const int cnt = CountInDisk(s, pts, cand, dead) + CountInDisk(s, pts, later, laterDead);
+				if (best < 0 || cnt < bestCnt)
+				{
+					best = int(k);
+					bestCnt = cnt;
+				}
+			}
+			if (best < 0) break;
+			const Point &s = pts[cand[best]];
+			KillInDisk(s, pts, cand, dead);
+			KillInDisk(s, pts, later, laterDead);
+			dead[best] = 1;
+			taken.push_back(cand[best]);
+		}
+
+		// move the taken samples right after the fixed ones
+		std::vector<Point> run;
+		run.reserve(cand.size());
+		for (size_t k = 0; k < taken.size(); ++k)
+			run.push_back(pts[taken[k]]);
+		for (size_t k = 0; k < cand.size(); ++k)
+			if (std::find(taken.begin(), taken.end(), cand[k]) == taken.end())
+				run.push_back(pts[cand[k]]);
+		std::copy(run.begin(), run.end(), pts.begin() + cellStart[c] + cellTaken[c]);
+		cellTaken[c] += int(taken.size());
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,924 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_REMESHING_H
+#define __ML_PARALLEL_REMESHING_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include "ml_parallel_bvh.h"
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Isotropic explicit remeshing (Botsch and Kobbelt 2004), the same scheme of
+  IsotropicRemeshing<>: each iteration splits the edges longer than 4/3 of
+  the target length, collapses the ones shorter than 4/5, flips edges to
+  bring the valences toward 6 (4 on borders), relaxes the vertices in their
+  tangent plane and projects them back on the original surface.
+
+  The mesh is worked on as flat index arrays. Before each pass the edge and
+  vertex-face adjacency are rebuilt by sorting, then:
+  - all the long edges are split at once, every face being replaced by its
+    1 to 4 children;
+  - collapses and flips are validated in parallel on the current state and
+    then applied on a maximal independent set of them, chosen by priority
+    (shorter edges, larger valence gains first), so that no two applied
+    operations read or write the same vertices. A few rounds are done, each
+    on the operations left by the previous one;
+  - smoothing is a Jacobi pass and the projection queries a BVH of the
+    original mesh, both over all the vertices at once.
+  Everything is independent of the number of threads.
+
+  Feature edges (dihedral angle above the crease angle), borders and, with
+  selectedOnly, the border of the selection are preserved: vertices with two
+  such edges only slide along them, vertices with a different number are
+  never moved.
+*/
+template <class MeshType>
+class ParallelIsotropicRemeshing
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::FaceType       FaceType;
+
+	struct Params
+	{
+		ScalarType targetLen;
+		ScalarType featureAngleDeg;
+		ScalarType maxSurfDist;
+		int  iter;
+		bool selectedOnly;
+		bool splitFlag;
+		bool collapseFlag;
+		bool swapFlag;
+		bool smoothFlag;
+		bool projectFlag;
+		bool surfDistCheck;
+
+		Params() : targetLen(1), featureAngleDeg(30), maxSurfDist(1), iter(10), selectedOnly(false),
+			splitFlag(true), collapseFlag(true), swapFlag(true), smoothFlag(true), projectFlag(true), surfDistCheck(false) {}
+	};
+
+	// wall clock seconds spent in each pass, summed over the iterations
+	struct Timing
+	{
+		double split, collapse, swap, smooth, project;
+		Timing() : split(0), collapse(0), swap(0), smooth(0), project(0) {}
+	};
+
+	// rounds of collapses and flips in each iteration
+	static const int MaxRounds = 3;
+
+	/** True if Do can handle m. The faces are rewritten in place with new
+	 * corners and per-wedge data would not follow them, so meshes with
+	 * per-wedge texture coordinates, normals or colors have to go through
+	 * IsotropicRemeshing<>.
+	 */
+	static bool CanRemesh(const MeshType &m)
+	{
+		return !HasPerWedgeTexCoord(m) && !HasPerWedgeNormal(m) && !HasPerWedgeColor(m);
+	}
+
+	/** Remesh m; original is the surface the vertices are projected on (and
+	 * the distance is checked against), usually a copy of m. m must have no
+	 * unreferenced vertices.
+	 */
+	static void Do(MeshType &m, MeshType &original, const Params &par, Timing &timing, CallBackPos *cb = 0)
+	{
+		ParallelIsotropicRemeshing r(par);
+		if (par.projectFlag || par.surfDistCheck)
+			r.bvh.Set(original);
+		r.Load(m);
+		for (int i = 0; i < par.iter; ++i)
+		{
+			if (cb) cb(100 * i / par.iter, "Remeshing");
+			std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+			if (par.splitFlag)
+			{
+				r.Split();
+				timing.split += Elapsed(t);
+			}
+			if (par.collapseFlag)
+			{
+				for (int round = 0; round < MaxRounds && r.Collapse() > 0; ++round) {}
+				timing.collapse += Elapsed(t);
+			}
+			if (par.swapFlag)
+			{
+				for (int round = 0; round < MaxRounds && r.Flip() > 0; ++round) {}
+				timing.swap += Elapsed(t);
+			}
+			if (par.smoothFlag)
+			{
+				r.Smooth();
+				timing.smooth += Elapsed(t);
+			}
+			if (par.projectFlag)
+			{
+				r.Project();
+				timing.project += Elapsed(t);
+			}
+		}
+		r.Store(m);
+	}
+
+private:
+	enum { Free = 0, Crease = 1, Corner = 2 };
+
+	Params par;
+	ParallelBVH<MeshType> bvh;
+	ScalarType cosFeature;
+
+	int origVertNum, origFaceNum;
+	std::vector<CoordType> pos;
+	std::vector<int>  vertSrc;     // vertex of the input whose data is copied on this one
+	std::vector<char> vertDead;
+	std::vector<char> vertFixed;   // on a face left out of the remeshing
+	std::vector<int>  tri;         // 3 per face, all -1 for removed faces
+	std::vector<char> edgeFeat;    // per wedge w = 3*f+k, for the edge from V(k) to V(k+1)
+	std::vector<int>  faceSrc;     // face of the input whose data is copied on this one
+	std::vector<char> faceActive;
+
+	// adjacency, valid until the next topological change
+	bool topoValid;
+	std::vector<int>  opp;         // opposite wedge; -1 on borders, -2 on non manifold edges
+	std::vector<int>  vfStart;     // wedges of vertex v are vfWedge[vfStart[v]] ... vfWedge[vfStart[v+1]-1]
+	std::vector<int>  vfWedge;
+	std::vector<char> vertKind;
+
+	explicit ParallelIsotropicRemeshing(const Params &p) : par(p), topoValid(false)
+	{
+		cosFeature = std::cos(math::ToRad(par.featureAngleDeg));
+	}
+
+	static double Elapsed(std::chrono::steady_clock::time_point &t)
+	{
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		const double s = std::chrono::duration<double>(now - t).count();
+		t = now;
+		return s;
+	}
+
+	static int Next(int w) { return (w % 3 == 2) ? w - 2 : w + 1; }
+	static int Prev(int w) { return (w % 3 == 0) ? w + 2 : w - 1; }
+	int Org(int w) const { return tri[w]; }
+	int Dst(int w) const { return tri[Next(w)]; }
+	int FaceNum() const { return int(tri.size() / 3); }
+	bool Alive(int f) const { return tri[3 * f] >= 0; }
+
+	CoordType Normal(int a, int b, int c) const { return (pos[b] - pos[a]) ^ (pos[c] - pos[a]); }
+	CoordType Normal(int f) const { return Normal(tri[3 * f], tri[3 * f + 1], tri[3 * f + 2]); }
+
+	bool IsHard(int w) const
+	{
+		return opp[w] < 0 || edgeFeat[w] || !faceActive[w / 3] || !faceActive[opp[w] / 3];
+	}
+
+	bool NearSurface(const CoordType &p) const
+	{
+		typename ParallelBVH<MeshType>::ClosestHit hit;
+		return bvh.Closest(Point3f::Construct(p), float(par.maxSurfDist), hit);
+	}
+
+	// Distinct neighbours of v, sorted.
+	void Ring(int v, std::vector<int> &ring) const
+	{
+		ring.clear();
+		for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+		{
+			ring.push_back(Dst(vfWedge[i]));
+			ring.push_back(Org(Prev(vfWedge[i])));
+		}
+		std::sort(ring.begin(), ring.end());
+		ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+	}
+
+	void Load(MeshType &m)
+	{
+		origVertNum = int(m.vert.size());
+		origFaceNum = int(m.face.size());
+		pos.resize(origVertNum);
+		vertSrc.resize(origVertNum);
+		vertDead.resize(origVertNum);
+		vertFixed.assign(origVertNum, 0);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < origVertNum; ++i)
+		{
+			pos[i] = m.vert[i].cP();
+			vertSrc[i] = i;
+			vertDead[i] = m.vert[i].IsD() ? 1 : 0;
+		}
+
+		tri.resize(size_t(3) * origFaceNum);
+		edgeFeat.assign(size_t(3) * origFaceNum, 0);
+		faceSrc.resize(origFaceNum);
+		faceActive.resize(origFaceNum);
+#pragma omp parallel for schedule(static)
+		for (int f = 0; f < origFaceNum; ++f)
+		{
+			const FaceType &face = m.face[f];
+			for (int k = 0; k < 3; ++k)
+				tri[3 * f + k] = face.IsD() ? -1 : int(Index(m, face.cV(k)));
+			faceSrc[f] = f;
+			faceActive[f] = (!face.IsD() && (!par.selectedOnly || face.IsS())) ? 1 : 0;
+		}
+		for (int f = 0; f < origFaceNum; ++f)
+			if (Alive(f) && !faceActive[f])
+				for (int k = 0; k < 3; ++k)
+					vertFixed[tri[3 * f + k]] = 1;
+
+		// crease edges of the input
+		BuildTopology();
+		const int wedgeNum = int(tri.size());
+#pragma omp parallel for schedule(static)
+		for (int w = 0; w < wedgeNum; ++w)
+		{
+			if (!Alive(w / 3) || opp[w] < 0) continue;
+			const CoordType n0 = Normal(w / 3), n1 = Normal(opp[w] / 3);
+			const ScalarType den = n0.Norm() * n1.Norm();
+			edgeFeat[w] = (den > 0 && (n0 * n1) < cosFeature * den) ? 1 : 0;
+		}
+		topoValid = false;
+	}
+
+	// Rebuild opp, the vertex-face lists and the vertex kinds.
+	void BuildTopology()
+	{
+		if (topoValid) return;
+		const int vertNum = int(pos.size());
+		const int wedgeNum = int(tri.size());
+
+		// wedges around each vertex: counted, scattered, then put in order
+		std::vector<std::atomic<int> > cnt(vertNum + 1);
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v <= vertNum; ++v)
+			cnt[v].store(0, std::memory_order_relaxed);
+#pragma omp parallel for schedule(static)
+		for (int w = 0; w < wedgeNum; ++w)
+			if (Alive(w / 3)) cnt[Org(w)].fetch_add(1, std::memory_order_relaxed);
+		vfStart.resize(vertNum + 1);
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v <= vertNum; ++v)
+			vfStart[v] = cnt[v].load(std::memory_order_relaxed);
+		const int aliveNum = MLParallel::ExclusiveScan(vfStart);
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v <= vertNum; ++v)
+			cnt[v].store(vfStart[v], std::memory_order_relaxed);
+		vfWedge.resize(aliveNum);
+#pragma omp parallel for schedule(static)
+		for (int w = 0; w < wedgeNum; ++w)
+			if (Alive(w / 3)) vfWedge[cnt[Org(w)].fetch_add(1, std::memory_order_relaxed)] = w;
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int v = 0; v < vertNum; ++v)
+			std::sort(vfWedge.begin() + vfStart[v], vfWedge.begin() + vfStart[v + 1]);
+
+		// the opposite of a->b is the only b->a, if there is no other a->b
+		opp.assign(wedgeNum, -1);
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int w = 0; w < wedgeNum; ++w)
+		{
+			if (!Alive(w / 3)) continue;
+			const int a = Org(w), b = Dst(w);
+			int rev = 0, same = 0, o = -1;
+			for (int i = vfStart[b]; i < vfStart[b + 1]; ++i)
+				if (Dst(vfWedge[i]) == a) { ++rev; o = vfWedge[i]; }
+			for (int i = vfStart[a]; i < vfStart[a + 1]; ++i)
+				if (vfWedge[i] != w && Dst(vfWedge[i]) == b) ++same;
+			if (rev == 1 && same == 0) opp[w] = o;
+			else if (rev + same > 0) opp[w] = -2;   // non manifold or badly oriented
+		}
+
+		vertKind.resize(vertNum);
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v < vertNum; ++v)
+		{
+			int hard = 0;
+			bool nonManifold = false;
+			for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+			{
+				const int w = vfWedge[i];
+				// every edge of v is outgoing in one of its faces, but borders
+				if (opp[w] == -2 || opp[Prev(w)] == -2) nonManifold = true;
+				if (IsHard(w)) ++hard;
+				if (opp[Prev(w)] == -1) ++hard;
+			}
+			vertKind[v] = (vertFixed[v] || nonManifold || (hard != 0 && hard != 2)) ? Corner : (hard == 2 ? Crease : Free);
+		}
+		topoValid = true;
+	}
+
+	// Indices i in [0,n) for which pred(i) holds, in increasing order.
+	template <class Pred>
+	static void Gather(int n, Pred pred, std::vector<int> &out)
+	{
+		std::vector<int> off(n);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i)
+			off[i] = pred(i) ? 1 : 0;
+		std::vector<int> flag(off);
+		out.resize(MLParallel::ExclusiveScan(off));
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i)
+			if (flag[i]) out[off[i]] = i;
+	}
+
+	static void AtomicMin(std::atomic<unsigned long long> &a, unsigned long long v)
+	{
+		unsigned long long cur = a.load(std::memory_order_relaxed);
+		while (v < cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+	}
+
+	/* Select a maximal set of candidates with no vertex in common, the
+	 * vertices of candidate c being listed by region(c, vertices). Each round
+	 * keeps the candidates whose priority (lower first, all different) is the
+	 * smallest on all their vertices and drops the ones touching a kept one.
+	 */
+	template <class RegionFn>
+	void IndependentSet(const std::vector<unsigned long long> &prio, RegionFn region, std::vector<char> &keep) const
+	{
+		const int vertNum = int(pos.size());
+		const int candNum = int(prio.size());
+		std::vector<std::atomic<unsigned long long> > mark(vertNum);
+		std::vector<std::atomic<char> > taken(vertNum);
+#pragma omp parallel for schedule(static)
+		for (int v = 0; v < vertNum; ++v)
+			taken[v].store(0, std::memory_order_relaxed);
+
+		keep.assign(candNum, 0);
+		std::vector<int> open(candNum), next;
+		for (int c = 0; c < candNum; ++c)
+			open[c] = c;
+		while (!open.empty())
+		{
+			const int openNum = int(open.size());
+			std::vector<char> state(openNum, 0);   // 1 kept, 2 dropped
+#pragma omp parallel
+			{
+				std::vector<int> reg;
+#pragma omp for schedule(static)
+				for (int v = 0; v < vertNum; ++v)
+					mark[v].store(~0ULL, std::memory_order_relaxed);
+#pragma omp for schedule(dynamic, 1024)
+				for (int i = 0; i < openNum; ++i)
+				{
+					region(open[i], reg);
+					for (size_t j = 0; j < reg.size() && state[i] == 0; ++j)
+						if (taken[reg[j]].load(std::memory_order_relaxed)) state[i] = 2;
+					if (state[i] == 0)
+						for (size_t j = 0; j < reg.size(); ++j)
+							AtomicMin(mark[reg[j]], prio[open[i]]);
+				}
+#pragma omp for schedule(dynamic, 1024)
+				for (int i = 0; i < openNum; ++i)
+				{
+					if (state[i] != 0) continue;
+					region(open[i], reg);
+					bool best = true;
+					for (size_t j = 0; j < reg.size() && best; ++j)
+						best = mark[reg[j]].load(std::memory_order_relaxed) == prio[open[i]];
+					if (best) state[i] = 1;
+				}
+#pragma omp for schedule(dynamic, 1024)
+				for (int i = 0; i < openNum; ++i)
+				{
+					if (state[i] != 1) continue;
+					keep[open[i]] = 1;
+					region(open[i], reg);
+					for (size_t j = 0; j < reg.size(); ++j)
+						taken[reg[j]].store(1, std::memory_order_relaxed);
+				}
+			}
+			Gather(openNum, [&](int i) { return state[i] == 0; }, next);
+			for (size_t i = 0; i < next.size(); ++i)
+				next[i] = open[next[i]];
+			open.swap(next);
+		}
+	}
+
+	/* Priority of an operation: the coarse key first, then a scrambling of
+	 * its wedge, so that neighbouring operations with the same key are in
+	 * random order; ordering by the edge lengths alone would make long chains
+	 * in which only the first operation is applied.
+	 */
+	static unsigned long long Priority(unsigned int key, int w)
+	{
+		unsigned int x = (unsigned int)(w);
+		x ^= x >> 16; x *= 0x7feb352dU;
+		x ^= x >> 15; x *= 0x846ca68bU;
+		x ^= x >> 16;
+		return ((unsigned long long)(key) << 32) | x;
+	}
+
+	void SetFace(int f, int a, int b, int c, char fab, char fbc, char fca)
+	{
+		tri[3 * f] = a; tri[3 * f + 1] = b; tri[3 * f + 2] = c;
+		edgeFeat[3 * f] = fab; edgeFeat[3 * f + 1] = fbc; edgeFeat[3 * f + 2] = fca;
+	}
+
+	// Split all the edges longer than 4/3 of the target length.
+	int Split()
+	{
+		BuildTopology();
+		const ScalarType maxLen = par.targetLen * ScalarType(4.0 / 3.0);
+		const int faceNum = FaceNum();
+		const int wedgeNum = int(tri.size());
+
+		// the new vertex of an edge belongs to its wedge with the lowest index
+		std::vector<int> cut;
+		Gather(wedgeNum, [&](int w) {
+			const int f = w / 3;
+			if (!Alive(f) || !faceActive[f] || opp[w] == -2 || (opp[w] >= 0 && (opp[w] < w || !faceActive[opp[w] / 3])))
+				return false;
+			return (pos[Org(w)] - pos[Dst(w)]).SquaredNorm() > maxLen * maxLen;
+		}, cut);
+		const int cutNum = int(cut.size());
+		if (cutNum == 0) return 0;
+
+		const int vertNum = int(pos.size());
+		pos.resize(vertNum + cutNum);
+		vertSrc.resize(vertNum + cutNum);
+		vertDead.resize(vertNum + cutNum, 0);
+		vertFixed.resize(vertNum + cutNum, 0);
+		std::vector<int> mid(wedgeNum, -1);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < cutNum; ++i)
+		{
+			const int w = cut[i];
+			const int v = vertNum + i;
+			pos[v] = (pos[Org(w)] + pos[Dst(w)]) / ScalarType(2);
+			vertSrc[v] = vertSrc[Org(w)];
+			mid[w] = v;
+			if (opp[w] >= 0) mid[opp[w]] = v;
+		}
+
+		std::vector<int> extra(faceNum);
+#pragma omp parallel for schedule(static)
+		for (int f = 0; f < faceNum; ++f)
+			extra[f] = (mid[3 * f] >= 0) + (mid[3 * f + 1] >= 0) + (mid[3 * f + 2] >= 0);
+		const int extraNum = MLParallel::ExclusiveScan(extra);
+		tri.resize(size_t(3) * (faceNum + extraNum));
+		edgeFeat.resize(size_t(3) * (faceNum + extraNum));
+		faceSrc.resize(faceNum + extraNum);
+		faceActive.resize(faceNum + extraNum, 1);
+
+#pragma omp parallel for schedule(static)
+		for (int f = 0; f < faceNum; ++f)
+		{
+			const int *m = &mid[3 * f];
+			const int s = (m[0] >= 0) + (m[1] >= 0) + (m[2] >= 0);
+			if (s == 0) continue;
+			// rotate so that V(0)V(1) is cut and, with two cuts, V(2)V(0) is not
+			int r = 0;
+			if (s == 1) r = (m[0] >= 0) ? 0 : ((m[1] >= 0) ? 1 : 2);
+			if (s == 2) r = (m[2] < 0) ? 0 : ((m[0] < 0) ? 1 : 2);
+			const int a = tri[3 * f + r], b = tri[3 * f + (r + 1) % 3], c = tri[3 * f + (r + 2) % 3];
+			const int mab = m[r], mbc = m[(r + 1) % 3], mca = m[(r + 2) % 3];
+			const char fab = edgeFeat[3 * f + r], fbc = edgeFeat[3 * f + (r + 1) % 3], fca = edgeFeat[3 * f + (r + 2) % 3];
+			int child[3];
+			for (int j = 0; j < s; ++j)
+			{
+				child[j] = faceNum + extra[f] + j;
+				faceSrc[child[j]] = faceSrc[f];
+				faceActive[child[j]] = 1;
+			}
+			if (s == 1)
+			{
+				SetFace(f, a, mab, c, fab, 0, fca);
+				SetFace(child[0], mab, b, c, fab, fbc, 0);
+			}
+			else if (s == 2)
+			{
+				SetFace(child[0], mab, b, mbc, fab, fbc, 0);
+				// the quad a mab mbc c is split along its shorter diagonal
+				if ((pos[a] - pos[mbc]).SquaredNorm() <= (pos[mab] - pos[c]).SquaredNorm())
+				{
+					SetFace(f, a, mab, mbc, fab, 0, 0);
+					SetFace(child[1], a, mbc, c, 0, fbc, fca);
+				}
+				else
+				{
+					SetFace(f, a, mab, c, fab, 0, fca);
+					SetFace(child[1], mab, mbc, c, 0, fbc, 0);
+				}
+			}
+			else
+			{
+				SetFace(f, mab, mbc, mca, 0, 0, 0);
+				SetFace(child[0], a, mab, mca, fab, 0, fca);
+				SetFace(child[1], mab, b, mbc, fab, fbc, 0);
+				SetFace(child[2], mca, mbc, c, 0, fbc, fca);
+			}
+		}
+		topoValid = false;
+		return cutNum;
+	}
+
+	// Collapse an independent set of the edges shorter than 4/5 of the target length.
+	int Collapse()
+	{
+		BuildTopology();
+		const ScalarType minLen = par.targetLen * ScalarType(4.0 / 5.0);
+		const ScalarType maxLen = par.targetLen * ScalarType(4.0 / 3.0);
+		const int wedgeNum = int(tri.size());
+
+		std::vector<int> cand;
+		Gather(wedgeNum, [&](int w) {
+			const int f = w / 3;
+			if (!Alive(f) || !faceActive[f] || opp[w] == -2 || (opp[w] >= 0 && (opp[w] < w || !faceActive[opp[w] / 3])))
+				return false;
+			return (pos[Org(w)] - pos[Dst(w)]).SquaredNorm() < minLen * minLen;
+		}, cand);
+		const int candNum = int(cand.size());
+		if (candNum == 0) return 0;
+
+		// validation: survivor (-1 if not valid), its new position and the priority
+		std::vector<int> survivor(candNum);
+		std::vector<CoordType> target(candNum);
+		std::vector<unsigned long long> prio(candNum);
+#pragma omp parallel
+		{
+			std::vector<int> ra, rb;
+#pragma omp for schedule(dynamic, 1024)
+			for (int c = 0; c < candNum; ++c)
+			{
+				const int w = cand[c];
+				const int a = Org(w), b = Dst(w);
+				prio[c] = ~0ULL;
+				survivor[c] = -1;
+
+				const int ka = vertKind[a], kb = vertKind[b];
+				if (ka == Corner && kb == Corner) continue;
+				if (!IsHard(w) && ka != Free && kb != Free) continue;
+				if (ka > kb) { survivor[c] = a; target[c] = pos[a]; }
+				else if (kb > ka) { survivor[c] = b; target[c] = pos[b]; }
+				else { survivor[c] = std::min(a, b); target[c] = (pos[a] + pos[b]) / ScalarType(2); }
+
+				// link condition: the only common neighbours are the opposite vertices
+				Ring(a, ra);
+				Ring(b, rb);
+				int common = 0;
+				for (size_t i = 0, j = 0; i < ra.size() && j < rb.size();)
+				{
+					if (ra[i] < rb[j]) ++i;
+					else if (rb[j] < ra[i]) ++j;
+					else { ++common; ++i; ++j; }
+				}
+				if (common != (opp[w] >= 0 ? 2 : 1)) { survivor[c] = -1; continue; }
+
+				// no face turns more than the crease angle and no new edge is too long
+				bool ok = true;
+				for (int v = 0; v < 2 && ok; ++v)
+				{
+					const int x = v ? b : a;
+					for (int i = vfStart[x]; i < vfStart[x + 1] && ok; ++i)
+					{
+						const int f = vfWedge[i] / 3;
+						int q[3];
+						bool both = false;
+						for (int k = 0; k < 3; ++k)
+						{
+							q[k] = tri[3 * f + k];
+							if (q[k] == (x == a ? b : a)) both = true;
+						}
+						if (both) continue;
+						const CoordType n0 = Normal(q[0], q[1], q[2]);
+						CoordType p[3];
+						for (int k = 0; k < 3; ++k)
+						{
+							p[k] = (q[k] == a || q[k] == b) ? target[c] : pos[q[k]];
+							if (q[k] != a && q[k] != b && (p[k] - target[c]).SquaredNorm() > maxLen * maxLen) ok = false;
+						}
+						const CoordType n1 = (p[1] - p[0]) ^ (p[2] - p[0]);
+						if (n0 * n1 <= cosFeature * n0.Norm() * n1.Norm()) ok = false;
+					}
+				}
+				if (!ok) { survivor[c] = -1; continue; }
+				if (par.surfDistCheck && !NearSurface(target[c])) { survivor[c] = -1; continue; }
+
+				// shorter edges first, in four classes
+				prio[c] = Priority((unsigned int)(4 * (pos[a] - pos[b]).SquaredNorm() / (minLen * minLen)), w);
+			}
+		}
+
+		std::vector<int> valid;
+		Gather(candNum, [&](int c) { return survivor[c] >= 0; }, valid);
+		const int validNum = int(valid.size());
+		if (validNum == 0) return 0;
+		std::vector<unsigned long long> vprio(validNum);
+		for (int i = 0; i < validNum; ++i)
+			vprio[i] = prio[valid[i]];
+		std::vector<char> keep;
+		IndependentSet(vprio, [&](int i, std::vector<int> &reg) {
+			const int w = cand[valid[i]];
+			reg.clear();
+			for (int v = 0; v < 2; ++v)
+			{
+				const int x = v ? Dst(w) : Org(w);
+				for (int j = vfStart[x]; j < vfStart[x + 1]; ++j)
+				{
+					reg.push_back(Dst(vfWedge[j]));
+					reg.push_back(Org(Prev(vfWedge[j])));
+				}
+			}
+		}, keep);
+
+		int done = 0;
+#pragma omp parallel for schedule(dynamic, 1024) reduction(+: done)
+		for (int i = 0; i < validNum; ++i)
+		{
+			if (!keep[i]) continue;
+			const int c = valid[i];
+			const int w = cand[c];
+			const int s = survivor[c];
+			const int r = (s == Org(w)) ? Dst(w) : Org(w);
+			pos[s] = target[c];
+			for (int j = vfStart[r]; j < vfStart[r + 1]; ++j)
+			{
+				const int x = vfWedge[j];
+				const int f = x / 3;
+				const int xs = (tri[3 * f] == s) ? 3 * f : ((tri[3 * f + 1] == s) ? 3 * f + 1 : ((tri[3 * f + 2] == s) ? 3 * f + 2 : -1));
+				if (xs < 0)
+				{
+					tri[x] = s;
+					continue;
+				}
+				// a face on the edge: its other two edges become one
+				const int wsc = (Dst(xs) == r) ? Prev(xs) : xs;
+				const int wrc = (Dst(x) == s) ? Prev(x) : x;
+				const char feat = edgeFeat[wsc] | edgeFeat[wrc];
+				if (opp[wsc] >= 0) edgeFeat[opp[wsc]] |= feat;
+				if (opp[wrc] >= 0) edgeFeat[opp[wrc]] |= feat;
+				tri[3 * f] = tri[3 * f + 1] = tri[3 * f + 2] = -1;
+			}
+			vertDead[r] = 1;
+			++done;
+		}
+		if (done > 0) topoValid = false;
+		return done;
+	}
+
+	// Flip an independent set of the edges whose flip improves the valences.
+	int Flip()
+	{
+		BuildTopology();
+		const int vertNum = int(pos.size());
+		const int wedgeNum = int(tri.size());
+
+		std::vector<int> valence(vertNum);
+		std::vector<char> border(vertNum);
+#pragma omp parallel
+		{
+			std::vector<int> ring;
+#pragma omp for schedule(dynamic, 1024)
+			for (int v = 0; v < vertNum; ++v)
+			{
+				Ring(v, ring);
+				valence[v] = int(ring.size());
+				border[v] = 0;
+				for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+					if (opp[vfWedge[i]] < 0 || opp[Prev(vfWedge[i])] < 0) border[v] = 1;
+			}
+		}
+
+		std::vector<int> cand;
+		Gather(wedgeNum, [&](int w) {
+			const int f = w / 3;
+			return Alive(f) && opp[w] > w && !IsHard(w);
+		}, cand);
+		const int candNum = int(cand.size());
+		std::vector<unsigned long long> prio(candNum, ~0ULL);
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int i = 0; i < candNum; ++i)
+		{
+			const int w = cand[i], o = opp[w];
+			const int a = Org(w), b = Dst(w), c = Org(Prev(w)), d = Org(Prev(o));
+			if (c == d || valence[a] <= 3 || valence[b] <= 3) continue;
+			// the new edge must not exist already
+			bool exists = false;
+			for (int j = vfStart[c]; j < vfStart[c + 1] && !exists; ++j)
+				exists = Dst(vfWedge[j]) == d || Org(Prev(vfWedge[j])) == d;
+			if (exists) continue;
+
+			const int q[4] = { a, b, c, d };
+			const int delta[4] = { -1, -1, 1, 1 };
+			int before = 0, after = 0;
+			for (int k = 0; k < 4; ++k)
+			{
+				const int t = border[q[k]] ? 4 : 6;
+				before += (valence[q[k]] - t) * (valence[q[k]] - t);
+				after += (valence[q[k]] + delta[k] - t) * (valence[q[k]] + delta[k] - t);
+			}
+			if (after >= before) continue;
+
+			const CoordType n0 = Normal(a, b, c) + Normal(b, a, d);
+			const CoordType n1 = Normal(a, d, c), n2 = Normal(d, b, c);
+			if (n1 * n0 <= 0 || n2 * n0 <= 0) continue;
+			if (n1 * n2 < cosFeature * n1.Norm() * n2.Norm()) continue;
+			if (par.surfDistCheck && !NearSurface((pos[c] + pos[d]) / ScalarType(2))) continue;
+
+			prio[i] = Priority((unsigned int)(std::max(0, (1 << 20) - (before - after))), w);
+		}
+
+		std::vector<int> valid;
+		Gather(candNum, [&](int i) { return prio[i] != ~0ULL; }, valid);
+		const int validNum = int(valid.size());
+		if (validNum == 0) return 0;
+		std::vector<unsigned long long> vprio(validNum);
+		for (int i = 0; i < validNum; ++i)
+			vprio[i] = prio[valid[i]];
+		std::vector<char> keep;
+		IndependentSet(vprio, [&](int i, std::vector<int> &reg) {
+			const int w = cand[valid[i]];
+			reg.clear();
+			reg.push_back(Org(w));
+			reg.push_back(Dst(w));
+			reg.push_back(Org(Prev(w)));
+			reg.push_back(Org(Prev(opp[w])));
+		}, keep);
+
+		int done = 0;
+#pragma omp parallel for schedule(static) reduction(+: done)
+		for (int i = 0; i < validNum; ++i)
+		{
+			if (!keep[i]) continue;
+			const int w = cand[valid[i]], o = opp[w];
+			const int a = Org(w), b = Dst(w), c = Org(Prev(w)), d = Org(Prev(o));
+			const char fbc = edgeFeat[Next(w)], fca = edgeFeat[Prev(w)];
+			const char fad = edgeFeat[Next(o)], fdb = edgeFeat[Prev(o)];
+			SetFace(w / 3, a, d, c, fad, 0, fca);
+			SetFace(o / 3, d, b, c, fdb, fbc, 0);
+			++done;
+		}
+		if (done > 0) topoValid = false;
+		return done;
+	}
+
+	/* Tangential relaxation; crease vertices slide along their crease. As in
+	 * the planar laplacian of vcg, moves that turn a face by more than the
+	 * crease angle are undone, until no face turns too much.
+	 */
+	void Smooth()
+	{
+		BuildTopology();
+		const int vertNum = int(pos.size());
+		std::vector<CoordType> newPos(pos);
+#pragma omp parallel
+		{
+			std::vector<int> ring;
+#pragma omp for schedule(dynamic, 1024)
+			for (int v = 0; v < vertNum; ++v)
+			{
+				if (vertDead[v] || vertKind[v] == Corner || vfStart[v] == vfStart[v + 1]) continue;
+				const CoordType &p = pos[v];
+				if (vertKind[v] == Free)
+				{
+					CoordType n(0, 0, 0), cen(0, 0, 0);
+					for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+						n += Normal(vfWedge[i] / 3);
+					Ring(v, ring);
+					for (size_t i = 0; i < ring.size(); ++i)
+						cen += pos[ring[i]];
+					cen /= ScalarType(ring.size());
+					n.Normalize();
+					const CoordType d = cen - p;
+					newPos[v] = p + d - n * (n * d);
+				}
+				else
+				{
+					int h[2], hn = 0;
+					for (int i = vfStart[v]; i < vfStart[v + 1] && hn < 2; ++i)
+					{
+						const int w = vfWedge[i];
+						if (IsHard(w)) h[hn++] = Dst(w);
+						if (hn < 2 && opp[Prev(w)] == -1) h[hn++] = Org(Prev(w));
+					}
+					if (hn < 2) continue;
+					CoordType t = pos[h[1]] - pos[h[0]];
+					t.Normalize();
+					const CoordType d = (pos[h[0]] + pos[h[1]]) / ScalarType(2) - p;
+					newPos[v] = p + t * (t * d);
+				}
+			}
+		}
+
+		std::vector<char> stay(vertNum, 0);
+		for (int undone = 1; undone > 0;)
+		{
+			undone = 0;
+#pragma omp parallel for schedule(dynamic, 1024)
+			for (int v = 0; v < vertNum; ++v)
+			{
+				if (stay[v] || newPos[v] == pos[v]) continue;
+				for (int i = vfStart[v]; i < vfStart[v + 1]; ++i)
+				{
+					const int *q = &tri[3 * (vfWedge[i] / 3)];
+					const CoordType n0 = Normal(q[0], q[1], q[2]);
+					const CoordType n1 = (newPos[q[1]] - newPos[q[0]]) ^ (newPos[q[2]] - newPos[q[0]]);
+					if (n0 * n1 <= cosFeature * n0.Norm() * n1.Norm())
+					{
+						stay[v] = 1;
+						break;
+					}
+				}
+			}
+			// reset in a separate pass, the check above reads the neighbours
+#pragma omp parallel for schedule(static) reduction(+: undone)
+			for (int v = 0; v < vertNum; ++v)
+				if (stay[v] && newPos[v] != pos[v])
+				{
+					newPos[v] = pos[v];
+					++undone;
+				}
+		}
+		pos.swap(newPos);
+	}
+
+	// Move the vertices on the closest point of the original surface.
+	void Project()
+	{
+		BuildTopology();
+		const int vertNum = int(pos.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int v = 0; v < vertNum; ++v)
+		{
+			if (vertDead[v] || vertKind[v] == Corner || vfStart[v] == vfStart[v + 1]) continue;
+			typename ParallelBVH<MeshType>::ClosestHit hit;
+			if (bvh.Closest(Point3f::Construct(pos[v]), std::numeric_limits<float>::max(), hit))
+				pos[v] = CoordType::Construct(hit.p);
+		}
+	}
+
+	// Write the result back in m, reusing the elements of the input.
+	void Store(MeshType &m)
+	{
+		const int vertNum = int(pos.size());
+		const int faceNum = FaceNum();
+		if (vertNum > origVertNum)
+			Allocator<MeshType>::AddVertices(m, vertNum - origVertNum);
+		if (faceNum > origFaceNum)
+			Allocator<MeshType>::AddFaces(m, faceNum - origFaceNum);
+
+		// attributes of the new elements are copied, before the sources change
+#pragma omp parallel for schedule(static)
+		for (int i = origVertNum; i < vertNum; ++i)
+			m.vert[i].ImportData(m.vert[vertSrc[i]]);
+#pragma omp parallel for schedule(static)
+		for (int f = origFaceNum; f < faceNum; ++f)
+			m.face[f].ImportData(m.face[faceSrc[f]]);
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+			if (!vertDead[i]) m.vert[i].P() = pos[i];
+#pragma omp parallel for schedule(static)
+		for (int f = 0; f < faceNum; ++f)
+		{
+			if (!Alive(f)) continue;
+			for (int k = 0; k < 3; ++k)
+				m.face[f].V(k) = &m.vert[tri[3 * f + k]];
+		}
+		for (int f = 0; f < faceNum; ++f)
+			if (!Alive(f) && !m.face[f].IsD())
+				Allocator<MeshType>::DeleteFace(m, m.face[f]);
+		for (int i = 0; i < vertNum; ++i)
+			if (vertDead[i] && !m.vert[i].IsD())
+				Allocator<MeshType>::DeleteVertex(m, m.vert[i]);
+		Allocator<MeshType>::CompactEveryVector(m);
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,450 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_SDF_H
+#define __ML_PARALLEL_SDF_H
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/create/marching_cubes.h>
+#include "ml_parallel_bvh.h"
+#include "ml_parallel_update.h"
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Sparse signed distance volume of a mesh and its isosurface, the same
+  resampling done by Resampler<>::Resample, computed by all the cores.
+
+  The volume is split in blocks of BlockSide^3 cells and only the blocks
+  nearer than maxDist to some face are ever touched, so the memory follows
+  the area of the surface and not the size of the volume. Each block is an
+  independent task: it samples the distance at its (BlockSide+1)^3 corners
+  with closest point queries on a ParallelBVH, runs the marching cubes on
+  its own cells and keeps only the triangles. The samples on the faces
+  shared by two blocks are computed by both, with the same result, so the
+  vertices on the shared cell edges are welded afterwards by their global
+  edge key. Nothing depends on the number of threads.
+
+  As in Resampler the sign is taken from the face normal or, when the
+  closest point is on an edge or a vertex, from the interpolated vertex
+  normals; the distances farther than maxDist are not valid and the cells
+  touching them are skipped. The normals of the source mesh are updated
+  first; the vertex ones are angle weighted, that is the weighting that
+  gives the right sign also near sharp edges.
+*/
+template <class MeshType>
+class ParallelSignedDistance
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::VertexPointer  VertexPointer;
+	typedef typename MeshType::FaceType       FaceType;
+	typedef unsigned long long                KeyType;
+
+	static const int BlockSide = 8;
+
+	struct Info
+	{
+		int blockNum;        ///< blocks of the whole volume
+		int activeBlockNum;  ///< blocks near the surface, the only ones sampled
+	};
+
+	/** Build in newMesh the isosurface at offset of the distance field of
+	 * oldMesh sampled on the grid of volumeDim cells spanning volumeBox.
+	 * The parameters have the meaning they have in Resampler<>::Resample.
+	 */
+	static Info Resample(MeshType &oldMesh, MeshType &newMesh, const Box3<ScalarType> &volumeBox, const Point3i &volumeDim,
+	                     ScalarType maxDist, ScalarType offset, bool discretizeFlag, bool multiSampleFlag, bool absDistFlag,
+	                     CallBackPos *cb = 0)
+	{
+		Volume vol;
+		vol.src = &oldMesh;
+		vol.origin = volumeBox.min;
+		vol.dim = volumeDim;
+		for (int k = 0; k < 3; ++k)
+		{
+			vol.voxel[k] = volumeBox.Dim()[k] / volumeDim[k];
+			vol.blocks[k] = (volumeDim[k] + BlockSide - 1) / BlockSide;
+		}
+		vol.maxDist = maxDist;
+		vol.offset = offset;
+		vol.discretize = discretizeFlag;
+		vol.multiSample = multiSampleFlag;
+		vol.absDist = absDistFlag;
+
+		if (cb) cb(0, "Building the BVH");
+		ParallelUpdateNormal<MeshType>::PerFaceNormalized(oldMesh);
+		ParallelUpdateNormal<MeshType>::PerVertexAngleWeighted(oldMesh);
+		vol.bvh.Set(oldMesh);
+
+		if (cb) cb(5, "Finding the blocks near the surface");
+		std::vector<int> active;
+		ActiveBlocks(vol, active);
+		Info info;
+		info.blockNum = vol.blocks[0] * vol.blocks[1] * vol.blocks[2];
+		info.activeBlockNum = int(active.size());
+
+		const int activeNum = int(active.size());
+		std::vector<BlockOut> out(activeNum);
+		std::atomic<int> done(0);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int b = 0; b < activeNum; ++b)
+		{
+			ProcessBlock(vol, active[b], out[b]);
+			const int d = ++done;
+			if (cb && MLParallel::ThreadId() == 0) cb(10 + 85 * d / activeNum, "Sampling the distance field");
+		}
+
+		if (cb) cb(95, "Welding the blocks");
+		Weld(out, newMesh);
+		OrientOutside(newMesh);
+		return info;
+	}
+
+private:
+	static KeyType NoKey() { return ~KeyType(0); }
+
+	struct Volume
+	{
+		MeshType *src;
+		ParallelBVH<MeshType> bvh;
+		CoordType origin;
+		CoordType voxel;
+		Point3i dim;      // cells
+		Point3i blocks;
+		ScalarType maxDist;
+		ScalarType offset;
+		bool discretize;
+		bool multiSample;
+		bool absDist;
+
+		CoordType Pos(const Point3i &p) const
+		{
+			return CoordType(origin[0] + p[0] * voxel[0], origin[1] + p[1] * voxel[1], origin[2] + p[2] * voxel[2]);
+		}
+		// the edge from p along axis
+		KeyType EdgeKey(const Point3i &p, int axis) const
+		{
+			return ((KeyType(p[0]) * (dim[1] + 1) + p[1]) * (dim[2] + 1) + p[2]) * 3 + axis;
+		}
+	};
+
+	struct BlockOut
+	{
+		std::vector<CoordType> pos;
+		std::vector<KeyType> key;
+		std::vector<int> tri;
+	};
+
+	/* A block is active when its box is within maxDist of the plane of a
+	 * face whose inflated box overlaps it; a conservative test, the exact
+	 * distance is the job of the samples.
+	 */
+	static void ActiveBlocks(const Volume &vol, std::vector<int> &active)
+	{
+		const MeshType &m = *vol.src;
+		const int blockNum = vol.blocks[0] * vol.blocks[1] * vol.blocks[2];
+		std::unique_ptr<std::atomic<unsigned char>[]> flag(new std::atomic<unsigned char>[blockNum]());
+		const CoordType blockDim = vol.voxel * ScalarType(BlockSide);
+		const ScalarType halfDiag = blockDim.Norm() / 2;
+		const int faceNum = int(m.face.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int fi = 0; fi < faceNum; ++fi)
+		{
+			const FaceType &f = m.face[fi];
+			if (f.IsD()) continue;
+			Box3<ScalarType> fb;
+			for (int j = 0; j < 3; ++j)
+				fb.Add(f.cP(j));
+			fb.Offset(vol.maxDist);
+			CoordType n = (f.cP(1) - f.cP(0)) ^ (f.cP(2) - f.cP(0));
+			const ScalarType nl = n.Norm();
+			if (nl > 0) n /= nl;
+			Point3i bmin, bmax;
+			for (int k = 0; k < 3; ++k)
+			{
+				bmin[k] = std::max(0, int(std::floor((fb.min[k] - vol.origin[k]) / blockDim[k])));
+				bmax[k] = std::min(vol.blocks[k] - 1, int(std::floor((fb.max[k] - vol.origin[k]) / blockDim[k])));
+			}
+			for (int z = bmin[2]; z <= bmax[2]; ++z)
+				for (int y = bmin[1]; y <= bmax[1]; ++y)
+					for (int x = bmin[0]; x <= bmax[0]; ++x)
+					{
+						const int bi = (z * vol.blocks[1] + y) * vol.blocks[0] + x;
+						if (flag[bi].load(std::memory_order_relaxed)) continue;
+						if (nl > 0)
+						{
+							const CoordType c(vol.origin[0] + (x + ScalarType(0.5)) * blockDim[0],
+							                  vol.origin[1] + (y + ScalarType(0.5)) * blockDim[1],
+							                  vol.origin[2] + (z + ScalarType(0.5)) * blockDim[2]);
+							if (std::fabs(n * (c - f.cP(0))) > vol.maxDist + halfDiag) continue;
+						}
+						flag[bi].store(1, std::memory_order_relaxed);
+					}
+		}
+		for (int bi = 0; bi < blockNum; ++bi)
+			if (flag[bi].load(std::memory_order_relaxed)) active.push_back(bi);
+	}
+
+	// signed (or absolute) distance minus offset, max() if farther than maxDist
+	static ScalarType Distance(const Volume &vol, const CoordType &p)
+	{
+		typename ParallelBVH<MeshType>::ClosestHit hit;
+		if (!vol.bvh.Closest(Point3f::Construct(p), float(vol.maxDist), hit))
+			return std::numeric_limits<ScalarType>::max();
+		ScalarType dist = ScalarType(hit.dist);
+		if (!vol.absDist)
+		{
+			const FaceType &f = vol.src->face[hit.face];
+			const CoordType q = CoordType::Construct(hit.p);
+			const CoordType dir = p - q;
+			const ScalarType eps = ScalarType(0.00001);
+			CoordType bary;
+			CoordType nrm;
+			// near an edge or a vertex, or on a degenerate face, the face normal is not reliable
+			if (!Barycentric(f, q, bary) || bary[0] < eps || bary[1] < eps || bary[2] < eps)
+				nrm = f.cV(0)->cN() * bary[0] + f.cV(1)->cN() * bary[1] + f.cV(2)->cN() * bary[2];
+			else
+				nrm = f.cN();
+			if (dir * nrm < 0) dist = -dist;
+		}
+		return dist - vol.offset;
+	}
+
+	// false, with equal weights, if the face has no area
+	static bool Barycentric(const FaceType &f, const CoordType &q, CoordType &bary)
+	{
+		const CoordType n = (f.cP(1) - f.cP(0)) ^ (f.cP(2) - f.cP(0));
+		const ScalarType area2 = n * n;
+		if (area2 <= 0)
+		{
+			bary = CoordType(ScalarType(1) / 3, ScalarType(1) / 3, ScalarType(1) / 3);
+			return false;
+		}
+		const ScalarType b0 = (((f.cP(1) - q) ^ (f.cP(2) - q)) * n) / area2;
+		const ScalarType b1 = (((f.cP(2) - q) ^ (f.cP(0) - q)) * n) / area2;
+		bary = CoordType(b0, b1, 1 - b0 - b1);
+		return true;
+	}
+
+	static ScalarType Sample(const Volume &vol, const Point3i &g)
+	{
+		const CoordType p = vol.Pos(g);
+		if (!vol.multiSample)
+			return Distance(vol, p);
+		// average of the center and of six points a quarter of voxel away
+		ScalarType sum = 0;
+		int cnt = 0;
+		for (int s = 0; s < 7; ++s)
+		{
+			CoordType q = p;
+			if (s > 0) q[(s - 1) / 2] += vol.voxel[(s - 1) / 2] * ((s % 2) ? ScalarType(0.25) : ScalarType(-0.25));
+			const ScalarType d = Distance(vol, q);
+			if (d == std::numeric_limits<ScalarType>::max()) continue;
+			sum += d;
+			++cnt;
+		}
+		return (cnt == 0) ? std::numeric_limits<ScalarType>::max() : sum / cnt;
+	}
+
+	/* Walker of the marching cubes on the samples of a single block; the
+	 * intercepts are made once per cell edge and remember their global key.
+	 */
+	class BlockWalker
+	{
+	public:
+		static const int Side = BlockSide + 1;
+
+		BlockWalker(const Volume &v, const Point3i &o, MeshType &m) : vol(v), org(o), mesh(m)
+		{
+			val.resize(Side * Side * Side);
+			edgeVert.assign(3 * Side * Side * Side, -1);
+		}
+
+		int Index(const Point3i &g) const { return ((g[2] - org[2]) * Side + (g[1] - org[1])) * Side + (g[0] - org[0]); }
+		ScalarType &Val(const Point3i &g) { return val[Index(g)]; }
+		bool Valid(const Point3i &g) const { return val[Index(g)] != std::numeric_limits<ScalarType>::max(); }
+
+		float V(int i, int j, int k) const { return float(val[Index(Point3i(i, j, k))]); }
+
+		bool Exist(const Point3i &p0, const Point3i &p1, VertexPointer &v)
+		{
+			const int e = EdgeIndex(p0, p1);
+			v = (edgeVert[e] < 0) ? 0 : &mesh.vert[edgeVert[e]];
+			return v != 0;
+		}
+		void GetXIntercept(const Point3i &p1, const Point3i &p2, VertexPointer &v) { Intercept(p1, p2, v); }
+		void GetYIntercept(const Point3i &p1, const Point3i &p2, VertexPointer &v) { Intercept(p1, p2, v); }
+		void GetZIntercept(const Point3i &p1, const Point3i &p2, VertexPointer &v) { Intercept(p1, p2, v); }
+
+		std::vector<KeyType> key;   // global edge key of each vertex of mesh
+
+	private:
+		int EdgeIndex(const Point3i &p0, const Point3i &p1) const
+		{
+			const int axis = (p0[0] != p1[0]) ? 0 : (p0[1] != p1[1]) ? 1 : 2;
+			const Point3i lo(std::min(p0[0], p1[0]), std::min(p0[1], p1[1]), std::min(p0[2], p1[2]));
+			return Index(lo) * 3 + axis;
+		}
+
+		void Intercept(const Point3i &p1, const Point3i &p2, VertexPointer &v)
+		{
+			const int e = EdgeIndex(p1, p2);
+			if (edgeVert[e] < 0)
+			{
+				edgeVert[e] = int(mesh.vert.size());
+				Allocator<MeshType>::AddVertices(mesh, 1);
+				const ScalarType v1 = val[Index(p1)], v2 = val[Index(p2)];
+				const ScalarType t = (vol.discretize || v1 == v2) ? ScalarType(0.5) : v1 / (v1 - v2);
+				mesh.vert.back().P() = vol.Pos(p1) + (vol.Pos(p2) - vol.Pos(p1)) * t;
+				key.resize(mesh.vert.size(), NoKey());
+				const Point3i lo(std::min(p1[0], p2[0]), std::min(p1[1], p2[1]), std::min(p1[2], p2[2]));
+				key.back() = vol.EdgeKey(lo, e % 3);
+			}
+			v = &mesh.vert[edgeVert[e]];
+		}
+
+		const Volume &vol;
+		Point3i org;
+		MeshType &mesh;
+		std::vector<ScalarType> val;
+		std::vector<int> edgeVert;
+	};
+
+	static void ProcessBlock(const Volume &vol, int bi, BlockOut &out)
+	{
+		const Point3i b(bi % vol.blocks[0], (bi / vol.blocks[0]) % vol.blocks[1], bi / (vol.blocks[0] * vol.blocks[1]));
+		const Point3i org = b * BlockSide;
+		Point3i end;
+		for (int k = 0; k < 3; ++k)
+			end[k] = std::min(org[k] + BlockSide, vol.dim[k]);
+
+		MeshType local;
+		BlockWalker walker(vol, org, local);
+		bool neg = false, pos = false;
+		for (int z = org[2]; z <= end[2]; ++z)
+			for (int y = org[1]; y <= end[1]; ++y)
+				for (int x = org[0]; x <= end[0]; ++x)
+				{
+					const Point3i g(x, y, z);
+					const ScalarType d = Sample(vol, g);
+					walker.Val(g) = d;
+					if (d == std::numeric_limits<ScalarType>::max()) continue;
+					if (d < 0) neg = true;
+					else pos = true;
+				}
+		if (!(neg && pos)) return;
+
+		MarchingCubes<MeshType, BlockWalker> mc(local, walker);
+		mc.Initialize();
+		for (int z = org[2]; z < end[2]; ++z)
+			for (int y = org[1]; y < end[1]; ++y)
+				for (int x = org[0]; x < end[0]; ++x)
+				{
+					const Point3i p1(x, y, z), p2(x + 1, y + 1, z + 1);
+					bool valid = true;
+					for (int c = 0; c < 8 && valid; ++c)
+						valid = walker.Valid(Point3i((c & 1) ? p2[0] : p1[0], (c & 2) ? p2[1] : p1[1], (c & 4) ? p2[2] : p1[2]));
+					if (valid) mc.ProcessCell(p1, p2);
+				}
+		mc.Finalize();
+
+		// vertices added by the marching cubes inside a cell are not shared
+		walker.key.resize(local.vert.size(), NoKey());
+		out.key.swap(walker.key);
+		out.pos.resize(local.vert.size());
+		for (size_t i = 0; i < local.vert.size(); ++i)
+			out.pos[i] = local.vert[i].cP();
+		out.tri.reserve(local.face.size() * 3);
+		for (size_t i = 0; i < local.face.size(); ++i)
+			for (int j = 0; j < 3; ++j)
+				out.tri.push_back(int(tri::Index(local, local.face[i].cV(j))));
+	}
+
+	// merge the vertices with the same edge key, in block order
+	static void Weld(std::vector<BlockOut> &out, MeshType &m)
+	{
+		const int blockNum = int(out.size());
+		std::vector<int> triOffset(blockNum + 1, 0);
+		for (int b = 0; b < blockNum; ++b)
+			triOffset[b] = int(out[b].tri.size()) / 3;
+		const int triTot = MLParallel::ExclusiveScan(triOffset);
+		std::vector<int> vertOffset, welded;
+		std::vector< std::pair<int, int> > source;
+		const int weldNum = MLParallel::Weld(out, NoKey(), vertOffset, welded, source);
+
+		const int vertBase = int(m.vert.size());
+		const int faceBase = int(m.face.size());
+		if (weldNum > 0) Allocator<MeshType>::AddVertices(m, weldNum);
+		if (triTot > 0) Allocator<MeshType>::AddFaces(m, triTot);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < weldNum; ++i)
+			m.vert[vertBase + i].P() = out[source[i].first].pos[source[i].second];
+#pragma omp parallel for schedule(dynamic, 64)
+		for (int b = 0; b < blockNum; ++b)
+		{
+			const std::vector<int> &t = out[b].tri;
+			for (int i = 0; i < int(t.size()); ++i)
+				m.face[faceBase + triOffset[b] + i / 3].V(i % 3) = &m.vert[vertBase + welded[vertOffset[b] + t[i]]];
+		}
+	}
+
+	// the marching cubes convention aside, the surface must enclose a positive volume
+	static void OrientOutside(MeshType &m)
+	{
+		const int faceNum = int(m.face.size());
+		const int chunkNum = (faceNum < MLParallel::MinParallelSize) ? 1 : MLParallel::ThreadNum();
+		const std::vector<int> bnd = MLParallel::Chunks(faceNum, chunkNum);
+		std::vector<double> partial(chunkNum, 0);
+#pragma omp parallel for schedule(static, 1)
+		for (int c = 0; c < chunkNum; ++c)
+			for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+			{
+				const FaceType &f = m.face[i];
+				if (f.IsD()) continue;
+				partial[c] += double(f.cP(0) * (f.cP(1) ^ f.cP(2)));
+			}
+		double vol = 0;
+		for (int c = 0; c < chunkNum; ++c)
+			vol += partial[c];
+		if (vol >= 0) return;
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+			if (!m.face[i].IsD())
+				std::swap(m.face[i].V(1), m.face[i].V(2));
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
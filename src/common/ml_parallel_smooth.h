@@ -0,0 +1,444 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_SMOOTH_H
+#define __ML_PARALLEL_SMOOTH_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <vcg/space/triangle3.h>
+#include "ml_parallel_topology.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Multithreaded versions of the tri::Smooth<> vertex smoothing functions.
+
+  The face loops of tri::Smooth<> scatter the contributions of each edge on
+  its two vertices. Here the vertex-face adjacency is built once per call
+  as a CSR table and every iteration is a parallel gather over the vertices
+  that visits the incident faces in increasing index order, exactly the
+  order in which the serial face loop scatters them. For this reason the
+  Laplacian, Taubin, HC and scale dependent versions give bit-identical
+  results to the serial ones; the normal smoothing step of the two-step
+  smoothing only differs for the summation order of the normals.
+
+  As in tri::Smooth<> the border of the mesh is given by the face border
+  flags and, with the exception of the two-step smoothing, no vcg topology
+  is needed.
+*/
+template <class MeshType>
+class ParallelSmooth
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::FaceType       FaceType;
+
+	class LaplacianInfo
+	{
+	public:
+		CoordType sum;
+		ScalarType cnt;
+	};
+
+	class HCSmoothInfo
+	{
+	public:
+		CoordType dif;
+		CoordType sum;
+		int cnt;
+	};
+
+	class ScaleLaplacianInfo
+	{
+	public:
+		CoordType PntSum;
+		ScalarType LenSum;
+	};
+
+	/// Same as Smooth<>::VertexCoordLaplacian
+	static void VertexCoordLaplacian(MeshType &m, int step, bool SmoothSelected = false, bool cotangentWeight = false, vcg::CallBackPos *cb = 0)
+	{
+		std::vector<int> vfOffset, vfFace;
+		ParallelTopology<MeshType>::VertexFaceCSR(m, vfOffset, vfFace);
+		std::vector<LaplacianInfo> TD(m.vert.size());
+		std::vector<float> edgeWeight;
+		const int vertNum = int(m.vert.size());
+		for (int i = 0; i < step; ++i)
+		{
+			if (cb) cb(100 * i / step, "Classic Laplacian Smoothing");
+			AccumulateLaplacianInfo(m, vfOffset, vfFace, TD, edgeWeight, cotangentWeight);
+#pragma omp parallel for schedule(static)
+			for (int vi = 0; vi < vertNum; ++vi)
+			{
+				VertexType &v = m.vert[vi];
+				if (!v.IsD() && TD[vi].cnt > 0)
+				{
+					if (!SmoothSelected || v.IsS())
+						v.P() = (v.P() + TD[vi].sum) / (TD[vi].cnt + 1);
+				}
+			}
+		}
+	}
+
+	/// Same as Smooth<>::VertexCoordTaubin
+	static void VertexCoordTaubin(MeshType &m, int step, float lambda, float mu, bool SmoothSelected = false, vcg::CallBackPos *cb = 0)
+	{
+		std::vector<int> vfOffset, vfFace;
+		ParallelTopology<MeshType>::VertexFaceCSR(m, vfOffset, vfFace);
+		std::vector<LaplacianInfo> TD(m.vert.size());
+		std::vector<float> edgeWeight;
+		const int vertNum = int(m.vert.size());
+		for (int i = 0; i < step; ++i)
+		{
+			if (cb) cb(100 * i / step, "Taubin Smoothing");
+			for (int pass = 0; pass < 2; ++pass)
+			{
+				const float factor = (pass == 0) ? lambda : mu;
+				AccumulateLaplacianInfo(m, vfOffset, vfFace, TD, edgeWeight, false);
+#pragma omp parallel for schedule(static)
+				for (int vi = 0; vi < vertNum; ++vi)
+				{
+					VertexType &v = m.vert[vi];
+					if (!v.IsD() && TD[vi].cnt > 0)
+					{
+						if (!SmoothSelected || v.IsS())
+						{
+							CoordType Delta = TD[vi].sum / TD[vi].cnt - v.P();
+							v.P() = v.P() + Delta * factor;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/** Same as Smooth<>::VertexCoordLaplacianHC.
+	 * Unreferenced vertices are left untouched (the serial version divides by zero on them).
+	 */
+	static void VertexCoordLaplacianHC(MeshType &m, int step, bool SmoothSelected = false)
+	{
+		const ScalarType beta = 0.5;
+		std::vector<int> vfOffset, vfFace;
+		ParallelTopology<MeshType>::VertexFaceCSR(m, vfOffset, vfFace);
+		std::vector<HCSmoothInfo> TD(m.vert.size());
+		const int vertNum = int(m.vert.size());
+		for (int i = 0; i < step; ++i)
+		{
+			// First Loop compute the laplacian
+#pragma omp parallel for schedule(static)
+			for (int vi = 0; vi < vertNum; ++vi)
+			{
+				HCSmoothInfo &hi = TD[vi];
+				hi.sum = CoordType(0, 0, 0);
+				hi.dif = CoordType(0, 0, 0);
+				hi.cnt = 0;
+				const VertexType *vp = &m.vert[vi];
+				for (int k = vfOffset[vi]; k < vfOffset[vi + 1]; ++k)
+				{
+					if (k > vfOffset[vi] && vfFace[k] == vfFace[k - 1]) continue;
+					const FaceType &f = m.face[vfFace[k]];
+					for (int j = 0; j < 3; ++j)
+					{
+						// a border edge is counted twice
+						const int times = f.IsB(j) ? 2 : 1;
+						for (int t = 0; t < times; ++t)
+						{
+							if (f.cV0(j) == vp) hi.sum += f.cP1(j);
+							if (f.cV1(j) == vp) hi.sum += f.cP0(j);
+							if (f.cV0(j) == vp) ++hi.cnt;
+							if (f.cV1(j) == vp) ++hi.cnt;
+						}
+					}
+				}
+				if (hi.cnt > 0)
+					hi.sum /= (float)hi.cnt;
+			}
+
+			// Second Loop compute average difference
+#pragma omp parallel for schedule(static)
+			for (int vi = 0; vi < vertNum; ++vi)
+			{
+				HCSmoothInfo &hi = TD[vi];
+				const VertexType *vp = &m.vert[vi];
+				for (int k = vfOffset[vi]; k < vfOffset[vi + 1]; ++k)
+				{
+					if (k > vfOffset[vi] && vfFace[k] == vfFace[k - 1]) continue;
+					const FaceType &f = m.face[vfFace[k]];
+					for (int j = 0; j < 3; ++j)
+					{
+						const int times = f.IsB(j) ? 2 : 1;
+						for (int t = 0; t < times; ++t)
+						{
+							if (f.cV0(j) == vp) hi.dif += TD[tri::Index(m, f.cV1(j))].sum - f.cP1(j);
+							if (f.cV1(j) == vp) hi.dif += TD[tri::Index(m, f.cV0(j))].sum - f.cP0(j);
+						}
+					}
+				}
+			}
+
+#pragma omp parallel for schedule(static)
+			for (int vi = 0; vi < vertNum; ++vi)
+			{
+				HCSmoothInfo &hi = TD[vi];
+				VertexType &v = m.vert[vi];
+				if (hi.cnt == 0) continue;
+				hi.dif /= (float)hi.cnt;
+				if (!SmoothSelected || v.IsS())
+					v.P() = hi.sum - (hi.sum - v.P()) * beta + (hi.dif) * beta;
+			}
+		}
+	}
+
+	/// Same as Smooth<>::VertexCoordScaleDependentLaplacian_Fujiwara
+	static void VertexCoordScaleDependentLaplacian_Fujiwara(MeshType &m, int step, ScalarType delta)
+	{
+		std::vector<int> vfOffset, vfFace;
+		ParallelTopology<MeshType>::VertexFaceCSR(m, vfOffset, vfFace);
+		std::vector<ScaleLaplacianInfo> TD(m.vert.size());
+		const int vertNum = int(m.vert.size());
+		for (int i = 0; i < step; ++i)
+		{
+#pragma omp parallel for schedule(static)
+			for (int vi = 0; vi < vertNum; ++vi)
+			{
+				ScaleLaplacianInfo &si = TD[vi];
+				const VertexType *vp = &m.vert[vi];
+				// vertices on a border edge are averaged only along the border
+				bool border = false;
+				for (int pass = 0; pass < 2; ++pass)
+				{
+					si.PntSum = CoordType(0, 0, 0);
+					si.LenSum = 0;
+					for (int k = vfOffset[vi]; k < vfOffset[vi + 1]; ++k)
+					{
+						if (k > vfOffset[vi] && vfFace[k] == vfFace[k - 1]) continue;
+						const FaceType &f = m.face[vfFace[k]];
+						for (int j = 0; j < 3; ++j)
+						{
+							if (f.cV0(j) != vp && f.cV1(j) != vp) continue;
+							if (f.IsB(j) != (pass == 1))
+							{
+								if (f.IsB(j)) border = true;
+								continue;
+							}
+							CoordType edge = f.cP1(j) - f.cP0(j);
+							ScalarType len = Norm(edge);
+							edge /= len;
+							if (f.cV0(j) == vp) si.PntSum += edge;
+							if (f.cV1(j) == vp) si.PntSum -= edge;
+							if (f.cV0(j) == vp) si.LenSum += len;
+							if (f.cV1(j) == vp) si.LenSum += len;
+						}
+					}
+					if (!border) break;
+				}
+			}
+
+			// The second cycle that add the new positions
+#pragma omp parallel for schedule(static)
+			for (int vi = 0; vi < vertNum; ++vi)
+			{
+				VertexType &v = m.vert[vi];
+				if (!v.IsD() && TD[vi].LenSum > 0)
+					v.P() = v.P() + (TD[vi].PntSum / TD[vi].LenSum) * delta;
+			}
+		}
+	}
+
+	/** Same as Smooth<>::VertexCoordPasoDoble, the two steps (normal smoothing + vertex fitting)
+	 * smoothing of Belyaev and Ohtake. Face normals must be already computed and normalized.
+	 * It does not need the VF topology.
+	 */
+	static void VertexCoordPasoDoble(MeshType &m, int NormalSmoothStep, ScalarType Sigma = 0, int FitStep = 10, bool SmoothSelected = false)
+	{
+		std::vector<int> vfOffset, vfFace;
+		ParallelTopology<MeshType>::VertexFaceCSR(m, vfOffset, vfFace);
+		for (int j = 0; j < NormalSmoothStep; ++j)
+			FaceNormalAngleThreshold(m, vfOffset, vfFace, Sigma);
+		for (int j = 0; j < FitStep; ++j)
+			FitMesh(m, vfOffset, vfFace, SmoothSelected);
+	}
+
+private:
+	static void AccumulateLaplacianInfo(MeshType &m, const std::vector<int> &vfOffset, const std::vector<int> &vfFace,
+		std::vector<LaplacianInfo> &TD, std::vector<float> &edgeWeight, bool cotangentFlag)
+	{
+		const int faceNum = int(m.face.size());
+		const int vertNum = int(m.vert.size());
+		if (cotangentFlag)
+		{
+			edgeWeight.resize(size_t(faceNum) * 3);
+#pragma omp parallel for schedule(static)
+			for (int fi = 0; fi < faceNum; ++fi)
+			{
+				const FaceType &f = m.face[fi];
+				if (f.IsD()) continue;
+				for (int j = 0; j < 3; ++j)
+				{
+					float angle = Angle(f.cP1(j) - f.cP2(j), f.cP0(j) - f.cP2(j));
+					edgeWeight[size_t(fi) * 3 + j] = tan((M_PI * 0.5) - angle);
+				}
+			}
+		}
+
+#pragma omp parallel for schedule(static)
+		for (int vi = 0; vi < vertNum; ++vi)
+		{
+			LaplacianInfo &li = TD[vi];
+			li.sum = CoordType(0, 0, 0);
+			li.cnt = 0;
+			const VertexType *vp = &m.vert[vi];
+			bool border = false;
+			for (int k = vfOffset[vi]; k < vfOffset[vi + 1]; ++k)
+			{
+				if (k > vfOffset[vi] && vfFace[k] == vfFace[k - 1]) continue;
+				const int fi = vfFace[k];
+				const FaceType &f = m.face[fi];
+				for (int j = 0; j < 3; ++j)
+				{
+					if (f.cV0(j) != vp && f.cV1(j) != vp) continue;
+					if (f.IsB(j))
+					{
+						border = true;
+						continue;
+					}
+					const float weight = cotangentFlag ? edgeWeight[size_t(fi) * 3 + j] : 1.0f;
+					if (f.cV0(j) == vp) li.sum += f.cP1(j) * weight;
+					if (f.cV1(j) == vp) li.sum += f.cP0(j) * weight;
+					if (f.cV0(j) == vp) li.cnt += weight;
+					if (f.cV1(j) == vp) li.cnt += weight;
+				}
+			}
+
+			// if the vertex is on a border edge it is averaged only with its border neighbours
+			if (border)
+			{
+				li.sum = vp->cP();
+				li.cnt = 1;
+				for (int k = vfOffset[vi]; k < vfOffset[vi + 1]; ++k)
+				{
+					if (k > vfOffset[vi] && vfFace[k] == vfFace[k - 1]) continue;
+					const FaceType &f = m.face[vfFace[k]];
+					for (int j = 0; j < 3; ++j)
+						if (f.IsB(j))
+						{
+							if (f.cV0(j) == vp) li.sum += f.cV1(j)->cP();
+							if (f.cV1(j) == vp) li.sum += f.cV0(j)->cP();
+							if (f.cV0(j) == vp) ++li.cnt;
+							if (f.cV1(j) == vp) ++li.cnt;
+						}
+				}
+			}
+		}
+	}
+
+	// Each face normal is replaced by the weighted average of the normals of the
+	// faces sharing a vertex with it: the more similar the normals, the larger the weight.
+	static void FaceNormalAngleThreshold(MeshType &m, const std::vector<int> &vfOffset, const std::vector<int> &vfFace, ScalarType sigma)
+	{
+		const int faceNum = int(m.face.size());
+		std::vector<CoordType> newNormal(faceNum);
+#pragma omp parallel
+		{
+			std::vector<int> ring;
+#pragma omp for schedule(dynamic, 1024)
+			for (int fi = 0; fi < faceNum; ++fi)
+			{
+				const FaceType &f = m.face[fi];
+				if (f.IsD()) continue;
+				ring.clear();
+				for (int i = 0; i < 3; ++i)
+				{
+					const int vi = int(tri::Index(m, f.cV(i)));
+					ring.insert(ring.end(), vfFace.begin() + vfOffset[vi], vfFace.begin() + vfOffset[vi + 1]);
+				}
+				std::sort(ring.begin(), ring.end());
+				ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+
+				CoordType normalSum = CoordType(0, 0, 0);
+				for (size_t k = 0; k < ring.size(); ++k)
+				{
+					const FaceType &ff = m.face[ring[k]];
+					if (sigma > 0)
+					{
+						ScalarType cosang = ff.cN().dot(f.cN());
+						cosang = math::Clamp(cosang, ScalarType(0.0001), ScalarType(1.f));
+						if (cosang >= sigma)
+						{
+							ScalarType w = cosang - sigma;
+							normalSum += ff.cN() * (w * w);   // similar normals have a higher weight
+						}
+					}
+					else normalSum += ff.cN();
+				}
+				normalSum.Normalize();
+				newNormal[fi] = normalSum;
+			}
+		}
+#pragma omp parallel for schedule(static)
+		for (int fi = 0; fi < faceNum; ++fi)
+			if (!m.face[fi].IsD())
+				m.face[fi].N() = newNormal[fi];
+	}
+
+	// Move each vertex so that it best fits the planes of its incident faces.
+	// The faces are summed in increasing index order, Smooth<>::FitMesh follows
+	// the VF list, so the results can differ in the last bits.
+	static void FitMesh(MeshType &m, const std::vector<int> &vfOffset, const std::vector<int> &vfFace, bool OnlySelected)
+	{
+		const int vertNum = int(m.vert.size());
+		std::vector<CoordType> np(vertNum);
+#pragma omp parallel for schedule(static)
+		for (int vi = 0; vi < vertNum; ++vi)
+		{
+			const VertexType &v = m.vert[vi];
+			np[vi] = v.cP();
+			if (v.IsD() || vfOffset[vi] == vfOffset[vi + 1]) continue;
+			CoordType Sum(0, 0, 0);
+			ScalarType cnt = 0;
+			for (int k = vfOffset[vi]; k < vfOffset[vi + 1]; ++k)
+			{
+				const FaceType &f = m.face[vfFace[k]];
+				CoordType bc = Barycenter(f);
+				Sum += f.cN() * (f.cN().dot(bc - v.cP()));
+				++cnt;
+			}
+			np[vi] = v.cP() + Sum * (1.0 / cnt);
+		}
+#pragma omp parallel for schedule(static)
+		for (int vi = 0; vi < vertNum; ++vi)
+			if (!OnlySelected || m.vert[vi].IsS())
+				m.vert[vi].P() = np[vi];
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,490 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_SUBDIVISION_H
+#define __ML_PARALLEL_SUBDIVISION_H
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/refine.h>
+#include <vcg/complex/algorithms/update/topology.h>
+#include "ml_parallel_topology.h"
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Subdivision steps computed in parallel on the whole mesh at once.
+
+  RefineE and RefineOddEven walk the faces one after the other, adding the
+  vertices and the faces as they go. Here the edges to split are numbered
+  first (each one by the face of lowest index that has it), the number of
+  new vertices and faces is then known and the mesh is grown only once;
+  after that every new vertex and every face split only depend on the old
+  mesh and are computed in parallel. The usual vcg midpoint and even point
+  functors give the positions: each thread works on its own copy of them,
+  as some of them keep scratch data.
+
+  The mesh must be compact and have FF adjacency, that is rebuilt at the
+  end, with the face border flags.
+*/
+template <class MeshType>
+class ParallelSubdivision
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+	typedef typename MeshType::CoordType      CoordType;
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::VertexPointer  VertexPointer;
+	typedef typename MeshType::FaceType       FaceType;
+	typedef typename FaceType::TexCoordType   TexCoordType;
+	typedef face::Pos<FaceType>               PosType;
+
+	/// As tri::Refine: the edges longer than thr are split with the given midpoint functor.
+	template <class MIDPOINT>
+	static bool Refine(MeshType &m, MIDPOINT mid, ScalarType thr = 0, bool selected = false, CallBackPos *cb = 0)
+	{
+		EdgeLen<MeshType, ScalarType> ep(thr);
+		return Subdivide(m, mid, NoEven(), false, ep, selected, cb);
+	}
+
+	/// As tri::RefineOddEven: also the old vertices of the faces refined are moved with the even functor.
+	template <class ODD_VERT, class EVEN_VERT>
+	static bool RefineOddEven(MeshType &m, ODD_VERT odd, EVEN_VERT even, ScalarType thr = 0, bool selected = false, CallBackPos *cb = 0)
+	{
+		EdgeLen<MeshType, ScalarType> ep(thr);
+		return Subdivide(m, odd, even, true, ep, selected, cb);
+	}
+
+	/** One step of 4-8 refinement of a tri/quad (faux edge) mesh, as
+	 * BitQuadCreation::MakePureByRefine: every triangle gets a vertex in its
+	 * barycenter and is split in three around it, every quad gets a vertex
+	 * in the midpoint of its faux diagonal, shared by its two triangles, and
+	 * is split in four around it. The old edges become the faux diagonals of
+	 * the new quads, and the border edges are split in their midpoint. The
+	 * result is a pure quad mesh; new vertices are linearly interpolated.
+	 */
+	static void RefineBitQuad(MeshType &m, CallBackPos *cb = 0)
+	{
+		const int faceNum = int(m.face.size());
+		// the center of a quad is made by the lower index of its two triangles
+		std::vector<int> vertOffset(faceNum + 1, 0), faceOffset(faceNum + 1, 0);
+#pragma omp parallel for schedule(static) if (faceNum >= MLParallel::MinParallelSize)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			const FaceType &f = m.face[i];
+			if (f.IsD()) continue;
+			const int fk = FauxEdge(f);
+			int borderNum = 0;
+			for (int k = 0; k < 3; ++k)
+				if (face::IsBorder(f, k)) ++borderNum;
+			const bool center = (fk < 0 || i < int(tri::Index(m, f.cFFp(fk))));
+			vertOffset[i] = (center ? 1 : 0) + borderNum;
+			faceOffset[i] = (fk < 0 ? 2 : 1) + borderNum;
+		}
+		const int vertBase = int(m.vert.size());
+		const int faceBase = int(m.face.size());
+		const int vertTot = MLParallel::ExclusiveScan(vertOffset);
+		const int faceTot = MLParallel::ExclusiveScan(faceOffset);
+		if (vertTot == 0) return;
+		Allocator<MeshType>::AddVertices(m, vertTot);
+		Allocator<MeshType>::AddFaces(m, faceTot);
+		if (cb) cb(30, "Refining...");
+
+		const bool hasWT = HasPerWedgeTexCoord(m);
+#pragma omp parallel for schedule(static) if (faceNum >= MLParallel::MinParallelSize)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			FaceType &f = m.face[i];
+			if (f.IsD()) continue;
+			const int fk = FauxEdge(f);
+
+			// corners 0..2 are the old vertices, 3 the center, 4.. the border midpoints
+			VertexPointer vp[7];
+			TexCoordType wt[7];
+			int mid[3] = { -1, -1, -1 };
+			for (int k = 0; k < 3; ++k)
+			{
+				vp[k] = f.V(k);
+				if (hasWT) wt[k] = f.WT(k);
+			}
+			int vi = vertBase + vertOffset[i];
+			if (fk < 0)
+			{
+				vp[3] = &m.vert[vi++];
+				Interpolate(m, *vp[3], vp, 3);
+				if (hasWT) wt[3] = Average(wt, 0, 1, 2);
+			}
+			else
+			{
+				const int j = int(tri::Index(m, f.cFFp(fk)));
+				if (i < j)
+				{
+					vp[3] = &m.vert[vi++];
+					VertexPointer ends[2] = { vp[fk], vp[(fk + 1) % 3] };
+					Interpolate(m, *vp[3], ends, 2);
+				}
+				else
+					vp[3] = &m.vert[vertBase + vertOffset[j]];
+				if (hasWT) wt[3] = Average(wt, fk, (fk + 1) % 3, -1);
+			}
+			int cornerNum = 4;
+			for (int k = 0; k < 3; ++k)
+				if (face::IsBorder(f, k))
+				{
+					VertexPointer ends[2] = { vp[k], vp[(k + 1) % 3] };
+					vp[cornerNum] = &m.vert[vi++];
+					Interpolate(m, *vp[cornerNum], ends, 2);
+					if (hasWT) wt[cornerNum] = Average(wt, k, (k + 1) % 3, -1);
+					mid[k] = cornerNum++;
+				}
+
+			// each child is {v0, v1, v2, faux edge}; the faux diagonal of a
+			// quad holds the center, so it gives no child of its own
+			int child[6][4];
+			int childNum = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				if (k == fk) continue;
+				const int a = k, b = (k + 1) % 3;
+				if (mid[k] < 0)
+				{
+					const int c[4] = { a, b, 3, 0 };
+					std::copy(c, c + 4, child[childNum++]);
+				}
+				else
+				{
+					const int c0[4] = { a, mid[k], 3, 1 };
+					const int c1[4] = { mid[k], b, 3, 2 };
+					std::copy(c0, c0 + 4, child[childNum++]);
+					std::copy(c1, c1 + 4, child[childNum++]);
+				}
+			}
+			for (int c = childNum - 1; c >= 0; --c)
+			{
+				FaceType &nf = (c == 0) ? f : m.face[faceBase + faceOffset[i] + c - 1];
+				if (c > 0) nf.ImportData(f);
+				for (int j = 0; j < 3; ++j)
+				{
+					nf.V(j) = vp[child[c][j]];
+					if (hasWT) nf.WT(j) = wt[child[c][j]];
+					nf.ClearF(j);
+				}
+				nf.SetF(child[c][3]);
+			}
+		}
+		if (cb) cb(70, "Refining...");
+		UpdateAdjacency(m);
+	}
+
+private:
+	struct NoEven
+	{
+		void operator()(VertexType &, PosType) {}
+	};
+
+	template <class ODD_VERT, class EVEN_VERT, class PREDICATE>
+	static bool Subdivide(MeshType &m, const ODD_VERT &odd, const EVEN_VERT &even, bool moveEven,
+	                      const PREDICATE &ep, bool selected, CallBackPos *cb)
+	{
+		const int faceNum = int(m.face.size());
+		const int vertNum = int(m.vert.size());
+
+		// the edges to split get the index of their new vertex from the face that owns them
+		std::vector<int> edgeVert(3 * faceNum + 1, 0);
+#pragma omp parallel for schedule(static) if (faceNum >= MLParallel::MinParallelSize)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			FaceType &f = m.face[i];
+			for (int k = 0; k < 3; ++k)
+			{
+				edgeVert[3 * i + k] = 0;
+				if (f.IsD() || !OwnsEdge(m, i, k)) continue;
+				if (selected && !f.IsS() && !f.FFp(k)->IsS()) continue;
+				if (ep(PosType(&f, k))) edgeVert[3 * i + k] = 1;
+			}
+		}
+		std::vector<char> owned(3 * faceNum);
+#pragma omp parallel for schedule(static) if (faceNum >= MLParallel::MinParallelSize)
+		for (int i = 0; i < 3 * faceNum; ++i)
+			owned[i] = char(edgeVert[i]);
+		const int newVertNum = MLParallel::ExclusiveScan(edgeVert);
+		if (newVertNum == 0) return false;
+#pragma omp parallel for schedule(static) if (faceNum >= MLParallel::MinParallelSize)
+		for (int i = 0; i < 3 * faceNum; ++i)
+			if (!owned[i]) edgeVert[i] = -1;
+		// the other face of each split edge takes the same vertex
+		std::vector<int> faceOffset(faceNum + 1, 0);
+#pragma omp parallel for schedule(static) if (faceNum >= MLParallel::MinParallelSize)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			const FaceType &f = m.face[i];
+			if (f.IsD()) continue;
+			int splitNum = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				if (!owned[3 * i + k])
+				{
+					const int g = int(tri::Index(m, f.cFFp(k)));
+					edgeVert[3 * i + k] = owned[3 * g + f.cFFi(k)] ? edgeVert[3 * g + f.cFFi(k)] : -1;
+				}
+				if (edgeVert[3 * i + k] >= 0) ++splitNum;
+			}
+			faceOffset[i] = splitNum;
+		}
+		const int newFaceNum = MLParallel::ExclusiveScan(faceOffset);
+		if (cb) cb(10, "Refining...");
+
+		// even vertices, from the old mesh: each one through its first corner
+		std::vector<VertexType> newEven;
+		std::vector<int> evenCorner;
+		if (moveEven)
+		{
+			std::vector< std::atomic<int> > corner(vertNum);
+#pragma omp parallel for schedule(static) if (vertNum >= MLParallel::MinParallelSize)
+			for (int i = 0; i < vertNum; ++i)
+				corner[i].store(INT_MAX, std::memory_order_relaxed);
+#pragma omp parallel for schedule(static) if (faceNum >= MLParallel::MinParallelSize)
+			for (int i = 0; i < faceNum; ++i)
+			{
+				const FaceType &f = m.face[i];
+				if (f.IsD() || (selected && !f.IsS())) continue;
+				for (int k = 0; k < 3; ++k)
+				{
+					std::atomic<int> &c = corner[tri::Index(m, f.cV(k))];
+					int cur = c.load(std::memory_order_relaxed);
+					while (3 * i + k < cur && !c.compare_exchange_weak(cur, 3 * i + k, std::memory_order_relaxed)) {}
+				}
+			}
+			evenCorner.resize(vertNum);
+			newEven.resize(vertNum);
+#pragma omp parallel if (vertNum >= MLParallel::MinParallelSize)
+			{
+				EVEN_VERT localEven(even);
+#pragma omp for schedule(static)
+				for (int i = 0; i < vertNum; ++i)
+				{
+					evenCorner[i] = corner[i].load(std::memory_order_relaxed);
+					if (evenCorner[i] != INT_MAX)
+						localEven(newEven[i], PosType(&m.face[evenCorner[i] / 3], evenCorner[i] % 3));
+				}
+			}
+		}
+		if (cb) cb(30, "Refining...");
+
+		// the mesh grows once, then the odd vertices are computed from the old ones
+		Allocator<MeshType>::AddVertices(m, newVertNum);
+		if (newFaceNum > 0) Allocator<MeshType>::AddFaces(m, newFaceNum);
+#pragma omp parallel if (faceNum >= MLParallel::MinParallelSize)
+		{
+			ODD_VERT localOdd(odd);
+#pragma omp for schedule(static)
+			for (int i = 0; i < faceNum; ++i)
+				for (int k = 0; k < 3; ++k)
+					if (owned[3 * i + k])
+						localOdd(m.vert[vertNum + edgeVert[3 * i + k]], PosType(&m.face[i], k));
+		}
+		if (moveEven)
+		{
+#pragma omp parallel for schedule(static) if (vertNum >= MLParallel::MinParallelSize)
+			for (int i = 0; i < vertNum; ++i)
+				if (evenCorner[i] != INT_MAX)
+					m.vert[i].P() = newEven[i].cP();
+		}
+		if (cb) cb(60, "Refining...");
+
+		const bool hasWT = HasPerWedgeTexCoord(m);
+		const bool hasWC = HasPerWedgeColor(m);
+#pragma omp parallel if (faceNum >= MLParallel::MinParallelSize)
+		{
+			ODD_VERT localOdd(odd);
+#pragma omp for schedule(static)
+			for (int i = 0; i < faceNum; ++i)
+			{
+				if (m.face[i].IsD()) continue;
+				const int *ev = &edgeVert[3 * i];
+				if (ev[0] < 0 && ev[1] < 0 && ev[2] < 0) continue;
+				SplitFace(m, i, ev, vertNum, faceNum + faceOffset[i], localOdd, hasWT, hasWC);
+			}
+		}
+		if (cb) cb(80, "Refining...");
+		UpdateAdjacency(m);
+		return true;
+	}
+
+	// an edge is owned by the face of lower index among the two sharing it
+	static bool OwnsEdge(const MeshType &m, int i, int k)
+	{
+		return int(tri::Index(m, m.face[i].cFFp(k))) >= i;
+	}
+
+	/* Split of a face given the new vertex on each of its edges (-1 if the
+	 * edge is not split), as RefineE does: 4 faces with three split edges, 2
+	 * with one, and 3 with two, cutting the quad along its shortest diagonal.
+	 * The face keeps the first piece, the others go from firstNew on.
+	 */
+	template <class ODD_VERT>
+	static void SplitFace(MeshType &m, int i, const int *ev, int vertBase, int firstNew, ODD_VERT &odd, bool hasWT, bool hasWC)
+	{
+		FaceType &f = m.face[i];
+		// corners 0..2 are the old vertices, 3+k the vertex on edge k
+		VertexPointer vp[6];
+		TexCoordType wt[6];
+		Color4b wc[6];
+		for (int k = 0; k < 3; ++k)
+		{
+			vp[k] = f.V(k);
+			if (hasWT) wt[k] = f.WT(k);
+			if (hasWC) wc[k] = f.WC(k);
+		}
+		int splitNum = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			if (ev[k] < 0) continue;
+			++splitNum;
+			vp[3 + k] = &m.vert[vertBase + ev[k]];
+			if (hasWT) wt[3 + k] = odd.WedgeInterp(wt[k], wt[(k + 1) % 3]);
+			if (hasWC) wc[3 + k].lerp(wc[k], wc[(k + 1) % 3], 0.5f);
+		}
+
+		int child[4][3];
+		int childNum = 0;
+		if (splitNum == 3)
+		{
+			const int c[4][3] = { { 0, 3, 5 }, { 3, 1, 4 }, { 5, 4, 2 }, { 3, 4, 5 } };
+			std::copy(&c[0][0], &c[0][0] + 12, &child[0][0]);
+			childNum = 4;
+		}
+		else if (splitNum == 1)
+		{
+			const int k = (ev[0] >= 0) ? 0 : (ev[1] >= 0 ? 1 : 2);
+			const int c[2][3] = { { k, 3 + k, (k + 2) % 3 }, { 3 + k, (k + 1) % 3, (k + 2) % 3 } };
+			std::copy(&c[0][0], &c[0][0] + 6, &child[0][0]);
+			childNum = 2;
+		}
+		else
+		{
+			// rotated so that the edge not split is the third one
+			const int r = (((ev[0] < 0) ? 0 : (ev[1] < 0 ? 1 : 2)) + 1) % 3;
+			const int v0 = r, v1 = (r + 1) % 3, v2 = (r + 2) % 3;
+			const int m0 = 3 + r, m1 = 3 + (r + 1) % 3;
+			const int c0[3] = { m0, v1, m1 };
+			std::copy(c0, c0 + 3, child[0]);
+			if (SquaredDistance(vp[v0]->cP(), vp[m1]->cP()) < SquaredDistance(vp[m0]->cP(), vp[v2]->cP()))
+			{
+				const int c[2][3] = { { v0, m0, m1 }, { v0, m1, v2 } };
+				std::copy(&c[0][0], &c[0][0] + 6, &child[1][0]);
+			}
+			else
+			{
+				const int c[2][3] = { { v0, m0, v2 }, { m0, m1, v2 } };
+				std::copy(&c[0][0], &c[0][0] + 6, &child[1][0]);
+			}
+			childNum = 3;
+		}
+
+		for (int c = childNum - 1; c >= 0; --c)
+		{
+			FaceType &nf = (c == 0) ? f : m.face[firstNew + c - 1];
+			if (c > 0) nf.ImportData(f);
+			for (int j = 0; j < 3; ++j)
+			{
+				nf.V(j) = vp[child[c][j]];
+				if (hasWT) nf.WT(j) = wt[child[c][j]];
+				if (hasWC) nf.WC(j) = wc[child[c][j]];
+			}
+		}
+	}
+
+	// the faux edge of a face that is half of a quad, -1 for a triangle
+	static int FauxEdge(const FaceType &f)
+	{
+		for (int k = 0; k < 3; ++k)
+			if (f.IsF(k) && !face::IsBorder(f, k))
+				return k;
+		return -1;
+	}
+
+	static void UpdateAdjacency(MeshType &m)
+	{
+		ParallelTopology<MeshType>::FaceFace(m);
+		const int faceNum = int(m.face.size());
+#pragma omp parallel for schedule(static) if (faceNum >= MLParallel::MinParallelSize)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			FaceType &f = m.face[i];
+			if (f.IsD()) continue;
+			for (int k = 0; k < 3; ++k)
+				if (face::IsBorder(f, k)) f.SetB(k);
+				else f.ClearB(k);
+		}
+		if (HasVFAdjacency(m)) UpdateTopology<MeshType>::VertexFace(m);
+	}
+
+	static void Interpolate(const MeshType &m, VertexType &nv, VertexPointer const *v, int n)
+	{
+		CoordType p(0, 0, 0);
+		for (int j = 0; j < n; ++j)
+			p += v[j]->cP();
+		nv.P() = p / ScalarType(n);
+		if (HasPerVertexNormal(m))
+		{
+			CoordType nrm(0, 0, 0);
+			for (int j = 0; j < n; ++j)
+				nrm += v[j]->cN();
+			nv.N() = nrm.Normalize();
+		}
+		if (HasPerVertexQuality(m))
+		{
+			typename VertexType::QualityType q = 0;
+			for (int j = 0; j < n; ++j)
+				q += v[j]->cQ();
+			nv.Q() = q / n;
+		}
+		if (HasPerVertexColor(m))
+		{
+			if (n == 2) nv.C().lerp(v[0]->cC(), v[1]->cC(), 0.5f);
+			else nv.C().lerp(v[0]->cC(), v[1]->cC(), v[2]->cC(), Point3f(1.0f / 3, 1.0f / 3, 1.0f / 3));
+		}
+	}
+
+	// average of two (c < 0) or three wedge coordinates, in the texture of the first one
+	static TexCoordType Average(TexCoordType *wt, int a, int b, int c)
+	{
+		TexCoordType t = wt[a];
+		if (c < 0)
+			t.P() = (wt[a].P() + wt[b].P()) / 2;
+		else
+			t.P() = (wt[a].P() + wt[b].P() + wt[c].P()) / 3;
+		return t;
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
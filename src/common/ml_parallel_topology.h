@@ -0,0 +1,183 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_TOPOLOGY_H
+#define __ML_PARALLEL_TOPOLOGY_H
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include "ml_parallel_utils.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Compact (CSR) adjacency tables built in parallel.
+
+  Unlike the vcg FF/VF topology they do not live inside the mesh: they are
+  plain index arrays, so they can be built without enabling any optional
+  component and they are cache friendly when they are traversed many times.
+  The neighbours of the i-th element are
+      adj[offset[i]] ... adj[offset[i+1]-1]
+  and they are always sorted by index, so the tables are exactly the same
+  regardless of the number of threads.
+*/
+template <class MeshType>
+class ParallelTopology
+{
+public:
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::FaceType       FaceType;
+
+	/// For each vertex the indexes of the (not deleted) faces incident on it.
+	static void VertexFaceCSR(MeshType &m, std::vector<int> &offset, std::vector<int> &faceIdx)
+	{
+		const int vertNum = int(m.vert.size());
+		const int faceNum = int(m.face.size());
+		std::vector< std::atomic<int> > cnt(vertNum);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+			cnt[i].store(0, std::memory_order_relaxed);
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			const FaceType &f = m.face[i];
+			if (f.IsD()) continue;
+			for (int k = 0; k < f.VN(); ++k)
+				cnt[tri::Index(m, f.cV(k))].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		offset.resize(vertNum + 1);
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+			offset[i] = cnt[i].load(std::memory_order_relaxed);
+		offset[vertNum] = 0;
+		MLParallel::ExclusiveScan(offset);
+
+		faceIdx.resize(offset[vertNum]);
+		if (MLParallel::ThreadNum() == 1)
+		{
+			// with a single thread the atomic cursors would only serialize the
+			// scattered writes, and the faces are already inserted in order
+			std::vector<int> cursor(offset.begin(), offset.end() - 1);
+			for (int i = 0; i < faceNum; ++i)
+			{
+				const FaceType &f = m.face[i];
+				if (f.IsD()) continue;
+				for (int k = 0; k < f.VN(); ++k)
+					faceIdx[cursor[tri::Index(m, f.cV(k))]++] = i;
+			}
+			return;
+		}
+
+		// reuse the counters as insertion cursors
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < vertNum; ++i)
+			cnt[i].store(offset[i], std::memory_order_relaxed);
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			const FaceType &f = m.face[i];
+			if (f.IsD()) continue;
+			for (int k = 0; k < f.VN(); ++k)
+				faceIdx[cnt[tri::Index(m, f.cV(k))].fetch_add(1, std::memory_order_relaxed)] = i;
+		}
+
+		SortRanges(offset, faceIdx);
+	}
+
+	/** FF adjacency, as UpdateTopology<>::FaceFace: the faces sharing an
+	 * edge are linked in a cycle, here by increasing index, so a manifold
+	 * edge links its two faces and a border edge its own face.
+	 */
+	static void FaceFace(MeshType &m)
+	{
+		std::vector<int> offset, vf;
+		VertexFaceCSR(m, offset, vf);
+		const int faceNum = int(m.face.size());
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			FaceType &f = m.face[i];
+			if (f.IsD()) continue;
+			for (int k = 0; k < f.VN(); ++k)
+			{
+				const VertexType *v0 = f.cV(k);
+				const VertexType *v1 = f.cV((k + 1) % f.VN());
+				const int vi = int(tri::Index(m, v0));
+				// the first face with the edge after this one, or the first one at all
+				int first = -1, firstE = -1, next = -1, nextE = -1;
+				for (int a = offset[vi]; a < offset[vi + 1] && next < 0; ++a)
+				{
+					const int g = vf[a];
+					if (g == i) continue;
+					const int e = EdgeIndex(m.face[g], v0, v1);
+					if (e < 0) continue;
+					if (first < 0) { first = g; firstE = e; }
+					if (g > i) { next = g; nextE = e; }
+				}
+				if (next < 0) { next = first; nextE = firstE; }
+				if (next < 0)
+				{
+					f.FFp(k) = &f;
+					f.FFi(k) = k;
+				}
+				else
+				{
+					f.FFp(k) = &m.face[next];
+					f.FFi(k) = nextE;
+				}
+			}
+		}
+	}
+
+private:
+	static int EdgeIndex(const FaceType &f, const VertexType *v0, const VertexType *v1)
+	{
+		for (int j = 0; j < f.VN(); ++j)
+		{
+			const VertexType *a = f.cV(j);
+			const VertexType *b = f.cV((j + 1) % f.VN());
+			if ((a == v0 && b == v1) || (a == v1 && b == v0))
+				return j;
+		}
+		return -1;
+	}
+
+	static void SortRanges(const std::vector<int> &offset, std::vector<int> &adj)
+	{
+		const int num = int(offset.size()) - 1;
+#pragma omp parallel for schedule(dynamic, 1024)
+		for (int i = 0; i < num; ++i)
+			std::sort(adj.begin() + offset[i], adj.begin() + offset[i + 1]);
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,139 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_UPDATE_H
+#define __ML_PARALLEL_UPDATE_H
+
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/update/bounding.h>
+#include <vcg/complex/algorithms/update/normal.h>
+#include "ml_parallel_topology.h"
+
+namespace vcg {
+namespace tri {
+
+/*
+  Multithreaded versions of the bounding box and normal updates done after
+  every load and after most of the filters. They give exactly the same
+  results of tri::UpdateBounding<> and tri::UpdateNormal<>.
+*/
+template <class MeshType>
+class ParallelUpdateBounding
+{
+public:
+	typedef typename MeshType::ScalarType     ScalarType;
+
+	/// Same as UpdateBounding<>::Box
+	static void Box(MeshType &m)
+	{
+		const int vertNum = int(m.vert.size());
+		const int chunkNum = (vertNum < MLParallel::MinParallelSize) ? 1 : MLParallel::ThreadNum();
+		const std::vector<int> bnd = MLParallel::Chunks(vertNum, chunkNum);
+		std::vector< Box3<ScalarType> > partial(chunkNum);
+#pragma omp parallel for schedule(static, 1)
+		for (int c = 0; c < chunkNum; ++c)
+		{
+			partial[c].SetNull();
+			for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+				if (!m.vert[i].IsD())
+					partial[c].Add(m.vert[i].cP());
+		}
+		m.bbox.SetNull();
+		for (int c = 0; c < chunkNum; ++c)
+			m.bbox.Add(partial[c]);
+	}
+};
+
+template <class MeshType>
+class ParallelUpdateNormal
+{
+public:
+	typedef typename MeshType::VertexType     VertexType;
+	typedef typename MeshType::FaceType       FaceType;
+	typedef typename VertexType::NormalType   NormalType;
+
+	/// Same as UpdateNormal<>::PerFaceNormalized
+	static void PerFaceNormalized(MeshType &m)
+	{
+		tri::RequirePerFaceNormal(m);
+		const int faceNum = int(m.face.size());
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < faceNum; ++i)
+		{
+			FaceType &f = m.face[i];
+			if (!f.IsD())
+			{
+				face::ComputeNormal(f);
+				f.N().Normalize();
+			}
+		}
+	}
+
+	/** Same as UpdateNormal<>::PerVertexAngleWeighted.
+	 * Each vertex gathers the contributions of its incident faces in
+	 * increasing face order, that is the order in which the serial version
+	 * scatters them, so the sums are bit-identical. Vertices not referenced
+	 * by any face keep their normal. Unlike the serial version the visited
+	 * flags are left untouched.
+	 */
+	static void PerVertexAngleWeighted(MeshType &m)
+	{
+		tri::RequirePerVertexNormal(m);
+		if (m.fn < MLParallel::MinParallelSize || MLParallel::ThreadNum() < 2)
+		{
+			// building the adjacency is not worth it for a single thread
+			UpdateNormal<MeshType>::PerVertexAngleWeighted(m);
+			return;
+		}
+		std::vector<int> vfOffset, vfFace;
+		ParallelTopology<MeshType>::VertexFaceCSR(m, vfOffset, vfFace);
+		const int vertNum = int(m.vert.size());
+#pragma omp parallel for schedule(dynamic, 4096)
+		for (int vi = 0; vi < vertNum; ++vi)
+		{
+			VertexType &v = m.vert[vi];
+			if (v.IsD() || vfOffset[vi] == vfOffset[vi + 1]) continue;
+			NormalType n = v.IsRW() ? NormalType(0, 0, 0) : v.N();
+			for (int k = vfOffset[vi]; k < vfOffset[vi + 1]; ++k)
+			{
+				if (k > vfOffset[vi] && vfFace[k] == vfFace[k - 1]) continue;
+				const FaceType &f = m.face[vfFace[k]];
+				if (!f.IsR()) continue;
+				NormalType t = vcg::TriangleNormal(f).Normalize();
+				NormalType e0 = (f.cP1(0) - f.cP0(0)).Normalize();
+				NormalType e1 = (f.cP1(1) - f.cP0(1)).Normalize();
+				NormalType e2 = (f.cP1(2) - f.cP0(2)).Normalize();
+				if (f.cV(0) == &v) n += t * AngleN(e0, -e2);
+				if (f.cV(1) == &v) n += t * AngleN(-e0, e1);
+				if (f.cV(2) == &v) n += t * AngleN(-e1, e2);
+			}
+			v.N() = n;
+		}
+	}
+};
+
+} // end namespace tri
+} // end namespace vcg
+
+#endif
@@ -0,0 +1,265 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef __ML_PARALLEL_UTILS_H
+#define __ML_PARALLEL_UTILS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+  Small OpenMP building blocks shared by the parallel mesh processing
+  algorithms (ml_parallel_*.h). Everything degrades gracefully to the plain
+  serial code when the compiler has no OpenMP support.
+
+  All the loops use signed int indices, since on windows omp does not
+  support unsigned types for indices on cycles.
+*/
+class MLParallel
+{
+public:
+	// below this size the overhead of spawning threads is not worth it
+	static const int MinParallelSize = 1 << 14;
+
+	static int ThreadNum()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+	static int ThreadId()
+	{
+#ifdef _OPENMP
+		return omp_get_thread_num();
+#else
+		return 0;
+#endif
+	}
+
+	// true inside a parallel region, where nested regions run on the calling thread
+	static bool InParallel()
+	{
+#ifdef _OPENMP
+		return omp_in_parallel() != 0;
+#else
+		return false;
+#endif
+	}
+
+	// Split the range [0,n) in chunkNum contiguous, almost equal, chunks.
+	// Returns the chunkNum+1 boundaries.
+	static std::vector<int> Chunks(int n, int chunkNum)
+	{
+		std::vector<int> bnd(chunkNum + 1);
+		for (int i = 0; i <= chunkNum; ++i)
+			bnd[i] = int((long long)(n) * i / chunkNum);
+		return bnd;
+	}
+
+	// Parallel merge sort: every thread sorts its own chunk and then the
+	// sorted runs are merged pairwise. With a strict total order (e.g. ties
+	// broken by index) the result is exactly the one of std::sort.
+	template <class RandomIt, class Compare>
+	static void Sort(RandomIt first, RandomIt last, Compare comp)
+	{
+		const int n = int(last - first);
+		const int chunkNum = ThreadNum();
+		if (n < MinParallelSize || chunkNum < 2)
+		{
+			std::sort(first, last, comp);
+			return;
+		}
+		const std::vector<int> bnd = Chunks(n, chunkNum);
+#pragma omp parallel for schedule(static, 1)
+		for (int i = 0; i < chunkNum; ++i)
+			std::sort(first + bnd[i], first + bnd[i + 1], comp);
+
+		for (int step = 1; step < chunkNum; step *= 2)
+		{
+#pragma omp parallel for schedule(dynamic, 1)
+			for (int i = 0; i < chunkNum - step; i += 2 * step)
+			{
+				const int mid = i + step;
+				const int end = std::min(i + 2 * step, chunkNum);
+				std::inplace_merge(first + bnd[i], first + bnd[mid], first + bnd[end], comp);
+			}
+		}
+	}
+
+	// In place exclusive prefix sum; returns the total.
+	template <class T>
+	static T ExclusiveScan(std::vector<T> &v)
+	{
+		const int n = int(v.size());
+		const int chunkNum = (n < MinParallelSize) ? 1 : ThreadNum();
+		const std::vector<int> bnd = Chunks(n, chunkNum);
+		std::vector<T> partial(chunkNum + 1, T(0));
+#pragma omp parallel for schedule(static, 1)
+		for (int c = 0; c < chunkNum; ++c)
+		{
+			T sum = T(0);
+			for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+			{
+				T val = v[i];
+				v[i] = sum;
+				sum += val;
+			}
+			partial[c + 1] = sum;
+		}
+		for (int c = 0; c < chunkNum; ++c)
+			partial[c + 1] += partial[c];
+#pragma omp parallel for schedule(static, 1)
+		for (int c = 1; c < chunkNum; ++c)
+			for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+				v[i] += partial[c];
+		return partial[chunkNum];
+	}
+
+	// Weld of the vertices meshed independently by many blocks: the vertices
+	// of all the blocks with the same key (block[b].key[i]) become one, the
+	// ones keyed noKey are never merged. The welded vertices are numbered in
+	// order of first appearance, block after block. On return offset[b] is
+	// the global index of the first vertex of block b, welded[offset[b]+i]
+	// the welded index of its vertex i, and source[w] the (block, vertex)
+	// that welded vertex w comes from. Returns the number of welded vertices.
+	template <class BlockType, class KeyType>
+	static int Weld(const std::vector<BlockType> &block, KeyType noKey, std::vector<int> &offset,
+	                std::vector<int> &welded, std::vector< std::pair<int, int> > &source)
+	{
+		const int blockNum = int(block.size());
+		offset.assign(blockNum + 1, 0);
+		for (int b = 0; b < blockNum; ++b)
+			offset[b] = int(block[b].key.size());
+		const int vertTot = ExclusiveScan(offset);
+
+		std::vector< std::pair<KeyType, int> > item(vertTot);
+#pragma omp parallel for schedule(dynamic, 16)
+		for (int b = 0; b < blockNum; ++b)
+			for (int i = 0; i < int(block[b].key.size()); ++i)
+			{
+				const int gi = offset[b] + i;
+				// the unshared vertices get a key of their own
+				item[gi] = std::make_pair(block[b].key[i] == noKey ? noKey - KeyType(gi) : block[b].key[i], gi);
+			}
+		Sort(item.begin(), item.end(), std::less< std::pair<KeyType, int> >());
+
+		std::vector<int> remap(vertTot);
+		std::vector<int> first;
+		for (int i = 0; i < vertTot; ++i)
+		{
+			if (i == 0 || item[i].first != item[i - 1].first)
+				first.push_back(item[i].second);
+			remap[item[i].second] = int(first.size()) - 1;
+		}
+		// number the welded vertices in order of first appearance
+		const int firstNum = int(first.size());
+		std::vector<int> order(firstNum);
+		for (int i = 0; i < firstNum; ++i)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return first[a] < first[b]; });
+		std::vector<int> rank(firstNum);
+		for (int i = 0; i < firstNum; ++i)
+			rank[order[i]] = i;
+
+		welded.resize(vertTot);
+#pragma omp parallel for schedule(static) if (vertTot >= MinParallelSize)
+		for (int i = 0; i < vertTot; ++i)
+			welded[i] = rank[remap[i]];
+		source.resize(firstNum);
+		for (int b = 0; b < blockNum; ++b)
+			for (int i = offset[b]; i < offset[b + 1]; ++i)
+				if (first[remap[i]] == i)
+					source[rank[remap[i]]] = std::make_pair(b, i - offset[b]);
+		return firstNum;
+	}
+};
+
+/*
+  Lock-free union-find over the integers [0,n), safe to be used concurrently
+  from many threads. Union always links the higher root under the lower one,
+  so the root of each set is its lowest element, regardless of the order in
+  which the unions are done.
+*/
+class MLParallelUnionFind
+{
+public:
+	explicit MLParallelUnionFind(int n) : parent(n)
+	{
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < n; ++i)
+			parent[i].store(i, std::memory_order_relaxed);
+	}
+
+	bool IsRoot(int x) const
+	{
+		return parent[x].load(std::memory_order_relaxed) == x;
+	}
+
+	// Find with path halving; concurrent shortcuts are safe because they
+	// only ever replace a parent with one of its ancestors.
+	int Find(int x)
+	{
+		int p = parent[x].load(std::memory_order_relaxed);
+		while (p != x)
+		{
+			const int gp = parent[p].load(std::memory_order_relaxed);
+			if (gp != p)
+			{
+				int expected = p;
+				parent[x].compare_exchange_weak(expected, gp, std::memory_order_relaxed);
+			}
+			x = p;
+			p = gp;
+		}
+		return x;
+	}
+
+	void Union(int a, int b)
+	{
+		for (;;)
+		{
+			a = Find(a);
+			b = Find(b);
+			if (a == b) return;
+			if (a < b) std::swap(a, b);
+			int expected = a;
+			if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+				return;
+		}
+	}
+
+private:
+	std::vector< std::atomic<int> > parent;
+};
+
+#endif
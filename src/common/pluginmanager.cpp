@@ -46,6 +46,9 @@ PluginManager::~PluginManager()
 	for (MeshCommonInterface* plugin : ownerPlug)
 		delete plugin;
 	ownerPlug.clear();
+	for (PluginLibrary* library : libraries)
+		delete library;
+	libraries.clear();
 
 	for (int ii = 0; ii < meshEditInterfacePlug.size(); ++ii)
 		delete meshEditInterfacePlug[ii];
@@ -54,7 +57,7 @@ PluginManager::~PluginManager()
 
 
 
-void PluginManager::loadPlugins(RichParameterSet& defaultGlobal)
+void PluginManager::loadPlugins(RichParameterSet& defaultGlobal, bool loadGuiPlugins)
 {
 	pluginsDir = QDir(getDefaultPluginDirPath());
 	// without adding the correct library path in the mac the loading of jpg (done via qt plugins) fails
@@ -68,87 +71,129 @@ void PluginManager::loadPlugins(RichParameterSet& defaultGlobal)
 	pluginsDir.setNameFilters(pluginfilters);
 
 	qDebug("Current Plugins Dir is: %s ", qUtf8Printable(pluginsDir.absolutePath()));
+	const QString manifestPath = PluginManifest::defaultPath(pluginsDir.absolutePath());
+	PluginManifest cached, manifest;
+	cached.load(manifestPath, pluginsDir.absolutePath());
+	bool manifestChanged = false;
 	for(QString fileName : pluginsDir.entryList(QDir::Files))
 	{
 		//      qDebug() << fileName;
 		QString absfilepath = pluginsDir.absoluteFilePath(fileName);
 		QFileInfo fin(absfilepath);
+		const PluginManifest::Entry *entry = cached.find(fin);
+		if (entry != NULL && !entry->eager && !(loadGuiPlugins && entry->hasGuiPart()))
+		{
+			manifest.add(*entry);
+			if (entry->hasToolPart())
+				registerLazyPlugin(*entry, absfilepath, defaultGlobal);
+			else
+				entry->addGlobals(defaultGlobal);
+			continue;
+		}
 		QPluginLoader loader(absfilepath);
 		QObject *plugin = loader.instance();
 		if (plugin)
 		{
 			pluginsLoaded.push_back(fileName);
-			MeshCommonInterface *iCommon = nullptr;
-			MeshFilterInterface *iFilter = qobject_cast<MeshFilterInterface *>(plugin);
-			if (iFilter)
-			{
-				iCommon = iFilter;
-				meshFilterPlug.push_back(iFilter);
-				for(QAction *filterAction : iFilter->actions())
-				{
-					filterAction->setData(QVariant(fileName));
-					actionFilterMap.insert(filterAction->text(), filterAction);
-					stringFilterMap.insert(filterAction->text(), iFilter);
-					iFilter->initGlobalParameterSet(filterAction, defaultGlobal);
-					if(iFilter->getClass(filterAction)==MeshFilterInterface::Generic)
-						throw MLException("Missing class for "        +fileName+filterAction->text());
-					if(iFilter->getRequirements(filterAction) == int(MeshModel::MM_UNKNOWN))
-						throw MLException("Missing requirements for " +fileName+filterAction->text());
-					if(iFilter->getPreConditions(filterAction) == int(MeshModel::MM_UNKNOWN))
-						throw MLException("Missing preconditions for "+fileName+filterAction->text());
-					if(iFilter->postCondition(filterAction) == int(MeshModel::MM_UNKNOWN ))
-						throw MLException("Missing postcondition for "+fileName+filterAction->text());
-					if(iFilter->filterArity(filterAction) == MeshFilterInterface::UNKNOWN_ARITY )
-						throw MLException("Missing Arity for "        +fileName+filterAction->text());
-				}
-			}
-			MeshIOInterface *iIO = qobject_cast<MeshIOInterface *>(plugin);
-			if (iIO)
-			{
-				iCommon = iIO;
-				meshIOPlug.push_back(iIO);
-				iIO->initGlobalParameterSet(NULL, defaultGlobal);
-			}
-
-			MeshDecorateInterface *iDecorator = qobject_cast<MeshDecorateInterface *>(plugin);
-			if (iDecorator)
-			{
-				iCommon = iDecorator;
-				meshDecoratePlug.push_back(iDecorator);
-				foreach(QAction *decoratorAction, iDecorator->actions())
-				{
-					decoratorActionList.push_back(decoratorAction);
-					iDecorator->initGlobalParameterSet(decoratorAction, defaultGlobal);
-				}
-			}
-
-			MeshRenderInterface *iRender = qobject_cast<MeshRenderInterface *>(plugin);
-			if (iRender)
-			{
-				iCommon = iRender;
-				meshRenderPlug.push_back(iRender);
-			}
-
-			MeshEditInterfaceFactory *iEditFactory = qobject_cast<MeshEditInterfaceFactory *>(plugin);
-			if (iEditFactory)
+			registerPlugin(plugin, fileName, defaultGlobal);
+			if (entry == NULL)
 			{
-				meshEditInterfacePlug.push_back(iEditFactory);
-				foreach(QAction* editAction, iEditFactory->actions())
-					editActionList.push_back(editAction);
-			}
-			else if (iCommon)
-			{
-				ownerPlug.push_back(iCommon);
-			} else {
-				// qDebug("Plugin %s was loaded, but could not be casted to any known type.", qUtf8Printable(fileName));
+				manifest.add(PluginManifest::describe(plugin, fin));
+				manifestChanged = true;
 			}
+			else
+				manifest.add(*entry);
 		}
 		else
 			qDebug() << loader.errorString();
 	}
+	if (manifestChanged || manifest.size() != cached.size())
+		manifest.save(manifestPath, pluginsDir.absolutePath());
 	knownIOFormats();
 }
 
+void PluginManager::registerPlugin(QObject *plugin, const QString& fileName, RichParameterSet& defaultGlobal)
+{
+	MeshCommonInterface *iCommon = nullptr;
+	MeshFilterInterface *iFilter = qobject_cast<MeshFilterInterface *>(plugin);
+	if (iFilter)
+	{
+		iCommon = iFilter;
+		meshFilterPlug.push_back(iFilter);
+		for(QAction *filterAction : iFilter->actions())
+		{
+			filterAction->setData(QVariant(fileName));
+			actionFilterMap.insert(filterAction->text(), filterAction);
+			stringFilterMap.insert(filterAction->text(), iFilter);
+			iFilter->initGlobalParameterSet(filterAction, defaultGlobal);
+			if(iFilter->getClass(filterAction)==MeshFilterInterface::Generic)
+				throw MLException("Missing class for "        +fileName+filterAction->text());
+			if(iFilter->getRequirements(filterAction) == int(MeshModel::MM_UNKNOWN))
+				throw MLException("Missing requirements for " +fileName+filterAction->text());
+			if(iFilter->getPreConditions(filterAction) == int(MeshModel::MM_UNKNOWN))
+				throw MLException("Missing preconditions for "+fileName+filterAction->text());
+			if(iFilter->postCondition(filterAction) == int(MeshModel::MM_UNKNOWN ))
+				throw MLException("Missing postcondition for "+fileName+filterAction->text());
+			if(iFilter->filterArity(filterAction) == MeshFilterInterface::UNKNOWN_ARITY )
+				throw MLException("Missing Arity for "        +fileName+filterAction->text());
+		}
+	}
+	MeshIOInterface *iIO = qobject_cast<MeshIOInterface *>(plugin);
+	if (iIO)
+	{
+		iCommon = iIO;
+		meshIOPlug.push_back(iIO);
+		iIO->initGlobalParameterSet(NULL, defaultGlobal);
+	}
+
+	MeshDecorateInterface *iDecorator = qobject_cast<MeshDecorateInterface *>(plugin);
+	if (iDecorator)
+	{
+		iCommon = iDecorator;
+		meshDecoratePlug.push_back(iDecorator);
+		foreach(QAction *decoratorAction, iDecorator->actions())
+		{
+			decoratorActionList.push_back(decoratorAction);
+			iDecorator->initGlobalParameterSet(decoratorAction, defaultGlobal);
+		}
+	}
+
+	MeshRenderInterface *iRender = qobject_cast<MeshRenderInterface *>(plugin);
+	if (iRender)
+	{
+		iCommon = iRender;
+		meshRenderPlug.push_back(iRender);
+	}
+
+	MeshEditInterfaceFactory *iEditFactory = qobject_cast<MeshEditInterfaceFactory *>(plugin);
+	if (iEditFactory)
+	{
+		meshEditInterfacePlug.push_back(iEditFactory);
+		foreach(QAction* editAction, iEditFactory->actions())
+			editActionList.push_back(editAction);
+	}
+	else if (iCommon)
+	{
+		ownerPlug.push_back(iCommon);
+	} else {
+		// qDebug("Plugin %s was loaded, but could not be casted to any known type.", qUtf8Printable(fileName));
+	}
+}
+
+// Filter and io plugins are replaced by stand-ins built from the manifest;
+// the global parameters, collected when the manifest was written, are added as they are.
+void PluginManager::registerLazyPlugin(const PluginManifest::Entry& entry, const QString& absFilePath, RichParameterSet& defaultGlobal)
+{
+	PluginLibrary *library = new PluginLibrary(absFilePath);
+	libraries.push_back(library);
+	pluginsLoaded.push_back(entry.fileName);
+	if (entry.kinds & PluginManifest::FILTER)
+		registerPlugin(new LazyFilterPlugin(entry, library), entry.fileName, defaultGlobal);
+	if (entry.kinds & PluginManifest::IO)
+		registerPlugin(new LazyIOPlugin(entry, library), entry.fileName, defaultGlobal);
+	entry.addGlobals(defaultGlobal);
+}
+
 // Search among all the decorator plugins the one that contains a decoration with the given name
 MeshDecorateInterface *PluginManager::getDecoratorInterfaceByName(const QString& name)
 {
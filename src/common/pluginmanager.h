@@ -25,6 +25,7 @@
 #define PLUGINMANAGER_H
 
 #include "interfaces.h"
+#include "pluginmanifest.h"
 //#include "scriptsyntax.h"
 
 #include<QMap>
@@ -39,7 +40,9 @@ public:
     PluginManager();
     ~PluginManager();
     enum TypeIO{IMPORT,EXPORT};
-    void loadPlugins(RichParameterSet& defaultGlobal);
+    // plugins unchanged since the last run are not loaded until used, see PluginManifest;
+    // without loadGuiPlugins the decorate, render and edit only plugins are skipped
+    void loadPlugins(RichParameterSet& defaultGlobal, bool loadGuiPlugins = true);
     QString pluginsCode() const;
 
     inline QVector<MeshIOInterface*>& meshIOPlugins()  {return meshIOPlug;}
@@ -72,11 +75,17 @@ public:
     QVector<QAction *> decoratorActionList;
     // Used for unique destruction - this "owns" all IO, Filter, Render, and Decorate plugins
     QVector<MeshCommonInterface *> ownerPlug;
+    // libraries behind the lazy filter and io plugins, opened on first use
+    QVector<PluginLibrary *> libraries;
 
     QStringList pluginsLoaded;
 
     static QString osDependentFileBaseName(const QString& plname);
     static QString osIndependentPluginName(const QString& plname);
+
+private:
+    void registerPlugin(QObject *plugin, const QString& fileName, RichParameterSet& defaultGlobal);
+    void registerLazyPlugin(const PluginManifest::Entry& entry, const QString& absFilePath, RichParameterSet& defaultGlobal);
 };
 
 #endif // PLUGINMANAGER_H
@@ -0,0 +1,490 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#include "pluginmanifest.h"
+#include "mlapplication.h"
+
+#include <QBuffer>
+#include <QDateTime>
+#include <QDir>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPluginLoader>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtXml/QDomDocument>
+
+// bump when the layout of the manifest changes
+static const int ManifestFormat = 1;
+
+static QJsonArray toJson(const QStringList &l)
+{
+	QJsonArray a;
+	for (const QString &s : l)
+		a.append(s);
+	return a;
+}
+
+static QStringList toStringList(const QJsonArray &a)
+{
+	QStringList l;
+	for (const QJsonValue &v : a)
+		l.push_back(v.toString());
+	return l;
+}
+
+static QJsonArray formatsToJson(const QList<PluginManifest::Format> &fl)
+{
+	QJsonArray a;
+	for (const PluginManifest::Format &f : fl)
+	{
+		QJsonObject o;
+		o["description"] = f.description;
+		o["extensions"] = toJson(f.extensions);
+		a.append(o);
+	}
+	return a;
+}
+
+static QList<PluginManifest::Format> formatsFromJson(const QJsonArray &a)
+{
+	QList<PluginManifest::Format> fl;
+	for (const QJsonValue &v : a)
+	{
+		PluginManifest::Format f;
+		f.description = v.toObject()["description"].toString();
+		f.extensions = toStringList(v.toObject()["extensions"].toArray());
+		fl.push_back(f);
+	}
+	return fl;
+}
+
+static QJsonObject entryToJson(const PluginManifest::Entry &e)
+{
+	QJsonObject o;
+	o["file"] = e.fileName;
+	o["size"] = QString::number(e.size);
+	o["modified"] = QString::number(e.modified);
+	o["name"] = e.pluginName;
+	o["kinds"] = e.kinds;
+	o["eager"] = e.eager;
+	QJsonArray filters;
+	for (const PluginManifest::Filter &f : e.filters)
+	{
+		QJsonObject fo;
+		fo["name"] = f.name;
+		fo["info"] = f.info;
+		fo["script"] = f.scriptName;
+		fo["shortcut"] = f.shortcut;
+		fo["icon"] = QString::fromLatin1(f.icon.toBase64());
+		fo["class"] = f.filterClass;
+		fo["requirements"] = f.requirements;
+		fo["preconditions"] = f.preConditions;
+		fo["postcondition"] = f.postCondition;
+		fo["arity"] = f.arity;
+		fo["priority"] = f.priority;
+		filters.append(fo);
+	}
+	o["filters"] = filters;
+	o["import"] = formatsToJson(e.importFormats);
+	o["export"] = formatsToJson(e.exportFormats);
+	QJsonObject mask;
+	for (QMap<QString, QPair<int, int> >::const_iterator it = e.exportMask.begin(); it != e.exportMask.end(); ++it)
+		mask[it.key()] = QJsonArray({ it.value().first, it.value().second });
+	o["exportMask"] = mask;
+	o["globals"] = e.globals;
+	return o;
+}
+
+static PluginManifest::Entry entryFromJson(const QJsonObject &o)
+{
+	PluginManifest::Entry e;
+	e.fileName = o["file"].toString();
+	e.size = o["size"].toString().toLongLong();
+	e.modified = o["modified"].toString().toLongLong();
+	e.pluginName = o["name"].toString();
+	e.kinds = o["kinds"].toInt();
+	e.eager = o["eager"].toBool();
+	for (const QJsonValue &v : o["filters"].toArray())
+	{
+		const QJsonObject fo = v.toObject();
+		PluginManifest::Filter f;
+		f.name = fo["name"].toString();
+		f.info = fo["info"].toString();
+		f.scriptName = fo["script"].toString();
+		f.shortcut = fo["shortcut"].toString();
+		f.icon = QByteArray::fromBase64(fo["icon"].toString().toLatin1());
+		f.filterClass = fo["class"].toInt();
+		f.requirements = fo["requirements"].toInt();
+		f.preConditions = fo["preconditions"].toInt();
+		f.postCondition = fo["postcondition"].toInt();
+		f.arity = fo["arity"].toInt();
+		f.priority = fo["priority"].toInt();
+		e.filters.push_back(f);
+	}
+	e.importFormats = formatsFromJson(o["import"].toArray());
+	e.exportFormats = formatsFromJson(o["export"].toArray());
+	const QJsonObject mask = o["exportMask"].toObject();
+	for (QJsonObject::const_iterator it = mask.begin(); it != mask.end(); ++it)
+	{
+		const QJsonArray a = it.value().toArray();
+		e.exportMask[it.key()] = qMakePair(a.at(0).toInt(), a.at(1).toInt());
+	}
+	e.globals = o["globals"].toString();
+	return e;
+}
+
+static QByteArray iconToPng(const QIcon &icon)
+{
+	QByteArray data;
+	if (icon.isNull()) return data;
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::WriteOnly);
+	icon.pixmap(QSize(32, 32)).save(&buffer, "PNG");
+	return data;
+}
+
+bool PluginManifest::Entry::matches(const QFileInfo &fi) const
+{
+	return fi.fileName() == fileName && fi.size() == size && fi.lastModified().toMSecsSinceEpoch() == modified;
+}
+
+bool PluginManifest::Entry::addGlobals(RichParameterSet &globalParams) const
+{
+	if (globals.isEmpty()) return true;
+	QDomDocument doc;
+	if (!doc.setContent(globals)) return false;
+	bool ok = true;
+	for (QDomElement el = doc.documentElement().firstChildElement(); !el.isNull(); el = el.nextSiblingElement())
+	{
+		RichParameter *rp = NULL;
+		if (RichParameterAdapter::create(el, &rp))
+			globalParams.addParam(rp);
+		else
+			ok = false;
+	}
+	return ok;
+}
+
+QString PluginManifest::defaultPath(const QString &pluginDir)
+{
+	const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/meshlab";
+	return cacheDir + "/plugins-" + QString::number(qHash(pluginDir), 16) + ".json";
+}
+
+bool PluginManifest::load(const QString &path, const QString &pluginDir)
+{
+	entries.clear();
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) return false;
+	const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+	if (root["format"].toInt() != ManifestFormat || root["version"].toString() != MeshLabApplication::appVer() || root["pluginDir"].toString() != pluginDir)
+		return false;
+	for (const QJsonValue &v : root["plugins"].toArray())
+		entries.push_back(entryFromJson(v.toObject()));
+	return true;
+}
+
+bool PluginManifest::save(const QString &path, const QString &pluginDir) const
+{
+	QDir().mkpath(QFileInfo(path).absolutePath());
+	QJsonObject root;
+	root["format"] = ManifestFormat;
+	root["version"] = MeshLabApplication::appVer();
+	root["pluginDir"] = pluginDir;
+	QJsonArray plugins;
+	for (const Entry &e : entries)
+		plugins.append(entryToJson(e));
+	root["plugins"] = plugins;
+
+	// written aside and renamed, meshlab and meshlabserver may start together
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) return false;
+	file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+	return file.commit();
+}
+
+const PluginManifest::Entry *PluginManifest::find(const QFileInfo &fi) const
+{
+	for (const Entry &e : entries)
+		if (e.matches(fi)) return &e;
+	return NULL;
+}
+
+PluginManifest::Entry PluginManifest::describe(QObject *plugin, const QFileInfo &fi)
+{
+	Entry e;
+	e.fileName = fi.fileName();
+	e.size = fi.size();
+	e.modified = fi.lastModified().toMSecsSinceEpoch();
+	// icons can be stored only when there is a gui to render them
+	const bool canStoreIcons = qobject_cast<QGuiApplication *>(QCoreApplication::instance()) != NULL;
+	RichParameterSet globals;
+
+	MeshFilterInterface *iFilter = qobject_cast<MeshFilterInterface *>(plugin);
+	if (iFilter)
+	{
+		e.kinds |= FILTER;
+		e.pluginName = iFilter->pluginName();
+		for (QAction *filterAction : iFilter->actions())
+		{
+			Filter f;
+			f.name = filterAction->text();
+			f.info = iFilter->filterInfo(filterAction);
+			f.scriptName = iFilter->filterScriptFunctionName(iFilter->ID(filterAction));
+			f.shortcut = filterAction->shortcut().toString();
+			f.priority = filterAction->priority();
+			f.filterClass = iFilter->getClass(filterAction);
+			f.requirements = iFilter->getRequirements(filterAction);
+			f.preConditions = iFilter->getPreConditions(filterAction);
+			f.postCondition = iFilter->postCondition(filterAction);
+			f.arity = iFilter->filterArity(filterAction);
+			if (!filterAction->icon().isNull())
+			{
+				if (canStoreIcons)
+					f.icon = iconToPng(filterAction->icon());
+				else
+					e.eager = true;
+			}
+			e.filters.push_back(f);
+			iFilter->initGlobalParameterSet(filterAction, globals);
+		}
+	}
+
+	MeshIOInterface *iIO = qobject_cast<MeshIOInterface *>(plugin);
+	if (iIO)
+	{
+		e.kinds |= IO;
+		e.pluginName = iIO->pluginName();
+		for (const MeshIOInterface::Format &f : iIO->importFormats())
+			e.importFormats.push_back(Format{ f.description, f.extensions });
+		for (const MeshIOInterface::Format &f : iIO->exportFormats())
+		{
+			e.exportFormats.push_back(Format{ f.description, f.extensions });
+			for (QString ext : f.extensions)
+			{
+				int capability = 0, defaultBits = 0;
+				iIO->GetExportMaskCapability(ext, capability, defaultBits);
+				e.exportMask[ext.toLower()] = qMakePair(capability, defaultBits);
+			}
+		}
+		iIO->initGlobalParameterSet(NULL, globals);
+	}
+
+	MeshDecorateInterface *iDecorator = qobject_cast<MeshDecorateInterface *>(plugin);
+	if (iDecorator)
+	{
+		e.kinds |= DECORATE;
+		for (QAction *decoratorAction : iDecorator->actions())
+			iDecorator->initGlobalParameterSet(decoratorAction, globals);
+	}
+	if (qobject_cast<MeshRenderInterface *>(plugin))
+		e.kinds |= RENDER;
+	if (qobject_cast<MeshEditInterfaceFactory *>(plugin))
+		e.kinds |= EDIT;
+
+	if (!globals.isEmpty())
+	{
+		QDomDocument doc("MeshLabGlobals");
+		QDomElement root = doc.createElement("globals");
+		doc.appendChild(root);
+		for (RichParameter *p : globals.paramList)
+		{
+			RichParameterXMLVisitor v(doc);
+			p->accept(v);
+			root.appendChild(v.parElem);
+		}
+		e.globals = doc.toString();
+		// parameters that do not survive the round trip keep the plugin eager
+		RichParameterSet check;
+		if (!e.addGlobals(check) || check.paramList.size() != globals.paramList.size())
+			e.eager = true;
+	}
+	return e;
+}
+
+QObject *PluginLibrary::instance()
+{
+	QMutexLocker locker(&mutex);
+	if (!tried)
+	{
+		tried = true;
+		QPluginLoader loader(filePath);
+		plugin = loader.instance();
+		if (plugin == NULL)
+		{
+			error = loader.errorString();
+			qDebug() << error;
+		}
+	}
+	return plugin;
+}
+
+LazyFilterPlugin::LazyFilterPlugin(const PluginManifest::Entry &e, PluginLibrary *lib) : entry(e), library(lib)
+{
+	for (int i = 0; i < entry.filters.size(); ++i)
+	{
+		const PluginManifest::Filter &f = entry.filters[i];
+		QAction *filterAction = new QAction(f.name, this);
+		if (!f.icon.isEmpty())
+		{
+			QPixmap pm;
+			pm.loadFromData(f.icon, "PNG");
+			filterAction->setIcon(QIcon(pm));
+		}
+		if (!f.shortcut.isEmpty())
+			filterAction->setShortcut(QKeySequence(f.shortcut));
+		filterAction->setPriority(QAction::Priority(f.priority));
+		actionList << filterAction;
+		typeList << i;
+	}
+}
+
+MeshFilterInterface *LazyFilterPlugin::real(QAction *a, QAction *&realAction)
+{
+	MeshFilterInterface *r = qobject_cast<MeshFilterInterface *>(library->instance());
+	realAction = NULL;
+	if (r == NULL)
+	{
+		errorMessage = "Unable to load the plugin " + library->path() + ": " + library->errorString();
+		return NULL;
+	}
+	realAction = r->AC(a->text());
+	r->setLog(getLog());
+	return r;
+}
+
+void LazyFilterPlugin::initParameterSet(QAction *a, MeshModel &m, RichParameterSet &par)
+{
+	QAction *ra;
+	MeshFilterInterface *r = real(a, ra);
+	if (r) r->initParameterSet(ra, m, par);
+}
+
+void LazyFilterPlugin::initParameterSet(QAction *a, MeshDocument &md, RichParameterSet &par)
+{
+	QAction *ra;
+	MeshFilterInterface *r = real(a, ra);
+	if (r) r->initParameterSet(ra, md, par);
+}
+
+bool LazyFilterPlugin::applyFilter(QAction *a, MeshDocument &md, RichParameterSet &par, vcg::CallBackPos *cb)
+{
+	QAction *ra;
+	MeshFilterInterface *r = real(a, ra);
+	if (r == NULL) return false;
+	// the framework sets up the gl context on the stand-in
+	r->glContext = glContext;
+	const bool ret = r->applyFilter(ra, md, par, cb);
+	r->glContext = NULL;
+	errorMessage = r->errorMsg();
+	generatedScriptCode = r->generatedScriptCode;
+	return ret;
+}
+
+QList<MeshIOInterface::Format> LazyIOPlugin::formats(const QList<PluginManifest::Format> &fl)
+{
+	QList<Format> res;
+	for (const PluginManifest::Format &f : fl)
+	{
+		Format format(f.description, f.extensions.value(0));
+		for (int i = 1; i < f.extensions.size(); ++i)
+			format.extensions << f.extensions[i];
+		res.push_back(format);
+	}
+	return res;
+}
+
+MeshIOInterface *LazyIOPlugin::real()
+{
+	MeshIOInterface *r = qobject_cast<MeshIOInterface *>(library->instance());
+	if (r == NULL)
+	{
+		errorMessage = "Unable to load the plugin " + library->path() + ": " + library->errorString();
+		return NULL;
+	}
+	r->setLog(getLog());
+	return r;
+}
+
+void LazyIOPlugin::GetExportMaskCapability(QString &format, int &capability, int &defaultBits) const
+{
+	QMap<QString, QPair<int, int> >::const_iterator it = entry.exportMask.find(format.toLower());
+	if (it != entry.exportMask.end())
+	{
+		capability = it.value().first;
+		defaultBits = it.value().second;
+		return;
+	}
+	MeshIOInterface *r = const_cast<LazyIOPlugin *>(this)->real();
+	if (r)
+		r->GetExportMaskCapability(format, capability, defaultBits);
+	else
+		capability = defaultBits = 0;
+}
+
+void LazyIOPlugin::initPreOpenParameter(const QString &format, const QString &fileName, RichParameterSet &par)
+{
+	MeshIOInterface *r = real();
+	if (r) r->initPreOpenParameter(format, fileName, par);
+}
+
+void LazyIOPlugin::initOpenParameter(const QString &format, MeshModel &m, RichParameterSet &par)
+{
+	MeshIOInterface *r = real();
+	if (r) r->initOpenParameter(format, m, par);
+}
+
+void LazyIOPlugin::applyOpenParameter(const QString &format, MeshModel &m, const RichParameterSet &par)
+{
+	MeshIOInterface *r = real();
+	if (r) r->applyOpenParameter(format, m, par);
+}
+
+void LazyIOPlugin::initSaveParameter(const QString &format, MeshModel &m, RichParameterSet &par)
+{
+	MeshIOInterface *r = real();
+	if (r) r->initSaveParameter(format, m, par);
+}
+
+bool LazyIOPlugin::open(const QString &format, const QString &fileName, MeshModel &m, int &mask, const RichParameterSet &par, vcg::CallBackPos *cb, QWidget *parent)
+{
+	MeshIOInterface *r = real();
+	if (r == NULL) return false;
+	r->errorMsg() = errorMessage;
+	const bool ret = r->open(format, fileName, m, mask, par, cb, parent);
+	errorMessage = r->errorMsg();
+	return ret;
+}
+
+bool LazyIOPlugin::save(const QString &format, const QString &fileName, MeshModel &m, const int mask, const RichParameterSet &par, vcg::CallBackPos *cb, QWidget *parent)
+{
+	MeshIOInterface *r = real();
+	if (r == NULL) return false;
+	r->errorMsg() = errorMessage;
+	const bool ret = r->save(format, fileName, m, mask, par, cb, parent);
+	errorMessage = r->errorMsg();
+	return ret;
+}
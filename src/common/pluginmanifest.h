@@ -0,0 +1,204 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef PLUGINMANIFEST_H
+#define PLUGINMANIFEST_H
+
+#include "interfaces.h"
+
+#include <QFileInfo>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+
+/**
+\brief Cache of what the plugins of a directory export, so that they do not have to be loaded at every start.
+
+For each plugin file the manifest keeps its size and modification time and
+everything the framework asks to a plugin before actually using it: the
+filter names, infos, classes, requirements, arities and icons, the
+import/export formats and the global parameters. An entry is valid only
+while the file is unchanged. The manifest is stored as JSON in the user
+cache directory, one per plugin directory.
+*/
+class PluginManifest
+{
+public:
+	enum Kind { FILTER = 0x01, IO = 0x02, DECORATE = 0x04, RENDER = 0x08, EDIT = 0x10 };
+
+	struct Filter
+	{
+		QString name;
+		QString info;
+		QString scriptName;
+		QString shortcut;
+		QByteArray icon;   // png
+		int filterClass;
+		int requirements;
+		int preConditions;
+		int postCondition;
+		int arity;
+		int priority;
+	};
+
+	struct Format
+	{
+		QString description;
+		QStringList extensions;
+	};
+
+	struct Entry
+	{
+		QString fileName;
+		qint64 size;
+		qint64 modified;
+		QString pluginName;
+		int kinds;
+		// true if something could not be cached: the plugin is always loaded
+		bool eager;
+		QList<Filter> filters;
+		QList<Format> importFormats;
+		QList<Format> exportFormats;
+		QMap<QString, QPair<int, int> > exportMask; // lower case extension -> capability, default bits
+		QString globals;                             // xml of the global parameters
+
+		Entry() : size(0), modified(0), kinds(0), eager(false) {}
+		bool matches(const QFileInfo &fi) const;
+		bool hasGuiPart() const { return (kinds & (DECORATE | RENDER | EDIT)) != 0; }
+		bool hasToolPart() const { return (kinds & (FILTER | IO)) != 0; }
+		bool addGlobals(RichParameterSet &globalParams) const;
+	};
+
+	static QString defaultPath(const QString &pluginDir);
+
+	/// Read the manifest of pluginDir stored in path; false (and empty) if missing or outdated.
+	bool load(const QString &path, const QString &pluginDir);
+	bool save(const QString &path, const QString &pluginDir) const;
+
+	const Entry *find(const QFileInfo &fi) const;
+	void add(const Entry &e) { entries.push_back(e); }
+	int size() const { return entries.size(); }
+
+	/// Collect the entry of a loaded plugin.
+	static Entry describe(QObject *plugin, const QFileInfo &fi);
+
+private:
+	QList<Entry> entries;
+};
+
+/**
+\brief A plugin library opened only the first time it is needed.
+*/
+class PluginLibrary
+{
+public:
+	PluginLibrary(const QString &path) : filePath(path), plugin(NULL), tried(false) {}
+	~PluginLibrary() { delete plugin; }
+
+	QObject *instance();
+	const QString &path() const { return filePath; }
+	const QString &errorString() const { return error; }
+
+private:
+	QString filePath;
+	QString error;
+	QObject *plugin;
+	bool tried;
+	QMutex mutex;
+};
+
+/**
+\brief Stand-in for a filter plugin that has not been loaded yet.
+
+Names, infos, classes, requirements and arities come from the manifest, so
+that menus can be built and scripts checked without loading the library.
+Its actions have the same text of the real ones. Parameters and filtering
+are forwarded to the real plugin, which is loaded at the first of them.
+*/
+class LazyFilterPlugin : public QObject, public MeshFilterInterface
+{
+	Q_OBJECT
+	Q_INTERFACES(MeshFilterInterface)
+
+public:
+	LazyFilterPlugin(const PluginManifest::Entry &e, PluginLibrary *lib);
+
+	using MeshFilterInterface::filterName;
+	using MeshFilterInterface::filterInfo;
+
+	QString pluginName() const { return entry.pluginName; }
+	QString filterName(FilterIDType filter) const { return entry.filters[filter].name; }
+	QString filterInfo(FilterIDType filter) const { return entry.filters[filter].info; }
+	QString filterScriptFunctionName(FilterIDType filter) { return entry.filters[filter].scriptName; }
+	FilterClass getClass(QAction *a) { return FilterClass(entry.filters[ID(a)].filterClass); }
+	int getRequirements(QAction *a) { return entry.filters[ID(a)].requirements; }
+	int getPreConditions(QAction *a) const { return entry.filters[ID(a)].preConditions; }
+	int postCondition(QAction *a) const { return entry.filters[ID(a)].postCondition; }
+	FILTER_ARITY filterArity(QAction *a) const { return FILTER_ARITY(entry.filters[ID(a)].arity); }
+
+	void initParameterSet(QAction *a, MeshModel &m, RichParameterSet &par);
+	void initParameterSet(QAction *a, MeshDocument &md, RichParameterSet &par);
+	bool applyFilter(QAction *a, MeshDocument &md, RichParameterSet &par, vcg::CallBackPos *cb);
+
+private:
+	MeshFilterInterface *real(QAction *a, QAction *&realAction);
+
+	PluginManifest::Entry entry;
+	PluginLibrary *library;
+};
+
+/**
+\brief Stand-in for an import/export plugin that has not been loaded yet.
+
+The formats and export capabilities come from the manifest; opening and
+saving are forwarded to the real plugin, loaded the first time.
+*/
+class LazyIOPlugin : public QObject, public MeshIOInterface
+{
+	Q_OBJECT
+	Q_INTERFACES(MeshIOInterface)
+
+public:
+	LazyIOPlugin(const PluginManifest::Entry &e, PluginLibrary *lib) : entry(e), library(lib) {}
+
+	QString pluginName() const { return entry.pluginName; }
+	QList<Format> importFormats() const { return formats(entry.importFormats); }
+	QList<Format> exportFormats() const { return formats(entry.exportFormats); }
+	void GetExportMaskCapability(QString &format, int &capability, int &defaultBits) const;
+
+	void initPreOpenParameter(const QString &format, const QString &fileName, RichParameterSet &par);
+	void initOpenParameter(const QString &format, MeshModel &m, RichParameterSet &par);
+	void applyOpenParameter(const QString &format, MeshModel &m, const RichParameterSet &par);
+	void initSaveParameter(const QString &format, MeshModel &m, RichParameterSet &par);
+	bool open(const QString &format, const QString &fileName, MeshModel &m, int &mask, const RichParameterSet &par, vcg::CallBackPos *cb = 0, QWidget *parent = 0);
+	bool save(const QString &format, const QString &fileName, MeshModel &m, const int mask, const RichParameterSet &par, vcg::CallBackPos *cb = 0, QWidget *parent = 0);
+
+private:
+	static QList<Format> formats(const QList<PluginManifest::Format> &fl);
+	MeshIOInterface *real();
+
+	PluginManifest::Entry entry;
+	PluginLibrary *library;
+};
+
+#endif // PLUGINMANIFEST_H
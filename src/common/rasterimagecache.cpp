@@ -0,0 +1,266 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#include "rasterimagecache.h"
+#include "meshmodel.h"
+
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+namespace {
+
+class PrefetchTask : public QRunnable
+{
+public:
+	PrefetchTask(Plane *p) : plane(p) {}
+	void run() { RasterImageCache::instance().acquireQueued(plane); }
+
+private:
+	Plane *plane;
+};
+
+}
+
+RasterImageCache &RasterImageCache::instance()
+{
+	static RasterImageCache cache;
+	return cache;
+}
+
+RasterImageCache::RasterImageCache() :
+	maxBytes(qint64(2048) << 20), used(0)
+{
+}
+
+void RasterImageCache::setBudget(qint64 bytes)
+{
+	QMutexLocker locker(&mutex);
+	maxBytes = bytes;
+	evict(NULL);
+}
+
+qint64 RasterImageCache::budget() const
+{
+	QMutexLocker locker(&mutex);
+	return maxBytes;
+}
+
+qint64 RasterImageCache::usedBytes() const
+{
+	QMutexLocker locker(&mutex);
+	return used;
+}
+
+QImage RasterImageCache::acquire(Plane *p)
+{
+	QMutexLocker locker(&mutex);
+	load(p);
+	touch(p);
+	evict(p);
+	// the copy shares the pixels, and keeps them alive if p is discarded later
+	return p->img;
+}
+
+bool RasterImageCache::inCore(const Plane *p) const
+{
+	QMutexLocker locker(&mutex);
+	return !p->img.isNull();
+}
+
+void RasterImageCache::acquireQueued(Plane *p)
+{
+	QMutexLocker locker(&mutex);
+	// already taken by acquire() or removed in the meantime
+	if (!queued.remove(p))
+		return;
+	if (p->img.isNull() && !p->owned && !p->unreadable)
+	{
+		loading.insert(p);
+		decode(p);
+	}
+	touch(p);
+	evict(p);
+}
+
+QSize RasterImageCache::size(Plane *p)
+{
+	QMutexLocker locker(&mutex);
+	if (p->imgSize.isValid())
+		return p->imgSize;
+	const QString path = p->fullPathFileName;
+	locker.unlock();
+
+	QImageReader reader(path);
+	const QSize s = reader.size();
+	// some formats can not tell the size without decoding the image
+	if (!s.isValid())
+		return acquire(p).size();
+
+	locker.relock();
+	p->imgSize = s;
+	return s;
+}
+
+void RasterImageCache::set(Plane *p, const QImage &img)
+{
+	QMutexLocker locker(&mutex);
+	queued.remove(p);
+	while (loading.contains(p))
+		loaded.wait(&mutex);
+	drop(p);
+	p->img = img;
+	p->owned = !img.isNull();
+	p->unreadable = false;
+	p->imgSize = img.size();
+}
+
+void RasterImageCache::prefetch(Plane *p)
+{
+	QMutexLocker locker(&mutex);
+	if (!p->img.isNull() || p->owned || p->unreadable || loading.contains(p) || queued.contains(p))
+		return;
+	queued.insert(p);
+	QThreadPool::globalInstance()->start(new PrefetchTask(p));
+}
+
+void RasterImageCache::discard(Plane *p)
+{
+	QMutexLocker locker(&mutex);
+	if (p->pinCount == 0 && !p->owned && !loading.contains(p))
+		drop(p);
+}
+
+void RasterImageCache::remove(Plane *p)
+{
+	QMutexLocker locker(&mutex);
+	queued.remove(p);
+	while (loading.contains(p))
+		loaded.wait(&mutex);
+	drop(p);
+}
+
+void RasterImageCache::pin(Plane *p)
+{
+	QMutexLocker locker(&mutex);
+	++p->pinCount;
+}
+
+void RasterImageCache::unpin(Plane *p)
+{
+	QMutexLocker locker(&mutex);
+	if (p->pinCount > 0 && --p->pinCount == 0)
+		evict(NULL);
+}
+
+void RasterImageCache::load(Plane *p)
+{
+	queued.remove(p);
+	while (loading.contains(p))
+		loaded.wait(&mutex);
+	if (p->img.isNull() && !p->owned && !p->unreadable)
+	{
+		loading.insert(p);
+		decode(p);
+	}
+}
+
+void RasterImageCache::decode(Plane *p)
+{
+	const QString path = p->fullPathFileName;
+	mutex.unlock();
+
+	QImage img(path);
+
+	mutex.lock();
+	loading.remove(p);
+	// set() may have assigned an image while this one was decoded
+	if (p->img.isNull() && !p->owned)
+	{
+		p->img = img;
+		p->imgSize = img.size();
+		p->unreadable = img.isNull();
+		used += bytes(img);
+	}
+	loaded.wakeAll();
+}
+
+void RasterImageCache::touch(Plane *p)
+{
+	if (p->owned || p->img.isNull())
+		return;
+	QHash<Plane *, std::list<Plane *>::iterator>::iterator it = lruPos.find(p);
+	if (it != lruPos.end())
+		lru.splice(lru.begin(), lru, it.value());
+	else
+	{
+		lru.push_front(p);
+		lruPos.insert(p, lru.begin());
+	}
+}
+
+void RasterImageCache::evict(Plane *keep)
+{
+	std::list<Plane *>::iterator it = lru.end();
+	while (used > maxBytes && it != lru.begin())
+	{
+		--it;
+		Plane *p = *it;
+		if (p == keep || p->pinCount > 0 || loading.contains(p))
+			continue;
+		// drop() erases it from the list, step back to its successor
+		++it;
+		drop(p);
+	}
+}
+
+void RasterImageCache::drop(Plane *p)
+{
+	QHash<Plane *, std::list<Plane *>::iterator>::iterator it = lruPos.find(p);
+	if (it != lruPos.end())
+	{
+		used -= bytes(p->img);
+		lru.erase(it.value());
+		lruPos.erase(it);
+	}
+	if (!p->owned)
+		p->img = QImage();
+}
+
+qint64 RasterImageCache::bytes(const QImage &img)
+{
+	return img.isNull() ? 0 : qint64(img.bytesPerLine()) * img.height();
+}
+
+RasterImagePin::~RasterImagePin()
+{
+	for (int i = 0; i < planes.size(); ++i)
+		RasterImageCache::instance().unpin(planes[i]);
+}
+
+void RasterImagePin::add(Plane *p)
+{
+	RasterImageCache::instance().pin(p);
+	planes.push_back(p);
+}
@@ -0,0 +1,127 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef RASTERIMAGECACHE_H
+#define RASTERIMAGECACHE_H
+
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QSize>
+#include <QWaitCondition>
+
+#include <list>
+
+class Plane;
+
+/**
+\brief Process wide cache of the decoded images of the raster planes.
+
+A Plane is created with just the path of its image, the pixels are decoded
+the first time they are asked for and kept in memory until the total size
+of the decoded images goes over the budget; then the least recently used
+planes are discarded, to be decoded again if needed later.
+
+Images assigned with Plane::setImage() do not come from a file and are never
+discarded. A plane that is pinned (see RasterImagePin) is not discarded
+either. The images are handed out as copies taken under the lock, that share
+the pixels with the cached one: a copy stays valid even if the plane is
+discarded meanwhile, pinning just avoids decoding it again.
+
+Filters that walk the rasters in order can prefetch() the next ones, that
+are decoded in the global thread pool while the current one is processed.
+All the functions can be called from any thread.
+*/
+class RasterImageCache
+{
+public:
+	static RasterImageCache &instance();
+
+	void setBudget(qint64 bytes);
+	qint64 budget() const;
+	qint64 usedBytes() const;
+
+	/// The full image of p, decoded if needed; null if the file can not be read.
+	QImage acquire(Plane *p);
+	/// True if the full image of p is in memory.
+	bool inCore(const Plane *p) const;
+	/// Size of the full image of p, read from the file header if it is not decoded.
+	QSize size(Plane *p);
+	void set(Plane *p, const QImage &img);
+
+	/// Start the decoding of p in background, if it is not already in memory.
+	void prefetch(Plane *p);
+	/// Free the decoded images of p, unless they are pinned or not backed by a file.
+	void discard(Plane *p);
+	/// Forget p; called when p is destroyed.
+	void remove(Plane *p);
+
+	void pin(Plane *p);
+	void unpin(Plane *p);
+
+	/// Body of the prefetch tasks: decode p if it is still waiting for it.
+	void acquireQueued(Plane *p);
+
+private:
+	RasterImageCache();
+	RasterImageCache(const RasterImageCache &);
+	RasterImageCache &operator=(const RasterImageCache &);
+
+	void load(Plane *p);                 // with the mutex locked, returns with it locked
+	void decode(Plane *p);               // p already marked as loading
+	void touch(Plane *p);
+	void evict(Plane *keep);
+	void drop(Plane *p);
+	static qint64 bytes(const QImage &img);
+
+	mutable QMutex mutex;
+	QWaitCondition loaded;
+	qint64 maxBytes;
+	qint64 used;
+	std::list<Plane *> lru;              // most recently used first
+	QHash<Plane *, std::list<Plane *>::iterator> lruPos;
+	QSet<Plane *> loading;
+	QSet<Plane *> queued;
+};
+
+/**
+\brief Keeps the images of some planes in memory for the life of the object.
+*/
+class RasterImagePin
+{
+public:
+	RasterImagePin() {}
+	explicit RasterImagePin(Plane *p) { add(p); }
+	~RasterImagePin();
+
+	void add(Plane *p);
+
+private:
+	RasterImagePin(const RasterImagePin &);
+	RasterImagePin &operator=(const RasterImagePin &);
+
+	QList<Plane *> planes;
+};
+
+#endif
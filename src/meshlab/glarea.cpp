@@ -246,9 +246,9 @@ void GLArea::pasteTile()
 
                         RasterModel *rastm = md()->rm();
 						rastm->shot = shot_tmp;
-                        float ratio=(float)rastm->currentPlane->image.height()/(float)rastm->shot.Intrinsics.ViewportPx[1];
-                        rastm->shot.Intrinsics.ViewportPx[0]=rastm->currentPlane->image.width();
-                        rastm->shot.Intrinsics.ViewportPx[1]=rastm->currentPlane->image.height();
+                        float ratio=(float)rastm->currentPlane->size().height()/(float)rastm->shot.Intrinsics.ViewportPx[1];
+                        rastm->shot.Intrinsics.ViewportPx[0]=rastm->currentPlane->size().width();
+                        rastm->shot.Intrinsics.ViewportPx[1]=rastm->currentPlane->size().height();
                         rastm->shot.Intrinsics.PixelSizeMm[1]/=ratio;
                         rastm->shot.Intrinsics.PixelSizeMm[0]/=ratio;
                         rastm->shot.Intrinsics.CenterPx[0]= rastm->shot.Intrinsics.ViewportPx[0]/2.0;
@@ -1856,12 +1856,14 @@ void GLArea::loadRaster(int id)
         if(rm->id()==id)
         {
             this->md()->setCurrentRaster(id);
-            if (rm->currentPlane->image.isNull())
+            QImage target = rm->currentPlane->image();
+            if (target.isNull())
             {
                 Logf(0,"Image file %s has not been correctly loaded, a fake image is going to be shown.",rm->currentPlane->fullPathFileName.toUtf8().constData());
-                rm->currentPlane->image.load(":/images/dummy.png");
+                rm->currentPlane->setImage(QImage(":/images/dummy.png"));
+                target = rm->currentPlane->image();
             }
-            setTarget(rm->currentPlane->image);
+            setTarget(target);
             //load his shot or a default shot
 
             if (rm->shot.IsValid())
@@ -1900,8 +1902,8 @@ void GLArea::drawTarget()
     if(!targetTex) return;
 
     if(this->md()->rm()==0) return;
-    QImage &curImg = this->md()->rm()->currentPlane->image;
-    float imageRatio = float(curImg.width())/float(curImg.height());
+    const QSize curSize = this->md()->rm()->currentPlane->size();
+    float imageRatio = float(curSize.width())/float(curSize.height());
     float screenRatio = float(this->width())/float(this->height());
     //set orthogonal view
     glPushMatrix();
@@ -84,6 +84,9 @@ public:
 
 	std::ptrdiff_t maxTextureMemory;
 	inline static QString maxTextureMemoryParam()  {return "MeshLab::System::maxTextureMemory";}
+
+	std::ptrdiff_t maxRasterMemory;
+	inline static QString maxRasterMemoryParam()  {return "MeshLab::System::maxRasterMemory";}
 };
 
 class MainWindow : public QMainWindow, public MainWindowInterface
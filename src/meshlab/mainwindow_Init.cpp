@@ -1186,6 +1186,7 @@ void MainWindowSetting::initGlobalParameterSet(RichParameterSet* glbset)
 	if (MeshLabScalarTest<Scalarm>::doublePrecision())
 		glbset->addParam(new RichBool(highPrecisionRendering(), false, "High Precision Rendering", "If true all the models in the scene will be rendered at the center of the world"));
 	glbset->addParam(new RichInt(maxTextureMemoryParam(), 256, "Max Texture Memory (in MB)", "The maximum quantity of texture memory allowed to load mesh textures"));
+	glbset->addParam(new RichInt(maxRasterMemoryParam(), 2048, "Max Raster Image Memory (in MB)", "The maximum quantity of memory used to keep the decoded raster images; the least recently used ones are discarded and read again from the file when needed"));
 }
 
 void MainWindowSetting::updateGlobalParameterSet(RichParameterSet& rps)
@@ -1198,6 +1199,8 @@ void MainWindowSetting::updateGlobalParameterSet(RichParameterSet& rps)
 	if (MeshLabScalarTest<Scalarm>::doublePrecision())
 		highprecision = rps.getBool(highPrecisionRendering());
 	maxTextureMemory = (std::ptrdiff_t) rps.getInt(this->maxTextureMemoryParam()) * (float)(1024 * 1024);
+	maxRasterMemory = (std::ptrdiff_t) rps.getInt(this->maxRasterMemoryParam()) * (std::ptrdiff_t)(1024 * 1024);
+	RasterImageCache::instance().setBudget(maxRasterMemory);
 }
 
 void MainWindow::defaultPerViewRenderingData(MLRenderingData& dt) const
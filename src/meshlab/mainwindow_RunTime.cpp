@@ -45,6 +45,7 @@
 #include "../common/mlapplication.h"
 #include "../common/filterscript.h"
 #include "../common/mlexception.h"
+#include "../common/ml_parallel_update.h"
 
 #include <wrap/io_trimesh/alnParser.h>
 
@@ -987,6 +988,9 @@ void MainWindow::startFilter()
 
 void MainWindow::updateSharedContextDataAfterFilterExecution(int postcondmask,int fclasses,bool& newmeshcreated)
 {
+    if (meshDoc() != NULL)
+        for(MeshModel* mm = meshDoc()->nextMesh();mm != NULL;mm = meshDoc()->nextMesh(mm))
+            mm->clearKNNGraph(postcondmask);
     MultiViewer_Container* mvc = currentViewContainer();
     if ((meshDoc() != NULL) && (mvc != NULL))
     {
@@ -2030,9 +2034,9 @@ bool MainWindow::importRaster(const QString& fileImg)
             fclose(pFile);
             if (!ret || (ImageInfo.CCDWidth==0.0f && ImageInfo.FocalLength35mmEquiv==0.0f))
             {
-                rm->shot.Intrinsics.ViewportPx = vcg::Point2i(rm->currentPlane->image.width(), rm->currentPlane->image.height());
-                rm->shot.Intrinsics.CenterPx   = Point2m(float(rm->currentPlane->image.width()/2.0), float(rm->currentPlane->image.width()/2.0));
-                rm->shot.Intrinsics.PixelSizeMm[0]=36.0f/(float)rm->currentPlane->image.width();
+                rm->shot.Intrinsics.ViewportPx = vcg::Point2i(rm->currentPlane->size().width(), rm->currentPlane->size().height());
+                rm->shot.Intrinsics.CenterPx   = Point2m(float(rm->currentPlane->size().width()/2.0), float(rm->currentPlane->size().width()/2.0));
+                rm->shot.Intrinsics.PixelSizeMm[0]=36.0f/(float)rm->currentPlane->size().width();
                 rm->shot.Intrinsics.PixelSizeMm[1]=rm->shot.Intrinsics.PixelSizeMm[0];
                 rm->shot.Intrinsics.FocalMm = 50.0f;
             }
@@ -2165,12 +2169,12 @@ bool MainWindow::loadMesh(const QString& fileName, MeshIOInterface *pCurrentIOPl
     } // standard case
     else
     {
-        vcg::tri::UpdateNormal<CMeshO>::PerFaceNormalized(mm->cm);
+        vcg::tri::ParallelUpdateNormal<CMeshO>::PerFaceNormalized(mm->cm);
         if(!( mask & vcg::tri::io::Mask::IOM_VERTNORMAL) )
-            vcg::tri::UpdateNormal<CMeshO>::PerVertexAngleWeighted(mm->cm);
+            vcg::tri::ParallelUpdateNormal<CMeshO>::PerVertexAngleWeighted(mm->cm);
     }
 
-    vcg::tri::UpdateBounding<CMeshO>::Box(mm->cm);					// updates bounding box
+    vcg::tri::ParallelUpdateBounding<CMeshO>::Box(mm->cm);					// updates bounding box
     if(mm->cm.fn==0 && mm->cm.en==0)
     {
         if(mask & vcg::tri::io::Mask::IOM_VERTNORMAL)
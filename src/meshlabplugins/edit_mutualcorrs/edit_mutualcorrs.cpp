@@ -402,13 +402,13 @@ void EditMutualCorrsPlugin::receivedShot(QString name, Shotm shot)
 	if (name == "current")
 	{
 		align.shot = shot;
-		double ratio = (double)glArea->md()->rm()->currentPlane->image.height() / (double)align.shot.Intrinsics.ViewportPx[1];
+		double ratio = (double)glArea->md()->rm()->currentPlane->size().height() / (double)align.shot.Intrinsics.ViewportPx[1];
 		align.shot.Intrinsics.PixelSizeMm[0] /= ratio;
 		align.shot.Intrinsics.PixelSizeMm[1] /= ratio;
 
-		align.shot.Intrinsics.ViewportPx[0] = glArea->md()->rm()->currentPlane->image.width();
+		align.shot.Intrinsics.ViewportPx[0] = glArea->md()->rm()->currentPlane->size().width();
 		align.shot.Intrinsics.CenterPx[0] = (int)(align.shot.Intrinsics.ViewportPx[0] / 2);
-		align.shot.Intrinsics.ViewportPx[1] = glArea->md()->rm()->currentPlane->image.height();
+		align.shot.Intrinsics.ViewportPx[1] = glArea->md()->rm()->currentPlane->size().height();
 		align.shot.Intrinsics.CenterPx[1] = (int)(align.shot.Intrinsics.ViewportPx[1] / 2);
 	}
 
@@ -492,7 +492,9 @@ void EditMutualCorrsPlugin::applyMutual()
 {
 	Solver solver;
 	MutualInfo mutual;
-	align.image = &glArea->md()->rm()->currentPlane->image;
+	RasterImagePin pin(glArea->md()->rm()->currentPlane);
+	QImage image = glArea->md()->rm()->currentPlane->image();   // align keeps a pointer to it
+	align.image = &image;
 	align.mesh = &glArea->md()->mm()->cm;
 	int rendmode = mutualcorrsDialog->ui->renderingBox->currentIndex();
 	solver.optimize_focal = mutualcorrsDialog->ui->checkFocal->isChecked();
@@ -594,9 +596,9 @@ void EditMutualCorrsPlugin::applyMutual()
 		solver.levmar(&align, align.shot);
 
 		glArea->md()->rm()->shot = Shotm::Construct(align.shot);
-		float ratio = (float)glArea->md()->rm()->currentPlane->image.height() / (float)align.shot.Intrinsics.ViewportPx[1];
-		glArea->md()->rm()->shot.Intrinsics.ViewportPx[0] = glArea->md()->rm()->currentPlane->image.width();
-		glArea->md()->rm()->shot.Intrinsics.ViewportPx[1] = glArea->md()->rm()->currentPlane->image.height();
+		float ratio = (float)glArea->md()->rm()->currentPlane->size().height() / (float)align.shot.Intrinsics.ViewportPx[1];
+		glArea->md()->rm()->shot.Intrinsics.ViewportPx[0] = glArea->md()->rm()->currentPlane->size().width();
+		glArea->md()->rm()->shot.Intrinsics.ViewportPx[1] = glArea->md()->rm()->currentPlane->size().height();
 		glArea->md()->rm()->shot.Intrinsics.PixelSizeMm[1] /= ratio;
 		glArea->md()->rm()->shot.Intrinsics.PixelSizeMm[0] /= ratio;
 		glArea->md()->rm()->shot.Intrinsics.CenterPx[0] = (int)((float)glArea->md()->rm()->shot.Intrinsics.ViewportPx[0] / 2.0);
@@ -636,9 +638,9 @@ void EditMutualCorrsPlugin::applyMutual()
 		solver.optimize(&align, &mutual, align.shot);
 		
 		glArea->md()->rm()->shot = Shotm::Construct(align.shot);
-		float ratio = (float)glArea->md()->rm()->currentPlane->image.height() / (float)align.shot.Intrinsics.ViewportPx[1];
-		glArea->md()->rm()->shot.Intrinsics.ViewportPx[0] = glArea->md()->rm()->currentPlane->image.width();
-		glArea->md()->rm()->shot.Intrinsics.ViewportPx[1] = glArea->md()->rm()->currentPlane->image.height();
+		float ratio = (float)glArea->md()->rm()->currentPlane->size().height() / (float)align.shot.Intrinsics.ViewportPx[1];
+		glArea->md()->rm()->shot.Intrinsics.ViewportPx[0] = glArea->md()->rm()->currentPlane->size().width();
+		glArea->md()->rm()->shot.Intrinsics.ViewportPx[1] = glArea->md()->rm()->currentPlane->size().height();
 		glArea->md()->rm()->shot.Intrinsics.PixelSizeMm[1] /= ratio;
 		glArea->md()->rm()->shot.Intrinsics.PixelSizeMm[0] /= ratio;
 		glArea->md()->rm()->shot.Intrinsics.CenterPx[0] = (int)((float)glArea->md()->rm()->shot.Intrinsics.ViewportPx[0] / 2.0);
@@ -669,8 +671,8 @@ Point3m EditMutualCorrsPlugin::fromPickedToImage(Point2m picked)
 {
 	int glWidth= glArea->size().width();
 	int glHeight = glArea->size().height();
-	int imWidth = glArea->md()->rm()->currentPlane[0].image.width();
-	int imHeight = glArea->md()->rm()->currentPlane[0].image.height();
+	int imWidth = glArea->md()->rm()->currentPlane[0].size().width();
+	int imHeight = glArea->md()->rm()->currentPlane[0].size().height();
 	double ratio = (double)imHeight / (double)glHeight;
 	int wGLC = (int)(glWidth / 2.0) - picked[0];
 	int imWPick = (int)(imWidth / 2.0) - (int)(wGLC*ratio);
@@ -683,8 +685,8 @@ Point2m EditMutualCorrsPlugin::fromImageToGL(Point2m picked)
 {
 	int glWidth = glArea->size().width();
 	int glHeight = glArea->size().height();
-	int imWidth = glArea->md()->rm()->currentPlane[0].image.width();
-	int imHeight = glArea->md()->rm()->currentPlane[0].image.height();
+	int imWidth = glArea->md()->rm()->currentPlane[0].size().width();
+	int imHeight = glArea->md()->rm()->currentPlane[0].size().height();
 	
 	double ratio = (double)glHeight / (double)imHeight;
 
@@ -3,7 +3,7 @@
 
 #include <QTime>
 
-#include "knnGraph.h"
+#include <common/ml_parallel_knn.h>
 
 #include <vector>
 #include <stack>
@@ -101,28 +101,17 @@ public:
 /** This function is used to calculate the minimum distances between one point (v) and all the others
   * in the mesh. We use the Dijkstra algorithm with one change: only arcs with a cost less or equal
   * of maxHopDist will be taken into account.
-  * In the first call of this method, when neither DistParam or KNNGraph are present, we create these
-  * attributes and we construct the KNNGraph.
+  * The arcs are the first numOfNeighbours neighbours of each vertex in the knnGraph, that must
+  * have been built on m with at least numOfNeighbours neighbours (see MeshModel::knnGraph).
   * The notReachableVect is returned in order to calculate the border in other methods.
   **/
 
-static void Dijkstra(_MyMeshType& m, VertexType& v, int numOfNeighbours, float maxHopDist, std::vector<VertexType*> &notReachableVect)
+static void Dijkstra(_MyMeshType& m, VertexType& v, const ParallelKNNGraph<_MyMeshType> &knnGraph, int numOfNeighbours, float maxHopDist, std::vector<VertexType*> &notReachableVect)
 {
-    bool hasKNNGraph = tri::HasPerVertexAttribute(m, "KNNGraph");
-//    bool hasDistParam = tri::HasPerVertexAttribute(m, "DistParam");
-
     notReachableVect.clear();
 
     typename _MyMeshType::template PerVertexAttributeHandle<float> distFromCenter = vcg::tri::Allocator<_MyMeshType>::template GetPerVertexAttribute<float>(m, std::string("DistParam"));
 
-    if (!hasKNNGraph) {
-        KNNGraph<_MyMeshType>::MakeKNNTree(m, numOfNeighbours);
-    }
-
-    typename _MyMeshType::template PerVertexAttributeHandle<std::vector<VertexType*>* > neighboursVect = tri::Allocator<_MyMeshType>::template GetPerVertexAttribute<std::vector<VertexType*>* >(m,"KNNGraph");
-
-    typename std::vector<VertexType*>::iterator it;
-
     // For Dijkstra algorithm we use a Priority Queue
     typedef std::priority_queue<VertexType*, std::vector<VertexType*>, Compare > VertPriorityQueue;
     Compare Comparator(&distFromCenter);
@@ -142,21 +131,23 @@ static void Dijkstra(_MyMeshType& m, VertexType& v, int numOfNeighbours, float m
          VertexType* element = prQueue.top();
         prQueue.pop();
 
-        for (it = neighboursVect[element]->begin(); it != neighboursVect[element]->end(); it++) 
+        const int ei = int(tri::Index(m, element));
+        for (int k = knnGraph.Begin(ei); k < knnGraph.Begin(ei) + knnGraph.Size(ei, numOfNeighbours); k++)
 		{
+			VertexType* nv = &m.vert[knnGraph.nbr[k]];
 			//I have not to compute the arches connecting vertices already visited.
-			if (!(*it)->IsV())
+			if (!nv->IsV())
 			{
-				float distance = vcg::Distance((*it)->P(), element->P());
+				float distance = std::sqrt(knnGraph.dist2[k]);
 
 				// we take into account only the arcs with a distance less or equal to maxHopDist
 				if (distance <= maxHopDist) 
 				{
-					if ((distFromCenter[*element] + distance) < distFromCenter[*it])
+					if ((distFromCenter[*element] + distance) < distFromCenter[*nv])
 					{
-						distFromCenter[*it] = distFromCenter[*element] + distance;
-						prQueue.push(*it);
-						(*it)->SetV();
+						distFromCenter[*nv] = distFromCenter[*element] + distance;
+						prQueue.push(nv);
+						nv->SetV();
 					}
 				}
 				// all the other are the notReachable arcs
@@ -173,8 +164,6 @@ static void Dijkstra(_MyMeshType& m, VertexType& v, int numOfNeighbours, float m
 
 static void DeletePerVertexAttribute(_MyMeshType& m)
 {
-    KNNGraph<_MyMeshType>::DeleteKNNTree(m);
-
     bool hasDistParam = tri::HasPerVertexAttribute(m, "DistParam");
     if (hasDistParam) {
         Allocator<_MyMeshType>::DeletePerVertexAttribute(m, "DistParam");
@@ -66,7 +66,7 @@ void EditPointPlugin::Decorate(MeshModel &m, GLArea * gla, QPainter */*p*/)
         if(newStartingVertex)
         {
             startingVertex = newStartingVertex;
-            tri::ComponentFinder<CMeshO>::Dijkstra(m.cm, *startingVertex, K, this->maxHop, this->NotReachableVector);
+            tri::ComponentFinder<CMeshO>::Dijkstra(m.cm, *startingVertex, m.knnGraph(K), K, this->maxHop, this->NotReachableVector);
             ComponentVector.push_back(startingVertex);
         }
 
@@ -337,7 +337,7 @@ void EditPointPlugin::keyPressEvent(QKeyEvent *ev, MeshModel &m, GLArea *gla) {
        new arcs to consider in the Dijkstra algorithm.
        If we modified other parameters we need only to find the new selected component. */
     if (hopDistModified) {
-        tri::ComponentFinder<CMeshO>::Dijkstra(m.cm, *startingVertex, 6, this->maxHop, this->NotReachableVector);
+        tri::ComponentFinder<CMeshO>::Dijkstra(m.cm, *startingVertex, m.knnGraph(K), K, this->maxHop, this->NotReachableVector);
     }
     if (parameterModified) {
         BorderVector.clear();
@@ -370,7 +370,7 @@ void EditPointPlugin::wheelEvent(QWheelEvent* ev, MeshModel &m, GLArea *gla)
   }
 
   if (hopDistModified && (startingVertex != NULL)) {
-    tri::ComponentFinder<CMeshO>::Dijkstra(m.cm, *startingVertex, K, this->maxHop, this->NotReachableVector);
+    tri::ComponentFinder<CMeshO>::Dijkstra(m.cm, *startingVertex, m.knnGraph(K), K, this->maxHop, this->NotReachableVector);
   }
 
   if(startingVertex != NULL)
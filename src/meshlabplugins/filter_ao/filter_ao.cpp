@@ -25,6 +25,7 @@
 #include "filter_ao.h"
 #include <QGLFramebufferObject>
 #include <vcg/math/gen_normal.h>
+#include <common/ml_parallel_bvh.h>
 
 #include <wrap/qt/checkGLError.h>
 
@@ -118,9 +119,9 @@ void AmbientOcclusionPlugin::initParameterSet(QAction *action, MeshModel & /*m*/
 			parlst.addParam(new RichInt ("reqViews",AMBOCC_DEFAULT_NUM_VIEWS,"Requested views", "Number of different views uniformly placed around the mesh. More views means better accuracy at the cost of increased calculation time"));
 			parlst.addParam(new RichPoint3f("coneDir",Point3f(0,1,0),"Lighting Direction", "Number of different views placed around the mesh. More views means better accuracy at the cost of increased calculation time"));
 			parlst.addParam(new RichFloat("coneAngle",30,"Cone amplitude", "Number of different views uniformly placed around the mesh. More views means better accuracy at the cost of increased calculation time"));
-			parlst.addParam(new RichBool("useGPU",AMBOCC_USEGPU_BY_DEFAULT,"Use GPU acceleration","Only works for per-vertex AO. In order to use GPU-Mode, your hardware must support FBOs, FP32 Textures and Shaders. Normally increases the performance by a factor of 4x-5x"));
+			parlst.addParam(new RichBool("useGPU",AMBOCC_USEGPU_BY_DEFAULT,"Use GPU acceleration","Only works for per-vertex AO. In order to use GPU-Mode, your hardware must support FBOs, FP32 Textures and Shaders. When disabled the occlusion is computed by casting rays on all the CPU cores, with no need of a GL context."));
 			//parlst.addParam(new RichBool("useVBO",AMBOCC_USEVBO_BY_DEFAULT,"Use VBO if supported","By using VBO, Meshlab loads all the vertex structure in the VRam, greatly increasing rendering speed (for both CPU and GPU mode). Disable it if problem occurs"));
-			parlst.addParam(new RichInt ("depthTexSize",AMBOCC_DEFAULT_TEXTURE_SIZE,"Depth texture size(should be 2^n)", "Defines the depth texture size used to compute occlusion from each point of view. Higher values means better accuracy usually with low impact on performance"));
+			parlst.addParam(new RichInt ("depthTexSize",AMBOCC_DEFAULT_TEXTURE_SIZE,"Depth texture size(should be 2^n)", "Defines the depth texture size used to compute occlusion from each point of view in GPU mode. Higher values means better accuracy usually with low impact on performance"));
         break;
 		default: break; // do not add any parameter for the other filters
     }
@@ -168,6 +169,10 @@ bool AmbientOcclusionPlugin::applyFilter(QAction * /*filter*/, MeshDocument &md,
     viewDirVec.insert(viewDirVec.end(),coneDirVec.begin(),coneDirVec.begin()+coneNum);
     numViews = viewDirVec.size();
 
+    // the software path ray casts on the CPU and does not need any GL context
+    if (!useGPU)
+        return processCPU(m, viewDirVec, cb);
+
     this->glContext->makeCurrent();
     this->initGL(cb,m.cm.vn);
     unsigned int widgetSize = std::min(maxTexSize, depthTexSize);
@@ -241,14 +246,6 @@ bool AmbientOcclusionPlugin::processGL(MeshModel &m, vector<Point3f> &posVect)
     }
 
     tInitElapsed = tInit.elapsed();
-	vector<Point3f> faceCenterVec;
-	
-	if (perFace)
-	{
-		faceCenterVec.resize(m.cm.face.size());
-		for (int i = 0; i<m.cm.fn; i++)
-			faceCenterVec[i].Import(Barycenter(m.cm.face[i]));
-	}
 
     for (vi = posVect.begin(); vi != posVect.end(); vi++)
     {
@@ -284,30 +281,6 @@ bool AmbientOcclusionPlugin::processGL(MeshModel &m, vector<Point3f> &posVect)
             glViewport(0,0,maxTexSize,maxTexSize);
             generateOcclusionHW();
         }
-        else
-        {
-            glDisable(GL_BLEND);
-            glClear(GL_DEPTH_BUFFER_BIT);
-            // FIRST PASS - fill depth buffer
-            glColorMask(0, 0, 0, 0);
-
-            MLRenderingData dt;
-            MLRenderingData::RendAtts atts;
-            atts[MLRenderingData::ATT_NAMES::ATT_VERTPOSITION] = true;
-            dt.set(MLRenderingData::PR_SOLID,atts);
-            glContext->setRenderingData(m.id(),dt);
-            glContext->drawMeshModel(m.id());
-
-            glColorMask(1, 1, 1, 1);
-
-            glDisable(GL_POLYGON_OFFSET_FILL);
-
-            // SECOND PASS - use depth buffer to check occlusion
-            if(perFace) 
-				generateFaceOcclusionSW(m,faceCenterVec);
-            else 
-				generateOcclusionSW(m);
-        }
         checkGLError::debugInfo("Debug");
     }
 
@@ -374,6 +347,100 @@ bool AmbientOcclusionPlugin::processGL(MeshModel &m, vector<Point3f> &posVect)
     return true;
 }
 
+/*
+  Software occlusion: instead of reading back a depth map for each view, a ray
+  is cast from every vertex (or face barycenter) towards each direction over a
+  BVH of the mesh. The samples are independent, so they are spread on all the
+  cores and no GL context is needed at all.
+*/
+bool AmbientOcclusionPlugin::processCPU(MeshModel &m, vector<Point3f> &posVect, vcg::CallBackPos *cb)
+{
+    QElapsedTimer tInit, tAll;
+    tInit.start();
+    tAll.start();
+
+    vcg::tri::Allocator<CMeshO>::CompactVertexVector(m.cm);
+    vcg::tri::Allocator<CMeshO>::CompactFaceVector(m.cm);
+    vcg::tri::UpdateNormal<CMeshO>::PerVertexNormalizedPerFaceNormalized(m.cm);
+    vcg::tri::UpdateBounding<CMeshO>::Box(m.cm);
+
+    if (cb) cb(0, "Building the BVH");
+    const tri::ParallelBVH<CMeshO> bvh(m.cm);
+    const int tInitElapsed = tInit.elapsed();
+
+    // rays start slightly off the surface to avoid hitting the faces around the sample
+    const float eps = m.cm.bbox.Diag() * 1e-5f;
+    const float tMax = std::numeric_limits<float>::max();
+    const int sampleNum = perFace ? m.cm.fn : m.cm.vn;
+    const int viewNum = int(posVect.size());
+    std::vector<Point3f> dirVec(posVect);
+    for (int k = 0; k < viewNum; ++k)
+        dirVec[k].Normalize();
+    std::vector<float> occ(sampleNum);
+    std::vector<Point3f> bent(sampleNum);
+
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int i = 0; i < sampleNum; ++i)
+    {
+        Point3f p, n;
+        if (perFace)
+        {
+            p = Point3f::Construct(Barycenter(m.cm.face[i]));
+            n = Point3f::Construct(m.cm.face[i].cN());
+        }
+        else
+        {
+            p = Point3f::Construct(m.cm.vert[i].cP());
+            n = Point3f::Construct(m.cm.vert[i].cN());
+        }
+        const Point3f orig = p + n * eps;
+        float q = 0;
+        Point3f bn(0, 0, 0);
+        for (int k = 0; k < viewNum; ++k)
+        {
+            const Point3f &dir = dirVec[k];
+            const float cosine = n.dot(dir);
+            if (cosine <= 0) continue;
+            if (!bvh.Occluded(orig, dir, 0, tMax))
+            {
+                q += cosine;
+                bn += dir;
+            }
+        }
+        occ[i] = q / viewNum;
+        bent[i] = bn.Normalize();
+        if (cb && (i % 1024) == 0 && MLParallel::ThreadId() == 0)
+            cb(int((long long)(i) * 100 / sampleNum), "Casting rays ...");
+    }
+
+    if (perFace)
+    {
+        CMeshO::PerFaceAttributeHandle<Point3f> FBN = tri::Allocator<CMeshO>::GetPerFaceAttribute<Point3f>(m.cm, "BentNormal");
+        for (int i = 0; i < sampleNum; ++i)
+        {
+            m.cm.face[i].Q() = occ[i];
+            FBN[i] = bent[i];
+        }
+        tri::UpdateColor<CMeshO>::PerFaceQualityGray(m.cm);
+    }
+    else
+    {
+        CMeshO::PerVertexAttributeHandle<Point3f> BN = tri::Allocator<CMeshO>::GetPerVertexAttribute<Point3f>(m.cm, "BentNormal");
+        for (int i = 0; i < sampleNum; ++i)
+        {
+            m.cm.vert[i].Q() = occ[i];
+            BN[i] = bent[i];
+        }
+        tri::UpdateColor<CMeshO>::PerVertexQualityGray(m.cm, 0.0f, 0.0f);
+    }
+
+    Log(GLLogStream::SYSTEM,"Successfully calculated A.O. after %3.2f sec, %3.2f of which is due to initialization", ((float)tAll.elapsed()/1000.0f), ((float)tInitElapsed/1000.0f) );
+
+    if (glContext != NULL)
+        glContext->meshAttributesUpdated(m.id(),true,MLRenderingData::RendAtts());
+    return true;
+}
+
 void AmbientOcclusionPlugin::initGL(vcg::CallBackPos *cb, unsigned int numVertices)
 {
     //******* INIT GLEW ********/
@@ -768,79 +835,6 @@ void AmbientOcclusionPlugin::generateOcclusionHW()
     glUseProgram(0);
 }
 
-void AmbientOcclusionPlugin::generateOcclusionSW(MeshModel &m)
-{
-    GLdouble resCoords[3];
-    GLdouble mvMatrix_f[16];
-    GLdouble prMatrix_f[16];
-    GLint viewpSize[4];
-    GLfloat *dFloat = new GLfloat[depthTexArea];
-
-    glGetDoublev(GL_MODELVIEW_MATRIX, mvMatrix_f);
-    glGetDoublev(GL_PROJECTION_MATRIX, prMatrix_f);
-    glGetIntegerv(GL_VIEWPORT, viewpSize);
-
-    glReadPixels(0, 0, depthTexSize, depthTexSize, GL_DEPTH_COMPONENT, GL_FLOAT, dFloat);
-
-    cameraDir.Normalize();
-    CMeshO::PerVertexAttributeHandle<Point3f> BN = tri::Allocator<CMeshO>::GetPerVertexAttribute<Point3f>(m.cm, "BentNormal");
-
-    for (int i=0; i<m.cm.vn; ++i)
-    {
-        Point3<CMeshO::ScalarType> &vp = m.cm.vert[i].P();
-        gluProject(vp.X(), vp.Y(), vp.Z(),
-            (const GLdouble *) mvMatrix_f, (const GLdouble *) prMatrix_f, (const GLint *) viewpSize,
-            &resCoords[0], &resCoords[1], &resCoords[2] );
-
-        int x = floor(resCoords[0]);
-        int y = floor(resCoords[1]);
-
-        if (resCoords[2] <= (GLdouble)dFloat[depthTexSize*y+x])
-        {
-            m.cm.vert[i].Q() += max(Point3f::Construct(m.cm.vert[i].cN()).dot(cameraDir), 0.0f);
-            BN[ m.cm.vert[i] ] += cameraDir;
-        }
-    }
-
-    delete [] dFloat;
-}
-
-void AmbientOcclusionPlugin::generateFaceOcclusionSW(MeshModel &m, vector<Point3f> & faceCenterVec)
-{
-    GLdouble resCoords[3];
-    GLdouble mvMatrix_f[16];
-    GLdouble prMatrix_f[16];
-    GLint viewpSize[4];
-    GLfloat *dFloat = new GLfloat[depthTexArea];
-    glGetDoublev(GL_MODELVIEW_MATRIX, mvMatrix_f);
-    glGetDoublev(GL_PROJECTION_MATRIX, prMatrix_f);
-    glGetIntegerv(GL_VIEWPORT, viewpSize);
-
-    glReadPixels(0, 0, depthTexSize, depthTexSize, GL_DEPTH_COMPONENT, GL_FLOAT, dFloat);
-
-    cameraDir.Normalize();
-	CMeshO::PerFaceAttributeHandle<Point3f> FBN = tri::Allocator<CMeshO>::GetPerFaceAttribute<Point3f>(m.cm, "BentNormal");
-
-    for (uint i=0; i<faceCenterVec.size(); ++i)
-    {
-        Point3f &vp = faceCenterVec[i];
-        gluProject(vp.X(), vp.Y(), vp.Z(),
-            (const GLdouble *) mvMatrix_f, (const GLdouble *) prMatrix_f, (const GLint *) viewpSize,
-            &resCoords[0], &resCoords[1], &resCoords[2] );
-
-        int x = floor(resCoords[0]);
-        int y = floor(resCoords[1]);
-
-        if (resCoords[2] <= (GLdouble)dFloat[depthTexSize*y+x])
-        {
-            m.cm.face[i].Q() += max(Point3f::Construct(m.cm.face[i].cN()).dot(cameraDir), 0.0f);
-			FBN[m.cm.face[i]] += cameraDir;
-        }
-    }
-
-    delete [] dFloat;
-}
-
 void AmbientOcclusionPlugin::applyOcclusionHW(MeshModel &m)
 {
     const unsigned int texelNum = maxTexSize*maxTexSize;
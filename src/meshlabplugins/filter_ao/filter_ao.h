@@ -79,6 +79,7 @@ public:
     void initTextures(void);
     void initGL(vcg::CallBackPos *cb,unsigned int numVertices);
     bool processGL(MeshModel &m, std::vector<vcg::Point3f> &posVect);
+    bool processCPU(MeshModel &m, std::vector<vcg::Point3f> &posVect, vcg::CallBackPos *cb);
     bool checkFramebuffer();
 
     void vertexCoordsToTexture(MeshModel &m);
@@ -86,8 +87,6 @@ public:
     void setCamera(vcg::Point3f camDir,Box3m &meshBBox);
 
     void generateOcclusionHW();
-    void generateOcclusionSW(MeshModel &m);
-    void generateFaceOcclusionSW(MeshModel &m, std::vector<vcg::Point3f> & faceCenterVec);
 
 
     void applyOcclusionHW(MeshModel &m);
@@ -593,9 +593,9 @@ bool FilterCameraPlugin::applyFilter(QAction *filter, MeshDocument &md, RichPara
             }
             Shotm shotGot=par.getShotm("Shot");
             rm->shot = shotGot;
-            float ratio=(float)rm->currentPlane->image.height()/(float)shotGot.Intrinsics.ViewportPx[1];
-            rm->shot.Intrinsics.ViewportPx[0]=rm->currentPlane->image.width();
-            rm->shot.Intrinsics.ViewportPx[1]=rm->currentPlane->image.height();
+            float ratio=(float)rm->currentPlane->size().height()/(float)shotGot.Intrinsics.ViewportPx[1];
+            rm->shot.Intrinsics.ViewportPx[0]=rm->currentPlane->size().width();
+            rm->shot.Intrinsics.ViewportPx[1]=rm->currentPlane->size().height();
             rm->shot.Intrinsics.PixelSizeMm[1]/=ratio;
             rm->shot.Intrinsics.PixelSizeMm[0]/=ratio;
             rm->shot.Intrinsics.CenterPx[0]=(int)((float)rm->shot.Intrinsics.ViewportPx[0]/2.0);
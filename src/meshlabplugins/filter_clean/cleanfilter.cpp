@@ -24,6 +24,12 @@
 #include "cleanfilter.h"
 #include "align_tools.h"
 
+#include <cmath>
+
+#include <common/ml_parallel_ball_pivoting.h>
+#include <common/ml_parallel_clean.h>
+#include <common/ml_parallel_components.h>
+
 #include <vcg/complex/algorithms/clean.h>
 #include <vcg/complex/algorithms/create/platonic.h>
 #include <vcg/complex/algorithms/stat.h>
@@ -171,7 +177,7 @@ int CleanFilter::getRequirements(QAction *action)
 		case FP_REMOVE_WRT_Q:
 		case FP_BALL_PIVOTING:                return MeshModel::MM_VERTMARK;
 		case FP_REMOVE_ISOLATED_COMPLEXITY:
-		case FP_REMOVE_ISOLATED_DIAMETER:     return MeshModel::MM_FACEFACETOPO | MeshModel::MM_FACEMARK;
+		case FP_REMOVE_ISOLATED_DIAMETER:     return MeshModel::MM_NONE;
 		case FP_REMOVE_TVERTEX_COLLAPSE:      return MeshModel::MM_VERTMARK;
 		case FP_REMOVE_TVERTEX_FLIP:          return MeshModel::MM_FACEFACETOPO | MeshModel::MM_VERTMARK;
 		case FP_REMOVE_NON_MANIF_EDGE:        return MeshModel::MM_FACEFACETOPO | MeshModel::MM_VERTMARK;
@@ -227,6 +233,8 @@ void CleanFilter::initParameterSet(QAction *action,MeshDocument &md, RichParamet
           parlst.addParam(new RichFloat("Clustering",20.0f,"Clustering radius (% of ball radius)","To avoid the creation of too small triangles, if a vertex is found too close to a previous one, it is clustered/merged with it."));
           parlst.addParam(new RichFloat("CreaseThr", 90.0f,"Angle Threshold (degrees)","If we encounter a crease angle that is too large we should stop the ball rolling"));
           parlst.addParam(new RichBool("DeleteFaces",false,"Delete initial set of faces","if true all the initial faces of the mesh are deleted and the whole surface is rebuilt from scratch. Otherwise the current faces are used as a starting point. Useful if you run the algorithm multiple times with an increasing ball radius."));
+          parlst.addParam(new RichInt("RadiusPasses",1,"Number of radii","The ball is pivoted with this number of radii (from 1 to 8), each one twice the previous one, starting from the given radius. Every pass starts from the border of the surface built by the previous ones, so that larger holes are filled without creating large triangles where the sampling is dense."));
+          parlst.addParam(new RichBool("ParallelMode",true,"Parallel","If checked the space is split in blocks whose fronts are grown by all the cores at the same time, and the seams between blocks are then closed; a single spatial index is shared by all the radii."));
           break;
     case FP_REMOVE_ISOLATED_DIAMETER:
           parlst.addParam(new RichAbsPerc("MinComponentDiag",md.mm()->cm.bbox.Diag()/10.0f,0.0f,md.mm()->cm.bbox.Diag(),"Enter max diameter of isolated pieces","Delete all the connected components (floating pieces) with a diameter smaller than the specified one"));
@@ -275,16 +283,36 @@ bool CleanFilter::applyFilter(QAction *filter, MeshDocument &md, RichParameterSe
 		float Clustering = par.getFloat("Clustering") / 100.0f;
 		float CreaseThr = math::ToRad(par.getFloat("CreaseThr"));
 		bool DeleteFaces = par.getBool("DeleteFaces");
+		int RadiusPasses = par.getInt("RadiusPasses");
+		if(RadiusPasses < 1 || RadiusPasses > 8)
+		{
+			errorMessage = "The number of radii must be between 1 and 8";
+			return false;
+		}
 		if(DeleteFaces) 
 		{
 			m.cm.fn=0;
 			m.cm.face.resize(0);
 		}
-		m.updateDataMask(MeshModel::MM_VERTFACETOPO);
+		if(Radius == 0) Radius = tri::ParallelBallPivoting<CMeshO>::GuessRadius(m.cm);
+		std::vector<float> radii(RadiusPasses);
+		for(int i=0;i<RadiusPasses;++i)
+			radii[i] = Radius * std::ldexp(1.f, i);
 		int startingFn=m.cm.fn;
-		tri::BallPivoting<CMeshO> pivot(m.cm, Radius, Clustering, CreaseThr);
-		// the main processing
-		pivot.BuildMesh(cb);
+		if(par.getBool("ParallelMode"))
+		{
+			tri::ParallelBallPivoting<CMeshO>::Do(m.cm, radii, Clustering, CreaseThr, cb);
+		}
+		else
+		{
+			m.updateDataMask(MeshModel::MM_VERTFACETOPO);
+			for(int i=0;i<RadiusPasses;++i)
+			{
+				tri::BallPivoting<CMeshO> pivot(m.cm, radii[i], Clustering, CreaseThr);
+				// the main processing
+				pivot.BuildMesh(cb);
+			}
+		}
 		m.clearDataMask(MeshModel::MM_FACEFACETOPO);
 		Log("Reconstructed surface. Added %i faces",m.cm.fn-startingFn);
 	} break;
@@ -292,7 +320,7 @@ bool CleanFilter::applyFilter(QAction *filter, MeshDocument &md, RichParameterSe
 	case FP_REMOVE_ISOLATED_DIAMETER:
 	{
 		float minCC= par.getAbsPerc("MinComponentDiag");
-		std::pair<int,int> delInfo= tri::Clean<CMeshO>::RemoveSmallConnectedComponentsDiameter(m.cm,minCC);
+		std::pair<int,int> delInfo= tri::ParallelConnectedComponents<CMeshO>::RemoveSmallConnectedComponentsDiameter(m.cm,minCC);
 		Log("Removed %i connected components out of %i", delInfo.second, delInfo.first);
 		if (par.getBool("removeUnref"))
 		{
@@ -304,7 +332,7 @@ bool CleanFilter::applyFilter(QAction *filter, MeshDocument &md, RichParameterSe
 	case FP_REMOVE_ISOLATED_COMPLEXITY:
 	{
 		float minCC= par.getInt("MinComponentSize");
-		std::pair<int,int> delInfo=tri::Clean<CMeshO>::RemoveSmallConnectedComponentsSize(m.cm,minCC);
+		std::pair<int,int> delInfo=tri::ParallelConnectedComponents<CMeshO>::RemoveSmallConnectedComponentsSize(m.cm,minCC);
 		Log("Removed %i connected components out of %i", delInfo.second, delInfo.first);
 		if (par.getBool("removeUnref"))
 		{
@@ -367,13 +395,13 @@ bool CleanFilter::applyFilter(QAction *filter, MeshDocument &md, RichParameterSe
     case FP_MERGE_CLOSE_VERTEX :
 	{
 		float threshold = par.getAbsPerc("Threshold");
-		int total = tri::Clean<CMeshO>::MergeCloseVertex(m.cm, threshold);
+		int total = tri::ParallelClean<CMeshO>::MergeCloseVertex(m.cm, threshold);
 		Log("Successfully merged %d vertices", total);
 	} break;
 
 	case FP_REMOVE_DUPLICATE_FACE :
 	{
-		int total = tri::Clean<CMeshO>::RemoveDuplicateFace(m.cm);
+		int total = tri::ParallelClean<CMeshO>::RemoveDuplicateFace(m.cm);
 		Log("Successfully deleted %d duplicated faces", total);
 	} break;
 
@@ -423,7 +451,7 @@ bool CleanFilter::applyFilter(QAction *filter, MeshDocument &md, RichParameterSe
 
 	case FP_REMOVE_DUPLICATED_VERTEX:
 	{
-		int delvert = tri::Clean<CMeshO>::RemoveDuplicateVertex(m.cm);
+		int delvert = tri::ParallelClean<CMeshO>::RemoveDuplicateVertex(m.cm);
 		Log("Removed %d duplicated vertices", delvert);
 		if (delvert != 0) m.UpdateBoxAndNormals();
 		m.clearDataMask(MeshModel::MM_FACEFACETOPO);
@@ -0,0 +1,217 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef DEPTH_RASTER_H
+#define DEPTH_RASTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <common/ml_parallel_utils.h>
+#include "floatbuffer.h"
+
+/*
+  Software replacement of the depth map rendered by RenderHelper, so that the
+  rasters can be projected without any GL context.
+
+  The viewport is split in square tiles of TileSize pixels, the faces are
+  binned in the tiles their bounding box overlaps and each tile is rasterized
+  by a single thread. The depth test keeps the largest 1/z, which is linear in
+  screen space, so the result depends neither on the order of the faces nor on
+  the number of threads.
+*/
+class DepthRaster
+{
+public:
+    static const int TileSize = 64;
+
+    /** Depth of the mesh seen from shot, in the units of Shot::Depth(); the
+     * pixels not covered by the mesh are 0, as in RenderHelper::depth.
+     * depth must be an empty buffer, it is sized as the viewport. Faces with a
+     * vertex nearer than zNear are skipped, there is no clipping. Meshes
+     * without faces are drawn one pixel per vertex.
+     */
+    static void Render(const Shotm &shot, const CMeshO &m, float zNear, floatbuffer &depth)
+    {
+        const int w = shot.Intrinsics.ViewportPx[0];
+        const int h = shot.Intrinsics.ViewportPx[1];
+        depth.init(w, h);
+
+        // pixel coords and 1/z of the vertices; 1/z is 0 for the unusable ones
+        const int vertNum = int(m.vert.size());
+        std::vector<vcg::Point3f> sv(vertNum);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < vertNum; ++i)
+        {
+            const CMeshO::VertexType &v = m.vert[i];
+            const float z = v.IsD() ? 0 : float(shot.Depth(v.cP()));
+            if (z <= 0 || z < zNear)
+            {
+                sv[i] = vcg::Point3f(0, 0, 0);
+                continue;
+            }
+            const Point2m pp = shot.Project(v.cP());
+            sv[i] = vcg::Point3f(float(pp[0]), float(pp[1]), 1.0f / z);
+        }
+
+        float *invz = depth.data;
+#pragma omp parallel for schedule(static)
+        for (int k = 0; k < w * h; ++k)
+            invz[k] = 0;
+
+        if (m.fn == 0)
+        {
+            for (int i = 0; i < vertNum; ++i)
+            {
+                const vcg::Point3f &p = sv[i];
+                if (p[2] <= 0 || p[0] < 0 || p[1] < 0 || p[0] >= w || p[1] >= h) continue;
+                float &d = invz[int(p[1]) * w + int(p[0])];
+                d = std::max(d, p[2]);
+            }
+        }
+        else
+            RasterFaces(m, sv, w, h, invz);
+
+#pragma omp parallel for schedule(static)
+        for (int k = 0; k < w * h; ++k)
+            invz[k] = (invz[k] > 0) ? 1.0f / invz[k] : 0.0f;
+    }
+
+private:
+    // Pixels whose center can be covered by face f, clipped to the viewport.
+    static bool PixelRange(const CMeshO &m, const CMeshO::FaceType &f, const std::vector<vcg::Point3f> &sv,
+                           int w, int h, vcg::Box2i &r)
+    {
+        if (f.IsD()) return false;
+        vcg::Box2f bb;
+        for (int k = 0; k < 3; ++k)
+        {
+            const vcg::Point3f &p = sv[vcg::tri::Index(m, f.cV(k))];
+            if (p[2] <= 0) return false;
+            bb.Add(vcg::Point2f(p[0], p[1]));
+        }
+        r.min[0] = std::max(int(std::ceil(bb.min[0] - 0.5f)), 0);
+        r.min[1] = std::max(int(std::ceil(bb.min[1] - 0.5f)), 0);
+        r.max[0] = std::min(int(std::floor(bb.max[0] - 0.5f)), w - 1);
+        r.max[1] = std::min(int(std::floor(bb.max[1] - 0.5f)), h - 1);
+        return r.min[0] <= r.max[0] && r.min[1] <= r.max[1];
+    }
+
+    static float Edge(const vcg::Point3f &a, const vcg::Point3f &b, float x, float y)
+    {
+        return (b[0] - a[0]) * (y - a[1]) - (b[1] - a[1]) * (x - a[0]);
+    }
+
+    static void RasterFaces(const CMeshO &m, const std::vector<vcg::Point3f> &sv, int w, int h, float *invz)
+    {
+        const int tilesX = (w + TileSize - 1) / TileSize;
+        const int tilesY = (h + TileSize - 1) / TileSize;
+        const int tileNum = tilesX * tilesY;
+        const int faceNum = int(m.face.size());
+
+        // binning: a counting sort where each chunk of faces has its own slots in every tile
+        const int chunkNum = (faceNum < MLParallel::MinParallelSize) ? 1 : MLParallel::ThreadNum();
+        const std::vector<int> bnd = MLParallel::Chunks(faceNum, chunkNum);
+        std::vector<int> slot(size_t(chunkNum) * tileNum, 0);
+#pragma omp parallel for schedule(static, 1)
+        for (int c = 0; c < chunkNum; ++c)
+        {
+            int *cnt = &slot[size_t(c) * tileNum];
+            for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+            {
+                vcg::Box2i r;
+                if (!PixelRange(m, m.face[i], sv, w, h, r)) continue;
+                for (int ty = r.min[1] / TileSize; ty <= r.max[1] / TileSize; ++ty)
+                    for (int tx = r.min[0] / TileSize; tx <= r.max[0] / TileSize; ++tx)
+                        ++cnt[ty * tilesX + tx];
+            }
+        }
+        std::vector<int> tileOffset(tileNum + 1);
+        int total = 0;
+        for (int t = 0; t < tileNum; ++t)
+        {
+            tileOffset[t] = total;
+            for (int c = 0; c < chunkNum; ++c)
+            {
+                const int n = slot[size_t(c) * tileNum + t];
+                slot[size_t(c) * tileNum + t] = total;
+                total += n;
+            }
+        }
+        tileOffset[tileNum] = total;
+        std::vector<int> tileFace(total);
+#pragma omp parallel for schedule(static, 1)
+        for (int c = 0; c < chunkNum; ++c)
+        {
+            int *cursor = &slot[size_t(c) * tileNum];
+            for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+            {
+                vcg::Box2i r;
+                if (!PixelRange(m, m.face[i], sv, w, h, r)) continue;
+                for (int ty = r.min[1] / TileSize; ty <= r.max[1] / TileSize; ++ty)
+                    for (int tx = r.min[0] / TileSize; tx <= r.max[0] / TileSize; ++tx)
+                        tileFace[cursor[ty * tilesX + tx]++] = i;
+            }
+        }
+
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int t = 0; t < tileNum; ++t)
+        {
+            const int tx0 = (t % tilesX) * TileSize;
+            const int ty0 = (t / tilesX) * TileSize;
+            const int tx1 = std::min(tx0 + TileSize, w) - 1;
+            const int ty1 = std::min(ty0 + TileSize, h) - 1;
+            for (int k = tileOffset[t]; k < tileOffset[t + 1]; ++k)
+            {
+                const CMeshO::FaceType &f = m.face[tileFace[k]];
+                const vcg::Point3f &a = sv[vcg::tri::Index(m, f.cV(0))];
+                const vcg::Point3f &b = sv[vcg::tri::Index(m, f.cV(1))];
+                const vcg::Point3f &c = sv[vcg::tri::Index(m, f.cV(2))];
+                const float area = Edge(a, b, c[0], c[1]);
+                if (area == 0) continue;
+                vcg::Box2i r;
+                PixelRange(m, f, sv, w, h, r);
+                const int x0 = std::max(r.min[0], tx0), x1 = std::min(r.max[0], tx1);
+                const int y0 = std::max(r.min[1], ty0), y1 = std::min(r.max[1], ty1);
+                for (int y = y0; y <= y1; ++y)
+                {
+                    const float py = y + 0.5f;
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        const float px = x + 0.5f;
+                        // barycentric coords of the pixel center
+                        const float l0 = Edge(b, c, px, py) / area;
+                        const float l1 = Edge(c, a, px, py) / area;
+                        const float l2 = Edge(a, b, px, py) / area;
+                        if (l0 < 0 || l1 < 0 || l2 < 0) continue;
+                        const float iz = l0 * a[2] + l1 * b[2] + l2 * c[2];
+                        float &d = invz[y * w + x];
+                        if (iz > d) d = iz;
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -37,6 +37,7 @@
 
 #include "pushpull.h"
 #include "rastering.h"
+#include "depth_raster.h"
 #include <vcg/complex/algorithms/update/texture.h>
 
 
@@ -54,6 +55,217 @@ static QString extractFilenameWOExt(MeshModel* mm)
 }
 //-----------------------------------------
 
+// weighting of the color contributions in the multi image projections
+struct ProjectionWeighting
+{
+    float eta;             // depth threshold
+    bool  useangle;
+    bool  usedistance;
+    bool  useborders;
+    bool  usesilhouettes;
+    bool  usealphamask;
+    float allcammindepth;  // min max depth for depth weight normalization
+    float allcammaxdepth;
+};
+
+// depth map of a raster and, for the silhouette weighting, the per-pixel
+// distance from its depth discontinuities
+struct RasterDepth
+{
+    RasterModel *raster;
+    QImage image;          // pixels of the current plane, held for the whole batch
+    floatbuffer depth;
+    floatbuffer silhouette;
+    float maxsildist;
+};
+
+static void computeSilhouetteDistance(RasterDepth &rd)
+{
+    rd.silhouette.init(rd.depth.sx, rd.depth.sy);
+    rd.silhouette.applysobel(&rd.depth);
+    rd.silhouette.initborder(&rd.depth);
+    rd.maxsildist = rd.silhouette.distancefield();
+}
+
+// color and weight of the raster for the mesh point p with normal n; false if p is not visible
+static bool projectionWeight(const RasterDepth &rd, const ProjectionWeighting &pw, const Point3m &p, const Point3m &n, double &pweight, QRgb &pcolor)
+{
+    const Shotm &shot = rd.raster->shot;
+    const int width  = shot.Intrinsics.ViewportPx[0];
+    const int height = shot.Intrinsics.ViewportPx[1];
+
+    // pp is the projected point in image space
+    Point2m pp = shot.Project(p);
+    // pray is the vector from the point-to-be-colored to the camera center
+    Point3m pray = (shot.GetViewPoint() - p).Normalize();
+
+    //if inside image
+    if(pp[0]<0 || pp[1]<0 || pp[0]>=width || pp[1]>=height)
+        return false;
+    if((pray.dot(-shot.Axis(2))) > 0.0)
+        return false;
+
+    float depth  = shot.Depth(p);
+    float pdepth = rd.depth.getval(int(pp[0]), int(pp[1]));
+    if(depth > (pdepth + pw.eta))
+        return false;
+
+    // determine color
+    pcolor = rd.image.pixel(int(pp[0]), int(height - pp[1]));
+    // determine weight
+    pweight = 1.0;
+
+    if(pw.useangle)
+    {
+        Point3m pixnorm = n;
+        Point3m viewaxis  = shot.GetViewPoint() - p;
+        pixnorm.Normalize();
+        viewaxis.Normalize();
+
+        float ang = abs(pixnorm * viewaxis);
+        ang = min(1.0f, ang);
+
+        pweight *= ang;
+    }
+
+    if(pw.usedistance)
+    {
+        float distw = depth;
+        distw = 1.0 - (distw - (pw.allcammindepth*0.99)) / ((pw.allcammaxdepth*1.01) - (pw.allcammindepth*0.99));
+
+        pweight *= distw;
+        pweight *= distw;
+    }
+
+    if(pw.useborders)
+    {
+        double xdist = 1.0 - (abs(pp[0] - (width / 2.0)) / (width / 2.0));
+        double ydist = 1.0 - (abs(pp[1] - (height / 2.0)) / (height / 2.0));
+        double borderw = min (xdist , ydist);
+
+        pweight *= borderw;
+    }
+
+    if(pw.usesilhouettes)
+    {
+        // here the silhouette weight is applied, but it is calculated before, on a per-image basis
+        float silw = rd.silhouette.getval(int(pp[0]), int(pp[1])) / rd.maxsildist;
+        pweight *= silw;
+    }
+
+    if(pw.usealphamask) //alpha channel of image is an additional mask
+    {
+        pweight *= (qAlpha(pcolor) / 255.0);
+    }
+
+    return true;
+}
+
+/* Accumulate on each point the color of the visible rasters that see it,
+ * weighted as in pw. The depth maps are rendered by OpenGL one raster at a
+ * time or, with cpurender, by DepthRaster for a batch of rasters in parallel.
+ * The points are then processed in parallel, each one visiting the rasters in
+ * order, so the sums do not depend on the number of threads.
+ */
+static bool projectRasters(MeshDocument &md, MLPluginGLContext *glContext, const vector<TexelDesc> &points, ProjectionWeighting pw,
+                           const vector<float> &my_near, const vector<float> &my_far, bool cpurender,
+                           vector<TexelAccum> &accums, vcg::CallBackPos *cb, int start, int offset)
+{
+    MeshModel *model = md.mm();
+
+    vector<int> camlist;   // indexes of the rasters to be projected
+    pw.allcammaxdepth = -1000000;
+    pw.allcammindepth =  1000000;
+    for(int cam_ind = 0; cam_ind < md.rasterList.size(); cam_ind++)
+    {
+        if(my_far[cam_ind] > pw.allcammaxdepth)
+            pw.allcammaxdepth = my_far[cam_ind];
+        if(my_near[cam_ind] < pw.allcammindepth)
+            pw.allcammindepth = my_near[cam_ind];
+
+        // no drawing if raster is hidden or camera not valid
+        RasterModel *raster = md.rasterList[cam_ind];
+        if(raster->visible && raster->shot.IsValid())
+            camlist.push_back(cam_ind);
+    }
+
+    const int pointNum = int(points.size());
+    const int camNum = int(camlist.size());
+    const int batchSize = cpurender ? MLParallel::ThreadNum() : 1;
+    for(int batchStart = 0; batchStart < camNum; batchStart += batchSize)
+    {
+        const int batchNum = std::min(batchSize, camNum - batchStart);
+        vector<RasterDepth> batch(batchNum);
+        // pinned, so that the prefetch of the next batch does not evict them
+        RasterImagePin pin;
+        for(int j = 0; j < batchNum; j++)
+        {
+            batch[j].raster = md.rasterList[camlist[batchStart + j]];
+            pin.add(batch[j].raster->currentPlane);
+            batch[j].image = batch[j].raster->currentPlane->image();
+        }
+        // the images of the next batch are decoded while this one is projected
+        for(int j = batchStart + batchNum; j < std::min(batchStart + 2 * batchNum, camNum); j++)
+            md.rasterList[camlist[j]]->currentPlane->Prefetch();
+
+        if(cpurender)
+        {
+#pragma omp parallel for schedule(dynamic, 1)
+            for(int j = 0; j < batchNum; j++)
+            {
+                const int cam_ind = camlist[batchStart + j];
+                DepthRaster::Render(batch[j].raster->shot, model->cm, my_near[cam_ind]*0.5, batch[j].depth);
+                if(pw.usesilhouettes)
+                    computeSilhouetteDistance(batch[j]);
+            }
+        }
+        else
+        {
+            const int cam_ind = camlist[batchStart];
+            glContext->makeCurrent();
+            RenderHelper *rendermanager = new RenderHelper();
+            if(rendermanager->initializeGL(cb) != 0)
+            {
+                glContext->doneCurrent();
+                delete rendermanager;
+                return false;
+            }
+            // render normal & depth
+            rendermanager->renderScene(batch[0].raster->shot, model, RenderHelper::NORMAL, glContext, my_near[cam_ind]*0.5, my_far[cam_ind]*1.25);
+            glContext->doneCurrent();
+
+            const floatbuffer *rendered = rendermanager->depth;
+            batch[0].depth.init(rendered->sx, rendered->sy);
+            std::copy(rendered->data, rendered->data + rendered->sx * rendered->sy, batch[0].depth.data);
+            delete rendermanager;
+            if(pw.usesilhouettes)
+                computeSilhouetteDistance(batch[0]);
+        }
+
+#pragma omp parallel for schedule(dynamic, 4096)
+        for(int i = 0; i < pointNum; i++)
+        {
+            for(int j = 0; j < batchNum; j++)
+            {
+                double pweight;
+                QRgb pcolor;
+                if(!projectionWeight(batch[j], pw, points[i].meshpoint, points[i].meshnormal, pweight, pcolor))
+                    continue;
+                accums[i].weights += pweight;
+                accums[i].acc_red += (qRed(pcolor) * pweight / 255.0);
+                accums[i].acc_grn += (qGreen(pcolor) * pweight / 255.0);
+                accums[i].acc_blu += (qBlue(pcolor) * pweight / 255.0);
+            }
+        }
+
+        if(cb)
+            cb(start + offset * (batchStart + batchNum) / camNum, "Projecting rasters...");
+    }
+
+    return true;
+}
+//-----------------------------------------
+
 // Constructor
 FilterColorProjectionPlugin::FilterColorProjectionPlugin()
 {
@@ -156,6 +368,10 @@ void FilterColorProjectionPlugin::initParameterSet(QAction *action, MeshDocument
                 false,
                 "use image alpha weight",
                 "If true, alpha channel of the image is used as additional weight. In this way it is possible to mask-out parts of the images that should not be projected on the mesh. Please note this is not a transparency effect, but just influences the weigthing between different images"));
+            parlst.addParam(new RichBool ("cpurender",
+                false,
+                "render depth on CPU",
+                "If true, the depth maps of the rasters are computed by a multithreaded software rasterizer, several rasters at a time, instead of OpenGL. No GL context is needed, so the projection can run in batch on machines without a GPU"));
 			QColor color1 = QColor(0, 0, 0, 255);
 			parlst.addParam(new RichColor("blankColor", color1, "Color for unprojected areas", "Areas that cannot be projected willb e filled using this color. If R=0 G=0 B=0 A=0 old color is preserved"));
         }
@@ -205,6 +421,10 @@ void FilterColorProjectionPlugin::initParameterSet(QAction *action, MeshDocument
                 false,
                 "use image alpha weight",
                 "If true, alpha channel of the image is used as additional weight. In this way it is possible to mask-out parts of the images that should not be projected on the mesh. Please note this is not a transparency effect, but just influences the weigthing between different images"));
+            parlst.addParam(new RichBool ("cpurender",
+                false,
+                "render depth on CPU",
+                "If true, the depth maps of the rasters are computed by a multithreaded software rasterizer, several rasters at a time, instead of OpenGL. No GL context is needed, so the projection can run in batch on machines without a GPU"));
         }
         break;
 
@@ -243,6 +463,7 @@ bool FilterColorProjectionPlugin::applyFilter(QAction *filter, MeshDocument &md,
             // no projection if camera not valid
             if(!raster->shot.IsValid())
                 return false;
+            const QImage image = raster->currentPlane->image();
 
             // the mesh has to be correctly transformed before mapping
             tri::UpdatePosition<CMeshO>::Matrix(model->cm,model->cm.Tr,true);
@@ -297,7 +518,7 @@ bool FilterColorProjectionPlugin::applyFilter(QAction *filter, MeshDocument &md,
 
                             if(!use_depth || (depth <= (pdepth + eta)))
                             {
-                                QRgb pcolor = raster->currentPlane->image.pixel(pp[0],raster->shot.Intrinsics.ViewportPx[1] - pp[1]);
+                                QRgb pcolor = image.pixel(pp[0],raster->shot.Intrinsics.ViewportPx[1] - pp[1]);
                                 (*vi).C() = vcg::Color4b(qRed(pcolor), qGreen(pcolor), qBlue(pcolor), 255);
                             }
                         }
@@ -322,268 +543,72 @@ bool FilterColorProjectionPlugin::applyFilter(QAction *filter, MeshDocument &md,
     case FP_MULTIIMAGETRIVIALPROJ :
         {
             bool onselection = par.getBool("onselection");
-            float eta = par.getFloat("deptheta");
-            bool  useangle = par.getBool("useangle");
-            bool  usedistance = par.getBool("usedistance");
-            bool  useborders = par.getBool("useborders");
-            bool  usesilhouettes = par.getBool("usesilhouettes");
-            bool  usealphamask =  par.getBool("usealpha");
+            bool cpurender = par.getBool("cpurender");
             QColor blank = par.getColor("blankColor");
 
-            float  depth=0;     // depth of point (distance from camera)
-            float  pdepth=0;    // depth value of projected point (from depth map)
-            double pweight;     // pixel weight
-            MeshModel *model;
-            bool do_project;
-            int cam_ind;
-
-            // min max depth for depth weight normalization
-            float allcammaxdepth;
-            float allcammindepth;
-
-            // max image size for border weight normalization
-            float allcammaximagesize;
-
-            // accumulation buffers for colors and weights
-            int buff_ind;
-            double *weights;
-            double *acc_red;
-            double *acc_grn;
-            double *acc_blu;
+            ProjectionWeighting pw;
+            pw.eta = par.getFloat("deptheta");
+            pw.useangle = par.getBool("useangle");
+            pw.usedistance = par.getBool("usedistance");
+            pw.useborders = par.getBool("useborders");
+            pw.usesilhouettes = par.getBool("usesilhouettes");
+            pw.usealphamask =  par.getBool("usealpha");
 
             // get current model
-            model = md.mm();
+            MeshModel *model = md.mm();
 
             // the mesh has to be correctly transformed before mapping
             tri::UpdatePosition<CMeshO>::Matrix(model->cm,model->cm.Tr,true);
             tri::UpdateBounding<CMeshO>::Box(model->cm);
 
-            // init accumulation buffers for colors and weights
+            // points to be colored and accumulation buffers for colors and weights
             Log("init color accumulation buffers");
-            weights = new double[model->cm.vn];
-            acc_red = new double[model->cm.vn];
-            acc_grn = new double[model->cm.vn];
-            acc_blu = new double[model->cm.vn];
-            for(int buff_ind=0; buff_ind<model->cm.vn; buff_ind++)
+            vector<TexelDesc> points;
+            vector<CMeshO::VertexPointer> pointVert;
+            for(vi=model->cm.vert.begin();vi!=model->cm.vert.end();++vi)
             {
-                weights[buff_ind] = 0.0;
-                acc_red[buff_ind] = 0.0;
-                acc_grn[buff_ind] = 0.0;
-                acc_blu[buff_ind] = 0.0;
+                if(!(*vi).IsD() && (!onselection || (*vi).IsS()))
+                {
+                    TexelDesc point;
+                    point.meshpoint = (*vi).P();
+                    point.meshnormal = (*vi).N();
+                    points.push_back(point);
+                    pointVert.push_back(&*vi);
+                }
             }
+            TexelAccum zero = {0.0, 0.0, 0.0, 0.0};
+            vector<TexelAccum> accums(points.size(), zero);
 
             // calculate accuratenear/far for all cameras
             std::vector<float> my_near;
             std::vector<float> my_far;
             calculateNearFarAccurate(md, &my_near, &my_far);
 
-            allcammaxdepth =  -1000000;
-            allcammindepth =   1000000;
-            allcammaximagesize = -1000000;
-            for(cam_ind = 0; cam_ind < md.rasterList.size(); cam_ind++)
-            {
-                if(my_far[cam_ind] > allcammaxdepth)
-                    allcammaxdepth = my_far[cam_ind];
-                if(my_near[cam_ind] < allcammindepth)
-                    allcammindepth = my_near[cam_ind];
-
-                float imgdiag = sqrt(double(md.rasterList[cam_ind]->shot.Intrinsics.ViewportPx[0] * md.rasterList[cam_ind]->shot.Intrinsics.ViewportPx[1]));
-                if (imgdiag > allcammaximagesize)
-                    allcammaximagesize = imgdiag;
-            }
-
             //-- cycle all cameras
-            cam_ind = 0;
-            for(RasterModel *raster : md.rasterList){
-                if(raster->visible)
-                {
-                    do_project = true;
-
-                    // no drawing if camera not valid
-                    if(!raster->shot.IsValid())
-                        do_project = false;
-
-                    // no drawing if raster is not active
-                    //if(!raster->shot.IsValid())
-                    //  do_project = false;
-
-                    if(do_project)
-                    {
-                        // making context current
-                        glContext->makeCurrent();
-
-                        // delete & reinit rendermanager
-                        if(rendermanager != NULL)
-                            delete rendermanager;
-                        rendermanager = new RenderHelper();
-                        if( rendermanager->initializeGL(cb) != 0 )
-                            return false;
-                        Log("init GL");
-                        /*if( rendermanager->initializeMeshBuffers(model, cb) != 0 )
-                            return false;
-                        Log("init Buffers");*/
-
-                        // render normal & depth
-                        rendermanager->renderScene(raster->shot, model, RenderHelper::NORMAL, glContext, my_near[cam_ind]*0.5, my_far[cam_ind]*1.25);
-
-                        // unmaking context current
-                        glContext->doneCurrent();
-
-                        buff_ind=0;
-
-                        // If should be used silhouette weighting, it is needed to compute depth discontinuities
-                        // and per-pixel distance from detected borders on the entire image here
-                        // the weight is then applied later, per-vertex, when needed
-                        floatbuffer *silhouette_buff=NULL;
-                        float maxsildist = rendermanager->depth->sx + rendermanager->depth->sy;
-                        if(usesilhouettes)
-                        {
-                            silhouette_buff = new floatbuffer();
-                            silhouette_buff->init(rendermanager->depth->sx, rendermanager->depth->sy);
-
-                            silhouette_buff->applysobel(rendermanager->depth);
-                            //sprintf(dumpFileName,"Abord%i.pfm",cam_ind);
-                            //silhouette_buff->dumppfm(dumpFileName);
-
-                            silhouette_buff->initborder(rendermanager->depth);
-                            //sprintf(dumpFileName,"Bbord%i.pfm",cam_ind);
-                            //silhouette_buff->dumppfm(dumpFileName);
-
-                            maxsildist = silhouette_buff->distancefield();
-                            //sprintf(dumpFileName,"Cbord%i.pfm",cam_ind);
-                            //silhouette_buff->dumppfm(dumpFileName);
-                        }
-
-                        for(vi=model->cm.vert.begin();vi!=model->cm.vert.end();++vi)
-                        {
-                            if(!(*vi).IsD() && (!onselection || (*vi).IsS()))
-                            {
-                                // pp is the projected point in image space
-                                Point2m pp = raster->shot.Project((*vi).P());
-                                // pray is the vector from the point-to-be-colored to the camera center
-                                Point3m pray = (raster->shot.GetViewPoint() - (*vi).P()).Normalize();
-
-                                //if inside image
-                                if(pp[0]>=0 && pp[1]>=0 && pp[0]<raster->shot.Intrinsics.ViewportPx[0] && pp[1]<raster->shot.Intrinsics.ViewportPx[1])
-                                {
-                                    if((pray.dot(-raster->shot.Axis(2))) <= 0.0)
-                                    {
-
-                                        depth  = raster->shot.Depth((*vi).P());
-                                        pdepth = rendermanager->depth->getval(int(pp[0]), int(pp[1])); //  rendermanager->depth[(int(pp[1]) * raster->shot.Intrinsics.ViewportPx[0]) + int(pp[0])];
-
-                                        if(depth <= (pdepth + eta))
-                                        {
-                                            // determine color
-                                            QRgb pcolor = raster->currentPlane->image.pixel(pp[0],raster->shot.Intrinsics.ViewportPx[1] - pp[1]);
-                                            // determine weight
-                                            pweight = 1.0;
-
-                                            if(useangle)
-                                            {
-                                                Point3m pixnorm = (*vi).N();
-                                                Point3m viewaxis  = raster->shot.GetViewPoint() - (*vi).P();
-                                                pixnorm.Normalize();
-                                                viewaxis.Normalize();
-
-                                                float ang = abs(pixnorm * viewaxis);
-                                                ang = min(1.0f, ang);
-
-                                                pweight *= ang;
-                                            }
-
-                                            if(usedistance)
-                                            {
-                                                float distw = depth;
-                                                distw = 1.0 - (distw - (allcammindepth*0.99)) / ((allcammaxdepth*1.01) - (allcammindepth*0.99));
-
-                                                pweight *= distw;
-                                                pweight *= distw;
-                                            }
-
-                                            if(useborders)
-                                            {
-                                                double xdist = 1.0 - (abs(pp[0] - (raster->shot.Intrinsics.ViewportPx[0] / 2.0)) / (raster->shot.Intrinsics.ViewportPx[0] / 2.0));
-                                                double ydist = 1.0 - (abs(pp[1] - (raster->shot.Intrinsics.ViewportPx[1] / 2.0)) / (raster->shot.Intrinsics.ViewportPx[1] / 2.0));
-                                                double borderw = min (xdist , ydist);
-                                                //borderw = min(1.0,borderw); //debug debug
-                                                //borderw = max(0.0,borderw); //debug debug
-
-                                                pweight *= borderw;
-                                            }
-
-                                            if(usesilhouettes)
-                                            {
-                                                // here the silhouette weight is applied, but it is calculated before, on a per-image basis
-                                                float silw = 1.0;
-                                                silw = silhouette_buff->getval(int(pp[0]), int(pp[1])) / maxsildist;
-                                                //silw = min(1.0f,silw); //debug debug
-                                                //silw = max(0.0f,silw); //debug debug
-
-                                                pweight *= silw;
-                                            }
-
-                                            if(usealphamask) //alpha channel of image is an additional mask
-                                            {
-                                                pweight *= (qAlpha(pcolor) / 255.0);
-                                            }
-
-                                            weights[buff_ind] += pweight;
-                                            acc_red[buff_ind] += (qRed(pcolor) * pweight / 255.0);
-                                            acc_grn[buff_ind] += (qGreen(pcolor) * pweight / 255.0);
-                                            acc_blu[buff_ind] += (qBlue(pcolor) * pweight / 255.0);
-                                        }
-                                    }
-                                }
-                            }
-                            buff_ind++;
-                        }
-                        cam_ind ++;
-
-                        if(usesilhouettes)
-                        {
-                            delete silhouette_buff;
-                        }
-
-                    } // end foreach camera
-                } // end foreach camera
-            }
+            if(!projectRasters(md, glContext, points, pw, my_near, my_far, cpurender, accums, cb, 0, 100))
+                return false;
 
-            buff_ind = 0;
-            for(vi=model->cm.vert.begin();vi!=model->cm.vert.end();++vi)
+            for(size_t buff_ind = 0; buff_ind < points.size(); buff_ind++)
             {
-                if(!(*vi).IsD() && (!onselection || (*vi).IsS()))
+                CMeshO::VertexPointer vp = pointVert[buff_ind];
+                const TexelAccum &acc = accums[buff_ind];
+                if (acc.weights != 0) // if 0, it has not found any valid projection on any camera
                 {
-                    if (weights[buff_ind] != 0) // if 0, it has not found any valid projection on any camera
-                    {
-                        (*vi).C() = vcg::Color4b( (acc_red[buff_ind] / weights[buff_ind]) *255.0,
-                            (acc_grn[buff_ind] / weights[buff_ind]) *255.0,
-                            (acc_blu[buff_ind] / weights[buff_ind]) *255.0,
-                            255);
-                    }
-                    else
-                    {
-                        if ((blank.red() != 0) || (blank.green() != 0) || (blank.blue() != 0) || (blank.alpha() != 0))
-                            (*vi).C() = vcg::Color4b(blank.red(), blank.green(), blank.blue(), blank.alpha());
-                    }
+                    vp->C() = vcg::Color4b( (acc.acc_red / acc.weights) *255.0,
+                        (acc.acc_grn / acc.weights) *255.0,
+                        (acc.acc_blu / acc.weights) *255.0,
+                        255);
+                }
+                else
+                {
+                    if ((blank.red() != 0) || (blank.green() != 0) || (blank.blue() != 0) || (blank.alpha() != 0))
+                        vp->C() = vcg::Color4b(blank.red(), blank.green(), blank.blue(), blank.alpha());
                 }
-                buff_ind++;
             }
 
             // the mesh has to return to its original position
             tri::UpdatePosition<CMeshO>::Matrix(model->cm,Inverse(model->cm.Tr),true);
             tri::UpdateBounding<CMeshO>::Box(model->cm);
-
-            // delete rendermanager
-            if(rendermanager != NULL)
-                delete rendermanager;
-
-            // delete accumulation buffers
-            delete[]  weights;
-            delete[]  acc_red;
-            delete[]  acc_grn;
-            delete[]  acc_blu;
-
         }
         break;
 
@@ -600,33 +625,22 @@ bool FilterColorProjectionPlugin::applyFilter(QAction *filter, MeshDocument &md,
             //bool onselection = par.getBool("onselection");
             int texsize = par.getInt("texsize");
             bool  dorefill = par.getBool("dorefill");
-            float eta = par.getFloat("deptheta");
-            bool  useangle = par.getBool("useangle");
-            bool  usedistance = par.getBool("usedistance");
-            bool  useborders = par.getBool("useborders");
-            bool  usesilhouettes = par.getBool("usesilhouettes");
-            bool  usealphamask =  par.getBool("usealpha");
+            bool cpurender = par.getBool("cpurender");
             QString textName = par.getString("textName");
 
+            ProjectionWeighting pw;
+            pw.eta = par.getFloat("deptheta");
+            pw.useangle = par.getBool("useangle");
+            pw.usedistance = par.getBool("usedistance");
+            pw.useborders = par.getBool("useborders");
+            pw.usesilhouettes = par.getBool("usesilhouettes");
+            pw.usealphamask =  par.getBool("usealpha");
+
             int textW = texsize;
             int textH = texsize;
 
-            float  depth=0;     // depth of point (distance from camera)
-            float  pdepth=0;    // depth value of projected point (from depth map)
-            double pweight;     // pixel weight
-            MeshModel *model;
-            bool do_project;
-            int cam_ind;
-
-            // min max depth for depth weight normalization
-            float allcammaxdepth;
-            float allcammindepth;
-
-            // max image size for border weight normalization
-            float allcammaximagesize;
-
             // get the working model
-            model = md.mm();
+            MeshModel *model = md.mm();
 
             // the mesh has to be correctly transformed before mapping
             tri::UpdatePosition<CMeshO>::Matrix(model->cm,model->cm.Tr,true);
@@ -691,169 +705,9 @@ bool FilterColorProjectionPlugin::applyFilter(QAction *filter, MeshDocument &md,
             std::vector<float> my_far;
             calculateNearFarAccurate(md, &my_near, &my_far);
 
-            allcammaxdepth =  -1000000;
-            allcammindepth =   1000000;
-            allcammaximagesize = -1000000;
-            for(cam_ind = 0; cam_ind < md.rasterList.size(); cam_ind++)
-            {
-                if(my_far[cam_ind] > allcammaxdepth)
-                    allcammaxdepth = my_far[cam_ind];
-                if(my_near[cam_ind] < allcammindepth)
-                    allcammindepth = my_near[cam_ind];
-
-                float imgdiag = sqrt(double(md.rasterList[cam_ind]->shot.Intrinsics.ViewportPx[0] * md.rasterList[cam_ind]->shot.Intrinsics.ViewportPx[1]));
-                if (imgdiag > allcammaximagesize)
-                    allcammaximagesize = imgdiag;
-            }
-
             //-- cycle all cameras
-            cam_ind = 0;
-            for(RasterModel *raster : md.rasterList)
-            {
-                if(raster->visible)
-                {
-                    do_project = true;
-
-                    // no drawing if camera not valid
-                    if(!raster->shot.IsValid())
-                        do_project = false;
-
-                    // no drawing if raster is not active
-                    //if(!raster->shot.IsValid())
-                    //  do_project = false;
-
-                    if(do_project)
-                    {
-                        // making context current
-                        glContext->makeCurrent();
-
-                        // delete & reinit rendermanager
-                        if(rendermanager != NULL)
-                            delete rendermanager;
-                        rendermanager = new RenderHelper();
-                        if( rendermanager->initializeGL(cb) != 0 )
-                            return false;
-                        Log("init GL");
-                        /*if( rendermanager->initializeMeshBuffers(model, cb) != 0 )
-                            return false;
-                        Log("init Buffers");*/
-
-                        // render normal & depth
-                        rendermanager->renderScene(raster->shot, model, RenderHelper::NORMAL, glContext, my_near[cam_ind]*0.5, my_far[cam_ind]*1.25);
-
-                        // unmaking context current
-                        glContext->doneCurrent();
-
-                        // If should be used silhouette weighting, it is needed to compute depth discontinuities
-                        // and per-pixel distance from detected borders on the entire image here
-                        // the weight is then applied later, per-vertex, when needed
-                        floatbuffer *silhouette_buff=NULL;
-                        float maxsildist = rendermanager->depth->sx + rendermanager->depth->sy;
-                        if(usesilhouettes)
-                        {
-                            silhouette_buff = new floatbuffer();
-                            silhouette_buff->init(rendermanager->depth->sx, rendermanager->depth->sy);
-
-                            silhouette_buff->applysobel(rendermanager->depth);
-                            //sprintf(dumpFileName,"Abord%i.bmp",cam_ind);
-                            //silhouette_buff->dumpbmp(dumpFileName);
-
-                            silhouette_buff->initborder(rendermanager->depth);
-                            //sprintf(dumpFileName,"Bbord%i.bmp",cam_ind);
-                            //silhouette_buff->dumpbmp(dumpFileName);
-
-                            maxsildist = silhouette_buff->distancefield();
-                            //sprintf(dumpFileName,"Cbord%i.bmp",cam_ind);
-                            //silhouette_buff->dumpbmp(dumpFileName);
-                        }
-
-                        for(size_t texcount=0; texcount < texels.size(); texcount++)
-                        {
-                            Point2m pp = raster->shot.Project(texels[texcount].meshpoint);
-                            // pray is the vector from the point-to-be-colored to the camera center
-                            Point3m pray = (raster->shot.GetViewPoint() - texels[texcount].meshpoint).Normalize();
-
-                            //if inside image
-                            if(pp[0]>0 && pp[1]>0 && pp[0]<raster->shot.Intrinsics.ViewportPx[0] && pp[1]<raster->shot.Intrinsics.ViewportPx[1])
-                            {
-                                if((pray.dot(-raster->shot.Axis(2))) <= 0.0)
-                                {
-
-                                    depth  = raster->shot.Depth(texels[texcount].meshpoint);
-                                    pdepth = rendermanager->depth->getval(int(pp[0]), int(pp[1])); //  rendermanager->depth[(int(pp[1]) * raster->shot.Intrinsics.ViewportPx[0]) + int(pp[0])];
-
-                                    if(depth <= (pdepth + eta))
-                                    {
-                                        // determine color
-                                        QRgb pcolor = raster->currentPlane->image.pixel(pp[0],raster->shot.Intrinsics.ViewportPx[1] - pp[1]);
-                                        // determine weight
-                                        pweight = 1.0;
-
-                                        if(useangle)
-                                        {
-                                            Point3m pixnorm = texels[texcount].meshnormal;
-                                            pixnorm.Normalize();
-
-                                            Point3m viewaxis = raster->shot.GetViewPoint() - texels[texcount].meshpoint;
-                                            viewaxis.Normalize();
-
-                                            float ang = abs(pixnorm * viewaxis);
-                                            ang = min(1.0f, ang);
-
-                                            pweight *= ang;
-                                        }
-
-                                        if(usedistance)
-                                        {
-                                            float distw = depth;
-                                            distw = 1.0 - (distw - (allcammindepth*0.99)) / ((allcammaxdepth*1.01) - (allcammindepth*0.99));
-
-                                            pweight *= distw;
-                                            pweight *= distw;
-                                        }
-
-                                        if(useborders)
-                                        {
-                                            double xdist = 1.0 - (abs(pp[0] - (raster->shot.Intrinsics.ViewportPx[0] / 2.0)) / (raster->shot.Intrinsics.ViewportPx[0] / 2.0));
-                                            double ydist = 1.0 - (abs(pp[1] - (raster->shot.Intrinsics.ViewportPx[1] / 2.0)) / (raster->shot.Intrinsics.ViewportPx[1] / 2.0));
-                                            double borderw = min (xdist , ydist);
-
-                                            pweight *= borderw;
-                                        }
-
-                                        if(usesilhouettes)
-                                        {
-                                            // here the silhouette weight is applied, but it is calculated before, on a per-image basis
-                                            float silw = 1.0;
-                                            silw = silhouette_buff->getval(int(pp[0]), int(pp[1])) / maxsildist;
-                                            pweight *= silw;
-                                        }
-
-                                        if(usealphamask) //alpha channel of image is an additional mask
-                                        {
-                                            pweight *= (qAlpha(pcolor) / 255.0);
-                                        }
-
-                                        accums[texcount].weights += pweight;
-                                        accums[texcount].acc_red += (qRed(pcolor) * pweight / 255.0);
-                                        accums[texcount].acc_grn += (qGreen(pcolor) * pweight / 255.0);
-                                        accums[texcount].acc_blu += (qBlue(pcolor) * pweight / 255.0);
-                                    }
-                                }
-                            }
-
-                        } // end foreach texel
-                        cam_ind ++;
-
-                        if(usesilhouettes)
-                        {
-                            delete silhouette_buff;
-                        }
-
-                    } // end if(do_project)
-
-                }
-            } // end foreach camera
+            if(!projectRasters(md, glContext, texels, pw, my_near, my_far, cpurender, accums, cb, 81, 4))
+                return false;
 
             // for each texel.... divide accumulated values by weight and write to texture
             for(size_t texcount=0; texcount < texels.size(); texcount++)
@@ -2,6 +2,7 @@ include (../../shared.pri)
 
 HEADERS = \
     filter_color_projection.h \
+    depth_raster.h \
     render_helper.h \
     floatbuffer.h \
     pushpull.h \
@@ -100,7 +100,7 @@ int floatbuffer::destroy()
 	return 1;
 }
 
-float floatbuffer::getval(int xx, int yy)
+float floatbuffer::getval(int xx, int yy) const
 {
   if(!loaded)
 	  return -1.0;
@@ -228,89 +228,84 @@ int floatbuffer::initborder(floatbuffer* zerofrom)
  return 1;
 }
 
-int floatbuffer::distancefield()
+// squared distance transform of the 1D function f (Felzenszwalb & Huttenlocher):
+// d[q] = min over p of (q-p)^2 + f[p], in linear time. v and z are scratch
+// buffers of n and n+1 elements.
+static void distancetransform1d(const double *f, int n, double *d, int *v, double *z)
 {
-	int kk;
-	int xx,yy;
-	int cx,cy;
-	float currval;
-	queue<int> todo;
-  int maxval = -10000;
+	const double inf = numeric_limits<double>::max();
+	int k = 0;
+	v[0] = 0;
+	z[0] = -inf;
+	z[1] = +inf;
+	for(int q=1; q<n; q++)
+	{
+		double s = ((f[q] + double(q)*q) - (f[v[k]] + double(v[k])*v[k])) / (2.0*q - 2.0*v[k]);
+		while(s <= z[k])
+		{
+			k--;
+			s = ((f[q] + double(q)*q) - (f[v[k]] + double(v[k])*v[k])) / (2.0*q - 2.0*v[k]);
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k+1] = +inf;
+	}
 
-	// init queue.. push in all border
-	for(kk=0; kk<sx*sy; kk++)
+	k = 0;
+	for(int q=0; q<n; q++)
 	{
-		if(data[kk] == 0)
-			todo.push(kk);
+		while(z[k+1] < q)
+			k++;
+		d[q] = double(q-v[k])*(q-v[k]) + f[v[k]];
 	}
-	
-	//
-	while(! todo.empty())
+}
+
+// exact euclidean distance of each pixel from the nearest border pixel (the
+// zeroes), computed separably by columns and then by rows. Background pixels
+// (-1) are left untouched. Returns the maximum distance.
+float floatbuffer::distancefield()
+{
+	const double unreached = 1e20;	// no border pixel in the column
+	vector<double> sqdist(sx * sy);
+
+#pragma omp parallel
 	{
-		yy = todo.front() / sx;
-		xx = todo.front() % sx;
-		currval = data[todo.front()] + 1;
-		todo.pop();
-
-		//---------
-		cx = xx-1;
-		cy = yy;
-
-		if(cx >=0)									// inside image
-			if(data[cx + (sx*cy)] != -1)			// not background
-				if(data[cx + (sx*cy)] > currval)	// need update
-				{
-				 data[cx + (sx*cy)] = currval;
-				 todo.push(cx + (sx*cy));
-         if(currval > maxval)
-           maxval = currval;
-				}
-
-		//---------
-		cx = xx+1;
-		cy = yy;
-
-		if(cx < sx)									// inside image
-			if(data[cx + (sx*cy)] != -1)			// not background
-				if(data[cx + (sx*cy)] > currval)	// need update
-				{
-				 data[cx + (sx*cy)] = currval;
-				 todo.push(cx + (sx*cy));
-         if(currval > maxval)
-           maxval = currval;
-				}
-
-		//---------
-		cx = xx;
-		cy = yy-1;
-
-		if(cy >=0)									// inside image
-			if(data[cx + (sx*cy)] != -1)			// not background
-				if(data[cx + (sx*cy)] > currval)	// need update
-				{
-				 data[cx + (sx*cy)] = currval;
-				 todo.push(cx + (sx*cy));
-         if(currval > maxval)
-           maxval = currval;
-
-				}
-
-		//---------
-		cx = xx;
-		cy = yy+1;
-
-		if(cy < sy)									// inside image
-			if(data[cx + (sx*cy)] != -1)			// not background
-				if(data[cx + (sx*cy)] > currval)	// need update
-				{
-				 data[cx + (sx*cy)] = currval;
-				 todo.push(cx + (sx*cy));
-         if(currval > maxval)
-           maxval = currval;
-				}
+		vector<double> f(sy), d(sy), z(sy+1);
+		vector<int> v(sy);
+#pragma omp for schedule(static)
+		for(int xx=0; xx<sx; xx++)
+		{
+			for(int yy=0; yy<sy; yy++)
+				f[yy] = (data[(yy * sx) + xx] == 0) ? 0.0 : unreached;
+			distancetransform1d(&f[0], sy, &d[0], &v[0], &z[0]);
+			for(int yy=0; yy<sy; yy++)
+				sqdist[(yy * sx) + xx] = d[yy];
+		}
+	}
 
+#pragma omp parallel
+	{
+		vector<double> d(sx), z(sx+1);
+		vector<int> v(sx);
+#pragma omp for schedule(static)
+		for(int yy=0; yy<sy; yy++)
+		{
+			distancetransform1d(&sqdist[yy * sx], sx, &d[0], &v[0], &z[0]);
+			for(int xx=0; xx<sx; xx++)
+				if(data[(yy * sx) + xx] != -1)
+					data[(yy * sx) + xx] = sqrt(d[xx]);
+		}
 	}
 
+	float maxval = 0;
+	for(int kk=0; kk<sx*sy; kk++)
+		if(data[kk] > maxval)
+			maxval = data[kk];
+
+	// no pixel to be filled: avoid dividing by zero when normalizing
+	if(maxval == 0)
+		maxval = 1;
 	return maxval;
 }
 
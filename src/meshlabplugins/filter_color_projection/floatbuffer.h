@@ -28,7 +28,9 @@
 
 #include<QString>
 #include<QImage>
-#include<queue>
+#include<vector>
+#include<limits>
+#include<cmath>
 
 using namespace std;
 using namespace vcg;
@@ -66,14 +68,14 @@ class floatbuffer
 	int init(int sizex, int sizey);
 	int destroy();
 
-	float getval(int xx, int yy);
+	float getval(int xx, int yy) const;
 	int   setval(int xx, int yy, float val);
 
 	int fillwith(float val);
 
 	int applysobel(floatbuffer *from);
 	int initborder(floatbuffer* zerofrom);
-	int distancefield();
+	float distancefield();
 
 	int dumppfm(QString filename);
 };
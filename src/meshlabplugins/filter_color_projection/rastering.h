@@ -43,10 +43,10 @@ typedef struct{
 
 typedef struct{
 
-  float weights;
-  float acc_red;
-  float acc_grn;
-  float acc_blu;
+  double weights;
+  double acc_red;
+  double acc_grn;
+  double acc_blu;
 
 } TexelAccum;
 
@@ -31,6 +31,7 @@
 #include <vcg/complex/algorithms/parametrization/distortion.h>
 #include <vcg/space/fitting3.h>
 #include <vcg/math/random_generator.h>
+#include <common/ml_parallel_curvature.h>
 
 #include <stdlib.h>
 #include <time.h>
@@ -651,19 +652,19 @@ bool FilterColorProc::applyFilter(QAction *filter, MeshDocument &md, RichParamet
 
 		case CP_DISCRETE_CURVATURE:
 		{
-			m->updateDataMask(MeshModel::MM_FACEFACETOPO | MeshModel::MM_VERTCURV);
+			m->updateDataMask(MeshModel::MM_VERTCURV);
 			m->updateDataMask(MeshModel::MM_VERTCOLOR | MeshModel::MM_VERTQUALITY);
-			tri::UpdateFlags<CMeshO>::FaceBorderFromFF(m->cm);
-
-			if (tri::Clean<CMeshO>::CountNonManifoldEdgeFF(m->cm) > 0) {
-				errorMessage = "Mesh has some not 2-manifold faces, Curvature computation requires manifoldness"; // text
-				return false; // can't continue, mesh can't be processed
-			}
 
 			int delvert = tri::Clean<CMeshO>::RemoveUnreferencedVertex(m->cm);
 			if (delvert) Log("Pre-Curvature Cleaning: Removed %d unreferenced vertices", delvert);
 			tri::Allocator<CMeshO>::CompactVertexVector(m->cm);
-			tri::UpdateCurvature<CMeshO>::MeanAndGaussian(m->cm);
+
+			tri::ParallelCurvature<CMeshO> curv(m->cm);
+			if (curv.NonManifoldEdgeNum() > 0) {
+				errorMessage = "Mesh has some not 2-manifold faces, Curvature computation requires manifoldness"; // text
+				return false; // can't continue, mesh can't be processed
+			}
+			curv.MeanAndGaussian();
 			int curvType = par.getEnum("CurvatureType");
 
 			switch (curvType)
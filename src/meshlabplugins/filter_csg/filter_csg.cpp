@@ -28,6 +28,7 @@
 #include <fstream>
 #include "gmpfrac.h"
 #include "intercept.h"
+#include "sparse_intercept.h"
 
 using namespace std;
 using namespace vcg;
@@ -99,6 +100,10 @@ void FilterCSG::initParameterSet(QAction *action, MeshDocument & md, RichParamet
                                          "Intersection takes the volume shared between the two meshes; "
                                          "Union takes the volume included in at least one of the two meshes; "
                                          "Difference takes the volume included in the first mesh but not in the second one"));
+            parlst.addParam(new RichBool("FastMode", true, "Fast sparse mode",
+                                         "Rasterize, combine and rebuild the volumes with all the cores, storing only the sampling lines that cross the surfaces. "
+                                         "Vertices are rounded to the same lattice of the exact mode and exact rational arithmetic is used only for the nearly coincident intersections, so the result is the same of the exact mode. "
+                                         "Volumes or faces too large for this mode are processed in exact mode anyway."));
 //            parlst.addParam(new RichBool("Extended", false, "Extended Marching Cubes",
 //                                         "Use extended marching cubes for surface reconstruction. "
 //                                         "It tries to improve the quality of the mesh by reconstructing the sharp features "
@@ -167,11 +172,68 @@ bool FilterCSG::applyFilter(QAction *filter, MeshDocument &md, RichParameterSet
 			vcg::tri::UpdateBounding<CMeshO>::Box(tmpsecondmesh.cm);
 			vcg::tri::UpdateNormal<CMeshO>::PerVertexNormalizedPerFaceNormalized(tmpfirstmesh.cm);
 
-//            typedef CMeshO::ScalarType scalar;
-            typedef Intercept<mpq_class,Scalarm> intercept;
             const Scalarm d = par.getFloat("Delta");
             const Point3m delta(d, d, d);
             const int subFreq = par.getInt("SubDelta");
+
+            if (par.getBool("FastMode")) {
+                typedef SparseInterceptVolume<SparseIntercept<Scalarm> > SparseVolume;
+                Box3m box = tmpfirstmesh.cm.bbox;
+                box.Add(tmpsecondmesh.cm.bbox);
+                SparseVolume::Frame frame;
+                if (SparseVolume::Frame::Make(box, delta, subFreq, frame)) {
+                    Log(GLLogStream::SYSTEM, "Rasterizing volumes...");
+                    SparseVolume v(frame), tmp(frame);
+                    const bool built = v.Build(tmpfirstmesh.cm, cb) && tmp.Build(tmpsecondmesh.cm, cb);
+                    if (v.Cancelled() || tmp.Cancelled()) {
+                        errorMessage = "Operation cancelled";
+                        return false;
+                    }
+                    if (built) {
+                        const int odd = v.OddRayNum() + tmp.OddRayNum();
+                        if (odd > 0)
+                            Log("Warning: %i sampling lines cross the surfaces an odd number of times", odd);
+
+                        MeshModel *mesh;
+                        switch(par.getEnum("Operator")){
+                        case CSG_OPERATION_INTERSECTION:
+                            v &= tmp;
+                            mesh = md.addNewMesh("","intersection");
+                            break;
+
+                        case CSG_OPERATION_UNION:
+                            v |= tmp;
+                            mesh = md.addNewMesh("","union");
+                            break;
+
+                        case CSG_OPERATION_DIFFERENCE:
+                            v -= tmp;
+                            mesh = md.addNewMesh("","difference");
+                            break;
+
+                        default:
+                            assert(0);
+                            return true;
+                        }
+
+                        Log(GLLogStream::SYSTEM, "Building mesh...");
+                        if (!v.BuildMesh(mesh->cm, cb)) {
+                            md.delMesh(mesh);
+                            errorMessage = "Operation cancelled";
+                            return false;
+                        }
+                        Log(GLLogStream::SYSTEM, "Done");
+
+                        vcg::tri::UpdateBounding<CMeshO>::Box(mesh->cm);
+                        vcg::tri::UpdateNormal<CMeshO>::PerFaceFromCurrentVertexNormal(mesh->cm);
+                        return true;
+                    }
+                }
+                Log("Volume or faces too large for the fast mode, using the exact one");
+            }
+
+//            typedef CMeshO::ScalarType scalar;
+            typedef Intercept<mpq_class,Scalarm> intercept;
             Log(GLLogStream::SYSTEM, "Rasterizing first volume...");
             InterceptVolume<intercept> v = InterceptSet3<intercept>(tmpfirstmesh.cm, delta, subFreq, cb);
             Log(GLLogStream::SYSTEM, "Rasterizing second volume...");
@@ -3,6 +3,7 @@ include (../../shared.pri)
 HEADERS += \
     filter_csg.h \
     intercept.h \
+    sparse_intercept.h \
     gmpfrac.h
 
 SOURCES += \
@@ -0,0 +1,826 @@
+#ifndef SPARSE_INTERCEPT_H
+#define SPARSE_INTERCEPT_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+#include <vcg/complex/complex.h>
+#include <vcg/complex/algorithms/create/marching_cubes.h>
+#include <wrap/callback.h>
+#include <common/ml_parallel_utils.h>
+
+#include "gmpfrac.h"
+
+/*
+  Sparse and parallel version of the "Marching Intersections" volumes of intercept.h.
+
+  The results are the ones of InterceptSet3/InterceptVolume/Walker, but:
+   - the vertices are snapped to the same 1/subCellPrecision lattice with the same truncation
+     of InterceptSet3, and stored as 64 bit integers relative to the frame origin.
+     Whether a line crosses a face is then an exact integer test (with the same symbolic
+     perturbation of intercept.h) and the position of an intercept is the exact rational
+     base + num/den. Intercepts are compared on a double approximation and only when the
+     comparison is too close to call it is redone with GMP rationals (a filtered predicate);
+   - only the lines that cross the surface are stored, each family as a sorted list of
+     (line, intercepts) so the memory follows the surface and not the bounding box;
+   - faces are rasterized, lines combined and cells extracted by all the cores. The
+     marching cubes runs on independent chunks of cells and the vertices made for the same
+     intercept are welded afterwards, so the result does not depend on the number of threads.
+
+  All the operands of a boolean operation must be built on the same Frame, that is the
+  same lattice. The integer arithmetic limits the size of the lattice and of the faces
+  (see Frame::Make and SparseInterceptVolume::Build); when they are exceeded the caller
+  should use the exact intercept.h classes instead.
+  */
+
+namespace vcg {
+    namespace intercept {
+        /** Class FilteredDist
+            Exact position along a line, base + num/den with den > 0, in lattice units.
+            Every comparison is decided on the double approximation when the two values are farther
+            than its error bound, otherwise it is done exactly with rationals.
+         */
+        class FilteredDist
+        {
+        public:
+            inline FilteredDist() : _approx(0), _base(0), _num(0), _den(1) { }
+
+            inline FilteredDist(long long base, long long num, long long den) : _base(base), _num(num), _den(den) {
+                assert (den != 0);
+                if (_den < 0) {
+                    _num = -_num;
+                    _den = -_den;
+                }
+                _approx = double(_base) + double(_num) / double(_den);
+            }
+
+            inline double approx() const { return _approx; }
+
+            /* -1, 0, 1 if a is less, equal, greater than b */
+            static inline int Compare(const FilteredDist &a, const FilteredDist &b) {
+                const double diff = a._approx - b._approx;
+                const double tol = Tolerance(a._approx, b._approx);
+                if (diff > tol)
+                    return 1;
+                if (diff < -tol)
+                    return -1;
+                if (a._base == b._base && a._num == b._num && a._den == b._den)
+                    return 0;
+                return sgn(cmp(a.exact(), b.exact()));
+            }
+
+            static inline int Compare(const FilteredDist &a, long long s) {
+                const double diff = a._approx - double(s);
+                const double tol = Tolerance(a._approx, double(s));
+                if (diff > tol)
+                    return 1;
+                if (diff < -tol)
+                    return -1;
+                return sgn(cmp(a.exact(), mpq_class(toMpz(s))));
+            }
+
+            /* Largest integer k such that k * q <= this, for q > 0 */
+            inline long long Floor(long long q) const {
+                long long k = (long long)(std::floor(_approx / double(q)));
+                while (Compare(*this, k * q) < 0)
+                    --k;
+                while (Compare(*this, (k + 1) * q) >= 0)
+                    ++k;
+                return k;
+            }
+
+        private:
+            /* |num/den| is bounded by the extent of a face, less than 2^20 units, so the double
+               evaluation is off by less than 2^-31 plus the rounding of the sum; the margin
+               below is orders of magnitude larger */
+            static inline double Tolerance(double a, double b) { return (std::fabs(a) + std::fabs(b) + 1.0) * 1e-9; }
+
+            static inline int sgn(int c) { return (c > 0) - (c < 0); }
+
+            /* long is 32 bits on some platforms, so the conversion goes through two halves */
+            static inline mpz_class toMpz(long long x) {
+                mpz_class r(long(x >> 32));
+                r <<= 32;
+                r += (unsigned long)(x & 0xffffffffLL);
+                return r;
+            }
+
+            inline mpq_class exact() const {
+                mpq_class q(toMpz(_num), toMpz(_den));
+                q.canonicalize();
+                return q + mpq_class(toMpz(_base));
+            }
+
+            double _approx;
+            long long _base, _num, _den;
+        };
+
+        /** Class SparseIntercept
+            Same as Intercept, with a FilteredDist as distance.
+            @param _scalar (Template Parameter) Specifies the type of the scalar elements
+         */
+        template <typename _scalar>
+                class SparseIntercept
+        {
+        public:
+            typedef FilteredDist DistType;
+            typedef _scalar Scalar;
+            typedef vcg::Point3<Scalar> Point3x;
+
+            inline SparseIntercept() { }
+
+            inline SparseIntercept(const DistType &dist, const Point3x &norm, const Scalar &sort_norm, const Scalar &quality) :
+                    _dist(dist), _norm(norm), _sort_norm(sort_norm), _quality(quality) { }
+
+            inline SparseIntercept operator -() const { return SparseIntercept(_dist, -_norm, -_sort_norm, _quality); }
+
+            inline bool operator <(const SparseIntercept &other) const {
+                const int c = DistType::Compare(_dist, other._dist);
+                return c < 0 || (c == 0 && _sort_norm < other._sort_norm);
+            }
+
+            inline const DistType& dist() const { return _dist; }
+
+            inline const Scalar& sort_norm() const { return _sort_norm; }
+
+            inline const Scalar& quality() const { return _quality; }
+
+            inline const Point3x& norm() const { return _norm; }
+
+        private:
+            DistType _dist;
+            Point3x _norm;
+            Scalar _sort_norm;
+            Scalar _quality;
+        };
+
+        /** Class SparseBeam
+            The intersections between a surface and a family of parallel lines, keeping only the lines
+            that actually cross it: line key[r] has the intercepts [start[r], start[r+1]) of icpt.
+            @param InterceptType (Template Parameter) Specifies the type of the intercepts
+         */
+        template <typename InterceptType>
+                class SparseBeam
+        {
+        public:
+            typedef unsigned long long RayKey;
+
+            static inline RayKey Key(int u, int v) { return (RayKey(unsigned(u)) << 32) | RayKey(unsigned(v)); }
+
+            inline SparseBeam() : start(1, 0) { }
+
+            inline int RayNum() const { return int(key.size()); }
+
+            /* Index of the line (u,v), -1 if it does not cross the surface */
+            inline int Find(int u, int v) const {
+                typename std::vector<RayKey>::const_iterator p = std::lower_bound(key.begin(), key.end(), Key(u, v));
+                return (p != key.end() && *p == Key(u, v)) ? int(p - key.begin()) : -1;
+            }
+
+            /* Index of the first intercept of line r not before s, start[r+1] if none */
+            inline int LowerBound(int r, long long s) const {
+                int lo = start[r], hi = start[r + 1];
+                while (lo < hi) {
+                    const int mid = (lo + hi) / 2;
+                    if (FilteredDist::Compare(icpt[mid].dist(), s) < 0)
+                        lo = mid + 1;
+                    else
+                        hi = mid;
+                }
+                return lo;
+            }
+
+            /* Returns -1 if the point at s along the line (u,v) is outside,
+               0 if it is on the boundary, 1 if it is inside. */
+            inline int IsIn(int u, int v, long long s) const {
+                const int r = Find(u, v);
+                if (r < 0)
+                    return -1;
+                const int p = LowerBound(r, s);
+                if (p == start[r + 1])
+                    return -1;
+                else if (FilteredDist::Compare(icpt[p].dist(), s) == 0)
+                    return 0;
+                else
+                    return ((p - start[r]) & 1) ? 1 : -1;
+            }
+
+            std::vector<RayKey> key;
+            std::vector<int> start;
+            std::vector<InterceptType> icpt;
+        };
+
+        /** Class SparseInterceptVolume
+            Three orthogonal SparseBeam instances on a common lattice, defining a volume
+            @param InterceptType (Template Parameter) Specifies the type of the intercepts
+         */
+        template <typename InterceptType>
+                class SparseInterceptVolume
+        {
+            typedef typename InterceptType::Scalar Scalar;
+            typedef typename InterceptType::DistType DistType;
+            typedef vcg::Point3<Scalar> Point3x;
+            typedef SparseBeam<InterceptType> BeamType;
+            typedef typename BeamType::RayKey RayKey;
+            typedef unsigned long long KeyType;
+
+            enum { INTERSECTION, UNION, DIFFERENCE };
+
+            static const long long MaxFaceUnits = 1LL << 20;
+            static const int MaxCells = 1 << 20;
+
+        public:
+            /* The lattice: lines and cells are spaced delta, the lattice point (0,0,0) is the cell
+               origin of the grid of spacing delta and vertices are rounded to 1/subCellPrecision of a cell. */
+            struct Frame
+            {
+                Point3x delta;
+                Point3i origin;
+                Point3i dim;
+                int subCellPrecision;
+
+                /* The lattice for the given box (all the operands); false if too large for the integer arithmetic */
+                static bool Make(const vcg::Box3<Scalar> &box, const Point3x &delta, int subCellPrecision, Frame &f) {
+                    f.delta = delta;
+                    f.subCellPrecision = subCellPrecision;
+                    for (int i = 0; i < 3; ++i) {
+                        f.origin[i] = int(std::floor(box.min[i] / delta[i])) - 2;
+                        f.dim[i] = int(std::ceil(box.max[i] / delta[i])) + 2 - f.origin[i];
+                        if (f.dim[i] <= 0 || f.dim[i] >= MaxCells)
+                            return false;
+                        /* the absolute lattice coordinates must fit the int of makeFraction, as in InterceptSet3 */
+                        if ((std::abs((long long)(f.origin[i])) + f.dim[i]) * (long long)(subCellPrecision) >= (1LL << 31))
+                            return false;
+                    }
+                    return subCellPrecision > 0;
+                }
+            };
+
+            inline explicit SparseInterceptVolume(const Frame &f) : frame(f), cancelled(false) { }
+
+            /* True if the last Build or BuildMesh was stopped by the callback */
+            inline bool Cancelled() const { return cancelled; }
+
+            /* Rasterize the faces of m; false if some face is too large for the integer arithmetic
+               or if the callback asked to stop (see Cancelled) */
+            template <class MeshType>
+                    bool Build(const MeshType &m, vcg::CallBackPos *cb=vcg::DummyCallBackPos) {
+                const int faceNum = int(m.face.size());
+                const long long sub = frame.subCellPrecision;
+                const int chunkNum = (faceNum < MLParallel::MinParallelSize) ? 1 : 8 * MLParallel::ThreadNum();
+                const std::vector<int> bnd = MLParallel::Chunks(faceNum, chunkNum);
+                const Point3x invDelta(Scalar(1) / frame.delta.X(),
+                                       Scalar(1) / frame.delta.Y(),
+                                       Scalar(1) / frame.delta.Z());
+                std::vector<std::vector<Entry> > chunkEntry(3 * chunkNum);
+                int tooLarge = 0;
+                std::atomic<bool> stop(false);
+                cancelled = false;
+
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : tooLarge)
+                for (int c = 0; c < chunkNum; ++c) {
+                    if (stop)
+                        continue;
+                    for (int fi = bnd[c]; fi < bnd[c + 1]; ++fi) {
+                        const typename MeshType::FaceType &f = m.face[fi];
+                        if (f.IsD())
+                            continue;
+                        /* same rounding of InterceptSet3: scaled by 1/delta and truncated to the
+                           1/subCellPrecision lattice, then moved to the frame origin */
+                        Point3ll v[3];
+                        for (int j = 0; j < 3; ++j) {
+                            Point3x p(f.cP(j));
+                            p.Scale(invDelta);
+                            for (int k = 0; k < 3; ++k)
+                                v[j][k] = (long long)(int(p[k] * frame.subCellPrecision)) - (long long)(frame.origin[k]) * sub;
+                        }
+                        bool small = true;
+                        for (int k = 0; k < 3; ++k)
+                            small = small && std::max(v[0][k], std::max(v[1][k], v[2][k])) - std::min(v[0][k], std::min(v[1][k], v[2][k])) < MaxFaceUnits;
+                        if (!small) {
+                            ++tooLarge;
+                            continue;
+                        }
+                        Point3x norm(f.cN());
+                        norm.Normalize();
+                        RasterFace<0>(v, fi, norm, f.cQ(), chunkEntry[3 * c + 0]);
+                        RasterFace<1>(v, fi, norm, f.cQ(), chunkEntry[3 * c + 1]);
+                        RasterFace<2>(v, fi, norm, f.cQ(), chunkEntry[3 * c + 2]);
+                    }
+                    if (MLParallel::ThreadId() == 0 && !cb(int(50LL * bnd[c + 1] / std::max(faceNum, 1)), "Rasterizing mesh..."))
+                        stop = true;
+                }
+                if (stop) {
+                    cancelled = true;
+                    return false;
+                }
+                if (tooLarge > 0)
+                    return false;
+
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (!cb(50 + 15 * axis, "Sorting intercepts...")) {
+                        cancelled = true;
+                        return false;
+                    }
+                    std::vector<Entry> entry;
+                    size_t entryNum = 0;
+                    for (int c = 0; c < chunkNum; ++c)
+                        entryNum += chunkEntry[3 * c + axis].size();
+                    entry.reserve(entryNum);
+                    for (int c = 0; c < chunkNum; ++c) {
+                        entry.insert(entry.end(), chunkEntry[3 * c + axis].begin(), chunkEntry[3 * c + axis].end());
+                        std::vector<Entry>().swap(chunkEntry[3 * c + axis]);
+                    }
+                    MLParallel::Sort(entry.begin(), entry.end(), EntryLess());
+
+                    BeamType &b = beam[axis];
+                    b = BeamType();
+                    b.icpt.resize(entry.size());
+                    for (size_t i = 0; i < entry.size(); ++i) {
+                        if (i == 0 || entry[i].key != entry[i - 1].key) {
+                            if (i > 0)
+                                b.start.push_back(int(i));
+                            b.key.push_back(entry[i].key);
+                        }
+                        b.icpt[i] = entry[i].icpt;
+                    }
+                    if (!entry.empty())
+                        b.start.push_back(int(entry.size()));
+                }
+                return true;
+            }
+
+            /* Number of lines crossing the surface an odd number of times, 0 for a watertight surface */
+            inline int OddRayNum() const {
+                int odd = 0;
+                for (int axis = 0; axis < 3; ++axis)
+                    for (int r = 0; r < beam[axis].RayNum(); ++r)
+                        odd += (beam[axis].start[r + 1] - beam[axis].start[r]) & 1;
+                return odd;
+            }
+
+            inline SparseInterceptVolume& operator &=(const SparseInterceptVolume &other) { return Combine(other, INTERSECTION); }
+
+            inline SparseInterceptVolume& operator |=(const SparseInterceptVolume &other) { return Combine(other, UNION); }
+
+            inline SparseInterceptVolume& operator -=(const SparseInterceptVolume &other) { return Combine(other, DIFFERENCE); }
+
+            /* Return 1 if the given lattice point is in the volume, -1 if it is outside, 0 if the beams disagree */
+            inline int IsIn(const vcg::Point3i &p) const {
+                const long long sub = frame.subCellPrecision;
+                int r[3];
+                for (int i = 0; i < 3; ++i)
+                    r[i] = beam[i].IsIn(p.V((i+1)%3), p.V((i+2)%3), p.V(i) * sub);
+
+                /* If some beams are unable to tell whether a point is inside or outside
+                   (i.e. they return 0), try to make them consistent with other beams */
+                for (int i = 0; i < 3; ++i)
+                    if (r[i] == 0)
+                        r[i] = r[(i+1)%3] + r[(i+2)%3];
+
+                if (r[0]>0 && r[1]>0 && r[2]>0)
+                    return 1;
+                else if ((r[0]<0 && r[1]<0 && r[2]<0) || (r[0]==0 && r[1]==0 && r[2]==0))
+                    return -1;
+                return 0;
+            }
+
+            /* Extract the surface with the marching cubes, visiting only the cells crossed by some intercept;
+               false, with an empty mesh, if the callback asked to stop (see Cancelled) */
+            template <class MeshType>
+                    bool BuildMesh(MeshType &mesh, vcg::CallBackPos *cb=vcg::DummyCallBackPos) {
+                typedef SparseWalker<MeshType> WalkerType;
+                const long long sub = frame.subCellPrecision;
+                mesh.Clear();
+                cancelled = false;
+
+                if (!cb(0, "Collecting cells...")) {
+                    cancelled = true;
+                    return false;
+                }
+                std::vector<KeyType> cell;
+                for (int c0 = 0; c0 < 3; ++c0) {
+                    const int c1 = (c0 + 1) % 3, c2 = (c0 + 2) % 3;
+                    const BeamType &b = beam[c0];
+                    const int rayNum = b.RayNum();
+                    const int chunkNum = (rayNum < 1024) ? 1 : 8 * MLParallel::ThreadNum();
+                    const std::vector<int> bnd = MLParallel::Chunks(rayNum, chunkNum);
+                    std::vector<std::vector<KeyType> > chunkCell(chunkNum);
+#pragma omp parallel for schedule(dynamic, 1)
+                    for (int c = 0; c < chunkNum; ++c) {
+                        for (int r = bnd[c]; r < bnd[c + 1]; ++r) {
+                            vcg::Point3i p;
+                            p[c1] = int(b.key[r] >> 32);
+                            p[c2] = int(b.key[r] & 0xffffffffULL);
+                            for (int i = b.start[r]; i < b.start[r + 1]; ++i) {
+                                const long long s = b.icpt[i].dist().Floor(sub);
+                                /* intercepts on a lattice point touch the cells on both sides */
+                                const int lo = (FilteredDist::Compare(b.icpt[i].dist(), s * sub) == 0) ? int(s) - 1 : int(s);
+                                for (p[c0] = lo; p[c0] <= int(s); ++p[c0])
+                                    for (int j = 0; j < 4; ++j) {
+                                        vcg::Point3i q = p;
+                                        q[c1] -= (j & 1) ? 0 : 1;
+                                        q[c2] -= (j & 2) ? 0 : 1;
+                                        chunkCell[c].push_back(CellKey(q));
+                                    }
+                            }
+                        }
+                    }
+                    for (int c = 0; c < chunkNum; ++c)
+                        cell.insert(cell.end(), chunkCell[c].begin(), chunkCell[c].end());
+                }
+                MLParallel::Sort(cell.begin(), cell.end(), std::less<KeyType>());
+                cell.erase(std::unique(cell.begin(), cell.end()), cell.end());
+
+                /* chunks of consecutive cells, so that the vertices are mostly shared inside a chunk */
+                const int cellNum = int(cell.size());
+                const int chunkNum = (cellNum + CellChunk - 1) / CellChunk;
+                std::vector<ChunkOut> out(chunkNum);
+                std::atomic<bool> stop(false);
+#pragma omp parallel for schedule(dynamic, 1)
+                for (int c = 0; c < chunkNum; ++c) {
+                    if (stop)
+                        continue;
+                    MeshType local;
+                    WalkerType walker(*this, local);
+                    vcg::tri::MarchingCubes<MeshType, WalkerType> mc(local, walker);
+                    mc.Initialize();
+                    const int end = std::min(cellNum, (c + 1) * CellChunk);
+                    for (int i = c * CellChunk; i < end; ++i) {
+                        const vcg::Point3i p1 = CellPoint(cell[i]);
+                        walker.SetCell(p1);
+                        mc.ProcessCell(p1, p1 + vcg::Point3i(1, 1, 1));
+                    }
+                    mc.Finalize();
+                    walker.Export(out[c]);
+                    if (MLParallel::ThreadId() == 0 && !cb(int(10 + 80LL * end / std::max(cellNum, 1)), "Reconstructing surface..."))
+                        stop = true;
+                }
+                if (stop || !cb(90, "Welding...")) {
+                    cancelled = true;
+                    return false;
+                }
+
+                Weld(out, mesh);
+                return true;
+            }
+
+            const Frame frame;
+
+        private:
+            struct Point3ll
+            {
+                long long v[3];
+                inline long long &operator [](int i) { return v[i]; }
+                inline const long long &operator [](int i) const { return v[i]; }
+            };
+
+            struct Entry
+            {
+                RayKey key;
+                InterceptType icpt;
+                int face;
+            };
+
+            /* by line, then as the intercepts, then by face to have a total order */
+            struct EntryLess
+            {
+                inline bool operator ()(const Entry &a, const Entry &b) const {
+                    if (a.key != b.key)
+                        return a.key < b.key;
+                    if (a.icpt < b.icpt)
+                        return true;
+                    if (b.icpt < a.icpt)
+                        return false;
+                    return a.face < b.face;
+                }
+            };
+
+            struct ChunkOut
+            {
+                std::vector<Point3x> pos;
+                std::vector<Point3x> norm;
+                std::vector<Scalar> quality;
+                std::vector<KeyType> key;
+                std::vector<int> tri;
+            };
+
+            static const int CellChunk = 4096;
+
+            static inline KeyType NoKey() { return ~KeyType(0); }
+
+            static inline KeyType CellKey(const vcg::Point3i &p) {
+                return (KeyType(p[0]) << 42) | (KeyType(p[1]) << 21) | KeyType(p[2]);
+            }
+
+            static inline vcg::Point3i CellPoint(KeyType k) {
+                return vcg::Point3i(int(k >> 42), int((k >> 21) & 0x1fffff), int(k & 0x1fffff));
+            }
+
+            /* Same as InterceptSet3::RasterFace, on integer coordinates: the lattice lines are
+               every subCellPrecision units and the face is at most MaxFaceUnits wide, so all the
+               products below fit in 64 bits */
+            template <const int CoordZ>
+                    void RasterFace(const Point3ll v[3], int face, const Point3x &norm, const Scalar &quality,
+                                    std::vector<Entry> &entry) const
+            {
+                const int crd0 = (CoordZ+0)%3;
+                const int crd1 = (CoordZ+1)%3;
+                const int crd2 = (CoordZ+2)%3;
+                const long long sub = frame.subCellPrecision;
+                const Point3ll &v0 = v[0], &v1 = v[1], &v2 = v[2];
+                long long d10[3], d21[3], d02[3];
+                for (int k = 0; k < 3; ++k) {
+                    d10[k] = v1[k] - v0[k];
+                    d21[k] = v2[k] - v1[k];
+                    d02[k] = v0[k] - v2[k];
+                }
+
+                const long long det0 = d21[crd2] * d02[crd1] - d21[crd1] * d02[crd2];
+                const long long det1 = d21[crd0] * d02[crd2] - d21[crd2] * d02[crd0];
+                const long long det2 = d21[crd1] * d02[crd0] - d21[crd0] * d02[crd1];
+                if (det0 == 0)
+                    return;
+
+                const long long xmin = FloorDiv(std::min(v0[crd1], std::min(v1[crd1], v2[crd1])), sub);
+                const long long xmax = FloorDiv(std::max(v0[crd1], std::max(v1[crd1], v2[crd1])), sub) + 1;
+                const long long ymin = FloorDiv(std::min(v0[crd2], std::min(v1[crd2], v2[crd2])), sub);
+                const long long ymax = FloorDiv(std::max(v0[crd2], std::max(v1[crd2], v2[crd2])), sub) + 1;
+                for (long long x = xmin; x <= xmax; ++x) {
+                    for (long long y = ymin; y <= ymax; ++y) {
+                        const long long X = x * sub, Y = y * sub;
+                        long long n0 = (v1[crd1]-X)*d21[crd2] - (v1[crd2]-Y)*d21[crd1];
+                        long long n1 = (v2[crd1]-X)*d02[crd2] - (v2[crd2]-Y)*d02[crd1];
+                        long long n2 = (v0[crd1]-X)*d10[crd2] - (v0[crd2]-Y)*d10[crd1];
+
+                        /* Solve the inside/outside problem for on-edge points.
+                           The point (x,y,z) is actually considered to be
+                           (x+eps, y+eps^2, z+eps^2) with eps->0. */
+                        if (crd1 > crd2) {
+                            if (n0 == 0)
+                                n0 = d21[crd1];
+                            if (n0 == 0)
+                                n0 -= d21[crd2];
+
+                            if (n1 == 0)
+                                n1 = d02[crd1];
+                            if (n1 == 0)
+                                n1 -= d02[crd2];
+
+                            if (n2 == 0)
+                                n2 = d10[crd1];
+                            if (n2 == 0)
+                                n2 -= d10[crd2];
+                        } else {
+                            if (n0 == 0)
+                                n0 -= d21[crd2];
+                            if (n0 == 0)
+                                n0 = d21[crd1];
+
+                            if (n1 == 0)
+                                n1 -= d02[crd2];
+                            if (n1 == 0)
+                                n1 = d02[crd1];
+
+                            if (n2 == 0)
+                                n2 -= d10[crd2];
+                            if (n2 == 0)
+                                n2 = d10[crd1];
+                        }
+
+                        if((n0>0 && n1>0 && n2>0) || (n0<0 && n1<0 && n2<0)) {
+                            Entry e;
+                            e.key = BeamType::Key(int(x), int(y));
+                            e.icpt = InterceptType(DistType(v0[crd0], (v0[crd2] - Y) * det2 + (v0[crd1] - X) * det1, det0),
+                                                   norm, norm[crd0], quality);
+                            e.face = face;
+                            entry.push_back(e);
+                        }
+                    }
+                }
+            }
+
+            static inline long long FloorDiv(long long a, long long b) {
+                return (a >= 0) ? a / b : -((-a + b - 1) / b);
+            }
+
+            SparseInterceptVolume& Combine(const SparseInterceptVolume &other, int op) {
+                assert (frame.delta == other.frame.delta && frame.origin == other.frame.origin);
+                for (int axis = 0; axis < 3; ++axis)
+                    CombineBeam(beam[axis], other.beam[axis], op);
+                return *this;
+            }
+
+            /* The lines of a and b are merged by key, then the intercepts of each line are swept
+               in order keeping those where the result changes between inside and outside */
+            static void CombineBeam(BeamType &a, const BeamType &b, int op) {
+                std::vector<std::pair<int, int> > ray;
+                ray.reserve(a.key.size() + b.key.size());
+                size_t i = 0, j = 0;
+                while (i < a.key.size() || j < b.key.size()) {
+                    if (j == b.key.size() || (i < a.key.size() && a.key[i] < b.key[j]))
+                        ray.push_back(std::make_pair(int(i++), -1));
+                    else if (i == a.key.size() || b.key[j] < a.key[i])
+                        ray.push_back(std::make_pair(-1, int(j++)));
+                    else
+                        ray.push_back(std::make_pair(int(i++), int(j++)));
+                }
+
+                const int rayNum = int(ray.size());
+                std::vector<std::vector<InterceptType> > res(rayNum);
+#pragma omp parallel for schedule(dynamic, 256)
+                for (int r = 0; r < rayNum; ++r) {
+                    const int ia = ray[r].first, ib = ray[r].second;
+                    int p = (ia < 0) ? 0 : a.start[ia], pe = (ia < 0) ? 0 : a.start[ia + 1];
+                    int q = (ib < 0) ? 0 : b.start[ib], qe = (ib < 0) ? 0 : b.start[ib + 1];
+                    bool inA = false, inB = false, in = false;
+                    std::vector<InterceptType> &out = res[r];
+                    while (p < pe || q < qe) {
+                        const bool fromA = (q == qe) || (p < pe && !(b.icpt[q] < a.icpt[p]));
+                        const InterceptType &x = fromA ? a.icpt[p++] : b.icpt[q++];
+                        if (fromA)
+                            inA = !inA;
+                        else
+                            inB = !inB;
+                        const bool now = (op == INTERSECTION) ? (inA && inB) : (op == UNION) ? (inA || inB) : (inA && !inB);
+                        if (now == in)
+                            continue;
+                        in = now;
+                        /* an interval closed where it was opened, or opened where the previous was closed, vanishes */
+                        if (!out.empty() && DistType::Compare(out.back().dist(), x.dist()) == 0)
+                            out.pop_back();
+                        else
+                            out.push_back((op == DIFFERENCE && !fromA) ? -x : x);
+                    }
+                }
+
+                BeamType c;
+                std::vector<int> size(rayNum);
+                for (int r = 0; r < rayNum; ++r)
+                    size[r] = int(res[r].size());
+                c.icpt.resize(MLParallel::ExclusiveScan(size));
+#pragma omp parallel for schedule(dynamic, 256)
+                for (int r = 0; r < rayNum; ++r)
+                    std::copy(res[r].begin(), res[r].end(), c.icpt.begin() + size[r]);
+                for (int r = 0; r < rayNum; ++r)
+                    if (!res[r].empty()) {
+                        c.key.push_back(ray[r].first >= 0 ? a.key[ray[r].first] : b.key[ray[r].second]);
+                        c.start.push_back(size[r] + int(res[r].size()));
+                    }
+                std::swap(a, c);
+            }
+
+            /* Walker of the marching cubes on a chunk of cells; the in/out values of the current cell
+               are cached and each vertex remembers the intercept it was made for. */
+            template <class MeshType>
+                    class SparseWalker
+            {
+                typedef typename MeshType::VertexPointer VertexPointer;
+
+            public:
+                SparseWalker(const SparseInterceptVolume &v, MeshType &m) : vol(v), mesh(m) { }
+
+                void SetCell(const vcg::Point3i &p) {
+                    org = p;
+                    for (int c = 0; c < 8; ++c)
+                        val[c] = float(vol.IsIn(p + vcg::Point3i(c & 1, (c >> 1) & 1, (c >> 2) & 1)));
+                }
+
+                inline float V(int i, int j, int k) const { return val[(i - org[0]) + 2 * (j - org[1]) + 4 * (k - org[2])]; }
+
+                inline float V(const vcg::Point3i &p) const { return V(p[0], p[1], p[2]); }
+
+                inline void GetXIntercept(const vcg::Point3i &p1, const vcg::Point3i &p2, VertexPointer& p) { GetIntercept<0>(p1, p2, p); }
+
+                inline void GetYIntercept(const vcg::Point3i &p1, const vcg::Point3i &p2, VertexPointer& p) { GetIntercept<1>(p1, p2, p); }
+
+                inline void GetZIntercept(const vcg::Point3i &p1, const vcg::Point3i &p2, VertexPointer& p) { GetIntercept<2>(p1, p2, p); }
+
+                bool Exist(const vcg::Point3i &p1, const vcg::Point3i &p2, VertexPointer& p) {
+                    if (V(p1) == V(p2))
+                        return false;
+
+                    vcg::Point3i d = p2 - p1;
+                    if (d.X())
+                        GetXIntercept(p1, p2, p);
+                    else if (d.Y())
+                        GetYIntercept(p1, p2, p);
+                    else if (d.Z())
+                        GetZIntercept(p1, p2, p);
+
+                    return true;
+                }
+
+                void Export(ChunkOut &out) {
+                    const size_t vn = mesh.vert.size();
+                    key.resize(vn, NoKey());
+                    out.key.swap(key);
+                    out.pos.resize(vn);
+                    out.norm.resize(vn);
+                    out.quality.resize(vn);
+                    for (size_t i = 0; i < vn; ++i) {
+                        out.pos[i] = mesh.vert[i].cP();
+                        out.norm[i] = mesh.vert[i].cN();
+                        out.quality[i] = mesh.vert[i].cQ();
+                    }
+                    out.tri.reserve(mesh.face.size() * 3);
+                    for (size_t i = 0; i < mesh.face.size(); ++i)
+                        for (int j = 0; j < 3; ++j)
+                            out.tri.push_back(int(vcg::tri::Index(mesh, mesh.face[i].cV(j))));
+                }
+
+            private:
+                template <const int coord>
+                void GetIntercept(const vcg::Point3i &p1, const vcg::Point3i &p2, VertexPointer& p) {
+                    const int c1 = (coord + 1) % 3, c2 = (coord + 2) % 3;
+                    const vcg::Point3i &lo = (p1[coord] < p2[coord]) ? p1 : p2;
+                    const BeamType &b = vol.beam[coord];
+                    const long long sub = vol.frame.subCellPrecision;
+                    const int r = b.Find(lo[c1], lo[c2]);
+                    const int i = (r < 0) ? -1 : b.LowerBound(r, lo[coord] * sub);
+
+                    /* the intercepts of the three beams are numbered in sequence */
+                    KeyType k = NoKey();
+                    if (i >= 0 && i < b.start[r + 1]) {
+                        k = KeyType(i);
+                        for (int a = 0; a < coord; ++a)
+                            k += KeyType(vol.beam[a].icpt.size());
+                        typename std::unordered_map<KeyType, int>::const_iterator v = vertex.find(k);
+                        if (v != vertex.end()) {
+                            p = &mesh.vert[v->second];
+                            return;
+                        }
+                    }
+
+                    const int vi = int(mesh.vert.size());
+                    vcg::tri::Allocator<MeshType>::AddVertices(mesh, 1);
+                    p = &mesh.vert[vi];
+                    for (int a = 0; a < 3; ++a)
+                        p->P().V(a) = (lo[a] + vol.frame.origin[a]) * vol.frame.delta[a];
+                    if (k == NoKey()) {
+                        /* the beams disagree, should never happen on a consistent volume */
+                        p->P().V(coord) += vol.frame.delta[coord] / 2;
+                        p->N() = Point3x(0, 0, 0);
+                        p->Q() = 0;
+                    } else {
+                        const InterceptType &x = b.icpt[i];
+                        p->P().V(coord) = (Scalar(x.dist().approx() / sub) + vol.frame.origin[coord]) * vol.frame.delta[coord];
+                        p->N() = x.norm();
+                        p->Q() = x.quality();
+                        vertex[k] = vi;
+                    }
+                    key.resize(mesh.vert.size(), NoKey());
+                    key[vi] = k;
+                }
+
+                const SparseInterceptVolume &vol;
+                MeshType &mesh;
+                vcg::Point3i org;
+                float val[8];
+                std::unordered_map<KeyType, int> vertex; /* maps intercept -> vertex of the chunk */
+                std::vector<KeyType> key;                /* intercept of each vertex of the chunk */
+            };
+
+            /* merge the vertices made for the same intercept, numbering them in chunk order */
+            template <class MeshType>
+                    static void Weld(std::vector<ChunkOut> &out, MeshType &m) {
+                const int chunkNum = int(out.size());
+                std::vector<int> triOffset(chunkNum + 1, 0);
+                for (int c = 0; c < chunkNum; ++c)
+                    triOffset[c] = int(out[c].tri.size()) / 3;
+                const int triTot = MLParallel::ExclusiveScan(triOffset);
+                std::vector<int> vertOffset, welded;
+                std::vector<std::pair<int, int> > source;
+                const int weldNum = MLParallel::Weld(out, NoKey(), vertOffset, welded, source);
+
+                if (weldNum > 0)
+                    vcg::tri::Allocator<MeshType>::AddVertices(m, weldNum);
+                if (triTot > 0)
+                    vcg::tri::Allocator<MeshType>::AddFaces(m, triTot);
+#pragma omp parallel for schedule(static)
+                for (int i = 0; i < weldNum; ++i) {
+                    const ChunkOut &o = out[source[i].first];
+                    const int li = source[i].second;
+                    m.vert[i].P() = o.pos[li];
+                    m.vert[i].N() = o.norm[li];
+                    m.vert[i].Q() = o.quality[li];
+                }
+#pragma omp parallel for schedule(dynamic, 16)
+                for (int c = 0; c < chunkNum; ++c) {
+                    const std::vector<int> &t = out[c].tri;
+                    for (int i = 0; i < int(t.size()); ++i)
+                        m.face[triOffset[c] + i / 3].V(i % 3) = &m.vert[welded[vertOffset[c] + t[i]]];
+                }
+            }
+
+            BeamType beam[3];
+            bool cancelled;
+        };
+    }
+}
+
+#endif // SPARSE_INTERCEPT_H
@@ -35,6 +35,7 @@
 #include <Qt>
 
 #include "filter_geodesic.h"
+#include <common/ml_parallel_geodesic.h>
 
 using namespace std;
 using namespace vcg;
@@ -97,7 +98,7 @@ int FilterGeodesic::getRequirements(QAction *action)
 	{
 	case FP_QUALITY_BORDER_GEODESIC  :
 	case FP_QUALITY_SELECTED_GEODESIC:
-	case FP_QUALITY_POINT_GEODESIC   : return MeshModel::MM_VERTFACETOPO;
+	case FP_QUALITY_POINT_GEODESIC   : return MeshModel::MM_NONE;
 	default: assert(0);
 	}
 	return 0;
@@ -111,11 +112,9 @@ bool FilterGeodesic::applyFilter(QAction *filter, MeshDocument &md, RichParamete
 	switch (ID(filter)) {
 	case FP_QUALITY_POINT_GEODESIC:
 	{
-		m.updateDataMask(MeshModel::MM_VERTFACETOPO);
-		m.updateDataMask(MeshModel::MM_VERTMARK);
 		m.updateDataMask(MeshModel::MM_VERTQUALITY);
 		m.updateDataMask(MeshModel::MM_VERTCOLOR);
-		tri::UpdateFlags<CMeshO>::FaceBorderFromVF(m.cm);
+		tri::UpdateFlags<CMeshO>::FaceBorderFromNone(m.cm);
 		tri::UpdateFlags<CMeshO>::VertexBorderFromFaceBorder(m.cm);
 		Point3m startPoint = par.getPoint3m("startPoint");
 		// first search the closest point on the surface;
@@ -134,7 +133,7 @@ bool FilterGeodesic::applyFilter(QAction *filter, MeshDocument &md, RichParamete
 		// Now actually compute the geodesic distance from the closest point
 		float dist_thr = par.getAbsPerc("maxDistance");
 		tri::EuclideanDistance<CMeshO> dd;
-		tri::Geodesic<CMeshO>::Compute(m.cm, vector<CVertexO*>(1,startVertex),dd,dist_thr);
+		tri::ParallelGeodesic<CMeshO>::Compute(m.cm, vector<CVertexO*>(1,startVertex),dd,dist_thr);
 
 		// Cleaning Quality value of the unreferenced vertices
 		// Unreached vertices has a quality that is maxfloat
@@ -154,14 +153,12 @@ bool FilterGeodesic::applyFilter(QAction *filter, MeshDocument &md, RichParamete
 		break;
 	case FP_QUALITY_BORDER_GEODESIC:
 	{
-		m.updateDataMask(MeshModel::MM_VERTFACETOPO);
-		m.updateDataMask(MeshModel::MM_VERTMARK);
 		m.updateDataMask(MeshModel::MM_VERTQUALITY);
 		m.updateDataMask(MeshModel::MM_VERTCOLOR);
-		tri::UpdateFlags<CMeshO>::FaceBorderFromVF(m.cm);
+		tri::UpdateFlags<CMeshO>::FaceBorderFromNone(m.cm);
 		tri::UpdateFlags<CMeshO>::VertexBorderFromFaceBorder(m.cm);
 
-		bool ret = tri::Geodesic<CMeshO>::DistanceFromBorder(m.cm);
+		bool ret = tri::ParallelGeodesic<CMeshO>::DistanceFromBorder(m.cm);
 
 		// Cleaning Quality value of the unreferenced vertices
 		// Unreached vertices has a quality that is maxfloat
@@ -182,11 +179,9 @@ bool FilterGeodesic::applyFilter(QAction *filter, MeshDocument &md, RichParamete
 		break;
 	case FP_QUALITY_SELECTED_GEODESIC:
 	{
-		m.updateDataMask(MeshModel::MM_VERTFACETOPO);
-		m.updateDataMask(MeshModel::MM_VERTMARK);
 		m.updateDataMask(MeshModel::MM_VERTQUALITY);
 		m.updateDataMask(MeshModel::MM_VERTCOLOR);
-		tri::UpdateFlags<CMeshO>::FaceBorderFromVF(m.cm);
+		tri::UpdateFlags<CMeshO>::FaceBorderFromNone(m.cm);
 		tri::UpdateFlags<CMeshO>::VertexBorderFromFaceBorder(m.cm);
 
 		std::vector<CMeshO::VertexPointer> seedVec;
@@ -199,7 +194,7 @@ bool FilterGeodesic::applyFilter(QAction *filter, MeshDocument &md, RichParamete
 		{
 			float dist_thr = par.getAbsPerc("maxDistance");
 			tri::EuclideanDistance<CMeshO> dd;
-			tri::Geodesic<CMeshO>::Compute(m.cm, seedVec, dd, dist_thr);
+			tri::ParallelGeodesic<CMeshO>::Compute(m.cm, seedVec, dd, dist_thr);
 
 			// Cleaning Quality value of the unreferenced vertices
 			// Unreached vertices has a quality that is maxfloat
@@ -26,13 +26,19 @@
 #include <gr/algorithms/Functor4pcs.h>
 #include <gr/algorithms/FunctorSuper4pcs.h>
 #include <gr/algorithms/PointPairFilter.h>
+#include <common/ml_parallel_utils.h>
+#include <wrap/io_trimesh/alnParser.h>
+#include <algorithm>
+#include <atomic>
+#include <QDir>
+#include <QFileInfo>
 //#include <QtScript>
 
 using PointType = gr::Point3D<float>;
 
 GlobalRegistrationPlugin::GlobalRegistrationPlugin()
 {
-    typeList << FP_GLOBAL_REGISTRATION;
+    typeList << FP_GLOBAL_REGISTRATION << FP_GLOBAL_REGISTRATION_BATCH;
 
   foreach(FilterIDType tt , types())
       actionList << new QAction(filterName(tt), this);
@@ -42,6 +48,7 @@ QString GlobalRegistrationPlugin::filterName(FilterIDType filterId) const
 {
   switch(filterId) {
         case FP_GLOBAL_REGISTRATION :  return QString("Global registration");
+        case FP_GLOBAL_REGISTRATION_BATCH :  return QString("Global registration of visible layers");
         default : assert(0);
     }
   return QString();
@@ -51,6 +58,12 @@ QString GlobalRegistrationPlugin::filterName(FilterIDType filterId) const
 {
   switch(filterId) {
         case FP_GLOBAL_REGISTRATION :  return QString("Compute the rigid transforation aligning two 3d objets.");
+        case FP_GLOBAL_REGISTRATION_BATCH :  return QString("Coarse alignment of all the visible layers, e.g. a set of unordered scans.<br>"
+                                                            "Each layer is sampled once, then every pair of layers is registered as in <i>Global registration</i>, "
+                                                            "running several pairs in parallel. The pairs whose LCP score is above the threshold form a graph; "
+                                                            "the best pairs spanning it give the transformation matrix of each layer, "
+                                                            "with respect to the first layer of its connected component, which is not moved.<br>"
+                                                            "The result can be saved as an .aln project and refined with the Align tool.");
         default : assert(0);
     }
     return QString("Unknown Filter");
@@ -60,20 +73,46 @@ GlobalRegistrationPlugin::FilterClass GlobalRegistrationPlugin::getClass(QAction
 {
   switch(ID(a))
     {
-        case FP_GLOBAL_REGISTRATION :  return MeshFilterInterface::PointSet;
+        case FP_GLOBAL_REGISTRATION :
+        case FP_GLOBAL_REGISTRATION_BATCH :  return MeshFilterInterface::PointSet;
         default : assert(0);
     }
     return MeshFilterInterface::Generic;
 }
 
+int GlobalRegistrationPlugin::postCondition(QAction *a) const
+{
+  switch(ID(a))
+    {
+        case FP_GLOBAL_REGISTRATION :  return MeshModel::MM_VERTCOORD;
+        case FP_GLOBAL_REGISTRATION_BATCH :  return MeshModel::MM_TRANSFMATRIX;
+        default : assert(0);
+    }
+    return MeshModel::MM_NONE;
+}
+
+MeshFilterInterface::FILTER_ARITY GlobalRegistrationPlugin::filterArity(QAction *a) const
+{
+  switch(ID(a))
+    {
+        case FP_GLOBAL_REGISTRATION :  return SINGLE_MESH;
+        case FP_GLOBAL_REGISTRATION_BATCH :  return VARIABLE;
+        default : assert(0);
+    }
+    return NONE;
+}
+
 void GlobalRegistrationPlugin::initParameterSet(QAction *action,MeshDocument &md, RichParameterSet & parlst)
 {
 
      switch(ID(action))	 {
         case FP_GLOBAL_REGISTRATION :
+        case FP_GLOBAL_REGISTRATION_BATCH :
 
-         parlst.addParam(new RichMesh ("refMesh",md.mm(),&md, "Reference Mesh",	"Reference point-cloud or mesh"));
-         parlst.addParam(new RichMesh ("targetMesh",md.mm(),&md, "Target Mesh",	"Point-cloud or mesh to be aligned to the reference"));
+         if (ID(action) == FP_GLOBAL_REGISTRATION) {
+             parlst.addParam(new RichMesh ("refMesh",md.mm(),&md, "Reference Mesh",	"Reference point-cloud or mesh"));
+             parlst.addParam(new RichMesh ("targetMesh",md.mm(),&md, "Target Mesh",	"Point-cloud or mesh to be aligned to the reference"));
+         }
          parlst.addParam(new RichAbsPerc("overlap", 50, 0, 100, "Overlap Ratio", "Overlap ratio between the two clouds (command line option: -o)"));
          parlst.addParam(new RichFloat("delta",   0.1, "Registration tolerance", "Tolerance value for the congruent set exploration and LCP computation (command line option: -d)"));
          parlst.addParam(new RichInt("nbSamples", 200, "Number of samples", "Number of samples used in each mesh (command line option: -n)"));
@@ -82,6 +121,12 @@ void GlobalRegistrationPlugin::initParameterSet(QAction *action,MeshDocument &md
          parlst.addParam(new RichInt("max_time_seconds", 10000, "Max. Computation time, in seconds", "Stop the computation before the end of the exploration (command line option: -t)"));
          parlst.addParam(new RichBool("useSuper4PCS", true, "Use Super4PCS", "When disable, use 4PCS algorithm (command line option: -x"));
 
+         if (ID(action) == FP_GLOBAL_REGISTRATION_BATCH) {
+             parlst.addParam(new RichFloat("minLCP", 0.25f, "Min. LCP score", "A pair of layers is used only if its LCP score (the fraction of samples that are brought within the tolerance) is at least this value"));
+             parlst.addParam(new RichInt("threads", 0, "Threads", "How many pairs are registered at the same time; 0 means one per core"));
+             parlst.addParam(new RichSaveFile("alnFile", "", "*.aln", "Save ALN project", "If not empty, the visible layers and their new transformations are saved in this .aln file, ready to be refined with the Align tool"));
+         }
+
          break;
      default : assert(0);
     }
@@ -131,15 +176,12 @@ auto fillPointSet = [] (const CMeshO& m, std::vector<gr::Point3D<CMeshO::ScalarT
     }
 };
 
-template <typename MatcherType>
-float align ( CMeshO* refMesh, CMeshO* trgMesh,
-              RichParameterSet & par,
-              MatrixType & mat,
-              typename MatcherType::TransformVisitor & v) {
-
-    using SamplerType   = gr::UniformDistSampler<gr::Point3D<CMeshO::ScalarType>>;
-    using OptionType    = typename MatcherType::OptionsType;
+using PointSetType = std::vector<gr::Point3D<CMeshO::ScalarType>>;
+using SuperMatcherType = gr::Match4pcsBase<gr::FunctorSuper4PCS, PointType, TransformVisitor, gr::AdaptivePointFilter, gr::AdaptivePointFilter::Options>;
+using BaseMatcherType  = gr::Match4pcsBase<gr::Functor4PCS, PointType, TransformVisitor, gr::AdaptivePointFilter, gr::AdaptivePointFilter::Options>;
 
+template <typename OptionType>
+OptionType buildOptions ( RichParameterSet & par ) {
     OptionType opt;
     opt.configureOverlap(par.getAbsPerc("overlap")/100.f);
     opt.delta                 = par.getFloat("delta");
@@ -147,10 +189,18 @@ float align ( CMeshO* refMesh, CMeshO* trgMesh,
     opt.max_normal_difference = par.getFloat("norm_diff");
     opt.max_color_distance    = par.getFloat("color_diff");
     opt.max_time_seconds      = par.getInt("max_time_seconds");
+    return opt;
+}
 
-    std::vector<gr::Point3D<CMeshO::ScalarType>> set1, set2;
-    fillPointSet(*refMesh, set1);
-    fillPointSet(*trgMesh, set2);
+// Each call has its own matcher (and random generator), so several
+// registrations can run at the same time.
+template <typename MatcherType>
+float align ( const PointSetType & set1, const PointSetType & set2,
+              const typename MatcherType::OptionsType & opt,
+              MatrixType & mat,
+              typename MatcherType::TransformVisitor & v) {
+
+    using SamplerType   = gr::UniformDistSampler<gr::Point3D<CMeshO::ScalarType>>;
 
     gr::Utils::Logger logger (gr::Utils::LogLevel::NoLog);
     SamplerType sampler;
@@ -161,11 +211,13 @@ float align ( CMeshO* refMesh, CMeshO* trgMesh,
 
 // The Real Core Function doing the actual mesh processing.
 // Move Vertex of a random quantity
-bool GlobalRegistrationPlugin::applyFilter(QAction */*filter*/,
-                                           MeshDocument &/*md*/,
+bool GlobalRegistrationPlugin::applyFilter(QAction *filter,
+                                           MeshDocument &md,
                                            RichParameterSet & par,
-                                           vcg::CallBackPos */*cb*/)
+                                           vcg::CallBackPos *cb)
 {
+    if (ID(filter) == FP_GLOBAL_REGISTRATION_BATCH)
+        return applyBatch(md, par, cb);
 
     MeshModel *mmref = par.getMesh("refMesh");
     MeshModel *mmtrg = par.getMesh("targetMesh");
@@ -181,12 +233,14 @@ bool GlobalRegistrationPlugin::applyFilter(QAction */*filter*/,
     v.mesh = trgMesh;
     v.plugin = this;
 
+    PointSetType set1, set2;
+    fillPointSet(*refMesh, set1);
+    fillPointSet(*trgMesh, set2);
+
     if (useSuper4PCS) {
-        using MatcherType = gr::Match4pcsBase<gr::FunctorSuper4PCS, PointType, TransformVisitor, gr::AdaptivePointFilter, gr::AdaptivePointFilter::Options>;
-        score = align< MatcherType >(refMesh, trgMesh, par, mat, v);
+        score = align< SuperMatcherType >(set1, set2, buildOptions<SuperMatcherType::OptionsType>(par), mat, v);
     } else {
-        using MatcherType = gr::Match4pcsBase<gr::Functor4PCS, PointType, TransformVisitor, gr::AdaptivePointFilter, gr::AdaptivePointFilter::Options>;
-        score = align< MatcherType >(refMesh, trgMesh, par, mat, v);
+        score = align< BaseMatcherType >(set1, set2, buildOptions<BaseMatcherType::OptionsType>(par), mat, v);
     }
 
     // run
@@ -196,4 +250,139 @@ bool GlobalRegistrationPlugin::applyFilter(QAction */*filter*/,
     return true;
 }
 
+/*
+  Registration of all the visible layers: every layer is sampled once, then
+  all the pairs are registered in parallel. The accepted pairs are the edges
+  of a graph between the layers, and the maximum spanning forest by LCP
+  score places each layer with respect to the first layer of its component.
+*/
+bool GlobalRegistrationPlugin::applyBatch(MeshDocument &md, RichParameterSet & par, vcg::CallBackPos *cb)
+{
+    using OptionType = SuperMatcherType::OptionsType;
+
+    std::vector<MeshModel*> layers;
+    foreach(MeshModel *mp, md.meshList)
+        if (mp->visible && mp->cm.vn > 0)
+            layers.push_back(mp);
+    const int layerNum = int(layers.size());
+    if (layerNum < 2) {
+        errorMessage = "At least two visible layers are needed";
+        return false;
+    }
+
+    const OptionType opt = buildOptions<OptionType>(par);
+    const bool useSuper4PCS = par.getBool("useSuper4PCS");
+    const float minLCP = par.getFloat("minLCP");
+    int threads = par.getInt("threads");
+    if (threads <= 0)
+        threads = MLParallel::ThreadNum();
+
+    // The same sampling the matcher does on its inputs (see MatchBase::init);
+    // being idempotent, doing it here once per layer does not change the results.
+    if (cb) cb(0, "Sampling layers");
+    std::vector<PointSetType> sets(layerNum);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+    for (int l = 0; l < layerNum; ++l)
+    {
+        PointSetType all;
+        fillPointSet(layers[l]->cm, all);
+        if (all.size() > opt.sample_size)
+            gr::UniformDistSampler<gr::Point3D<CMeshO::ScalarType>>()(all, opt, sets[l]);
+        else
+            sets[l].swap(all);
+    }
+
+    // pair p registers layer pairJ[p] onto layer pairI[p]; trans[p] maps the
+    // vertex coords of the former into the ones of the latter
+    std::vector<int> pairI, pairJ;
+    for (int i = 0; i < layerNum; ++i)
+        for (int j = i + 1; j < layerNum; ++j) {
+            pairI.push_back(i);
+            pairJ.push_back(j);
+        }
+    const int pairNum = int(pairI.size());
+    std::vector<float> score(pairNum, -1);
+    std::vector<Matrix44m> trans(pairNum);
+    std::atomic<int> done(0);
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+    for (int p = 0; p < pairNum; ++p)
+    {
+        MatrixType mat = MatrixType::Identity();
+        TransformVisitor v;
+        v.mesh = &layers[pairJ[p]]->cm;
+        v.plugin = this;
+        if (useSuper4PCS)
+            score[p] = align< SuperMatcherType >(sets[pairI[p]], sets[pairJ[p]], opt, mat, v);
+        else
+            score[p] = align< BaseMatcherType >(sets[pairI[p]], sets[pairJ[p]], opt, mat, v);
+        trans[p].FromEigenMatrix(mat);
+
+        const int d = ++done;
+        if (cb && MLParallel::ThreadId() == 0)
+            cb(5 + (90 * d) / pairNum, "Registering pairs");
+    }
+
+    // maximum spanning forest (Kruskal), ties go to the pair with the lower layers
+    std::vector<int> order;
+    for (int p = 0; p < pairNum; ++p)
+        if (score[p] >= minLCP)
+            order.push_back(p);
+    std::stable_sort(order.begin(), order.end(), [&score](int a, int b) { return score[a] > score[b]; });
+
+    MLParallelUnionFind components(layerNum);
+    std::vector<std::vector<int>> tree(layerNum);
+    for (int p : order) {
+        if (components.Find(pairI[p]) == components.Find(pairJ[p])) continue;
+        components.Union(pairI[p], pairJ[p]);
+        tree[pairI[p]].push_back(p);
+        tree[pairJ[p]].push_back(p);
+        Log("Pair %s - %s: LCP = %f", qUtf8Printable(layers[pairI[p]]->label()), qUtf8Printable(layers[pairJ[p]]->label()), score[p]);
+    }
+
+    // walk each tree from its lowest layer, which keeps its transformation
+    int componentNum = 0;
+    std::vector<bool> placed(layerNum, false);
+    for (int root = 0; root < layerNum; ++root) {
+        if (!components.IsRoot(root)) continue;
+        ++componentNum;
+        placed[root] = true;
+        std::vector<int> stack(1, root);
+        while (!stack.empty()) {
+            const int a = stack.back();
+            stack.pop_back();
+            for (int p : tree[a]) {
+                const bool aIsRef = (pairI[p] == a);
+                const int b = aIsRef ? pairJ[p] : pairI[p];
+                if (placed[b]) continue;
+                const Matrix44m &parentTr = layers[a]->cm.Tr;
+                layers[b]->cm.Tr = aIsRef ? parentTr * trans[p] : parentTr * vcg::Inverse(trans[p]);
+                placed[b] = true;
+                stack.push_back(b);
+            }
+        }
+    }
+    Log("Registered %i layers: %i pairs accepted out of %i, %i connected components",
+        layerNum, int(order.size()), pairNum, componentNum);
+
+    const QString alnFile = par.getSaveFileName("alnFile");
+    if (!alnFile.isEmpty()) {
+        // the .aln loaders resolve the mesh names relative to the .aln file
+        const QDir alnDir = QFileInfo(alnFile).absoluteDir();
+        std::vector<std::string> names;
+        std::vector<Matrix44m> transfs;
+        for (MeshModel *mp : layers) {
+            names.push_back(qUtf8Printable(alnDir.relativeFilePath(mp->fullName())));
+            transfs.push_back(mp->cm.Tr);
+        }
+        if (!ALNParser::SaveALN(qUtf8Printable(alnFile), names, transfs)) {
+            errorMessage = "Unable to save " + alnFile;
+            return false;
+        }
+        Log("Saved %s", qUtf8Printable(alnFile));
+    }
+
+    return true;
+}
+
 MESHLAB_PLUGIN_NAME_EXPORTER(GlobalRegistrationPlugin)
@@ -33,7 +33,7 @@ class GlobalRegistrationPlugin : public QObject, public MeshFilterInterface
     Q_INTERFACES(MeshFilterInterface)
 
 public:
-    enum { FP_GLOBAL_REGISTRATION  } ;
+    enum { FP_GLOBAL_REGISTRATION, FP_GLOBAL_REGISTRATION_BATCH } ;
 
     GlobalRegistrationPlugin();
 
@@ -43,9 +43,12 @@ public:
     QString filterInfo(FilterIDType filter) const;
     void initParameterSet(QAction *, MeshDocument &/*m*/, RichParameterSet & /*parent*/);
     bool applyFilter(QAction *filter, MeshDocument &md, RichParameterSet & /*parent*/, vcg::CallBackPos * cb) ;
-    int postCondition( QAction* ) const {return MeshModel::MM_VERTCOORD; }
+    int postCondition( QAction* ) const;
     FilterClass getClass(QAction *a);
-    FILTER_ARITY filterArity(QAction *) const {return SINGLE_MESH;}
+    FILTER_ARITY filterArity(QAction *) const;
+
+private:
+    bool applyBatch(MeshDocument &md, RichParameterSet &par, vcg::CallBackPos *cb);
 };
 
 
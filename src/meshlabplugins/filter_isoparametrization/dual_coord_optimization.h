@@ -1,5 +1,6 @@
 #ifndef DUAL_OPTIMIZER
 #define DUAL_OPTIMIZER
+#include <chrono>
 #include <wrap/callback.h>
 #ifndef IMPLICIT
 #include "texcoord_optimization.h"
@@ -399,10 +400,12 @@ public:
 
     void MinimizeStep(const int &phaseNum)
     {
-
-
-        //Ord_HVert[index]
-        for (unsigned int i=0;i<HRES_meshes.size();i++)
+        ///the submeshes are disjoint copies and each one reassigns only its
+        ///own vertices, so they are optimized at the same time, each thread
+        ///with the optimizer (and its scratch data) of the current submesh
+        const int num=int(HRES_meshes.size());
+#pragma omp parallel for schedule(dynamic,1)
+        for (int i=0;i<num;i++)
         {
 
             MeshType *currMesh=HRES_meshes[i];
@@ -548,8 +551,18 @@ public:
     vcg::CallBackPos *cb;
     int step;
 
+    typedef std::chrono::steady_clock Clock;
+
+    static float Seconds(const Clock::time_point &a,const Clock::time_point &b)
+    {
+        return std::chrono::duration<float>(b-a).count();
+    }
+
 public:
 
+    ///seconds spent in each stage of Optimize
+    float patchTime,starTime,diamondTime,faceTime;
+
 
     void Init(MeshType &_domain,
         MeshType &_h_res_mesh,
@@ -562,6 +575,7 @@ public:
         step=0;
         cb=_cb;
         accuracy=_accuracy;
+        patchTime=starTime=diamondTime=faceTime=0;
 
         vcg::tri::UpdateNormal<MeshType>::PerFaceNormalized(_domain);
 
@@ -629,7 +643,9 @@ public:
         step++;
 
 #ifndef IMPLICIT
+        Clock::time_point t0=Clock::now();
         DomOpt.OptimizePatches();
+        patchTime+=Seconds(t0,Clock::now());
         PrintAttributes();
 #endif
         while (ContinueOpt)
@@ -637,14 +653,20 @@ public:
             ///domain Optimization
             k++;
 
+            Clock::time_point t1=Clock::now();
             InitStarSubdivision();
             MinimizeStep(0);
+            Clock::time_point t2=Clock::now();
+            starTime+=Seconds(t1,t2);
 
             InitDiamondSubdivision();
             MinimizeStep(1);
+            Clock::time_point t3=Clock::now();
+            diamondTime+=Seconds(t2,t3);
 
             InitFaceSubdivision();
             MinimizeStep(2);
+            faceTime+=Seconds(t3,Clock::now());
             step++;
             PrintAttributes();
 
@@ -656,6 +678,10 @@ public:
                 ContinueOpt=false;
             distAggregate0=distAggregate1;
         }
+        char ret[200];
+        sprintf(ret," GLOBAL OPTIMIZATION patches:%.2fs stars:%.2fs diamonds:%.2fs faces:%.2fs ",
+                patchTime,starTime,diamondTime,faceTime);
+        (*cb)(100,ret);
     }
 };
 #endif
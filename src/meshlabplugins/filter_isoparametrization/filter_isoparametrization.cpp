@@ -230,6 +230,8 @@ bool FilterIsoParametrization::applyFilter(QAction *filter, MeshDocument& md, Ri
         int n_faces;
         Parametrizator.getValues(aggregate,L2,n_faces);
         Log("Num Faces of Abstract Domain: %d, One way stretch efficiency: %.4f, Area+Angle Distorsion %.4f  ",n_faces,L2,aggregate*100.f);
+        for (size_t i=0;i<Parametrizator.stage_times.size();i++)
+          Log("%s: %.2f s",Parametrizator.stage_times[i].first.c_str(),Parametrizator.stage_times[i].second);
       }
       else
       {
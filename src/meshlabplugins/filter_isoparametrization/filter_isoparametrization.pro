@@ -19,7 +19,8 @@ HEADERS += \
     uv_grid.h \
     defines.h \
     filter_isoparametrization.h\
-    stat_remeshing.h
+    stat_remeshing.h \
+    star_scheduler.h
 
 SOURCES += \
     filter_isoparametrization.cpp
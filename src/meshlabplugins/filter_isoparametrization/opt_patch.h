@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <vcg/complex/complex.h>
+#include "star_scheduler.h"
 
 
 template <class MeshType>
@@ -262,8 +263,9 @@ public:
 		varianceA=sqrt(varianceA/(ScalarType)base_mesh.fn);
 	}
 
-	///optimize UV of central vertex
-   static void OptimizeUV(VertexType *center,MeshType &base_domain)
+	///optimize UV of central vertex, lm_work (if any) is the working
+	///memory of the solver, at least LM_DIF_WORKSZ(2,2) floats
+   static void OptimizeUV(VertexType *center,MeshType &base_domain,float *lm_work=NULL)
 	{
 		///parametrize base domain star and subvertices
 		ParametrizeStarEquilateral<MeshType>(center,true);
@@ -327,7 +329,7 @@ public:
 		opts[3]=(float)1E-20;
 		opts[4]=(float)LM_DIFF_DELTA;
 
-		/*int num=*/slevmar_dif(Equi_energy,p,x,2,2,1000,opts,info,NULL,NULL,&Minf);
+		/*int num=*/slevmar_dif(Equi_energy,p,x,2,2,1000,opts,info,lm_work,NULL,&Minf);
 		
 		
 		///copy back values
@@ -390,9 +392,31 @@ public:
 	std::vector<Elem> Operations;
 
 
+	///optimization of a star on the thread it is run on, each thread
+	///has its own solver working memory
+	struct StarOptimizer
+	{
+		MeshType &base_domain;
+		std::vector<std::vector<float> > lm_work;
+
+		StarOptimizer(MeshType &_base_domain):base_domain(_base_domain),
+			lm_work(MLParallel::ThreadNum(),std::vector<float>(LM_DIF_WORKSZ(2,2))){}
+
+		void operator()(VertexType *center,int thread)
+		{
+			OptimizeUV(center,base_domain,&lm_work[thread][0]);
+		}
+	};
+
   void Execute(VertexType *center)
 	{
 		OptimizeUV(center,base_mesh);
+		UpdateNeighbors(center);
+	}
+
+	///push back the neighbors of an optimized star to the heap
+	void UpdateNeighbors(VertexType *center)
+	{
 		std::vector<typename MeshType::VertexType*> neigh;
 		getVertexStar<MeshType>(center,neigh);
 
@@ -446,22 +470,48 @@ void OptimizePatches()
 		ScalarType varianceL1;
 		ScalarType varianceA1;
 		bool continue_opt=true;
+		StarOptimizer starOpt(base_mesh);
+		///vertices whose mark is updated by the stars taken in the round
+		std::vector<bool> touched(base_mesh.vert.size(),false);
+		std::vector<VertexType*> neigh;
 		while (continue_opt)
 		{
-			int temp_oper=0;
-			while (temp_oper<20)
+			///take the next operations, then run the independent ones together.
+			///A star in the one ring of one taken before is dropped, as the
+			///serial loop would find its entry outdated by UpdateNeighbors;
+			///that UpdateNeighbors pushes it again with its new priority.
+			///Unlike the serial loop, those new entries only compete from
+			///the next round on.
+			std::vector<VertexType*> round;
+			while ((round.size()<20)&&(!Operations.empty()))
 			{
 				std::pop_heap(Operations.begin(),Operations.end());
 				VertexType* oper=Operations.back().center;
 				int t_mark=Operations.back().t_mark;
 				Operations.pop_back();
-				if (markers[oper]<=t_mark)
-				{
-					Execute(oper);
-					n_oper++;
-					temp_oper++;
-				}
+				if ((markers[oper]>t_mark)||(touched[vcg::tri::Index(base_mesh,oper)]))
+					continue;
+				round.push_back(oper);
+				neigh.clear();
+				getVertexStar<MeshType>(oper,neigh);
+				for (unsigned int i=0;i<neigh.size();i++)
+					touched[vcg::tri::Index(base_mesh,neigh[i])]=true;
+			}
+			if (round.empty())
+				break;
+			for (unsigned int i=0;i<round.size();i++)
+			{
+				neigh.clear();
+				getVertexStar<MeshType>(round[i],neigh);
+				for (unsigned int j=0;j<neigh.size();j++)
+					touched[vcg::tri::Index(base_mesh,neigh[j])]=false;
 			}
+			std::vector<typename StarScheduler<MeshType>::Batch> batches;
+			StarScheduler<MeshType>::Schedule(base_mesh,round,batches);
+			StarScheduler<MeshType>::Run(batches,starOpt);
+			for (unsigned int i=0;i<round.size();i++)
+				UpdateNeighbors(round[i]);
+			n_oper+=(int)round.size();
 			FindVarianceLenghtArea(base_mesh,averageLength,averageArea,varianceL1,varianceA1);
 			ScalarType percL=(varianceL0-varianceL1)*100/averageLength;
 			ScalarType percA=(varianceA0-varianceA1)*100/averageArea;
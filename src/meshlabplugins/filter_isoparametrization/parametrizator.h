@@ -40,7 +40,11 @@
 
 #include <opt_patch.h>
 #include <local_optimization.h>
+#include <star_scheduler.h>
 #include <statistics.h>
+#include <chrono>
+#include <string>
+#include <utility>
 #include <stat_remeshing.h>
 
 //extern int step_global;
@@ -71,8 +75,32 @@ public:
     typedef BaseMesh::CoordType CoordType;
     vcg::CallBackPos *cb;
     EnergyType EType;
+
+    ///seconds spent in each stage of the last Parametrize
+    std::vector<std::pair<std::string,float> > stage_times;
 private:
 
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point stage_start;
+
+    void StartStage()
+    {
+        stage_times.clear();
+        stage_start=Clock::now();
+    }
+
+    ///close the current stage, that started at the end of the previous one
+    void EndStage(const std::string &name)
+    {
+        Clock::time_point now=Clock::now();
+        float secs=std::chrono::duration<float>(now-stage_start).count();
+        stage_times.push_back(std::make_pair(name,secs));
+        stage_start=now;
+        char ret[200];
+        sprintf(ret," %s done in %.2f s ",name.c_str(),secs);
+        (*cb)(100,ret);
+    }
+
     void InitVoronoiArea()
     {
         ///area deviation respect to original
@@ -349,24 +377,41 @@ private:
         sprintf(ret," PERFORM GLOBAL OPTIMIZATION initializing... ");
         (*cb)(0,ret);
 
-        std::vector<vert_para> ord_vertex;
-        ord_vertex.resize(base_mesh.vn);
+        std::vector<BaseVertex*> centers;
         for (unsigned int i=0;i<base_mesh.vert.size();i++)
             if (!base_mesh.vert[i].IsD())
-            {
-                BaseVertex *v=&base_mesh.vert[i];
-                ScalarType val=StarDistorsion<BaseMesh>(&base_mesh.vert[i]);
-                //printf("i: %d\n",i);
-                ord_vertex[i].dist=val;
-                ord_vertex[i].v=v;
-            }
+                centers.push_back(&base_mesh.vert[i]);
 
+        ///evaluate the distorsion of every star, the independent ones together
+        std::vector<StarScheduler<BaseMesh>::Batch> batches;
+        std::vector<ScalarType> dist(base_mesh.vert.size(),0);
+        auto distOp=[&](BaseVertex *v,int)
+        {
+            dist[vcg::tri::Index(base_mesh,v)]=StarDistorsion<BaseMesh>(v);
+        };
+        StarScheduler<BaseMesh>::Schedule(base_mesh,centers,batches);
+        StarScheduler<BaseMesh>::Run(batches,distOp);
+
+        std::vector<vert_para> ord_vertex(centers.size());
+        for (unsigned int i=0;i<centers.size();i++)
+        {
+            ord_vertex[i].dist=dist[vcg::tri::Index(base_mesh,centers[i])];
+            ord_vertex[i].v=centers[i];
+        }
         std::sort(ord_vertex.begin(),ord_vertex.end());
+
+        ///then optimize from the most distorted star, each one together
+        ///with the following ones that do not conflict with it
         for (unsigned int i=0;i<ord_vertex.size();i++)
+            centers[i]=ord_vertex[i].v;
+        const int star_accuracy=pecp->Accuracy();
+        auto optOp=[&](BaseVertex *v,int)
         {
-                printf("%3.3f\n",ord_vertex[i].dist);
-        SmartOptimizeStar<BaseMesh>(ord_vertex[i].v,base_mesh,pecp->Accuracy(),EType);
-        }
+            SmartOptimizeStar<BaseMesh>(v,base_mesh,star_accuracy,EType);
+        };
+        StarScheduler<BaseMesh>::Schedule(base_mesh,centers,batches);
+        StarScheduler<BaseMesh>::Run(batches,optOp);
+        EndStage("star optimization");
     }
 
 
@@ -375,7 +420,8 @@ private:
         const int &targetFaces,
         const int &interval,
         bool execute_flip=true,
-        bool test_interpolation=true)
+        bool test_interpolation=true,
+        const std::string &stage="decimation")
     {
     vcg::tri::UpdateFlags<MeshType>::VertexClearV(*mesh);
     vcg::tri::UpdateFlags<MeshType>::FaceClearV(*mesh);
@@ -422,6 +468,7 @@ private:
 
         ///ASSOCIATE REMAINING VERTICES TO ONE FACE
         AssociateRemaining();
+        EndStage(stage);
 
         ///LAST OPTIMIZATION STEP ON STARS
         if (execute_flip)
@@ -749,6 +796,7 @@ public:
       BaryOptimizatorDual<BaseMesh> BaryOpt;
       BaryOpt.Init(base_mesh,final_mesh,cb,accuracy,EType);
       BaryOpt.Optimize(4.0f/(float)accuracy,accuracy*4);
+      EndStage("global optimization");
 #ifndef _MESHLAB
       printf("\n POST DUAL OPT:	\n");
       PrintAttributes();
@@ -778,6 +826,7 @@ public:
   ReturnCode Parametrize(MeshType *mesh,vcg::tri::ParamEdgeCollapseParameter &pecp,bool Two_steps=true,EnergyType _EType=EN_EXTMips)
     {
         EType=_EType;
+        StartStage();
 //		MyTriEdgeCollapse::EType()=EType;
 //		MyTriEdgeFlip::EType()=EType;
     pecp.EType()=_EType;
@@ -805,7 +854,7 @@ public:
             ///do a first parametrization step
             printf("\n STEP 1 \n");
             InitVoronoiArea();
-            ReturnCode res=InitBaseMesh<MeshType>(mesh,limit0,1,false,false);
+            ReturnCode res=InitBaseMesh<MeshType>(mesh,limit0,1,false,false,"decimation (step 1)");
             ScaleMesh(*mesh,1.0/factor);
             TranslateMesh(*mesh,-transl);
             if (res!=Done)
@@ -815,9 +864,10 @@ public:
             AbstractMesh abs_mesh0;
             //AbstractMesh abs_mesh_test;
             ExportMeshes(para_mesh0,abs_mesh0);
+            EndStage("export (step 1)");
 
             printf("\n STEP 2 \n");
-            res=InitBaseMesh<AbstractMesh>(&abs_mesh0,lower_limit,interval,true,true);
+            res=InitBaseMesh<AbstractMesh>(&abs_mesh0,lower_limit,interval,true,true,"decimation (step 2)");
             if (res!=Done)
                 return res;
 
@@ -889,6 +939,7 @@ public:
                 assert(bary.X()+bary.Y()<=1.0001);
                 base_f->vertices_bary.push_back(std::pair<BaseVertex *,CoordType>(&final_mesh.vert[i],bary));
             }
+            EndStage("merge");
          InitVoronoiArea();
      FinalOptimization(&pecp);
          printf("STEP 3 \n");
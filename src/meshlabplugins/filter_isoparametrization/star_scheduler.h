@@ -0,0 +1,72 @@
+#ifndef _STAR_SCHEDULER
+#define _STAR_SCHEDULER
+
+#include <algorithm>
+#include <vector>
+#include <vcg/complex/complex.h>
+#include <common/ml_parallel_utils.h>
+#include "mesh_operators.h"
+
+///schedule the local optimizations of the stars of the abstract domain
+///so that the ones running at the same time never share data.
+///The optimization of a star reads and writes the vertices of its closed
+///one ring, the faces around the center and the hres vertices falling in
+///them, so two stars can go together only when their centers are at least
+///three edges apart. Each center is put in the first batch after the ones
+///of all the conflicting centers that come before it: conflicting stars
+///are still optimized in the order given, only independent ones overlap.
+template <class MeshType>
+class StarScheduler
+{
+    typedef typename MeshType::VertexType VertexType;
+
+public:
+    typedef std::vector<VertexType*> Batch;
+
+    ///split centers, in that order, in batches of independent stars
+    static void Schedule(MeshType &domain,
+                         const std::vector<VertexType*> &centers,
+                         std::vector<Batch> &batches)
+    {
+        batches.clear();
+        ///batch of the last scheduled star on each vertex, -1 if none
+        std::vector<int> level(domain.vert.size(),-1);
+        std::vector<VertexType*> ring,ring2;
+        for (size_t i=0;i<centers.size();i++)
+        {
+            VertexType *center=centers[i];
+            int curr=level[vcg::tri::Index(domain,center)]+1;
+            ring.clear();
+            getVertexStar<MeshType>(center,ring);
+            for (size_t j=0;j<ring.size();j++)
+            {
+                curr=std::max(curr,level[vcg::tri::Index(domain,ring[j])]+1);
+                ring2.clear();
+                getVertexStar<MeshType>(ring[j],ring2);
+                for (size_t k=0;k<ring2.size();k++)
+                    curr=std::max(curr,level[vcg::tri::Index(domain,ring2[k])]+1);
+            }
+            level[vcg::tri::Index(domain,center)]=curr;
+            if (curr>=(int)batches.size())
+                batches.resize(curr+1);
+            batches[curr].push_back(center);
+        }
+    }
+
+    ///run op(center,thread) on every center, batch after batch; the
+    ///thread index lets op keep its own scratch space for each thread
+    template <class OpType>
+    static void Run(const std::vector<Batch> &batches,OpType &op)
+    {
+        for (size_t b=0;b<batches.size();b++)
+        {
+            const Batch &batch=batches[b];
+            const int n=int(batch.size());
+#pragma omp parallel for schedule(dynamic,1) if (n>1)
+            for (int i=0;i<n;i++)
+                op(batch[i],MLParallel::ThreadId());
+        }
+    }
+};
+
+#endif
@@ -28,6 +28,9 @@
 #include "filter_layer.h"
 
 #include<vcg/complex/append.h>
+#include <common/ml_parallel_append.h>
+#include <common/ml_parallel_clean.h>
+#include <common/ml_parallel_components.h>
 #include <QImageReader>
 
 
@@ -354,30 +357,42 @@ bool FilterLayerPlugin::applyFilter(QAction *filter, MeshDocument &md, RichParam
 		MeshModel *destModel = md.addNewMesh("", "Merged Mesh", true);
 
 		QList<MeshModel *> toBeDeletedList;
-
-		int cnt=0;
+		std::vector<CMeshO *> srcMeshes;
+		std::vector<Matrix44m> srcTr;
 		foreach(MeshModel *mmp, md.meshList)
-		{ 
-			++cnt;
-            if(mmp->visible || !mergeVisible)
-            {
-				if (mmp != destModel)
-                {
-                    cb(cnt*100/md.meshList.size(), "Merging layers...");
-                    tri::UpdatePosition<CMeshO>::Matrix(mmp->cm,mmp->cm.Tr,true);
-                    toBeDeletedList.push_back(mmp);
-                    if(!alsoUnreferenced)
-                    {
-                        vcg::tri::Clean<CMeshO>::RemoveUnreferencedVertex(mmp->cm);
-                    }
-					destModel->updateDataMask(mmp);
-					tri::Append<CMeshO, CMeshO>::Mesh(destModel->cm, mmp->cm);
-                    tri::UpdatePosition<CMeshO>::Matrix(mmp->cm,Inverse(mmp->cm.Tr),true);
-                    
-                }
-            }
+		{
+			if((mmp->visible || !mergeVisible) && mmp != destModel)
+			{
+				// the union of the components of all the merged layers
+				destModel->updateDataMask(mmp);
+				toBeDeletedList.push_back(mmp);
+				srcMeshes.push_back(&mmp->cm);
+				srcTr.push_back(mmp->cm.Tr);
+			}
+		}
+
+		if (tri::ParallelAppend<CMeshO>::CanFlatten(srcMeshes))
+		{
+			// all the layers are copied at once in a single allocation
+			tri::ParallelAppend<CMeshO>::Flatten(destModel->cm, srcMeshes, srcTr, alsoUnreferenced, cb);
+		}
+		else
+		{
+			int cnt=0;
+			foreach(MeshModel *mmp, toBeDeletedList)
+			{
+				++cnt;
+				cb(cnt*100/toBeDeletedList.size(), "Merging layers...");
+				tri::UpdatePosition<CMeshO>::Matrix(mmp->cm,mmp->cm.Tr,true);
+				if(!alsoUnreferenced)
+				{
+					vcg::tri::Clean<CMeshO>::RemoveUnreferencedVertex(mmp->cm);
+				}
+				tri::Append<CMeshO, CMeshO>::Mesh(destModel->cm, mmp->cm);
+				tri::UpdatePosition<CMeshO>::Matrix(mmp->cm,Inverse(mmp->cm.Tr),true);
+			}
 		}
-            
+
 		if( deleteLayer )
 		{
 			Log( "Deleted %d merged layers", toBeDeletedList.size());
@@ -388,7 +403,7 @@ bool FilterLayerPlugin::applyFilter(QAction *filter, MeshDocument &md, RichParam
 		
 		if( mergeVertices )
 		{
-			int delvert = tri::Clean<CMeshO>::RemoveDuplicateVertex(destModel->cm);
+			int delvert = tri::ParallelClean<CMeshO>::RemoveDuplicateVertex(destModel->cm);
 			Log( "Removed %d duplicated vertices", delvert);
 		}
 
@@ -400,16 +415,20 @@ bool FilterLayerPlugin::applyFilter(QAction *filter, MeshDocument &md, RichParam
 	{
 		MeshModel *currentModel = md.mm();
 		CMeshO &cm = md.mm()->cm;
-		md.mm()->updateDataMask(MeshModel::MM_FACEFACETOPO);
-		std::vector< std::pair<int,CMeshO::FacePointer> > connectedCompVec;
-		int numCC = tri::Clean<CMeshO>::ConnectedComponents(cm,  connectedCompVec);
+		std::vector<int> faceCC;
+		int numCC = tri::ParallelConnectedComponents<CMeshO>::Compute(cm, faceCC);
 		Log("Found %i Connected Components",numCC);
 		
-		for(size_t i=0; i<connectedCompVec.size();++i)
+		const int faceNum = int(cm.face.size());
+		for(int i=0; i<numCC;++i)
 		{
-			tri::UpdateSelection<CMeshO>::FaceClear(cm);
-			connectedCompVec[i].second->SetS();
-			tri::UpdateSelection<CMeshO>::FaceConnectedFF(cm/*,true*/);
+			// select exactly the faces of the i-th component
+#pragma omp parallel for schedule(static)
+			for(int fi=0; fi<faceNum; ++fi)
+			{
+				if(faceCC[fi]==i) cm.face[fi].SetS();
+				else cm.face[fi].ClearS();
+			}
 			tri::UpdateSelection<CMeshO>::VertexClear(cm);
 			tri::UpdateSelection<CMeshO>::VertexFromFaceLoose(cm);
 
@@ -2,6 +2,7 @@ include (../../shared.pri)
 
 HEADERS += \
     quadric_simp.h \
+    point_stream.h \
     meshfilter.h
 
 SOURCES += \
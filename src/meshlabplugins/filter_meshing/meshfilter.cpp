@@ -28,15 +28,18 @@
 #include <vcg/complex/algorithms/refine_loop.h>
 #include <vcg/complex/algorithms/bitquad_support.h>
 #include <vcg/complex/algorithms/bitquad_creation.h>
-#include <vcg/complex/algorithms/clustering.h>
 #include <vcg/complex/algorithms/attribute_seam.h>
 #include <vcg/complex/algorithms/update/curvature.h>
-#include <vcg/complex/algorithms/update/curvature_fitting.h>
-#include <vcg/complex/algorithms/pointcloud_normal.h>
 #include <vcg/complex/algorithms/isotropic_remeshing.h>
 #include <vcg/space/fitting3.h>
 #include <wrap/gl/glu_tessellator_cap.h>
 #include "quadric_simp.h"
+#include <common/ml_parallel_normals.h>
+#include <common/ml_parallel_clustering.h>
+#include <common/ml_parallel_remeshing.h>
+#include <common/ml_parallel_curvature.h>
+#include <common/ml_parallel_subdivision.h>
+#include "point_stream.h"
 
 using namespace std;
 using namespace vcg;
@@ -48,6 +51,7 @@ ExtraMeshFilterPlugin::ExtraMeshFilterPlugin(void)
 	    << FP_LOOP_SS
 	    << FP_BUTTERFLY_SS
 	    << FP_CLUSTERING
+	    << FP_CLUSTERING_STREAM
 	    << FP_QUADRIC_SIMPLIFICATION
 	    << FP_QUADRIC_TEXCOORD_SIMPLIFICATION
 	    << FP_EXPLICIT_ISOTROPIC_REMESHING
@@ -111,6 +115,7 @@ ExtraMeshFilterPlugin::ExtraMeshFilterPlugin(void)
 	lastisor_SwapFlag            = true;
 	lastisor_ProjectFlag         = true;
 	lastisor_FeatureDeg          = 30.0f;
+	lastisor_Parallel            = false;
 }
 
 ExtraMeshFilterPlugin::FilterClass ExtraMeshFilterPlugin::getClass(QAction * a)
@@ -129,6 +134,7 @@ ExtraMeshFilterPlugin::FilterClass ExtraMeshFilterPlugin::getClass(QAction * a)
 		case FP_FAUX_EXTRACT                     :
 		case FP_VATTR_SEAM                       :
 		case FP_REFINE_LS3_LOOP	                 : return MeshFilterInterface::Remeshing;
+		case FP_CLUSTERING_STREAM                : return MeshFilterInterface::MeshCreation;
 		case FP_REFINE_CATMULL                   :
 		case FP_REFINE_HALF_CATMULL              :
 		case FP_QUAD_DOMINANT                    :
@@ -193,6 +199,7 @@ int ExtraMeshFilterPlugin::getPreCondition(QAction *filter) const
 		case FP_REFINE_LS3_LOOP                  : return MeshModel::MM_FACENUMBER;
 		case FP_NORMAL_SMOOTH_POINTCLOUD         : return MeshModel::MM_VERTNORMAL;
 		case FP_CLUSTERING                       :
+		case FP_CLUSTERING_STREAM                :
 		case FP_SCALE                            :
 		case FP_CENTER                           :
 		case FP_ROTATE                           :
@@ -221,6 +228,7 @@ QString ExtraMeshFilterPlugin::filterName(FilterIDType filter) const
 		case FP_QUADRIC_TEXCOORD_SIMPLIFICATION  : return tr("Simplification: Quadric Edge Collapse Decimation (with texture)");
 		case FP_EXPLICIT_ISOTROPIC_REMESHING     : return tr("Remeshing: Isotropic Explicit Remeshing");
 		case FP_CLUSTERING                       : return tr("Simplification: Clustering Decimation");
+		case FP_CLUSTERING_STREAM                : return tr("Simplification: Clustering Decimation of a Point File");
 		case FP_REORIENT                         : return tr("Re-Orient all faces coherentely");
 		case FP_INVERT_FACES                     : return tr("Invert Faces Orientation");
 		case FP_SCALE                            : return tr("Transform: Scale, Normalize");
@@ -283,6 +291,10 @@ QString ExtraMeshFilterPlugin::filterInfo(FilterIDType filterID) const
 			                                               "<br> <i>Luiz Velho, Denis Zorin </i>"
 			                                               "<br>CAGD, volume 18, Issue 5, Pages 397-427. ");
 		case FP_CLUSTERING                         : return tr("Collapse vertices by creating a three dimensional grid enveloping the mesh and discretizes them based on the cells of this grid");
+		case FP_CLUSTERING_STREAM                  : return tr("Cluster the points of an ASCII point file (one point per line: <i>x y z [nx ny nz [r g b]]</i>) on a three dimensional grid, "
+			                                               "as <i>Clustering Decimation</i> does, reading the file a chunk at a time instead of loading it, "
+			                                               "so that clouds that do not fit in memory can be reduced. The file is read twice, the first time to find its bounding box. "
+			                                               "The result is a new layer.");
 		case FP_QUADRIC_SIMPLIFICATION             : return tr("Simplify a mesh using a Quadric based Edge Collapse Strategy; better than clustering but slower");
 		case FP_QUADRIC_TEXCOORD_SIMPLIFICATION    : return tr("Simplify a textured mesh using a Quadric based Edge Collapse Strategy preserving UV parametrization; better than clustering but slower");
 		case FP_EXPLICIT_ISOTROPIC_REMESHING       : return tr("Perform a explicit remeshing of a triangular mesh, by repeatedly applying edge flip, collapse, relax and refine to improve aspect ratio (triangle quality) and topological regularity.");
@@ -401,6 +413,7 @@ void ExtraMeshFilterPlugin::initParameterSet(QAction * action, MeshModel & m, Ri
 			parlst.addParam(new RichBool ("SwapFlag", lastisor_SwapFlag, "Edge-Swap Step", "If checked the remeshing operations will include a edge-swap step, aimed at improving the vertex valence of the resulting mesh."));
 			parlst.addParam(new RichBool ("SmoothFlag", lastisor_SmoothFlag, "Smooth Step", "If checked the remeshing operations will include a smoothing step, aimed at relaxing the vertex positions in a Laplacian sense."));
 			parlst.addParam(new RichBool ("ReprojectFlag", lastisor_ProjectFlag, "Reproject Step", "If checked the remeshing operations will include a step to reproject the mesh vertices on the original surface."));
+			parlst.addParam(new RichBool ("ParallelMode", lastisor_Parallel, "Parallel", "If checked the remeshing uses all the cores: each step is applied at once on a set of non overlapping operations and the time spent in each step is logged. Adaptive remeshing and meshes with per wedge attributes (e.g. texture coordinates) are not available in this mode."));
 
 			break;
 		case FP_CLOSE_HOLES:
@@ -430,6 +443,11 @@ void ExtraMeshFilterPlugin::initParameterSet(QAction * action, MeshModel & m, Ri
 			parlst.addParam(new RichBool ("Selected",m.cm.sfn>0,"Affect only selected faces","If selected the filter affect only the selected faces"));
 			break;
 
+		case FP_CLUSTERING_STREAM:
+			parlst.addParam(new RichOpenFile("FileName", "", QStringList("Point Files (*.xyz *.txt *.asc *.pts)"), "Point File", "The ASCII file with the points to be clustered."));
+			parlst.addParam(new RichFloat("CellSize", 0, "Cell Size", "The size of the cell of the clustering grid, in the units of the file; if 0 (the default) it is chosen, once the bounding box of the file is known, so that the grid has about one million cells."));
+			break;
+
 		case FP_CYLINDER_UNWRAP:
 			parlst.addParam(new RichFloat("startAngle", 0,"Start angle (deg)", "The starting angle of the unrolling process."));
 			parlst.addParam(new RichFloat("endAngle",360,"End angle (deg)","The ending angle of the unrolling process. Quality threshold for penalizing bad shaped faces.<br>The value is in the range [0..1]\n 0 accept any kind of face (no penalties),\n 0.5  penalize faces with quality < 0.5, proportionally to their shape\n"));
@@ -669,8 +687,61 @@ void ApplyTransform(MeshDocument &md, const Matrix44m &tr, bool toAllFlag, bool
 }
 
 
+bool ExtraMeshFilterPlugin::clusterPointStream(MeshDocument & md, RichParameterSet & par, vcg::CallBackPos * cb)
+{
+	QString fileName = par.getOpenFileName("FileName");
+	float cellSize = par.getFloat("CellSize");
+	PointStreamReader reader;
+	if (!reader.open(fileName))
+	{
+		errorMessage = "Unable to open " + fileName;
+		return false;
+	}
+
+	// first pass: bounding box
+	std::vector<Point3m> pos, nrm;
+	std::vector<Color4b> col;
+	Box3m bbox;
+	while (reader.readChunk(pos, NULL, NULL))
+	{
+		for (size_t i = 0; i < pos.size(); ++i)
+			bbox.Add(pos[i]);
+		if (cb) cb(reader.progress() / 4, "Computing bounding box");
+	}
+	if (bbox.IsNull())
+	{
+		errorMessage = "No points found in " + fileName;
+		return false;
+	}
+	const bool hasNormals = reader.fields() >= 6;
+	const bool hasColors = reader.fields() >= 9;
+
+	// second pass: clustering
+	tri::ParallelClustering<CMeshO> ClusteringGrid;
+	ClusteringGrid.Init(bbox, 1000000, cellSize);
+	reader.rewind();
+	while (reader.readChunk(pos, hasNormals ? &nrm : NULL, hasColors ? &col : NULL))
+	{
+		ClusteringGrid.AddPoints(pos, hasNormals ? &nrm : NULL, hasColors ? &col : NULL);
+		if (cb) cb(25 + (reader.progress() * 3) / 4, "Clustering points");
+	}
+
+	MeshModel *clustered = md.addNewMesh("", QFileInfo(fileName).baseName() + "_clustered", true);
+	if (hasColors)
+		clustered->updateDataMask(MeshModel::MM_VERTCOLOR);
+	ClusteringGrid.ExtractMesh(clustered->cm);
+	clustered->UpdateBoxAndNormals();
+	Log("Clustered %s on a %i x %i x %i grid: %i points", qUtf8Printable(fileName),
+		ClusteringGrid.GridSize()[0], ClusteringGrid.GridSize()[1], ClusteringGrid.GridSize()[2], clustered->cm.vn);
+	return true;
+}
+
 bool ExtraMeshFilterPlugin::applyFilter(QAction * filter, MeshDocument & md, RichParameterSet & par, vcg::CallBackPos * cb)
 {
+// it creates its layer from a file, the document may have no current mesh
+if (ID(filter) == FP_CLUSTERING_STREAM)
+	return clusterPointStream(md, par, cb);
+
 MeshModel & m = *md.mm();
 
 switch(ID(filter))
@@ -695,67 +766,54 @@ switch(ID(filter))
 		float threshold = par.getAbsPerc("Threshold");
 		int iterations = par.getInt("Iterations");
 
+		typedef tri::ParallelSubdivision<CMeshO> Subdivision;
+		typedef LS3Projection<CMeshO, double> LS3;
 		for(int i=0; i<iterations; ++i)
 		{
-			m.updateDataMask(MeshModel::MM_VERTFACETOPO);
 			switch(ID(filter))
 			{
 			case FP_LOOP_SS :
 				switch(par.getEnum("LoopWeight"))
 				{
 				case 0:
-					tri::RefineOddEven<CMeshO/*, tri::OddPointLoop<CMeshO>, tri::EvenPointLoop<CMeshO>*/ >
-					(m.cm, tri::OddPointLoop<CMeshO>(m.cm), tri::EvenPointLoop<CMeshO>(), threshold, selected, cb);
+					Subdivision::RefineOddEven(m.cm, tri::OddPointLoop<CMeshO>(m.cm), tri::EvenPointLoop<CMeshO>(), threshold, selected, cb);
 				break;
 				case 1:
-					tri::RefineOddEven<CMeshO/*,
-						tri::OddPointLoopGeneric<CMeshO, Centroid<CMeshO>, RegularLoopWeight<CMeshO::ScalarType> >,
-						tri::EvenPointLoopGeneric<CMeshO, Centroid<CMeshO>, RegularLoopWeight<CMeshO::ScalarType> >*/ >
-					(m.cm, tri::OddPointLoopGeneric<CMeshO, Centroid<CMeshO>, RegularLoopWeight<CMeshO::ScalarType> >(m.cm),
+					Subdivision::RefineOddEven(m.cm, tri::OddPointLoopGeneric<CMeshO, Centroid<CMeshO>, RegularLoopWeight<CMeshO::ScalarType> >(m.cm),
 					tri::EvenPointLoopGeneric<CMeshO, Centroid<CMeshO>, RegularLoopWeight<CMeshO::ScalarType> >(), threshold, selected, cb);
 				break;
 				case 2:
-					tri::RefineOddEven<CMeshO/*,
-						tri::OddPointLoopGeneric<CMeshO, Centroid<CMeshO>, ContinuityLoopWeight<CMeshO::ScalarType> >,
-						tri::EvenPointLoopGeneric<CMeshO, Centroid<CMeshO>, ContinuityLoopWeight<CMeshO::ScalarType> >*/ >
-					(m.cm, tri::OddPointLoopGeneric<CMeshO, Centroid<CMeshO>, ContinuityLoopWeight<CMeshO::ScalarType> >(m.cm),
+					Subdivision::RefineOddEven(m.cm, tri::OddPointLoopGeneric<CMeshO, Centroid<CMeshO>, ContinuityLoopWeight<CMeshO::ScalarType> >(m.cm),
 					tri::EvenPointLoopGeneric<CMeshO, Centroid<CMeshO>, ContinuityLoopWeight<CMeshO::ScalarType> >(), threshold, selected, cb);
 				break;
 				}
 			break;
 			case FP_BUTTERFLY_SS :
-				Refine<CMeshO,MidPointButterfly<CMeshO> > (m.cm, MidPointButterfly<CMeshO>(m.cm), threshold, selected, cb);
+				Subdivision::Refine(m.cm, MidPointButterfly<CMeshO>(m.cm), threshold, selected, cb);
 			break;
 			case FP_MIDPOINT :
-				Refine<CMeshO,MidPoint<CMeshO> > (m.cm, MidPoint<CMeshO>(&m.cm), threshold, selected, cb);
+				Subdivision::Refine(m.cm, MidPoint<CMeshO>(&m.cm), threshold, selected, cb);
 			break;
 			case FP_REFINE_LS3_LOOP :
 				switch(par.getEnum("LoopWeight"))
 				{
 				case 0:
-					tri::RefineOddEven<CMeshO/*, tri::OddPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double> >, tri::EvenPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double> >*/ >
-					(m.cm, tri::OddPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double> >(m.cm), tri::EvenPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double> >(), threshold, selected, cb);
+					Subdivision::RefineOddEven(m.cm, tri::OddPointLoopGeneric<CMeshO, LS3>(m.cm), tri::EvenPointLoopGeneric<CMeshO, LS3>(), threshold, selected, cb);
 				break;
 				case 1:
-					tri::RefineOddEven<CMeshO/*,
-						tri::OddPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double>, RegularLoopWeight<double> >,
-						tri::EvenPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double>, RegularLoopWeight<double> >*/ >
-					(m.cm, tri::OddPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double>, RegularLoopWeight<double> >(m.cm),
-					tri::EvenPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double>, RegularLoopWeight<double> >(), threshold, selected, cb);
+					Subdivision::RefineOddEven(m.cm, tri::OddPointLoopGeneric<CMeshO, LS3, RegularLoopWeight<double> >(m.cm),
+					tri::EvenPointLoopGeneric<CMeshO, LS3, RegularLoopWeight<double> >(), threshold, selected, cb);
 				break;
 				case 2:
-					tri::RefineOddEven<CMeshO/*,
-						tri::OddPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double>, ContinuityLoopWeight<double> >,
-						tri::EvenPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double>, ContinuityLoopWeight<double> >*/ >
-					(m.cm, tri::OddPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double>, ContinuityLoopWeight<double> >(m.cm),
-					tri::EvenPointLoopGeneric<CMeshO, LS3Projection<CMeshO, double>, ContinuityLoopWeight<double> >(), threshold, selected, cb);
+					Subdivision::RefineOddEven(m.cm, tri::OddPointLoopGeneric<CMeshO, LS3, ContinuityLoopWeight<double> >(m.cm),
+					tri::EvenPointLoopGeneric<CMeshO, LS3, ContinuityLoopWeight<double> >(), threshold, selected, cb);
 				break;
 				}
 			break;
 			}
-
-			m.clearDataMask(MeshModel::MM_VERTFACETOPO);
+			Log("Subdivision step %i: %i vertices, %i faces", i+1, m.cm.vn, m.cm.fn);
 		}
+		m.clearDataMask(MeshModel::MM_VERTFACETOPO);
 		m.UpdateBoxAndNormals();
 	    } break;
 
@@ -777,7 +835,7 @@ switch(ID(filter))
 	case FP_CLUSTERING:
 	{
 		float threshold = par.getAbsPerc("Threshold");
-		vcg::tri::Clustering<CMeshO, vcg::tri::AverageColorCell<CMeshO> > ClusteringGrid;
+		tri::ParallelClustering<CMeshO> ClusteringGrid;
 		ClusteringGrid.Init(m.cm.bbox,100000,threshold);
 		if(m.cm.FN() ==0)
 			ClusteringGrid.AddPointSet(m.cm);
@@ -976,6 +1034,37 @@ switch(ID(filter))
 
 		lastisor_MaxSurfDist= par.getFloat("MaxSurfDist");
 		lastisor_FeatureDeg = par.getFloat("FeatureDeg");
+		lastisor_Parallel   = par.getBool("ParallelMode");
+
+		const bool parallel = lastisor_Parallel && !params.adapt && tri::ParallelIsotropicRemeshing<CMeshO>::CanRemesh(m.cm);
+		if (lastisor_Parallel && params.adapt)
+			Log("Adaptive remeshing is not available in parallel mode, using the serial one");
+		else if (lastisor_Parallel && !parallel)
+			Log("Meshes with per wedge attributes are not supported in parallel mode, using the serial one");
+		if (parallel)
+		{
+			typedef tri::ParallelIsotropicRemeshing<CMeshO> ParallelRemeshing;
+			ParallelRemeshing::Params ppar;
+			ppar.targetLen       = par.getAbsPerc("TargetLen");
+			ppar.featureAngleDeg = par.getFloat("FeatureDeg");
+			ppar.maxSurfDist     = params.maxSurfDist;
+			ppar.iter            = params.iter;
+			ppar.selectedOnly    = params.selectedOnly;
+			ppar.splitFlag       = params.splitFlag;
+			ppar.collapseFlag    = params.collapseFlag;
+			ppar.swapFlag        = params.swapFlag;
+			ppar.smoothFlag      = params.smoothFlag;
+			ppar.projectFlag     = params.projectFlag;
+			ppar.surfDistCheck   = params.surfDistCheck;
+
+			ParallelRemeshing::Timing t;
+			ParallelRemeshing::Do(m.cm, toProjectCopy, ppar, t, cb);
+			Log("Remeshed in %.3f s: refine %.3f, collapse %.3f, edge-swap %.3f, smooth %.3f, reproject %.3f",
+			    t.split + t.collapse + t.swap + t.smooth + t.project, t.split, t.collapse, t.swap, t.smooth, t.project);
+			m.clearDataMask(MeshModel::MM_FACEFACETOPO | MeshModel::MM_VERTFACETOPO);
+			m.UpdateBoxAndNormals();
+			break;
+		}
 
 		try
 		{
@@ -1284,41 +1373,41 @@ switch(ID(filter))
 
 	case FP_NORMAL_EXTRAPOLATION :
 	{
-		tri::PointCloudNormal<CMeshO>::Param p;
+		tri::ParallelPointCloudNormal<CMeshO>::Param p;
 		p.fittingAdjNum = par.getInt("K");
 		p.smoothingIterNum = par.getInt("smoothIter");
 		p.viewPoint = par.getPoint3m("viewPos");
 		p.useViewPoint = par.getBool("flipFlag");
-		tri::PointCloudNormal<CMeshO>::Compute(m.cm, p,cb);
+		tri::ParallelPointCloudNormal<CMeshO>::Compute(m.cm, m.knnGraph(tri::ParallelPointCloudNormal<CMeshO>::RequiredNeighbours(p)), p, cb);
 	} break;
 
 	case FP_NORMAL_SMOOTH_POINTCLOUD :
 	{
-		tri::Allocator<CMeshO>::CompactVertexVector(m.cm);
-		tri::Smooth<CMeshO>::VertexNormalPointCloud(m.cm,par.getInt("K"),1);
+		tri::ParallelPointCloudNormal<CMeshO>::Smooth(m.cm, m.knnGraph(par.getInt("K") - 1), par.getInt("K"), 1);
 	} break;
 
 	case FP_COMPUTE_PRINC_CURV_DIR:
 	{
-		m.updateDataMask(MeshModel::MM_VERTFACETOPO | MeshModel::MM_FACEFACETOPO);
+		// all the methods run in parallel on their own flat topology
 		m.updateDataMask(MeshModel::MM_VERTCURV | MeshModel::MM_VERTCURVDIR);
 		m.updateDataMask(MeshModel::MM_VERTCOLOR | MeshModel::MM_VERTQUALITY);
-		if ( tri::Clean<CMeshO>::CountNonManifoldEdgeFF(m.cm) >0 ) {
-			errorMessage = "Mesh has some not 2-manifold faces, cannot compute principal curvature directions"; // text
-			return false; // can't continue, mesh can't be processed
-		}
 		tri::UpdateNormal<CMeshO>::NormalizePerVertex(m.cm);
 		if(par.getBool("Autoclean")){
 			int delvert=tri::Clean<CMeshO>::RemoveUnreferencedVertex(m.cm);
 			tri::Allocator<CMeshO>::CompactVertexVector(m.cm);
 			Log( "Removed %d unreferenced vertices",delvert);
 		}
+		tri::ParallelCurvature<CMeshO> curv(m.cm);
+		if (curv.NonManifoldEdgeNum() > 0) {
+			errorMessage = "Mesh has some not 2-manifold faces, cannot compute principal curvature directions"; // text
+			return false; // can't continue, mesh can't be processed
+		}
 		switch(par.getEnum("Method"))
 		{
-			case 0:	tri::UpdateCurvature<CMeshO>::PrincipalDirections(m.cm); break;
-			case 1: tri::UpdateCurvature<CMeshO>::PrincipalDirectionsPCA(m.cm,m.cm.bbox.Diag()/20.0,true,cb); break;
-			case 2: tri::UpdateCurvature<CMeshO>::PrincipalDirectionsNormalCycle(m.cm); break;
-			case 3: tri::UpdateCurvatureFitting<CMeshO>::computeCurvature(m.cm); break;
+			case 0: curv.PrincipalDirections(); break;
+			case 1: curv.PrincipalDirectionsPCA(m.cm.bbox.Diag()/20.0,cb); break;
+			case 2: curv.PrincipalDirectionsNormalCycle(); break;
+			case 3: curv.PrincipalDirectionsFitting(); break;
 			default:assert(0);break;
 		}
 		switch(par.getEnum("CurvColorMethod"))
@@ -1475,7 +1564,7 @@ switch(ID(filter))
 			return false;
 		}
 		m.updateDataMask(MeshModel::MM_FACEQUALITY | MeshModel::MM_FACEFACETOPO);
-		tri::BitQuadCreation<CMeshO>::MakePureByRefine(m.cm);
+		tri::ParallelSubdivision<CMeshO>::RefineBitQuad(m.cm, cb);
 		tri::UpdateNormal<CMeshO>::PerBitQuadFaceNormalized(m.cm);
 		m.clearDataMask( MeshModel::MM_FACEFACETOPO);
 		m.updateDataMask(MeshModel::MM_POLYGONAL);
@@ -1490,8 +1579,8 @@ switch(ID(filter))
 		}
 		// in practice it is just a simple double application of the FP_REFINE_HALF_CATMULL.
 		m.updateDataMask(MeshModel::MM_FACEQUALITY | MeshModel::MM_FACEFACETOPO);
-		tri::BitQuadCreation<CMeshO>::MakePureByRefine(m.cm);
-		tri::BitQuadCreation<CMeshO>::MakePureByRefine(m.cm);
+		tri::ParallelSubdivision<CMeshO>::RefineBitQuad(m.cm, cb);
+		tri::ParallelSubdivision<CMeshO>::RefineBitQuad(m.cm, cb);
 		tri::UpdateNormal<CMeshO>::PerBitQuadFaceNormalized(m.cm);
 		m.clearDataMask(MeshModel::MM_FACEFACETOPO);
 		m.updateDataMask(MeshModel::MM_POLYGONAL);
@@ -1795,11 +1884,12 @@ int ExtraMeshFilterPlugin::postCondition(QAction * filter) const
 		case FP_VATTR_SEAM :
 		case FP_REFINE_LS3_LOOP : return MeshModel::MM_GEOMETRY_AND_TOPOLOGY_CHANGE;
 
-		case FP_COMPUTE_PRINC_CURV_DIR : return MeshModel::MM_VERTFACETOPO | MeshModel::MM_FACEFACETOPO | MeshModel::MM_VERTCURV | MeshModel::MM_VERTCURVDIR | MeshModel::MM_VERTCOLOR | MeshModel::MM_VERTQUALITY;
+		case FP_COMPUTE_PRINC_CURV_DIR : return MeshModel::MM_VERTCURV | MeshModel::MM_VERTCURVDIR | MeshModel::MM_VERTCOLOR | MeshModel::MM_VERTQUALITY;
 
 		case FP_SLICE_WITH_A_PLANE :
 		case FP_PERIMETER_POLYLINE :
-		case FP_CYLINDER_UNWRAP : return MeshModel::MM_NONE; // they create a new layer
+		case FP_CYLINDER_UNWRAP :
+		case FP_CLUSTERING_STREAM : return MeshModel::MM_NONE; // they create a new layer
 
 		default                  : return MeshModel::MM_ALL;
 	}
@@ -76,7 +76,8 @@ public:
 		FP_FAUX_CREASE,
 		FP_FAUX_EXTRACT,
 		FP_VATTR_SEAM,
-		FP_REFINE_LS3_LOOP
+		FP_REFINE_LS3_LOOP,
+		FP_CLUSTERING_STREAM
 	} ;
 
 
@@ -91,7 +92,7 @@ public:
 	bool applyFilter(QAction *filter, MeshDocument &md, RichParameterSet & /*parent*/, vcg::CallBackPos * cb) ;
 	int postCondition(QAction *filter) const;
 	int getPreCondition(QAction *filter) const;
-	FILTER_ARITY filterArity(QAction *) const {return SINGLE_MESH;}
+	FILTER_ARITY filterArity(QAction *a) const {return ID(a) == FP_CLUSTERING_STREAM ? NONE : SINGLE_MESH;}
 
 protected:
 
@@ -120,6 +121,8 @@ protected:
 	bool lastisor_SwapFlag;
 	bool lastisor_SmoothFlag;
 	bool lastisor_ProjectFlag;
+	bool lastisor_Parallel;
 
+	bool clusterPointStream(MeshDocument &md, RichParameterSet &par, vcg::CallBackPos *cb);
 };
 #endif
@@ -0,0 +1,143 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef POINT_STREAM_H
+#define POINT_STREAM_H
+
+#include <algorithm>
+#include <vector>
+#include <locale.h>
+#include <stdlib.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#include <QByteArray>
+#include <QFile>
+#include <common/ml_mesh_type.h>
+
+/*
+  Reader of ASCII point lists, one point per line as
+      x y z [nx ny nz [r g b]]
+  (the .xyz/.txt exports of most scanners), that returns the points a chunk
+  of lines at a time, so that a file can be processed without loading it
+  all. The lines of a chunk are parsed in parallel. Lines with less than
+  three numbers (headers, point counts) are skipped.
+*/
+class PointStreamReader
+{
+public:
+    static const int ChunkLines = 1 << 20;
+
+    PointStreamReader() : fieldNum(0) {}
+
+    bool open(const QString &fileName)
+    {
+        file.setFileName(fileName);
+        fieldNum = 0;
+        return file.open(QIODevice::ReadOnly);
+    }
+
+    void rewind() { file.seek(0); }
+
+    // Percentage of the file read so far.
+    int progress() const { return file.size() > 0 ? int((100 * file.pos()) / file.size()) : 100; }
+
+    /* Smallest number of values found on a point line in the chunks read so
+     * far (at most 9): 6 or more means normals, 9 also colors.
+     */
+    int fields() const { return fieldNum; }
+
+    /* Read the next chunk of points; nrm and col may be NULL. Missing values
+     * are 0 for normals and white for colors. Returns false at end of file.
+     */
+    bool readChunk(std::vector<Point3m> &pos, std::vector<Point3m> *nrm, std::vector<vcg::Color4b> *col)
+    {
+        lines.clear();
+        while (int(lines.size()) < ChunkLines && !file.atEnd())
+            lines.push_back(file.readLine());
+        if (lines.empty()) return false;
+
+        const int lineNum = int(lines.size());
+        std::vector<double> val(size_t(9) * lineNum);
+        std::vector<int> cnt(lineNum);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < lineNum; ++i)
+            cnt[i] = parseLine(lines[i].constData(), &val[size_t(9) * i]);
+
+        pos.clear();
+        if (nrm) nrm->clear();
+        if (col) col->clear();
+        for (int i = 0; i < lineNum; ++i)
+        {
+            if (cnt[i] < 3) continue;
+            fieldNum = (fieldNum == 0) ? cnt[i] : std::min(fieldNum, cnt[i]);
+            const double *v = &val[size_t(9) * i];
+            pos.push_back(Point3m(v[0], v[1], v[2]));
+            if (nrm) nrm->push_back(cnt[i] >= 6 ? Point3m(v[3], v[4], v[5]) : Point3m(0, 0, 0));
+            if (col) col->push_back(cnt[i] >= 9 ? vcg::Color4b((unsigned char)(v[6]), (unsigned char)(v[7]), (unsigned char)(v[8]), 255) : vcg::Color4b(vcg::Color4b::White));
+        }
+        return true;
+    }
+
+private:
+    QFile file;
+    std::vector<QByteArray> lines;
+    int fieldNum;
+
+    static bool isSeparator(char c)
+    {
+        return c == ' ' || c == '\t' || c == ',' || c == ';' || c == '\r' || c == '\n';
+    }
+
+    // strtod in the C locale: the application locale may use ',' as
+    // decimal separator, and setlocale is not thread safe.
+    static double toDouble(const char *s, char **end)
+    {
+#ifdef _WIN32
+        static const _locale_t cLocale = _create_locale(LC_NUMERIC, "C");
+        return _strtod_l(s, end, cLocale);
+#else
+        static const locale_t cLocale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+        return strtod_l(s, end, cLocale);
+#endif
+    }
+
+    // The numbers are parsed in place in the line, that readLine ends with 0.
+    static int parseLine(const char *s, double *val)
+    {
+        int n = 0;
+        while (n < 9)
+        {
+            while (*s != 0 && isSeparator(*s)) ++s;
+            if (*s == 0) break;
+            char *end = 0;
+            val[n] = toDouble(s, &end);
+            if (end == s || (*end != 0 && !isSeparator(*end))) break;
+            ++n;
+            s = end;
+        }
+        return n;
+    }
+};
+
+#endif
@@ -30,6 +30,59 @@
 
 //#include "shutils.h"
 
+int SubGraph::bestNode(const std::vector<bool> &skip) const
+{
+	int bestLinks=0; int bestActive=-1;
+	int cand=-1;
+	for (int k=0; k<nodes.size(); k++)
+	{
+		int act=0;
+		if (nodes[k].arcs.size()>=bestLinks && !nodes[k].active && !skip[k])
+		{
+			for (int l=0; l<nodes[k].arcs.size(); l++)
+			{
+				if (nodes[nodes[k].arcs[l].projId].active)
+					act++;
+			}
+			if (act>bestActive)
+			{
+				bestActive=act;
+				bestLinks=nodes[k].arcs.size();
+				cand=k;
+			}
+			else if (act==bestActive && nodes[k].avMut>nodes[cand].avMut)
+			{
+				bestActive=act;
+				bestLinks=nodes[k].arcs.size();
+				cand=k;
+			}
+		}
+	}
+	return cand;
+}
+
+std::vector<int> SubGraph::independentNodes() const
+{
+	// arcs are stored on the node that is aligned, so also the nodes pointing to a node are its neighbours
+	std::vector< std::vector<int> > incoming(nodes.size());
+	for (int k=0; k<nodes.size(); k++)
+		for (int l=0; l<nodes[k].arcs.size(); l++)
+			incoming[nodes[k].arcs[l].projId].push_back(k);
+
+	std::vector<int> batch;
+	std::vector<bool> skip(nodes.size(), false);
+	for (int cand=bestNode(skip); cand>=0; cand=bestNode(skip))
+	{
+		batch.push_back(cand);
+		skip[cand]=true;
+		for (int l=0; l<nodes[cand].arcs.size(); l++)
+			skip[nodes[cand].arcs[l].projId]=true;
+		for (int l=0; l<incoming[cand].size(); l++)
+			skip[incoming[cand][l]]=true;
+	}
+	return batch;
+}
+
 #include <wrap/gl/shot.h>
 #include <wrap/gl/camera.h>
 
@@ -97,6 +97,28 @@ public:
 	int id;
 	std::vector<Node> nodes;
 
+	// next inactive node to align: the one with most active neighbours (ties: most arcs, then
+	// highest avMut), skipping the nodes marked in skip; -1 if none is left
+	int bestNode(const std::vector<bool> &skip) const;
+
+	// inactive nodes that can be aligned at the same time, in the order bestNode picks them:
+	// none of them is linked by an arc to another one, since a node reads the shots of its arcs
+	std::vector<int> independentNodes() const;
+
+};
+
+// outcome of the alignment of a node
+class AlignReport
+{
+public:
+
+	AlignReport() {id=0; startInfo=0.0; endInfo=0.0; evaluations=0; converged=false; }
+
+	int id;
+	double startInfo, endInfo; // value of the function before and after
+	int evaluations;
+	bool converged;            // the solver stopped before its iteration limit
+
 };
 
 //std::vector<SubGraph*> graphs;
@@ -47,6 +47,7 @@ AlignSet::AlignSet()
 	, depthPrg(0)
 	, depthW(1)
 	, depthH(1)
+	, softRender(false)
 {
 
   box.SetNull();
@@ -337,6 +338,13 @@ bool AlignSet::ProjectedImageChanged(const QImage & img)
 
 bool AlignSet::ProjectedMultiImageChanged()
 {
+	if (softRender)
+	{
+		// rebuilt by RenderMultiShadowMap, once the size of the rendering is known
+		projectors.clear();
+		return true;
+	}
+
 	assert(glGetError() == 0);
 
 	glPushAttrib(GL_ALL_ATTRIB_BITS);
@@ -555,6 +563,17 @@ bool AlignSet::RenderShadowMap(void)
 
 bool AlignSet::RenderMultiShadowMap(void)
 {
+	if (softRender)
+	{
+		// the arcs do not move while a node is aligned: the shadow maps are made once
+		if (projectors.size() != arcImages.size())
+		{
+			projectors.resize(arcImages.size());
+			for (size_t k = 0; k < arcImages.size(); k++)
+				softRaster.MakeProjector(*arcShots[k], *mesh, *arcImages[k], arcMI[k], wt, ht, projectors[k]);
+		}
+		return true;
+	}
 
 	glPushAttrib(GL_ALL_ATTRIB_BITS);
 
@@ -943,6 +962,21 @@ void AlignSet::resize(int max_side) {
 }
 
 void AlignSet::renderScene(vcg::Shot<float> &view, int component, bool save) {
+  if (softRender) {
+    // only the modes used to refine the nodes have a cpu implementation; nothing is saved,
+    // since several AlignSets can be rendering at the same time
+    if (mode == PROJMULTIIMG)
+      softRaster.RenderProjected(view, *mesh, projectors, wt, ht, rend);
+    else {
+      assert(mode < PROJIMG);
+      if (render) delete[] render;
+      render = new unsigned char[wt*ht];
+      if (component < 4)
+        softRaster.Render(view, *mesh, mode, component, wt, ht, render);
+    }
+    return;
+  }
+
   QSize fbosize(wt,ht);
   QGLFramebufferObjectFormat frmt;
   frmt.setInternalTextureFormat(GL_RGBA);
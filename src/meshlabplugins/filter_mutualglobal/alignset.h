@@ -8,6 +8,7 @@
 
 // local headers
 #include "common/meshmodel.h"
+#include "common/ml_mutualinfo.h"
 #include "alignGlobal.h"
 
 // VCG headers
@@ -71,6 +72,10 @@ class AlignSet {
 
   unsigned char *target, *render; //buffers for rendered images 
 
+  bool softRender; //render on the cpu, no GL context needed: each thread can align its own AlignSet
+  MLMutualInfoRaster softRaster;
+  std::vector<MLMutualInfoRaster::Projector> projectors; //cpu counterpart of the arc textures and shadow maps
+
   AlignSet();
   ~AlignSet();
 
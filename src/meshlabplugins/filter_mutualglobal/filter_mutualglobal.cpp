@@ -132,6 +132,7 @@ void FilterMutualInfoPlugin::initParameterSet(QAction *action,MeshDocument & md,
 			parlst.addParam(new RichBool("Pre-alignment",false,"Pre-alignment step","Pre-alignment step"));
 			parlst.addParam(new RichBool("Estimate Focal",true,"Estimate focal length","Estimate focal length"));
 			parlst.addParam(new RichBool("Fine",true,"Fine Alignment","Fine alignment"));
+			parlst.addParam(new RichBool("CPU Refinement",false,"CPU refinement","Render the nodes on the CPU during the global refinement, aligning at the same time the images that are not linked by an arc"));
 
 		  /*parlst.addParam(new RichBool ("UpdateNormals",
 											true,
@@ -203,7 +204,7 @@ bool FilterMutualInfoPlugin::applyFilter(QAction *action, MeshDocument &md, Rich
 				Log(0, "BuildGraph completed");
 				for (int i=0; i<par.getInt("Max number of refinement steps"); i++)
 				{
-					AlignGlobal(md, Graphs);
+					AlignGlobal(md, Graphs, par.getBool("CPU Refinement"));
 					float diff=calcShotsDifference(md,oldShots,myVec);
 					Log(0, "AlignGlobal %d of %d completed, average improvement %f pixels",i+1,par.getInt("Max number of refinement steps"),diff);
 					if (diff<thresDiff)
@@ -415,7 +416,12 @@ bool FilterMutualInfoPlugin::preAlignment(MeshDocument &md, RichParameterSet & p
 	{
 		if(md.rasterList[r]->visible)
 		{
-				alignset.image=&md.rasterList[r]->currentPlane->image;
+				RasterImagePin pin(md.rasterList[r]->currentPlane);
+				QImage image=md.rasterList[r]->currentPlane->image();
+				alignset.image=&image;
+				// decoded in background while this raster is aligned
+				if (r+1<md.rasterList.size())
+					md.rasterList[r+1]->currentPlane->Prefetch();
 				alignset.shot=md.rasterList[r]->shot;
 
 				alignset.resize(800);
@@ -432,9 +438,9 @@ bool FilterMutualInfoPlugin::preAlignment(MeshDocument &md, RichParameterSet & p
 				}
 
 				md.rasterList[r]->shot=alignset.shot;
-				float ratio=(float)md.rasterList[r]->currentPlane->image.height()/(float)alignset.shot.Intrinsics.ViewportPx[1];
-				md.rasterList[r]->shot.Intrinsics.ViewportPx[0]=md.rasterList[r]->currentPlane->image.width();
-				md.rasterList[r]->shot.Intrinsics.ViewportPx[1]=md.rasterList[r]->currentPlane->image.height();
+				float ratio=(float)md.rasterList[r]->currentPlane->size().height()/(float)alignset.shot.Intrinsics.ViewportPx[1];
+				md.rasterList[r]->shot.Intrinsics.ViewportPx[0]=md.rasterList[r]->currentPlane->size().width();
+				md.rasterList[r]->shot.Intrinsics.ViewportPx[1]=md.rasterList[r]->currentPlane->size().height();
 				md.rasterList[r]->shot.Intrinsics.PixelSizeMm[1]/=ratio;
 				md.rasterList[r]->shot.Intrinsics.PixelSizeMm[0]/=ratio;
 				md.rasterList[r]->shot.Intrinsics.CenterPx[0]=(int)((float)md.rasterList[r]->shot.Intrinsics.ViewportPx[0]/2.0);
@@ -521,7 +527,9 @@ std::vector<AlignPair> FilterMutualInfoPlugin::CalcPairs(MeshDocument &md, bool
 		if(md.rasterList[r]->visible)
 		{
 			AlignPair pair;
-			alignset.image=&md.rasterList[r]->currentPlane->image;
+			RasterImagePin pin(md.rasterList[r]->currentPlane);
+			QImage image=md.rasterList[r]->currentPlane->image();
+			alignset.image=&image;
 			alignset.shot=md.rasterList[r]->shot;
 
 			//this->initGL();
@@ -544,7 +552,9 @@ std::vector<AlignPair> FilterMutualInfoPlugin::CalcPairs(MeshDocument &md, bool
 				{
 					alignset.mode=AlignSet::PROJIMG;
 					alignset.shotPro=md.rasterList[p]->shot;
-					alignset.imagePro=&md.rasterList[p]->currentPlane->image;
+					RasterImagePin proPin(md.rasterList[p]->currentPlane);
+					QImage imagePro=md.rasterList[p]->currentPlane->image();
+					alignset.imagePro=&imagePro;
 					alignset.ProjectedImageChanged(*alignset.imagePro);
 					float countTot=0.0;
 					float countCol=0.0;
@@ -606,7 +616,9 @@ std::vector<AlignPair> FilterMutualInfoPlugin::CalcPairs(MeshDocument &md, bool
 					int p=weightList[i].projId;
 					alignset.mode=AlignSet::PROJIMG;
 					alignset.shotPro=md.rasterList[p]->shot;
-					alignset.imagePro=&md.rasterList[p]->currentPlane->image;
+					RasterImagePin proPin(md.rasterList[p]->currentPlane);
+					QImage imagePro=md.rasterList[p]->currentPlane->image();
+					alignset.imagePro=&imagePro;
 					alignset.ProjectedImageChanged(*alignset.imagePro);
 					float countTot=0.0;
 					float countCol=0.0;
@@ -790,8 +802,9 @@ std::vector<SubGraph> FilterMutualInfoPlugin::CreateGraphs(MeshDocument &md, std
 	return Gr;
 }
 
-bool FilterMutualInfoPlugin::AlignGlobal(MeshDocument &md, std::vector<SubGraph> graphs)
+bool FilterMutualInfoPlugin::AlignGlobal(MeshDocument &md, std::vector<SubGraph> graphs, bool cpuRefinement)
 {
+	std::vector<AlignReport> reports;
 	for (int j=0; j<1; j++)
 	{
 	for (int i=0; i<graphs.size(); i++)
@@ -799,11 +812,32 @@ bool FilterMutualInfoPlugin::AlignGlobal(MeshDocument &md, std::vector<SubGraph>
 		int n=0;
 		while (!allActive(graphs[i]))
 		{
+			if (cpuRefinement)
+			{
+				// every node of the batch is aligned with its own cpu AlignSet; UpdateGraph is skipped,
+				// it works on a copy of the graph and renders the pairs through GL
+				std::vector<int> batch=graphs[i].independentNodes();
+				for (int b=0; b<batch.size(); b++)
+					graphs[i].nodes[batch[b]].active=true;
+				std::vector<AlignReport> batchReports(batch.size());
+#pragma omp parallel for schedule(dynamic, 1)
+				for (int b=0; b<int(batch.size()); b++)
+				{
+					AlignSet set;
+					set.softRender=true;
+					AlignNode(md, graphs[i].nodes[batch[b]], set, batchReports[b]);
+				}
+				reports.insert(reports.end(), batchReports.begin(), batchReports.end());
+				n+=batch.size();
+				continue;
+			}
 			//Log(0, "Round %d of %d: get the right node",n+1,graphs[i].nodes.size());
 			int curr= getTheRightNode(graphs[i]);
 			graphs[i].nodes[curr].active=true;
 			//Log(0, "Round %d of %d: alignset the node",n+1,graphs[i].nodes.size());
-			AlignNode(md, graphs[i].nodes[curr]);
+			AlignReport report;
+			AlignNode(md, graphs[i].nodes[curr], alignset, report);
+			reports.push_back(report);
 			//Log(0, "Round %d of %d: update the graph",n+1,graphs[i].nodes.size());
 			UpdateGraph(md, graphs[i], curr);
 			//Log(0, "Image %d completed",curr);
@@ -818,39 +852,25 @@ bool FilterMutualInfoPlugin::AlignGlobal(MeshDocument &md, std::vector<SubGraph>
 	}
 	}
 
+	int converged=0;
+	for (int r=0; r<reports.size(); r++)
+	{
+		if (reports[r].evaluations==0)
+			continue;
+		Log(0, "Image %d: %s in %d evaluations, function value %f -> %f", reports[r].id,
+			reports[r].converged ? "converged" : "not converged", reports[r].evaluations,
+			reports[r].startInfo, reports[r].endInfo);
+		if (reports[r].converged)
+			converged++;
+	}
+	Log(0, "%d images converged", converged);
+
 	return true;
 }
 
 int FilterMutualInfoPlugin::getTheRightNode(SubGraph graph)
 {
-	int bestLinks=0; int bestActive=-1;
-	int cand;
-	for (int k=0; k<graph.nodes.size(); k++)
-	{
-		int act=0;
-		if (graph.nodes[k].arcs.size()>=bestLinks && !graph.nodes[k].active)
-		{
-			for (int l=0; l<graph.nodes[k].arcs.size(); l++)
-			{
-				if (graph.nodes[graph.nodes[k].arcs[l].projId].active)
-					act++;
-			}
-			if (act>bestActive)
-			{
-				bestActive=act;
-				bestLinks=graph.nodes[k].arcs.size();
-				cand=k;
-			}
-			else if (act==bestActive && graph.nodes[k].avMut>graph.nodes[cand].avMut)
-			{
-				bestActive=act;
-				bestLinks=graph.nodes[k].arcs.size();
-				cand=k;
-			}
-		}
-	}
-	return cand;
-
+	return graph.bestNode(std::vector<bool>(graph.nodes.size(), false));
 }
 
 bool FilterMutualInfoPlugin::allActive(SubGraph graph)
@@ -865,82 +885,100 @@ bool FilterMutualInfoPlugin::allActive(SubGraph graph)
 
 }
 
-bool FilterMutualInfoPlugin::AlignNode(MeshDocument &md, Node node)
+bool FilterMutualInfoPlugin::AlignNode(MeshDocument &md, Node node, AlignSet &set, AlignReport &report)
 {
 	Solver solver;
 	MutualInfo mutual;
 
-	alignset.mode=AlignSet::NODE;
-	alignset.node=&node;
+	set.mode=AlignSet::NODE;
+	set.node=&node;
 
-	alignset.image=&md.rasterList[node.id]->currentPlane->image;
-	alignset.shot=md.rasterList[node.id]->shot;
+	RasterImagePin pin(md.rasterList[node.id]->currentPlane);
+	QImage image=md.rasterList[node.id]->currentPlane->image();
+	set.image=&image;
+	// set keeps pointers to the arc images, the storage must not move
+	std::vector<QImage> arcImages;
+	arcImages.reserve(node.arcs.size()+2);
+	set.shot=md.rasterList[node.id]->shot;
 
-	alignset.mesh=&md.mm()->cm;
+	set.mesh=&md.mm()->cm;
 
 	for (int l=0; l<node.arcs.size(); l++)
 	{
-		alignset.arcImages.push_back(&md.rasterList[node.arcs[l].projId]->currentPlane->image);
-		alignset.arcShots.push_back(&md.rasterList[node.arcs[l].projId]->shot);
-		alignset.arcMI.push_back(node.arcs[l].mutual);
+		pin.add(md.rasterList[node.arcs[l].projId]->currentPlane);
+		arcImages.push_back(md.rasterList[node.arcs[l].projId]->currentPlane->image());
+		set.arcImages.push_back(&arcImages.back());
+		set.arcShots.push_back(&md.rasterList[node.arcs[l].projId]->shot);
+		set.arcMI.push_back(node.arcs[l].mutual);
 
 	}
 
-	if(alignset.arcImages.size()==0)
+	if(set.arcImages.size()==0)
 		return true;
-	else if(alignset.arcImages.size()==1)
+	else if(set.arcImages.size()==1)
 	{
-		alignset.arcImages.push_back(&md.rasterList[node.arcs[0].projId]->currentPlane->image);
-		alignset.arcShots.push_back(&md.rasterList[node.arcs[0].projId]->shot);
-		alignset.arcMI.push_back(node.arcs[0].mutual);
-		alignset.arcImages.push_back(&md.rasterList[node.arcs[0].projId]->currentPlane->image);
-		alignset.arcShots.push_back(&md.rasterList[node.arcs[0].projId]->shot);
-		alignset.arcMI.push_back(node.arcs[0].mutual);
+		pin.add(md.rasterList[node.arcs[0].projId]->currentPlane);
+		arcImages.push_back(md.rasterList[node.arcs[0].projId]->currentPlane->image());
+		set.arcImages.push_back(&arcImages.back());
+		set.arcShots.push_back(&md.rasterList[node.arcs[0].projId]->shot);
+		set.arcMI.push_back(node.arcs[0].mutual);
+		pin.add(md.rasterList[node.arcs[0].projId]->currentPlane);
+		arcImages.push_back(md.rasterList[node.arcs[0].projId]->currentPlane->image());
+		set.arcImages.push_back(&arcImages.back());
+		set.arcShots.push_back(&md.rasterList[node.arcs[0].projId]->shot);
+		set.arcMI.push_back(node.arcs[0].mutual);
 	}
-	else if(alignset.arcImages.size()==2)
+	else if(set.arcImages.size()==2)
 	{
-		alignset.arcImages.push_back(&md.rasterList[node.arcs[0].projId]->currentPlane->image);
-		alignset.arcShots.push_back(&md.rasterList[node.arcs[0].projId]->shot);
-		alignset.arcMI.push_back(node.arcs[0].mutual);
+		pin.add(md.rasterList[node.arcs[0].projId]->currentPlane);
+		arcImages.push_back(md.rasterList[node.arcs[0].projId]->currentPlane->image());
+		set.arcImages.push_back(&arcImages.back());
+		set.arcShots.push_back(&md.rasterList[node.arcs[0].projId]->shot);
+		set.arcMI.push_back(node.arcs[0].mutual);
 	}
 
-	alignset.ProjectedMultiImageChanged();
+	set.ProjectedMultiImageChanged();
 
 	/*solver.optimize_focal=true;
 	solver.fine_alignment=true;*/
 
 	//this->glContext->makeCurrent();
 	/*this->initGL();*/
-	alignset.resize(800);
+	set.resize(800);
 
-	vcg::Point3f *vertices = new vcg::Point3f[alignset.mesh->vn];
-	vcg::Point3f *normals = new vcg::Point3f[alignset.mesh->vn];
-	vcg::Color4b *colors = new vcg::Color4b[alignset.mesh->vn];
-	unsigned int *indices = new unsigned int[alignset.mesh->fn*3];
+	report.id=node.id;
 
-	for(int i = 0; i < alignset.mesh->vn; i++) {
-	vertices[i] = alignset.mesh->vert[i].P();
-	normals[i] = alignset.mesh->vert[i].N();
-	colors[i] = alignset.mesh->vert[i].C();
+	// the cpu renderer reads the mesh directly
+	if (!set.softRender)
+	{
+	vcg::Point3f *vertices = new vcg::Point3f[set.mesh->vn];
+	vcg::Point3f *normals = new vcg::Point3f[set.mesh->vn];
+	vcg::Color4b *colors = new vcg::Color4b[set.mesh->vn];
+	unsigned int *indices = new unsigned int[set.mesh->fn*3];
+
+	for(int i = 0; i < set.mesh->vn; i++) {
+	vertices[i] = set.mesh->vert[i].P();
+	normals[i] = set.mesh->vert[i].N();
+	colors[i] = set.mesh->vert[i].C();
 	}
 
-	for(int i = 0; i < alignset.mesh->fn; i++)
+	for(int i = 0; i < set.mesh->fn; i++)
 	for(int k = 0; k < 3; k++)
-	indices[k+i*3] = alignset.mesh->face[i].V(k) - &*alignset.mesh->vert.begin();
+	indices[k+i*3] = set.mesh->face[i].V(k) - &*set.mesh->vert.begin();
 
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, alignset.vbo);
-	glBufferDataARB(GL_ARRAY_BUFFER_ARB, alignset.mesh->vn*sizeof(vcg::Point3f),
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, set.vbo);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, set.mesh->vn*sizeof(vcg::Point3f),
 			  vertices, GL_STATIC_DRAW_ARB);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, alignset.nbo);
-	glBufferDataARB(GL_ARRAY_BUFFER_ARB, alignset.mesh->vn*sizeof(vcg::Point3f),
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, set.nbo);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, set.mesh->vn*sizeof(vcg::Point3f),
 			  normals, GL_STATIC_DRAW_ARB);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB, alignset.cbo);
-	glBufferDataARB(GL_ARRAY_BUFFER_ARB, alignset.mesh->vn*sizeof(vcg::Color4b),
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, set.cbo);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, set.mesh->vn*sizeof(vcg::Color4b),
 			  colors, GL_STATIC_DRAW_ARB);
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
 
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, alignset.ibo);
-	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, alignset.mesh->fn*3*sizeof(unsigned int),
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, set.ibo);
+	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, set.mesh->fn*3*sizeof(unsigned int),
 			  indices, GL_STATIC_DRAW_ARB);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
 
@@ -950,41 +988,46 @@ bool FilterMutualInfoPlugin::AlignNode(MeshDocument &md, Node node)
 	delete []normals;
 	delete []colors;
 	delete []indices;
+	}
 
-	//alignset.shot=par.getShotf("Shot");
+	//set.shot=par.getShotf("Shot");
 
-	alignset.shot.Intrinsics.ViewportPx[0]=int((double)alignset.shot.Intrinsics.ViewportPx[1]*alignset.image->width()/alignset.image->height());
-	alignset.shot.Intrinsics.CenterPx[0]=(int)(alignset.shot.Intrinsics.ViewportPx[0]/2);
+	set.shot.Intrinsics.ViewportPx[0]=int((double)set.shot.Intrinsics.ViewportPx[1]*set.image->width()/set.image->height());
+	set.shot.Intrinsics.CenterPx[0]=(int)(set.shot.Intrinsics.ViewportPx[0]/2);
 
 	int iter;
 	if (solver.fine_alignment)
-		iter=solver.optimize(&alignset, &mutual, alignset.shot);
+		iter=solver.optimize(&set, &mutual, set.shot);
 	else
-		solver.iterative(&alignset, &mutual, alignset.shot);
-	//alignset.renderScene(alignset.shot, 3);
-	//alignset.readRender(0);
-
-
-	//md.rasterList[node.id]->shot=alignset.shot;
-	md.rasterList[node.id]->shot=alignset.shot;
-	float ratio=(float)md.rasterList[node.id]->currentPlane->image.height()/(float)alignset.shot.Intrinsics.ViewportPx[1];
-	md.rasterList[node.id]->shot.Intrinsics.ViewportPx[0]=md.rasterList[node.id]->currentPlane->image.width();
-	md.rasterList[node.id]->shot.Intrinsics.ViewportPx[1]=md.rasterList[node.id]->currentPlane->image.height();
+		iter=solver.iterative(&set, &mutual, set.shot);
+	report.startInfo=solver.start;
+	report.endInfo=solver.end;
+	report.evaluations=iter;
+	report.converged=iter<solver.maxiter;
+	//set.renderScene(set.shot, 3);
+	//set.readRender(0);
+
+
+	//md.rasterList[node.id]->shot=set.shot;
+	md.rasterList[node.id]->shot=set.shot;
+	float ratio=(float)md.rasterList[node.id]->currentPlane->size().height()/(float)set.shot.Intrinsics.ViewportPx[1];
+	md.rasterList[node.id]->shot.Intrinsics.ViewportPx[0]=md.rasterList[node.id]->currentPlane->size().width();
+	md.rasterList[node.id]->shot.Intrinsics.ViewportPx[1]=md.rasterList[node.id]->currentPlane->size().height();
 	md.rasterList[node.id]->shot.Intrinsics.PixelSizeMm[1]/=ratio;
 	md.rasterList[node.id]->shot.Intrinsics.PixelSizeMm[0]/=ratio;
 	md.rasterList[node.id]->shot.Intrinsics.CenterPx[0]=(int)((float)md.rasterList[node.id]->shot.Intrinsics.ViewportPx[0]/2.0);
 	md.rasterList[node.id]->shot.Intrinsics.CenterPx[1]=(int)((float)md.rasterList[node.id]->shot.Intrinsics.ViewportPx[1]/2.0);
 	//this->glContext->doneCurrent();
 	//emit md.rasterSetChanged();
-	for (int l=0; l<alignset.arcImages.size(); l++)
+	for (int l=0; l<set.arcImages.size(); l++)
 	{
-		alignset.arcImages.pop_back();
-		alignset.arcMI.pop_back();
-		alignset.arcShots.pop_back();
-		alignset.arcImages.clear();
-		alignset.arcMI.clear();
-		alignset.arcShots.clear();
-		alignset.prjMats.clear();
+		set.arcImages.pop_back();
+		set.arcMI.pop_back();
+		set.arcShots.pop_back();
+		set.arcImages.clear();
+		set.arcMI.clear();
+		set.arcShots.clear();
+		set.prjMats.clear();
 	}
 
 	return true;
@@ -1046,7 +1089,9 @@ bool FilterMutualInfoPlugin::UpdateGraph(MeshDocument &md, SubGraph graph, int n
 
 				//this->glContext->makeCurrent();
 
-				alignset.image=&md.rasterList[imageId]->currentPlane->image;
+				RasterImagePin pin(md.rasterList[imageId]->currentPlane);
+				QImage image=md.rasterList[imageId]->currentPlane->image();
+				alignset.image=&image;
 				alignset.shot=md.rasterList[imageId]->shot;
 
 				//this->initGL();
@@ -1065,7 +1110,9 @@ bool FilterMutualInfoPlugin::UpdateGraph(MeshDocument &md, SubGraph graph, int n
 
 				alignset.mode=AlignSet::PROJIMG;
 				alignset.shotPro=md.rasterList[imageProj]->shot;
-				alignset.imagePro=&md.rasterList[imageProj]->currentPlane->image;
+				RasterImagePin proPin(md.rasterList[imageProj]->currentPlane);
+				QImage imagePro=md.rasterList[imageProj]->currentPlane->image();
+				alignset.imagePro=&imagePro;
 				alignset.ProjectedImageChanged(*alignset.imagePro);
 				float countTot=0.0;
 				float countCol=0.0;
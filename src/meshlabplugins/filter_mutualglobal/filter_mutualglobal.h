@@ -63,9 +63,9 @@ public:
 	std::vector<SubGraph> buildGraph(MeshDocument &md, bool globalign=true);
 	std::vector<AlignPair> CalcPairs(MeshDocument &md, bool globalign=true);
 	std::vector<SubGraph> CreateGraphs(MeshDocument &md, std::vector<AlignPair> arcs);
-	bool AlignGlobal(MeshDocument &md, std::vector<SubGraph> graphs);
+	bool AlignGlobal(MeshDocument &md, std::vector<SubGraph> graphs, bool cpuRefinement);
 	int getTheRightNode(SubGraph graph);
-	bool AlignNode(MeshDocument &md, Node node);
+	bool AlignNode(MeshDocument &md, Node node, AlignSet &set, AlignReport &report);
 	bool allActive(SubGraph graph);
 	bool UpdateGraph(MeshDocument &md, SubGraph graph, int n);
 	float calcShotsDifference(MeshDocument &md, std::vector<vcg::Shotf> oldShots, std::vector<vcg::Point3f> points);
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <QImage> /*debug*/
 #include "mutual.h"
+#include "common/ml_mutualinfo.h"
 
 using namespace std;
 MutualInfo::MutualInfo(unsigned int _nbins, int _bweight, bool _use_background):
@@ -28,7 +29,8 @@ void MutualInfo::setBins(unsigned int _nbins) {
   if(histo2D) delete []histo2D;
   if(histoA) delete []histoA;
   if(histoB) delete []histoB;
-  histo2D = new unsigned int[nbins*nbins];
+  //room for the interleaved partial histograms of MLMutualInfoRaster::JointHistogram
+  histo2D = new unsigned int[4*nbins*nbins];
   histoA = new unsigned int[nbins];
   histoB = new unsigned int[nbins];
 }
@@ -91,7 +93,6 @@ void MutualInfo::histogram(int width, int height,
                            int starty, int endy) {
   if(endx == 0) endx = width;
   if(endy == 0) endy = height;
-  memset(histo2D, 0, nbins*nbins*sizeof(int));
   int side = 256/nbins;
   assert(!(side & (side-1)));
 
@@ -103,14 +104,8 @@ void MutualInfo::histogram(int width, int height,
   int s = 0; 
   while ( bins>>=1) { ++s; }
 
-  for(int y = starty; y < endy; y++) {
-    int offset = width*y + startx;
-    for(int x = startx; x < endx; x++, offset++) {
-      unsigned char a = target[offset]>>k; //instead of /side;
-      unsigned char b = render[offset]>>k; //instead of /side;
-      histo2D[a + (b<<s)] += 2;//bweight; //instead of nbins*s
-    }
-  }
+  //each pixel adds 2 (instead of bweight) to histo2D[(target>>k) + ((render>>k)<<s)]
+  MLMutualInfoRaster::JointHistogram(width, target, render, startx, endx, starty, endy, k, s, histo2D);
   //weight of background is divided.
   //background is when b = 0 -> first row of histo2D
   if(bweight != 0) {
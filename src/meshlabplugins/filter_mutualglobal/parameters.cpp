@@ -1,4 +1,5 @@
 #include <iostream>
+#include <random>
 
 #include "../../common/meshmodel.h"
 #include "parameters.h"
@@ -131,11 +132,11 @@ double Parameters::pixelDiff(Shot &test, CMeshO &mesh, int nsamples) {
   double maxdist = 0.0;
   double avedist = 0.0;
   int count = 0;
+  //fixed seed and local state: the same samples whatever the other alignments running at the same time
+  std::minstd_rand gen(1);
+  std::uniform_int_distribution<int> pick(0, int(mesh.vert.size()) - 1);
   for(int i = 0; i < nsamples; i++) {
-    double r = (double)rand() / ((double)(RAND_MAX)+(double)(1));
-    double g = (double)rand() / ((double)(RAND_MAX)+(double)(1));
-    r = r*16000*16000+g*16000;
-    int v = ((int)r)%(mesh.vert.size());
+    int v = pick(gen);
     vcg::Point3f c;
     c.Import(mesh.vert[v].P());
     Point2f diff = pixelDiff(test, c);
@@ -21,6 +21,7 @@ Solver::Solver():
 
   start = 1e20; end = 0;
   f_evals = 0;
+  f_evals_total = 0;
 }
 
 //function that evaluate error
@@ -38,8 +39,6 @@ double Solver::operator()(int ndim, double *x) {
     //cout << p[i] << "\t";
   }
   //cout << endl;
-  static int iter = 0;
-  iter++;
 /*  double orig = p.scale[6];
   //p.scale[6] *= pow(iter/(double)maxiter, 4);
   double v = 4*(iter/(double)maxiter) - 2;
@@ -119,7 +118,7 @@ double Solver::operator()(int ndim, double *x) {
 	break;
    }
    case AlignSet::NODE: {
-		assert(glGetError() == 0);
+		assert(align->softRender || glGetError() == 0);
 		//QImage comb; std::vector<QImage> projimg;
 		/*align->mode=AlignSet::COMBINE;
 		align->renderScene(shot,1,true);
@@ -25,7 +25,7 @@
 using namespace std;
 
 AlignSet::AlignSet(): mode(COMBINE),
-    target(NULL), render(NULL),error(0)
+    target(NULL), render(NULL),error(0), softRender(false)
 {
         _cont = NULL;
         box.SetNull();
@@ -161,6 +161,14 @@ void AlignSet::resize(int max_side) {
 
 void AlignSet::renderScene(vcg::Shot<float> &view, int component) 
 {
+    if(softRender) {
+        if (render) delete[] render;
+        render = new unsigned char[wt*ht];
+        if(component < 4)
+            softRaster.Render(view, *mesh, mode, component, wt, ht, render);
+        return;
+    }
+
     QSize fbosize(wt,ht);
     QGLFramebufferObjectFormat frmt;
     frmt.setInternalTextureFormat(GL_RGBA);
@@ -8,6 +8,7 @@
 
 // local headers
 #include "common/meshmodel.h"
+#include "common/ml_mutualinfo.h"
 
 // VCG headers
 #include <vcg/math/shot.h>
@@ -46,6 +47,9 @@ class AlignSet {
   unsigned char *target, *render; //buffers for rendered images 
   double error; //alignment error in px
 
+  bool softRender; //render on the cpu, no GL context needed: each thread can align its own AlignSet
+  MLMutualInfoRaster softRaster;
+
   AlignSet();
   ~AlignSet();
 
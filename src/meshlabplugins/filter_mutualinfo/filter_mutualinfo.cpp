@@ -104,6 +104,9 @@ void FilterMutualInfoPlugin::initParameterSet(QAction *action,MeshDocument & /*m
 		parlst.addParam(new RichFloat("Tolerance", 0.1, "Tolerance", "Threshold to stop convergence"));
 		parlst.addParam(new RichFloat("ExpectedVariance", 2.0, "Expected Variance", "Expected Variance"));
 		parlst.addParam(new RichInt("BackgroundWeight", 2, "Background Weight", "Weight of background pixels (1, as all the other pixels; 2, one half of the other pixels etc etc)"));
+		parlst.addParam(new RichBool("CpuRender", false, "CPU rendering", "Render the model and evaluate the mutual information on the CPU instead of through OpenGL; when all the rasters are aligned they are processed in parallel"));
+		parlst.addParam(new RichBool("AllRasters", false, "Align all rasters", "Align every visible raster that has a valid shot, each one starting from its own shot, instead of the current raster from the starting shot; a summary of the convergence of each raster is logged"));
+		break;
 	default :
 		assert(0);
 	}
@@ -118,7 +121,8 @@ bool FilterMutualInfoPlugin::applyFilter(QAction *action, MeshDocument &md, Rich
 					par.getEnum("Rendering Mode"), par.getBool("Estimate Focal"),
 					par.getBool("Fine"), par.getFloat("ExpectedVariance"),
 					par.getFloat("Tolerance"), par.getInt("NumOfIterations"),
-					par.getInt("BackgroundWeight"), par.getShotf("Shot"));
+					par.getInt("BackgroundWeight"), par.getShotf("Shot"),
+					par.getBool("CpuRender"), par.getBool("AllRasters"));
 		break;
 	default :
 		assert(0);
@@ -140,11 +144,11 @@ bool FilterMutualInfoPlugin::imageMutualInfoAlign(
 		float tolerance,
 		int numIterations,
 		int backGroundWeight,
-		vcg::Shotf shot)
+		vcg::Shotf shot,
+		bool cpuRender,
+		bool allRasters)
 {
-	Solver solver;
-	MutualInfo mutual;
-	if (!shot.IsValid()){
+	if (!allRasters && !shot.IsValid()){
 		Log(GLLogStream::FILTER, "Error: shot not valid. Press 'Get Shot' button before applying!");
 		return false;
 	}
@@ -153,92 +157,165 @@ bool FilterMutualInfoPlugin::imageMutualInfoAlign(
 		Log(GLLogStream::FILTER, "You need a Raster Model to apply this filter!");
 		return false;
 	}
-	else {
-		align.image=&md.rm()->currentPlane->image;
-	}
-
-	align.mesh=&md.mm()->cm;
-	align.meshid = md.mm()->id();
-
-	solver.optimize_focal = estimateFocal;
-	solver.fine_alignment = fine;
-	solver.variance = expectedVariance;
-	solver.tolerance = tolerance;
-	solver.maxiter = numIterations;
-	mutual.bweight = backGroundWeight;
 
+	AlignSet::RenderingMode mode;
 	switch(rendmode)
 	{
 	case 0:
-		align.mode=AlignSet::COMBINE;
+		mode=AlignSet::COMBINE;
 		break;
 	case 1:
-		align.mode=AlignSet::NORMALMAP;
+		mode=AlignSet::NORMALMAP;
 		break;
 	case 2:
-		align.mode=AlignSet::COLOR;
+		mode=AlignSet::COLOR;
 		break;
 	case 3:
-		align.mode=AlignSet::SPECULAR;
+		mode=AlignSet::SPECULAR;
 		break;
 	case 4:
-		align.mode=AlignSet::SILHOUETTE;
+		mode=AlignSet::SILHOUETTE;
 		break;
 	case 5:
-		align.mode=AlignSet::SPECAMB;
+		mode=AlignSet::SPECAMB;
 		break;
 	default:
-		align.mode=AlignSet::COMBINE;
+		mode=AlignSet::COMBINE;
 		break;
 	}
 
-	align.shot = vcg::Shotf::Construct(shot);
-
-	align.shot.Intrinsics.ViewportPx[0]=int((double)align.shot.Intrinsics.ViewportPx[1]*align.image->width()/align.image->height());
-	align.shot.Intrinsics.CenterPx[0]=(int)(align.shot.Intrinsics.ViewportPx[0]/2);
+	std::vector<RasterModel *> rasters;
+	if (allRasters) {
+		for (RasterModel *rm : md.rasterList)
+			if (rm->visible && rm->currentPlane != NULL && rm->shot.IsValid())
+				rasters.push_back(rm);
+		if (rasters.empty()) {
+			Log(GLLogStream::FILTER, "Error: no visible raster with a valid shot to align");
+			return false;
+		}
+	}
+	else
+		rasters.push_back(md.rm());
 
 	///// Initialize GLContext
+	if (!cpuRender)
+	{
+		Log( "Initialize GL");
+		align.setGLContext(glContext);
+		glContext->makeCurrent();
+		if (initGLMutualInfo() == false)
+			return false;
 
-	Log( "Initialize GL");
-	align.setGLContext(glContext);
-	glContext->makeCurrent();
-	if (initGLMutualInfo() == false)
-		return false;
+		Log( "Done");
+	}
+
+	// on the cpu every raster gets its own AlignSet, so that independent rasters are aligned at the same time;
+	// through GL they share the context and go one after the other
+	const int rasterNum = int(rasters.size());
+	std::vector<AlignReport> reports(rasterNum);
+#pragma omp parallel for schedule(dynamic, 1) if (cpuRender && rasterNum > 1)
+	for (int i = 0; i < rasterNum; ++i)
+	{
+		AlignSet local;
+		AlignSet &set = cpuRender ? local : align;
+		set.softRender = cpuRender;
+		set.mode = mode;
+		set.mesh = &md.mm()->cm;
+		set.meshid = md.mm()->id();
+
+		Solver solver;
+		MutualInfo mutual;
+		solver.optimize_focal = estimateFocal;
+		solver.fine_alignment = fine;
+		solver.variance = expectedVariance;
+		solver.tolerance = tolerance;
+		solver.maxiter = numIterations;
+		mutual.bweight = backGroundWeight;
+
+		reports[i] = alignRaster(md, rasters[i], set, solver, mutual,
+				allRasters ? vcg::Shotf::Construct(rasters[i]->shot) : shot, rasterNum == 1);
+	}
+
+	if (!cpuRender)
+		this->glContext->doneCurrent();
+
+	if (allRasters)
+	{
+		int converged = 0;
+		for (int i = 0; i < rasterNum; ++i)
+		{
+			Log("%s: %s in %i evaluations, function value %f -> %f", qUtf8Printable(rasters[i]->label()),
+				reports[i].converged ? "converged" : "not converged", reports[i].evaluations,
+				reports[i].startInfo, reports[i].endInfo);
+			if (reports[i].converged) ++converged;
+		}
+		Log("%i of %i rasters converged", converged, rasterNum);
+		md.documentUpdated();
+	}
+
+	return true;
+}
+
+FilterMutualInfoPlugin::AlignReport FilterMutualInfoPlugin::alignRaster(
+		MeshDocument &md,
+		RasterModel *rm,
+		AlignSet &set,
+		Solver &solver,
+		MutualInfo &mutual,
+		vcg::Shotf shot,
+		bool updateDocument)
+{
+	RasterImagePin pin(rm->currentPlane);
+	QImage image=rm->currentPlane->image();   // set keeps a pointer to it
+	set.image=&image;
+
+	set.shot = shot;
 
-	Log( "Done");
+	set.shot.Intrinsics.ViewportPx[0]=int((double)set.shot.Intrinsics.ViewportPx[1]*set.image->width()/set.image->height());
+	set.shot.Intrinsics.CenterPx[0]=(int)(set.shot.Intrinsics.ViewportPx[0]/2);
+
+	set.resize(800);
+
+	AlignReport report;
+	report.startInfo = report.endInfo = 0;
+	report.evaluations = 0;
+	report.converged = false;
 
 	///// Mutual info calculation: every 30 iterations, the mail glarea is updated
 	int rounds=(int)(solver.maxiter/30);
+	solver.maxiter=30;
 	for (int i=0; i<rounds; i++)
 	{
-		Log( "Step %i of %i.", i+1, rounds );
-
-		solver.maxiter=30;
+		if (updateDocument)
+			Log( "Step %i of %i.", i+1, rounds );
 
+		int evals;
 		if (solver.fine_alignment)
-			solver.optimize(&align, &mutual, align.shot);
+			evals = solver.optimize(&set, &mutual, set.shot);
 		else
-			solver.iterative(&align, &mutual, align.shot);
-
-		md.rm()->shot = Shotm::Construct(align.shot);
-		float ratio=(float)md.rm()->currentPlane->image.height()/(float)align.shot.Intrinsics.ViewportPx[1];
-		md.rm()->shot.Intrinsics.ViewportPx[0]=md.rm()->currentPlane->image.width();
-		md.rm()->shot.Intrinsics.ViewportPx[1]=md.rm()->currentPlane->image.height();
-		md.rm()->shot.Intrinsics.PixelSizeMm[1]/=ratio;
-		md.rm()->shot.Intrinsics.PixelSizeMm[0]/=ratio;
-		md.rm()->shot.Intrinsics.CenterPx[0]=(int)((float)md.rm()->shot.Intrinsics.ViewportPx[0]/2.0);
-		md.rm()->shot.Intrinsics.CenterPx[1]=(int)((float)md.rm()->shot.Intrinsics.ViewportPx[1]/2.0);
-
-		QList<int> rl;
-		rl << md.rm()->id();
+			evals = solver.iterative(&set, &mutual, set.shot);
+
+		if (i == 0) report.startInfo = solver.start;
+		report.endInfo = solver.end;
+		report.evaluations += evals;
+		report.converged = evals < solver.maxiter;
+
+		rm->shot = Shotm::Construct(set.shot);
+		float ratio=(float)rm->currentPlane->size().height()/(float)set.shot.Intrinsics.ViewportPx[1];
+		rm->shot.Intrinsics.ViewportPx[0]=rm->currentPlane->size().width();
+		rm->shot.Intrinsics.ViewportPx[1]=rm->currentPlane->size().height();
+		rm->shot.Intrinsics.PixelSizeMm[1]/=ratio;
+		rm->shot.Intrinsics.PixelSizeMm[0]/=ratio;
+		rm->shot.Intrinsics.CenterPx[0]=(int)((float)rm->shot.Intrinsics.ViewportPx[0]/2.0);
+		rm->shot.Intrinsics.CenterPx[1]=(int)((float)rm->shot.Intrinsics.ViewportPx[1]/2.0);
 
 		//md.updateRenderStateRasters(rl,RasterModel::RM_ALL);
 
-		md.documentUpdated();
+		if (updateDocument)
+			md.documentUpdated();
 	}
-	this->glContext->doneCurrent();
 
-	return true;
+	return report;
 }
 
 bool FilterMutualInfoPlugin::initGLMutualInfo()
@@ -278,7 +355,6 @@ bool FilterMutualInfoPlugin::initGLMutualInfo()
 
 	//AlignSet &align = Autoreg::instance().align;
 	align.initializeGL();
-	align.resize(800);
 	//assert(glGetError() == 0);
 
 	Log(0, "GL Initialization done");
@@ -28,6 +28,8 @@
 
 #include <common/interfaces.h>
 #include "alignset.h"
+#include "solver.h"
+#include "mutual.h"
 
 class FilterMutualInfoPlugin : public QObject, public MeshFilterInterface
 {
@@ -54,6 +56,14 @@ public:
 private:
 	AlignSet align;
 
+	// outcome of the alignment of a raster
+	struct AlignReport
+	{
+		double startInfo, endInfo; // value of the function (2 - MI) before and after
+		int evaluations;
+		bool converged;            // the last step stopped before its iteration limit
+	};
+
 	//mutualInfo
 	bool imageMutualInfoAlign(
 			MeshDocument &md,
@@ -64,7 +74,18 @@ private:
 			float tolerance,
 			int numIterations,
 			int backGroundWeight,
-			vcg::Shotf shot);
+			vcg::Shotf shot,
+			bool cpuRender,
+			bool allRasters);
+
+	AlignReport alignRaster(
+			MeshDocument &md,
+			RasterModel *rm,
+			AlignSet &set,
+			Solver &solver,
+			MutualInfo &mutual,
+			vcg::Shotf shot,
+			bool updateDocument);
 
 	bool initGLMutualInfo();
 };
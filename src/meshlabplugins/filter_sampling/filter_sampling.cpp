@@ -39,6 +39,9 @@ $Log: samplefilter.cpp,v $
 #include <vcg/simplex/face/distance.h>
 #include <vcg/complex/algorithms/geodesic.h>
 #include <vcg/complex/algorithms/voronoi_processing.h>
+#include <common/ml_parallel_geodesic.h>
+#include <common/ml_parallel_poisson.h>
+#include <common/ml_parallel_sdf.h>
 
 using namespace vcg;
 using namespace std;
@@ -539,6 +542,8 @@ void FilterDocSampling::initParameterSet(QAction *action, MeshDocument & md, Ric
     parlst.addParam(new RichInt("BestSamplePool", 10, "Best Sample Pool Size", "Used only if the Best Sample Flag is true. It control the number of attempt that it makes to get the best sample. It is reasonable that it is smaller than the Montecarlo oversampling factor."));
     parlst.addParam(new RichBool("ExactNumFlag", false, "Exact number of samples", "If requested it will try to do a dicotomic search for the best poisson disk radius that will generate the requested number of samples with a tolerance of the 0.5%. Obviously it takes much longer."));
     parlst.addParam(new RichFloat("RadiusVariance", 1, "Radius Variance", "The radius of the disk is allowed to vary between r and r*var. If this parameter is 1 the sampling is the same of the Poisson Disk Sampling"));
+    parlst.addParam(new RichBool("ParallelMode", true, "Parallel", "If checked the Montecarlo samples are pruned by all the cores: the cells of a radius sized grid are processed in groups of non conflicting cells. Not used with the approximate geodesic distance."));
+    parlst.addParam(new RichInt("RandomSeed", 0, "Random seed", "To ensure repeatability you can specify the random seed used. If 0 the random seed is tied to the current clock."));
     break;
 
   case FP_TEXEL_SAMPLING :
@@ -648,6 +653,9 @@ void FilterDocSampling::initParameterSet(QAction *action, MeshDocument & md, Ric
                                   "If true a <b> not</b> signed distance field is computed. "
                                   "In this case you have to choose a not zero Offset and a double surface is built around the original surface, inside and outside. "
                                   "Is useful to convrt thin floating surfaces into <i> solid, thick meshes.</i>. t"));
+    parlst.addParam(new RichBool ("ParallelMode", true, "Parallel",
+                                  "If checked the distance field is computed by all the cores and only in the blocks of the volume near to the surface; "
+                                  "the marching cube is run independently on each of these blocks."));
   } break;
   case FP_VORONOI_COLORING :
   case FP_DISK_COLORING :
@@ -928,6 +936,7 @@ switch(ID(action))
 		tri::SurfaceSampling<CMeshO, BaseSampler>::PoissonDiskParam pp;
 		pp.radiusVariance = par.getFloat("RadiusVariance");
 		bool subsampleFlag = par.getBool("Subsample");
+		unsigned int randomSeed = par.getInt("RandomSeed");
 
 		if ((radius == 0.0) && (sampleNum == 0)){
 			Log("Poisson disk Sampling: Number of Samples AND Radius are both 0, cannot do anything");
@@ -981,6 +990,8 @@ switch(ID(action))
 				presampledMesh=&MontecarloMesh;
 
 			QElapsedTimer tt;tt.start();
+			if(randomSeed != 0)
+				tri::SurfaceSampling<CMeshO,BaseSampler>::SamplingRandomGenerator().initialize(randomSeed);
 			BaseSampler sampler(presampledMesh);
 			sampler.qualitySampling=true;
 			if(pp.adaptiveRadiusFlag)
@@ -1000,15 +1011,46 @@ switch(ID(action))
 		pp.geodesicDistanceFlag=par.getBool("ApproximateGeodesicDistance");
 		pp.bestSampleChoiceFlag=par.getBool("BestSampleFlag");
 		pp.bestSamplePoolSize =par.getInt("BestSamplePool");
-		if(par.getBool("ExactNumFlag"))
-			tri::SurfaceSampling<CMeshO,BaseSampler>::PoissonDiskPruningByNumber(mps, *presampledMesh, sampleNum, radius,pp,0.005);
+		if(par.getBool("ParallelMode") && !pp.geodesicDistanceFlag)
+		{
+			QElapsedTimer tt;tt.start();
+			tri::ParallelPoissonDisk<CMeshO>::Param ppp;
+			ppp.radiusVariance = pp.radiusVariance;
+			ppp.adaptiveRadiusFlag = pp.adaptiveRadiusFlag;
+			ppp.bestSampleChoiceFlag = pp.bestSampleChoiceFlag;
+			ppp.bestSamplePoolSize = pp.bestSamplePoolSize;
+			ppp.seed = (randomSeed != 0) ? randomSeed : (unsigned int)(time(0));
+			ppp.preGenMesh = pp.preGenFlag ? pp.preGenMesh : 0;
+			std::vector<const CVertexO *> samples;
+			if(par.getBool("ExactNumFlag"))
+				radius = tri::ParallelPoissonDisk<CMeshO>::PruneByNumber(*presampledMesh, sampleNum, radius, ppp, samples, 0.005);
+			else
+				tri::ParallelPoissonDisk<CMeshO>::Prune(*presampledMesh, radius, ppp, samples);
+
+			// a single allocation for all the samples
+			const int base = int(mm->cm.vert.size());
+			const int sampleCnt = int(samples.size());
+			tri::Allocator<CMeshO>::AddVertices(mm->cm, sampleCnt);
+#pragma omp parallel for schedule(static)
+			for(int i=0; i<sampleCnt; ++i)
+				mm->cm.vert[base+i].ImportData(*samples[i]);
+			vcg::tri::UpdateBounding<CMeshO>::Box(mm->cm);
+			Point3i &g=ppp.gridSize;
+			Log("Grid size was %i %i %i (%i cells not empty), radius %f",g[0],g[1],g[2], ppp.cellNum, radius);
+			Log("Parallel pruning took %i msec",int(tt.elapsed()));
+		}
 		else
-			tri::SurfaceSampling<CMeshO,BaseSampler>::PoissonDiskPruning(mps, *presampledMesh, radius,pp);
+		{
+			if(par.getBool("ExactNumFlag"))
+				tri::SurfaceSampling<CMeshO,BaseSampler>::PoissonDiskPruningByNumber(mps, *presampledMesh, sampleNum, radius,pp,0.005);
+			else
+				tri::SurfaceSampling<CMeshO,BaseSampler>::PoissonDiskPruning(mps, *presampledMesh, radius,pp);
 
-		//tri::SurfaceSampling<CMeshO,BaseSampler>::PoissonDisk(curMM->cm, mps, *presampledMesh, radius,pp);
-		vcg::tri::UpdateBounding<CMeshO>::Box(mm->cm);
-		Point3i &g=pp.pds.gridSize;
-		Log("Grid size was %i %i %i (%i allocated on %i)",g[0],g[1],g[2], pp.pds.gridCellNum, g[0]*g[1]*g[2]);
+			//tri::SurfaceSampling<CMeshO,BaseSampler>::PoissonDisk(curMM->cm, mps, *presampledMesh, radius,pp);
+			vcg::tri::UpdateBounding<CMeshO>::Box(mm->cm);
+			Point3i &g=pp.pds.gridSize;
+			Log("Grid size was %i %i %i (%i allocated on %i)",g[0],g[1],g[2], pp.pds.gridCellNum, g[0]*g[1]*g[2]);
+		}
 		Log("Poisson Disk Sampling created a new mesh of %i points", mm->cm.vn);
 	} break;
 
@@ -1246,7 +1288,15 @@ switch(ID(action))
 		Log("     VoxelSize is %f, offset is %f ", voxelSize,offsetThr);
 		Log("     Mesh Box is %f %f %f",baseMesh->cm.bbox.DimX(),baseMesh->cm.bbox.DimY(),baseMesh->cm.bbox.DimZ() );
 
-		tri::Resampler<CMeshO,CMeshO>::Resample(baseMesh->cm, offsetMesh->cm, volumeBox, volumeDim, voxelSize*3.5, offsetThr,discretizeFlag,multiSampleFlag,absDistFlag, cb);
+		if(par.getBool("ParallelMode"))
+		{
+			// the band must contain the offset surface, whatever the offset
+			tri::ParallelSignedDistance<CMeshO>::Info info =
+					tri::ParallelSignedDistance<CMeshO>::Resample(baseMesh->cm, offsetMesh->cm, volumeBox, volumeDim, voxelSize*3.5+fabs(offsetThr), offsetThr,discretizeFlag,multiSampleFlag,absDistFlag, cb);
+			Log("     Sampled %i of %i blocks of the volume",info.activeBlockNum,info.blockNum);
+		}
+		else
+			tri::Resampler<CMeshO,CMeshO>::Resample(baseMesh->cm, offsetMesh->cm, volumeBox, volumeDim, voxelSize*3.5, offsetThr,discretizeFlag,multiSampleFlag,absDistFlag, cb);
 		tri::UpdateBounding<CMeshO>::Box(offsetMesh->cm);
 		if(mergeCloseVert)
 		{
@@ -1276,7 +1326,7 @@ switch(ID(action))
 		tri::VoronoiProcessing<CMeshO>::SeedToVertexConversion	(mmM->cm, vecP, vecV);
 		Log("Converted %ui points into %ui vertex ",vecP.size(),vecV.size());
 		tri::EuclideanDistance<CMeshO> edFunc;
-		tri::VoronoiProcessing<CMeshO>::ComputePerVertexSources(mmM->cm,vecV,edFunc);
+		tri::ParallelGeodesic<CMeshO>::ComputePerVertexSources(mmM->cm,vecV,edFunc);
 
 		for(uint i=0;i<vecV.size();++i) vecV[i]->C()=Color4b::Red;
 		tri::VoronoiProcessing<CMeshO>::VoronoiColoring(mmM->cm,backwardFlag);
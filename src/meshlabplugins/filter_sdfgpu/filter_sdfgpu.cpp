@@ -7,6 +7,7 @@
 #include <vcg/space/index/spatial_hashing.h>
 #include <wrap/qt/to_string.h>
 #include <vcg/math/gen_normal.h>
+#include <common/ml_parallel_bvh.h>
 #include <wrap/qt/checkGLError.h>
 #include <stdio.h>
 #include <assert.h>
@@ -54,7 +55,13 @@ void SdfGpuPlugin::initParameterSet(QAction *action, MeshModel &/*m*/, RichParam
         "Two elements whose distance is below this value will be considered as belonging to the same layer."));
 
     if(mAction != SDF_DEPTH_COMPLEXITY)
+    {
         par.addParam(new RichFloat("coneAngle",120,"Cone amplitude", "Cone amplitude around normals in degrees. Rays are traced within this cone."));
+        par.addParam(new RichBool("cpuRayCasting",false,"CPU ray casting",
+            "Cast the rays on all the CPU cores against a BVH of the mesh instead of using depth peeling on the GPU. "
+            "No OpenGL context is needed, so the filter can run on machines without a GPU. "
+            "The depth texture and peeling parameters and the outliers removal are ignored."));
+    }
 
 
 
@@ -165,6 +172,12 @@ bool SdfGpuPlugin::applyFilter(QAction */*filter*/, MeshDocument &md, RichParame
     //MESH CLEAN UP
     setupMesh( md, mOnPrimitive );
 
+    if(mAction != SDF_DEPTH_COMPLEXITY && pars.getBool("cpuRayCasting"))
+    {
+        traceRaysCPU(*mm, numViews, cb);
+        return true;
+    }
+
     //glContext->makeCurrent();
     //GL INIT
     if(!initGL(*mm)) return false;
@@ -583,13 +596,115 @@ void SdfGpuPlugin::setupMesh(MeshDocument& md, ONPRIMITIVE onPrimitive )
         break;
     }
 
-    if(!vcg::tri::HasPerVertexAttribute(m,"maxQualityDir") && onPrimitive == ON_VERTICES)
-        mMaxQualityDirPerVertex = vcg::tri::Allocator<CMeshO>::AddPerVertexAttribute<Point3f>(m,std::string("maxQualityDir"));
-    else if(!vcg::tri::HasPerFaceAttribute(m,"maxQualityDir") && onPrimitive == ON_FACES)
-        mMaxQualityDirPerFace = vcg::tri::Allocator<CMeshO>::AddPerFaceAttribute<Point3f>(m,std::string("maxQualityDir"));
+    if(onPrimitive == ON_VERTICES)
+        mMaxQualityDirPerVertex = vcg::tri::Allocator<CMeshO>::GetPerVertexAttribute<Point3f>(m,std::string("maxQualityDir"));
+    else
+        mMaxQualityDirPerFace = vcg::tri::Allocator<CMeshO>::GetPerFaceAttribute<Point3f>(m,std::string("maxQualityDir"));
+
+    if(glContext != NULL)
+        glContext->meshAttributesUpdated(mm->id(),true,MLRenderingData::RendAtts());
+
+}
+
+/*
+  CPU version of the sdf and obscurance computation: the rays are cast against a
+  BVH of the mesh instead of peeling the depth layers, so the hits are exact
+  and no GL context is needed. Each vertex (or face) traces its own rays and
+  the elements are spread on all the cores.
+*/
+void SdfGpuPlugin::traceRaysCPU(MeshModel &mm, unsigned int numViews, vcg::CallBackPos *cb)
+{
+    CMeshO &m = mm.cm;
+    std::vector<Point3f> dirVec;
+    GenNormal<float>::Fibonacci(numViews,dirVec);
+    for(size_t k = 0; k < dirVec.size(); ++k)
+        dirVec[k].Normalize();
+    const int rayNum = int(dirVec.size());
+    Log(GLLogStream::SYSTEM, "Number of rays: %i ", rayNum );
+
+    if(cb) cb(0, "Building the BVH");
+    const tri::ParallelBVH<CMeshO> bvh(m);
+
+    // rays start slightly off the surface to avoid hitting the faces around the sample
+    const float eps  = m.bbox.Diag()*1e-5f;
+    const float tMax = std::numeric_limits<float>::max();
+    const bool onFaces = (mOnPrimitive == ON_FACES);
+    const int sampleNum = onFaces ? m.fn : m.vn;
+    std::vector<float>   quality(sampleNum);
+    std::vector<Point3f> qualityDir(sampleNum);
+
+#pragma omp parallel for schedule(dynamic, 256)
+    for(int i = 0; i < sampleNum; ++i)
+    {
+        Point3f p, n;
+        if(onFaces)
+        {
+            p = Point3f::Construct(Barycenter(m.face[i]));
+            n = Point3f::Construct(TriangleNormal(m.face[i])).Normalize();
+        }
+        else
+        {
+            p = Point3f::Construct(m.vert[i].cP());
+            n = Point3f::Construct(m.vert[i].cN()).Normalize();
+        }
+
+        float sum = 0, weightSum = 0;
+        Point3f dirSum(0,0,0);
+        for(int k = 0; k < rayNum; ++k)
+        {
+            const Point3f &dir = dirVec[k];
+            const float cosAngle = n.dot(dir);
+            tri::ParallelBVH<CMeshO>::RayHit hit;
+            if(mAction == SDF_SDF)
+            {
+                // the ray goes inside the mesh, against the direction
+                if(cosAngle <= 0 || cosAngle < mMinCos) continue;
+                if(!bvh.Intersect(p - n*eps, -dir, 0, tMax, hit)) continue;
+                if(mRemoveFalse && Point3f::Construct(TriangleNormal(m.face[hit.face])).dot(n) > 0) continue;
+                sum       += hit.t*cosAngle;
+                weightSum += cosAngle;
+                dirSum    += dir*(hit.t*cosAngle);
+            }
+            else
+            {
+                if(cosAngle <= 0) continue;
+                float obscurance = cosAngle;
+                if(bvh.Intersect(p + n*eps, dir, 0, tMax, hit))
+                    obscurance *= std::max(0.0f, 1.0f - std::exp(-mTau*hit.t));
+                sum    += obscurance;
+                dirSum += dir*obscurance;
+            }
+        }
+        if(mAction == SDF_SDF)
+            quality[i] = (weightSum > 0) ? sum/weightSum : 0;
+        else
+            quality[i] = sum/rayNum;
+        qualityDir[i] = dirSum.Normalize();
 
-    glContext->meshAttributesUpdated(mm->id(),true,MLRenderingData::RendAtts());
+        if(cb && (i % 1024) == 0 && MLParallel::ThreadId() == 0)
+            cb(int((long long)(i)*100/sampleNum), "Tracing rays...");
+    }
 
+    if(onFaces)
+    {
+        for(int i = 0; i < sampleNum; ++i)
+        {
+            m.face[i].Q() = quality[i];
+            mMaxQualityDirPerFace[i] = qualityDir[i];
+        }
+        if(mAction == SDF_OBSCURANCE)
+            tri::UpdateColor<CMeshO>::PerFaceQualityGray(m);
+    }
+    else
+    {
+        for(int i = 0; i < sampleNum; ++i)
+        {
+            m.vert[i].Q() = quality[i];
+            mMaxQualityDirPerVertex[i] = qualityDir[i];
+        }
+        if(mAction == SDF_OBSCURANCE)
+            tri::UpdateColor<CMeshO>::PerVertexQualityGray(m,0.0f,0.0f);
+    }
 }
 
 void SdfGpuPlugin::setCamera(Point3f camDir, Box3f meshBBox)
@@ -58,6 +58,9 @@ public:
     //Calculate sdf or obscurance along a ray
     void TraceRay(int peelingIteration, const vcg::Point3f& dir, MeshModel* mm );
 
+    //Calculate sdf or obscurance casting rays on the CPU, without any GL context
+    void traceRaysCPU(MeshModel &mm, unsigned int numViews, vcg::CallBackPos *cb);
+
     //Enable depth peeling shader
     void useDepthPeelingShader(FramebufferObject* fbo);
 
@@ -27,7 +27,8 @@
 #include "meshselect.h"
 #include <vcg/complex/algorithms/clean.h>
 #include <vcg/complex/algorithms/stat.h>
-#include <vcg/complex/algorithms/point_outlier.h>
+#include <common/ml_parallel_components.h>
+#include <common/ml_parallel_knn.h>
 
 using namespace vcg;
 
@@ -385,7 +386,7 @@ switch(ID(action))
 	} break;
 
 	case FP_SELECT_CONNECTED:
-		tri::UpdateSelection<CMeshO>::FaceConnectedFF(m.cm);
+		tri::ParallelConnectedComponents<CMeshO>::FaceConnected(m.cm);
 	break;
 
 	case FP_SELECTBYANGLE :
@@ -629,9 +630,7 @@ switch(ID(action))
 	{
 		float threshold = par.getDynamicFloat("PropThreshold");
 		int kNearest = par.getInt("KNearest");
-		VertexConstDataWrapper<CMeshO> wrapper(m.cm);
-		KdTree<typename CMeshO::ScalarType> kdTree(wrapper);
-		int selVertexNum = tri::OutlierRemoval<CMeshO>::SelectLoOPOutliers(m.cm, kdTree, kNearest, threshold);
+		int selVertexNum = tri::ParallelOutlierRemoval<CMeshO>::SelectLoOPOutliers(m.cm, m.knnGraph(kNearest), kNearest, threshold);
 		Log("Selected %d outlier vertices", selVertexNum);
 	} break;
 
@@ -682,8 +681,7 @@ MeshFilterInterface::FilterClass SelectionFilterPlugin::getClass(QAction *action
  switch(ID(action))
   {
 	case CP_SELECT_NON_MANIFOLD_FACE:
-	case CP_SELECT_NON_MANIFOLD_VERTEX:       
-    case FP_SELECT_CONNECTED: return MeshModel::MM_FACEFACETOPO;
+	case CP_SELECT_NON_MANIFOLD_VERTEX: return MeshModel::MM_FACEFACETOPO;
   
 	case CP_SELECT_TEXBORDER: return MeshModel::MM_FACEFACETOPO;
 	case CP_SELFINTERSECT_SELECT: return MeshModel::MM_FACEMARK | MeshModel::MM_FACEFACETOPO;
@@ -29,6 +29,9 @@
 #include "filter_texture.h"
 #include "pushpull.h"
 #include "rastering.h"
+#include "texture_baker.h"
+#include "parallel_atlas.h"
+#include <common/ml_parallel_update.h>
 #include <vcg/complex/algorithms/update/texture.h>
 #include<wrap/io_trimesh/export_ply.h>
 #include <vcg/complex/algorithms/parametrization/voronoi_atlas.h>
@@ -356,28 +359,44 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
       }
 
       MeshModel *paraModel=md.addNewMesh("","VoroAtlas",false);
-      tri::VoronoiAtlas<CMeshO>::VoronoiAtlasParam pp;
+      ParallelVoronoiAtlas<CMeshO>::Param pp;
       pp.sampleNum =par.getInt("regionNum");
       pp.overlap=par.getBool("overlapFlag");
 
-      paraModel->updateDataMask(MeshModel::MM_WEDGTEXCOORD);
+      // the face quality of the atlas keeps the stretch of the chart of each face
+      paraModel->updateDataMask(MeshModel::MM_WEDGTEXCOORD | MeshModel::MM_FACEQUALITY);
       // Note that CMesh has ocf texcoord and the append inside VoronoiAtlas class need that.
       // This is a design bug of the VCGLib...
       int bitToBeCleared =0;
       if(!baseModel->hasDataMask(MeshModel::MM_WEDGTEXCOORD)) bitToBeCleared |=MeshModel::MM_WEDGTEXCOORD;
       if(!baseModel->hasDataMask(MeshModel::MM_VERTTEXCOORD)) bitToBeCleared |=MeshModel::MM_VERTTEXCOORD;
       baseModel->updateDataMask(MeshModel::MM_WEDGTEXCOORD | MeshModel::MM_VERTTEXCOORD);
-      tri::VoronoiAtlas<CMeshO>::Build(baseModel->cm,paraModel->cm, pp);
+      ParallelVoronoiAtlas<CMeshO>::Build(baseModel->cm,paraModel->cm, pp, cb);
       if(pp.overlap==false)
         tri::Clean<CMeshO>::RemoveDuplicateVertex(paraModel->cm);
 
       paraModel->UpdateBoxAndNormals();
       baseModel->clearDataMask(bitToBeCleared);
-      Log("Voronoi Atlas: Completed Processing in %i iterations",pp.vas.iterNum);
-      Log("Asked %i generated %i regions",pp.sampleNum,pp.vas.regionNum);
-      Log("Unwrap Time   %6.3f s", float(pp.vas.unwrapTime) / CLOCKS_PER_SEC);
-      Log("Voronoi Time  %6.3f s", float(pp.vas.voronoiTime) / CLOCKS_PER_SEC);
-      Log("Sampling Time %6.3f s", float(pp.vas.samplingTime) / CLOCKS_PER_SEC);
+      Log("Voronoi Atlas: Completed Processing in %i iterations",pp.iterNum);
+      Log("Asked %i generated %i regions",pp.sampleNum,pp.regionNum);
+      Log("Unwrap Time   %6.3f s", pp.unwrapTime);
+      Log("Voronoi Time  %6.3f s", pp.voronoiTime);
+      Log("Sampling Time %6.3f s", pp.samplingTime);
+      Log("Packing Time  %6.3f s", pp.packTime);
+
+      double stretchSum = 0, areaSum = 0;
+      int worst = -1;
+      for (size_t i = 0; i < pp.charts.size(); ++i)
+      {
+          stretchSum += pp.charts[i].l2Stretch * pp.charts[i].area;
+          areaSum += pp.charts[i].area;
+          if (worst < 0 || pp.charts[i].l2Stretch > pp.charts[worst].l2Stretch) worst = int(i);
+      }
+      if (worst >= 0)
+      {
+          Log("Average L2 stretch %6.3f", areaSum > 0 ? stretchSum / areaSum : 1.0);
+          Log("Worst chart: L2 stretch %6.3f, max stretch %6.3f, %i faces", pp.charts[worst].l2Stretch, pp.charts[worst].maxStretch, pp.charts[worst].faceNum);
+      }
       }
       break;
 
@@ -452,22 +471,27 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
 
                 // Creates a vector of double areas
                 double maxArea = -1, minArea=DBL_MAX;
-                std::vector<double> areas;
-                int faceNo = 0;
-                for (uint i=0; i<m.cm.face.size(); ++i)
+                const int allFaceNo = int(m.cm.face.size());
+                std::vector<double> areas(allFaceNo);
+#pragma omp parallel for schedule(static) if(allFaceNo >= MLParallel::MinParallelSize)
+                for (int i=0; i<allFaceNo; ++i)
                 {
                     if (!m.cm.face[i].IsD())
                     {
                         double area = DoubleArea(m.cm.face[i]);
-                        if (area == 0) area = DBL_MIN;
-                        if (area > maxArea) maxArea = area;
-                        if (area < minArea) minArea = area;
-                        areas.push_back(area);
-                        ++faceNo;
+                        areas[i] = (area == 0) ? DBL_MIN : area;
                     } else {
-                        areas.push_back(-1.0);
+                        areas[i] = -1.0;
                     }
                 }
+                int faceNo = 0;
+                for (int i=0; i<allFaceNo; ++i)
+                {
+                    if (areas[i] < 0) continue;
+                    if (areas[i] > maxArea) maxArea = areas[i];
+                    if (areas[i] < minArea) minArea = areas[i];
+                    ++faceNo;
+                }
 
                 // Creates buckets containing each halfening level triangles (a histogram)
                 int    buckSize = (int)ceil(log_2(maxArea/minArea) + DBL_EPSILON);
@@ -523,18 +547,18 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
                 std::vector<Tri2> cache((1 << (halfeningLevels+1))-2);
                 buildTrianglesCache(cache, halfeningLevels, border, 1.0/dim);
 
-                // Setting texture coordinates (finally)
-                Tri2::CoordType origin;
-                Tri2::CoordType tmp;
+                // Cell and cache position of each face: the levels only grow along the
+                // cells, so this is a cheap serial pass and the texture coordinates are
+                // then set in parallel
+                std::vector<uint> slotFace(faceNo);
+                std::vector<int> slotCell(faceNo), slotPos(faceNo);
                 int buckIdx=0, face=0;
                 std::vector<uint>::iterator it = buckets[buckIdx].begin();
                 int currLevel = 1;
                 for (int i=0; i<dim && face<faceNo; ++i)
                 {
-                    origin.Y() = -((float)i)/dim;
                     for (int j=0; j<dim && face<faceNo; j++)
                     {
-                        origin.X() = ((float)j)/dim;
                         for (int pos=(1<<currLevel)-2; pos<(1<<(currLevel+1))-2 && face<faceNo; ++pos, ++face)
                         {
                             while (it == buckets[buckIdx].end()) {
@@ -545,38 +569,44 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
                                 }
                                 it = buckets[buckIdx].begin();
                             }
-                            int fidx = *it;
-                            int lEdge = getLongestEdge(m.cm.face[fidx]);
-                            Tri2 &t = cache[pos];
-                            tmp = t.P(0) + origin;
-                            m.cm.face[fidx].WT(lEdge) = CFaceO::TexCoordType(tmp.X(), tmp.Y());
-                            m.cm.face[fidx].WT(lEdge).N() = 0;
-                            lEdge = (lEdge+1)%3;
-                            tmp = t.P(1) + origin;
-                            m.cm.face[fidx].WT(lEdge) = CFaceO::TexCoordType(tmp.X(), tmp.Y());
-                            m.cm.face[fidx].WT(lEdge).N() = 0;
-                            lEdge = (lEdge+1)%3;
-                            tmp = t.P(2) + origin;
-                            m.cm.face[fidx].WT(lEdge) = CFaceO::TexCoordType(tmp.X(), tmp.Y());
-                            m.cm.face[fidx].WT(lEdge).N() = 0;
+                            slotFace[face] = *it;
+                            slotCell[face] = i*dim + j;
+                            slotPos[face] = pos;
                             ++it;
-                            cb(face*100/faceNo, "Generating parametrization...");
                         }
                     }
                 }
                 assert(face == faceNo);
                 assert(it == buckets[buckSize-1].end());
+                cb(50, "Generating parametrization...");
+
+                // Setting texture coordinates (finally)
+#pragma omp parallel for schedule(static) if(faceNo >= MLParallel::MinParallelSize)
+                for (int k=0; k<faceNo; ++k)
+                {
+                    const Tri2::CoordType origin(((float)(slotCell[k]%dim))/dim, -((float)(slotCell[k]/dim))/dim);
+                    CFaceO &f = m.cm.face[slotFace[k]];
+                    Tri2 &t = cache[slotPos[k]];
+                    int lEdge = getLongestEdge(f);
+                    for (int v=0; v<3; ++v, lEdge = (lEdge+1)%3)
+                    {
+                        const Tri2::CoordType tmp = t.P(v) + origin;
+                        f.WT(lEdge) = CFaceO::TexCoordType(tmp.X(), tmp.Y());
+                        f.WT(lEdge).N() = 0;
+                    }
+                }
                 Log( "Biggest triangle's catheti are %.2f px long", (cache[0].P(0)-cache[0].P(2)).Norm() * textDim);
                 Log( "Smallest triangle's catheti are %.2f px long", (cache[cache.size()-1].P(0)-cache[cache.size()-1].P(2)).Norm() * textDim);
 
             }
             else //BASIC
             {
-                //Get total faces and total undeleted face
+                //Get total faces and total undeleted face, with the position of each one among the latter
                 int faceNo = m.cm.face.size();
-                int faceNotD = 0;
-                for (CMeshO::FaceIterator fi=m.cm.face.begin(); fi!=m.cm.face.end(); ++fi)
-                    if (!fi->IsD()) ++faceNotD;
+                std::vector<int> ordinal(faceNo);
+                for (int i=0; i<faceNo; ++i)
+                    ordinal[i] = m.cm.face[i].IsD() ? 0 : 1;
+                int faceNotD = MLParallel::ExclusiveScan(ordinal);
 
                 // Minimum side dimension to get correct halfsquared triangles
                 int optimalDim = ceilf(sqrtf(faceNotD/2.));
@@ -592,44 +622,39 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
                 float bordersq2 = border / M_SQRT2;
                 float halfborder = border / 2;
 
-                bool odd = true;
-                CFaceO::TexCoordType botl, topr;
-                int face=0;
-                botl.V() = 1.;
-                for (int i=0; i<sideDim && face<faceNo; ++i)
+                // Faces go in pairs in each quad, two quads per row: the position of
+                // a face follows from its index among the undeleted ones
+#pragma omp parallel for schedule(static) if(faceNo >= MLParallel::MinParallelSize)
+                for (int face=0; face<faceNo; ++face)
                 {
-                    topr.V() = botl.V();
-                    topr.U() = 0.;
+                    if (m.cm.face[face].IsD()) continue;
+                    const int i = ordinal[face] / (2*sideDim);
+                    const int j = ordinal[face] % (2*sideDim);
+                    if (i >= sideDim) continue;
+                    CFaceO::TexCoordType botl, topr;
+                    botl.U() = 1.0/sideDim*(j/2);
                     botl.V() = 1.0 - 1.0/sideDim*(i+1);
-                    for (int j=0; j<2*sideDim && face<faceNo; ++face)
-                    {
-                        if (!m.cm.face[face].IsD())
-                        {
-                            int lEdge = getLongestEdge(m.cm.face[face]);
-                            if (odd) {
-                                botl.U() = topr.U();
-                                topr.U() = 1.0/sideDim*(j/2+1);
-                                CFaceO::TexCoordType bl(botl.U()+halfborder, botl.V()+halfborder+bordersq2);
-                                CFaceO::TexCoordType tr(topr.U()-(halfborder+bordersq2), topr.V()-halfborder);
-                                bl.N() = 0;
-                                tr.N() = 0;
-                                m.cm.face[face].WT(lEdge) = bl;
-                                m.cm.face[face].WT((++lEdge)%3) = tr;
-                                m.cm.face[face].WT((++lEdge)%3) = CFaceO::TexCoordType(bl.U(), tr.V());
-                                m.cm.face[face].WT(lEdge%3).N() = 0;
-                            } else {
-                                CFaceO::TexCoordType bl(botl.U()+(halfborder+bordersq2), botl.V()+halfborder);
-                                CFaceO::TexCoordType tr(topr.U()-halfborder, topr.V()-(halfborder+bordersq2));
-                                bl.N() = 0;
-                                tr.N() = 0;
-                                m.cm.face[face].WT(lEdge) = tr;
-                                m.cm.face[face].WT((++lEdge)%3) = bl;
-                                m.cm.face[face].WT((++lEdge)%3) = CFaceO::TexCoordType(tr.U(), bl.V());
-                                m.cm.face[face].WT(lEdge%3).N() = 0;
-                            }
-                            cb(face*100/faceNo, "Generating parametrization...");
-                            odd=!odd; ++j;
-                        }
+                    topr.U() = 1.0/sideDim*(j/2+1);
+                    topr.V() = 1.0 - 1.0/sideDim*i;
+                    int lEdge = getLongestEdge(m.cm.face[face]);
+                    if (j%2 == 0) {
+                        CFaceO::TexCoordType bl(botl.U()+halfborder, botl.V()+halfborder+bordersq2);
+                        CFaceO::TexCoordType tr(topr.U()-(halfborder+bordersq2), topr.V()-halfborder);
+                        bl.N() = 0;
+                        tr.N() = 0;
+                        m.cm.face[face].WT(lEdge) = bl;
+                        m.cm.face[face].WT((++lEdge)%3) = tr;
+                        m.cm.face[face].WT((++lEdge)%3) = CFaceO::TexCoordType(bl.U(), tr.V());
+                        m.cm.face[face].WT(lEdge%3).N() = 0;
+                    } else {
+                        CFaceO::TexCoordType bl(botl.U()+(halfborder+bordersq2), botl.V()+halfborder);
+                        CFaceO::TexCoordType tr(topr.U()-halfborder, topr.V()-(halfborder+bordersq2));
+                        bl.N() = 0;
+                        tr.N() = 0;
+                        m.cm.face[face].WT(lEdge) = tr;
+                        m.cm.face[face].WT((++lEdge)%3) = bl;
+                        m.cm.face[face].WT((++lEdge)%3) = CFaceO::TexCoordType(tr.U(), bl.V());
+                        m.cm.face[face].WT(lEdge%3).N() = 0;
                     }
                 }
                 Log( "Triangles' catheti are %.2f px long", (1.0/sideDim-border-bordersq2)*textDim);
@@ -779,8 +804,7 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
 
 		// Rasterizing triangles
 		RasterSampler rs(trgImgs);
-		rs.InitCallback(cb, m.cm.fn, 0, 80);
-		tri::SurfaceSampling<CMeshO,RasterSampler>::Texture(m.cm,rs,textW,textH,true);
+		TextureBaker::Texture(m.cm, rs, textW, textH, true, cb, 0, 80);
 
 		// Undo topology changes
 		tri::UpdateTopology<CMeshO>::FaceFace(m.cm);
@@ -790,13 +814,7 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
 		{
 			// Revert alpha values for border edge pixels to 255
 			cb(81, "Cleaning up texture ...");
-			for (int y = 0; y<textH; ++y)
-			for (int x = 0; x<textW; ++x)
-			{
-				QRgb px = trgImgs[texInd].pixel(x, y);
-				if (qAlpha(px) < 255 && (!pp || qAlpha(px) > 0))
-				trgImgs[texInd].setPixel(x, y, px | 0xff000000);
-			}
+			TextureBaker::MakeOpaque(trgImgs[texInd], pp);
 
 			// PullPush
 			if (pp)
@@ -972,19 +990,16 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
 		}
 
 		// Rasterizing faces
-		srcMesh->updateDataMask(MeshModel::MM_FACEMARK);
-		tri::UpdateNormal<CMeshO>::PerFaceNormalized(srcMesh->cm);
+		tri::ParallelUpdateNormal<CMeshO>::PerFaceNormalized(srcMesh->cm);
 		if (vertexSampling)
 		{
 			TransferColorSampler sampler(srcMesh->cm, trgImgs, upperbound, vertexMode); // color sampling
-			sampler.InitCallback(cb, trgMesh->cm.fn, 0, 80);
-			tri::SurfaceSampling<CMeshO, TransferColorSampler>::Texture(trgMesh->cm, sampler, textW, textH, false);
+			TextureBaker::Texture(trgMesh->cm, sampler, textW, textH, false, cb, 0, 80);
 		} 
 		else 
 		{ 
 			TransferColorSampler sampler(srcMesh->cm, trgImgs, &srcImgs, upperbound); // texture sampling
-			sampler.InitCallback(cb, trgMesh->cm.fn, 0, 80);
-			tri::SurfaceSampling<CMeshO, TransferColorSampler>::Texture(trgMesh->cm, sampler, textW, textH, false);
+			TextureBaker::Texture(trgMesh->cm, sampler, textW, textH, false, cb, 0, 80);
 		}
 
 		// the meshes have to return to their original position
@@ -1005,13 +1020,7 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
 		{
 			// Revert alpha values for border edge pixels to 255
 			cb(81, "Cleaning up texture ...");
-			for (int y = 0; y<textH; ++y)
-			for (int x = 0; x<textW; ++x)
-			{
-				QRgb px = trgImgs[trgTexInd].pixel(x, y);
-				if (qAlpha(px) < 255 && (!pp || qAlpha(px) > 0))
-					trgImgs[trgTexInd].setPixel(x, y, px | 0xff000000);
-			}
+			TextureBaker::MakeOpaque(trgImgs[trgTexInd], pp);
 
 			// PullPush
 			if (pp)
@@ -1066,7 +1075,6 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
 		}
 
 		trgMesh->updateDataMask(MeshModel::MM_VERTCOLOR);
-		srcMesh->updateDataMask(MeshModel::MM_FACEMARK);
 
 		// the meshes have to be transformed
 		// only if source different from target (if single mesh, it does not matter)
@@ -1078,11 +1086,10 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
 				tri::UpdatePosition<CMeshO>::Matrix(trgMesh->cm, trgMesh->cm.Tr, true);
 		}
 
-		tri::UpdateNormal<CMeshO>::PerFaceNormalized(srcMesh->cm);
+		tri::ParallelUpdateNormal<CMeshO>::PerFaceNormalized(srcMesh->cm);
 		// Colorizing vertices
 		VertexSampler vs(srcMesh->cm, srcImgs, upperbound);
-		vs.InitCallback(cb, trgMesh->cm.vn);
-		tri::SurfaceSampling<CMeshO,VertexSampler>::VertexUniform(trgMesh->cm,vs,trgMesh->cm.vn);
+		TextureBaker::AllVertex(trgMesh->cm, vs, cb);
 
 		// the meshes have to return to their original position
 		// only if source different from target (if single mesh, it does not matter)
@@ -1093,8 +1100,6 @@ bool FilterTexturePlugin::applyFilter(QAction *filter, MeshDocument &md, RichPar
 			if (trgMesh->cm.Tr != Matrix44m::Identity())
 				tri::UpdatePosition<CMeshO>::Matrix(trgMesh->cm, Inverse(trgMesh->cm.Tr), true);
 		}
-
-		srcMesh->clearDataMask(MeshModel::MM_FACEMARK);
 	}
 	break;
 
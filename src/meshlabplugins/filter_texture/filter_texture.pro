@@ -4,6 +4,8 @@ HEADERS += \
     filter_texture.h \
     pushpull.h \
     rastering.h \
+    texture_baker.h \
+    parallel_atlas.h \
     $$VCGDIR/vcg/complex/algorithms/parametrization/voronoi_atlas.h
 
 SOURCES += \
@@ -0,0 +1,545 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef _PARALLEL_ATLAS_H
+#define _PARALLEL_ATLAS_H
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <common/ml_parallel_utils.h>
+#include <vcg/complex/algorithms/stat.h>
+#include <vcg/complex/algorithms/parametrization/voronoi_atlas.h>
+
+/*
+  Skyline packing of axis aligned rectangles in a strip of fixed width.
+
+  The skyline is the upper profile of what has been placed so far, stored
+  as a list of horizontal segments; every rectangle goes at the lowest (then
+  leftmost) place where it fits over it. Rectangles can be added in batches,
+  each batch is sorted by decreasing height before being placed, so that
+  charts can be packed as soon as they are ready.
+*/
+class SkylinePacker
+{
+public:
+    typedef vcg::Point2f Point2x;
+
+    explicit SkylinePacker(float width = 1) { Reset(width); }
+
+    void Reset(float width)
+    {
+        w = width;
+        h = 0;
+        sky.assign(1, Segment(0, 0, width));
+    }
+
+    float Width() const { return w; }
+    float Height() const { return h; }
+
+    /** Place the rectangles of the given sizes over the ones already packed;
+     * pos receives their lower left corners. The strip gets wider if a
+     * rectangle does not fit in its width.
+     */
+    void PackBatch(const std::vector<Point2x> &size, std::vector<Point2x> &pos)
+    {
+        std::vector<int> order(size.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = int(i);
+        std::stable_sort(order.begin(), order.end(), [&size](int a, int b) { return size[a][1] > size[b][1]; });
+        pos.resize(size.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            pos[order[i]] = Place(size[order[i]][0], size[order[i]][1]);
+    }
+
+private:
+    struct Segment
+    {
+        Segment(float _x, float _y, float _w) : x(_x), y(_y), w(_w) {}
+        float x, y, w;
+    };
+    std::vector<Segment> sky;
+    float w, h;
+
+    Point2x Place(float rw, float rh)
+    {
+        if (rw > w)
+        {
+            sky.push_back(Segment(w, 0, rw - w));
+            w = rw;
+        }
+        const float eps = w * 1e-6f;
+
+        // lowest top of the skyline under [x, x+rw) over all the segment starts
+        int best = 0;
+        float bestY = FLT_MAX;
+        for (size_t i = 0; i < sky.size() && sky[i].x + rw <= w + eps; ++i)
+        {
+            float y = 0;
+            for (size_t j = i; j < sky.size() && sky[j].x < sky[i].x + rw - eps && y < bestY; ++j)
+                y = std::max(y, sky[j].y);
+            if (y < bestY)
+            {
+                bestY = y;
+                best = int(i);
+            }
+        }
+
+        // the segments under the rectangle are replaced by its top side
+        const float x = sky[best].x;
+        const float xEnd = x + rw;
+        size_t last = best;
+        while (last < sky.size() && sky[last].x + sky[last].w <= xEnd + eps)
+            ++last;
+        if (last < sky.size() && sky[last].x < xEnd)
+        {
+            sky[last].w -= xEnd - sky[last].x;
+            sky[last].x = xEnd;
+        }
+        sky.erase(sky.begin() + best, sky.begin() + last);
+        sky.insert(sky.begin() + best, Segment(x, bestY + rh, rw));
+
+        // merge with the neighbours at the same height
+        if (size_t(best) + 1 < sky.size() && sky[best + 1].y == sky[best].y)
+        {
+            sky[best].w += sky[best + 1].w;
+            sky.erase(sky.begin() + best + 1);
+        }
+        if (best > 0 && sky[best - 1].y == sky[best].y)
+        {
+            sky[best - 1].w += sky[best].w;
+            sky.erase(sky.begin() + best);
+        }
+
+        h = std::max(h, bestY + rh);
+        return Point2x(x, bestY);
+    }
+};
+
+/*
+  Multithreaded version of tri::VoronoiAtlas<>::Build().
+
+  As there, the surface is split in geodesic Voronoi regions around Poisson
+  disk samples, each region that is a disk is parametrized with the Poisson
+  solver, and the faces of the regions that cannot be parametrized without
+  folds are partitioned again. Here the regions of a partition are extracted
+  and unwrapped in parallel, each in its own mesh, and the charts are scaled
+  to their surface area and packed with a skyline packer a partition at a
+  time, instead of with the polygon packer at the end.
+
+  After maxIterNum partitions the faces left become one chart each, so the
+  process always ends. For every chart the L2 and the maximum stretch
+  (Sander et al. 2001) are kept in charts and, if the output mesh has face
+  quality, the L2 stretch of its chart is stored in each face.
+*/
+template <class MeshType>
+class ParallelVoronoiAtlas
+{
+public:
+    typedef typename vcg::tri::VoronoiAtlas<MeshType>::VoroMesh VoroMesh;
+    typedef typename VoroMesh::VertexType VoroVertex;
+    typedef typename VoroMesh::VertexPointer VoroVertexPointer;
+    typedef typename VoroMesh::FaceType VoroFace;
+    typedef vcg::Point2f Point2x;
+
+    struct ChartStat
+    {
+        int faceNum;
+        float area;        // surface area, also the uv area of the chart
+        float l2Stretch;   // area weighted L2 stretch, 1 for an isometric map
+        float maxStretch;  // largest stretch of its faces
+    };
+
+    struct Param
+    {
+        Param() : sampleNum(10), overlap(false), maxIterNum(5), gutter(2.0f / 1024.0f),
+            iterNum(0), regionNum(0), samplingTime(0), voronoiTime(0), unwrapTime(0), packTime(0) {}
+
+        int sampleNum;
+        bool overlap;
+        int maxIterNum;
+        float gutter;       // empty space around each chart, about as a fraction of the atlas side
+
+        int iterNum;
+        int regionNum;
+        float samplingTime, voronoiTime, unwrapTime, packTime; // seconds
+        std::vector<ChartStat> charts;
+    };
+
+    static void Build(MeshType &startMesh, MeshType &paraMesh, Param &pp, vcg::CallBackPos *cb = 0)
+    {
+        pp.iterNum = pp.regionNum = 0;
+        pp.samplingTime = pp.voronoiTime = pp.unwrapTime = pp.packTime = 0;
+        pp.charts.clear();
+
+        VoroMesh *m = new VoroMesh();  // the mesh used for the processing is a copy of the passed one
+        vcg::tri::Append<VoroMesh, MeshType>::Mesh(*m, startMesh);
+        vcg::tri::Clean<VoroMesh>::RemoveUnreferencedVertex(*m);
+        vcg::tri::Allocator<VoroMesh>::CompactEveryVector(*m);
+        vcg::tri::UpdateTopology<VoroMesh>::VertexFace(*m);
+        const int totalFaces = std::max(m->fn, 1);
+
+        // the charts keep their surface area, so the width of the atlas is known from the start
+        const float side = std::sqrt(float(vcg::tri::Stat<VoroMesh>::ComputeMeshArea(*m)));
+        const float gutter = pp.gutter * side;
+        SkylinePacker packer(side * 1.1f);
+
+        std::vector<VoroMesh *> charts;
+        std::vector<Point2x> chartPos;
+        int sampleNum = pp.sampleNum;
+        while (m->fn > 0)
+        {
+            if (cb) cb(100 - int(100.0 * m->fn / totalFaces), "Building Voronoi atlas...");
+            const bool lastIter = pp.iterNum >= pp.maxIterNum;
+            std::vector< std::vector<int> > coreFaces;
+            if (lastIter)
+            {
+                coreFaces.resize(m->fn);
+                for (int i = 0; i < m->fn; ++i)
+                    coreFaces[i].push_back(i);
+            }
+            else
+                Partition(*m, sampleNum, pp, coreFaces);
+            ++pp.iterNum;
+
+            const Clock::time_point t0 = Clock::now();
+            const int regionNum = int(coreFaces.size());
+            std::vector<VoroMesh *> region(regionNum, (VoroMesh *)0);
+            std::vector<Point2x> size(regionNum);
+            std::vector<ChartStat> stat(regionNum);
+            std::vector<char> good(regionNum, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+            for (int r = 0; r < regionNum; ++r)
+            {
+                if (coreFaces[r].empty()) continue;
+                region[r] = ExtractRegion(*m, coreFaces[r], pp.overlap && !lastIter);
+                good[r] = lastIter ? FlattenTriangle(*region[r]) : Unwrap(*region[r]);
+                if (good[r])
+                    size[r] = Normalize(*region[r], stat[r]);
+                else
+                {
+                    delete region[r];
+                    region[r] = 0;
+                }
+            }
+            const Clock::time_point t1 = Clock::now();
+            pp.unwrapTime += Seconds(t0, t1);
+
+            // the good charts are packed as a batch, the faces of the others are partitioned again
+            std::vector<Point2x> batchSize, batchPos;
+            int badNum = 0;
+            vcg::tri::UpdateFlags<VoroMesh>::FaceClearS(*m);
+            for (int r = 0; r < regionNum; ++r)
+            {
+                if (good[r])
+                {
+                    charts.push_back(region[r]);
+                    pp.charts.push_back(stat[r]);
+                    batchSize.push_back(size[r] + Point2x(2 * gutter, 2 * gutter));
+                }
+                else if (!coreFaces[r].empty())
+                {
+                    ++badNum;
+                    for (size_t i = 0; i < coreFaces[r].size(); ++i)
+                        m->face[coreFaces[r][i]].SetS();
+                }
+            }
+            packer.PackBatch(batchSize, batchPos);
+            for (size_t i = 0; i < batchPos.size(); ++i)
+                chartPos.push_back(batchPos[i] + Point2x(gutter, gutter));
+            pp.packTime += Seconds(t1, Clock::now());
+
+            VoroMesh *rest = new VoroMesh();
+            if (badNum > 0)
+            {
+                vcg::tri::Append<VoroMesh, VoroMesh>::Mesh(*rest, *m, true);
+                vcg::tri::Allocator<VoroMesh>::CompactEveryVector(*rest);
+                vcg::tri::UpdateTopology<VoroMesh>::VertexFace(*rest);
+            }
+            delete m;
+            m = rest;
+            // every region that failed is split at least in two
+            sampleNum = std::max(2 * badNum, 2);
+        }
+        delete m;
+
+        // all the charts in the output mesh, scaled in the unit square
+        const int chartNum = int(charts.size());
+        const float scale = 1.0f / std::max(packer.Width(), packer.Height());
+        std::vector<int> vertOffset(chartNum + 1, 0), faceOffset(chartNum + 1, 0);
+        for (int c = 0; c < chartNum; ++c)
+        {
+            vertOffset[c] = charts[c]->vn;
+            faceOffset[c] = charts[c]->fn;
+        }
+        const int vertBase = int(paraMesh.vert.size());
+        const int faceBase = int(paraMesh.face.size());
+        const int vertTot = MLParallel::ExclusiveScan(vertOffset);
+        const int faceTot = MLParallel::ExclusiveScan(faceOffset);
+        if (vertTot > 0) vcg::tri::Allocator<MeshType>::AddVertices(paraMesh, vertTot);
+        if (faceTot > 0) vcg::tri::Allocator<MeshType>::AddFaces(paraMesh, faceTot);
+        const bool hasQuality = vcg::tri::HasPerFaceQuality(paraMesh);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int c = 0; c < chartNum; ++c)
+        {
+            VoroMesh &rm = *charts[c];
+            for (int i = 0; i < rm.vn; ++i)
+                paraMesh.vert[vertBase + vertOffset[c] + i].ImportData(rm.vert[i]);
+            for (int i = 0; i < rm.fn; ++i)
+            {
+                typename MeshType::FaceType &df = paraMesh.face[faceBase + faceOffset[c] + i];
+                df.ImportData(rm.face[i]);
+                for (int j = 0; j < 3; ++j)
+                {
+                    df.V(j) = &paraMesh.vert[vertBase + vertOffset[c] + vcg::tri::Index(rm, rm.face[i].cV(j))];
+                    const Point2x uv = (rm.face[i].cWT(j).P() + chartPos[c]) * scale;
+                    df.WT(j).U() = uv[0];
+                    df.WT(j).V() = uv[1];
+                    df.WT(j).N() = 0;
+                }
+                if (hasQuality) df.Q() = pp.charts[c].l2Stretch;
+            }
+            delete charts[c];
+        }
+        pp.regionNum = chartNum;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static float Seconds(const Clock::time_point &a, const Clock::time_point &b)
+    {
+        return std::chrono::duration<float>(b - a).count();
+    }
+
+    // Voronoi partition of m around sampleNum Poisson disk samples: the faces of each region
+    static void Partition(VoroMesh &m, int sampleNum, Param &pp, std::vector< std::vector<int> > &coreFaces)
+    {
+        const Clock::time_point t0 = Clock::now();
+        std::vector<vcg::Point3f> poissonSamples;
+        float diskRadius = 0;
+        vcg::tri::PoissonSampling(m, poissonSamples, sampleNum, diskRadius);
+        const Clock::time_point t1 = Clock::now();
+        pp.samplingTime += Seconds(t0, t1);
+
+        std::vector<VoroVertexPointer> seedVec;
+        vcg::tri::VoronoiProcessing<VoroMesh>::SeedToVertexConversion(m, poissonSamples, seedVec);
+        vcg::tri::UpdateTopology<VoroMesh>::VertexFace(m);
+        vcg::tri::VoronoiProcessing<VoroMesh>::ComputePerVertexSources(m, seedVec);
+        vcg::tri::VoronoiProcessing<VoroMesh>::FaceAssociateRegion(m);
+        pp.voronoiTime += Seconds(t1, Clock::now());
+
+        // the seed of each face, as left by FaceAssociateRegion
+        typename VoroMesh::template PerFaceAttributeHandle<VoroVertexPointer> sources =
+                vcg::tri::Allocator<VoroMesh>::template GetPerFaceAttribute<VoroVertexPointer>(m, "sources");
+        std::vector<int> seedRegion(m.vert.size(), -1);
+        for (size_t i = 0; i < seedVec.size(); ++i)
+            seedRegion[vcg::tri::Index(m, seedVec[i])] = int(i);
+
+        // faces not reached by any seed are gathered in an extra region
+        coreFaces.assign(seedVec.size() + 1, std::vector<int>());
+        for (int i = 0; i < int(m.face.size()); ++i)
+        {
+            const VoroVertexPointer s = sources[i];
+            const int r = s ? seedRegion[vcg::tri::Index(m, s)] : -1;
+            coreFaces[r >= 0 ? r : int(seedVec.size())].push_back(i);
+        }
+    }
+
+    // Copy of the given faces of m, with the ring of faces around them when overlapping.
+    static VoroMesh *ExtractRegion(VoroMesh &m, const std::vector<int> &core, bool overlap)
+    {
+        std::vector<int> faces(core);
+        if (overlap)
+        {
+            for (size_t i = 0; i < core.size(); ++i)
+                for (int j = 0; j < 3; ++j)
+                    for (vcg::face::VFIterator<VoroFace> vfi(m.face[core[i]].V(j)); !vfi.End(); ++vfi)
+                        faces.push_back(int(vcg::tri::Index(m, vfi.F())));
+            std::sort(faces.begin(), faces.end());
+            faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+        }
+        std::vector<int> verts;
+        verts.reserve(faces.size() * 3);
+        for (size_t i = 0; i < faces.size(); ++i)
+            for (int j = 0; j < 3; ++j)
+                verts.push_back(int(vcg::tri::Index(m, m.face[faces[i]].V(j))));
+        std::sort(verts.begin(), verts.end());
+        verts.erase(std::unique(verts.begin(), verts.end()), verts.end());
+
+        VoroMesh *rm = new VoroMesh();
+        vcg::tri::Allocator<VoroMesh>::AddVertices(*rm, int(verts.size()));
+        for (size_t i = 0; i < verts.size(); ++i)
+        {
+            rm->vert[i].ImportData(m.vert[verts[i]]);
+            rm->vert[i].Flags() = 0;
+        }
+        vcg::tri::Allocator<VoroMesh>::AddFaces(*rm, int(faces.size()));
+        for (size_t i = 0; i < faces.size(); ++i)
+        {
+            rm->face[i].ImportData(m.face[faces[i]]);
+            rm->face[i].Flags() = 0;
+            for (int j = 0; j < 3; ++j)
+            {
+                const int v = int(vcg::tri::Index(m, m.face[faces[i]].V(j)));
+                rm->face[i].V(j) = &rm->vert[std::lower_bound(verts.begin(), verts.end(), v) - verts.begin()];
+            }
+        }
+        return rm;
+    }
+
+    // Harmonic parametrization of a disk-like region, false if it is not a disk or it folds.
+    static bool Unwrap(VoroMesh &rm)
+    {
+        vcg::tri::UpdateTopology<VoroMesh>::FaceFace(rm);
+        vcg::tri::UpdateTopology<VoroMesh>::VertexFace(rm);
+        vcg::tri::PoissonSolver<VoroMesh> PS(rm);
+        if (!PS.IsFeasible())
+            return false;
+        PS.Init();
+        PS.FixDefaultVertices();
+        PS.SolvePoisson(false);
+        vcg::tri::UpdateTexture<VoroMesh>::WedgeTexFromVertexTex(rm);
+
+        // all the faces must keep the same orientation in uv
+        int pos = 0, neg = 0;
+        for (int i = 0; i < rm.fn; ++i)
+        {
+            const float a = UVDoubleArea(rm.face[i]);
+            if (a > 0) ++pos;
+            else if (a < 0) ++neg;
+            else return false;
+        }
+        if (pos > 0 && neg > 0)
+            return false;
+        if (neg > 0)
+            for (int i = 0; i < rm.fn; ++i)
+                for (int j = 0; j < 3; ++j)
+                    rm.face[i].WT(j).U() = -rm.face[i].WT(j).U();
+        return true;
+    }
+
+    // Isometric parametrization of a region made of a single face.
+    static bool FlattenTriangle(VoroMesh &rm)
+    {
+        VoroFace &f = rm.face[0];
+        const vcg::Point3f e1 = f.cP(1) - f.cP(0);
+        const vcg::Point3f e2 = f.cP(2) - f.cP(0);
+        const float l1 = e1.Norm();
+        const float u2 = l1 > 0 ? (e1 * e2) / l1 : 0;
+        const float v2 = std::sqrt(std::max(e2.SquaredNorm() - u2 * u2, 0.0f));
+        f.WT(0).P() = Point2x(0, 0);
+        f.WT(1).P() = Point2x(l1, 0);
+        f.WT(2).P() = Point2x(u2, v2);
+        return true;
+    }
+
+    static float UVDoubleArea(const VoroFace &f)
+    {
+        const Point2x a = f.cWT(1).P() - f.cWT(0).P();
+        const Point2x b = f.cWT(2).P() - f.cWT(0).P();
+        return a[0] * b[1] - a[1] * b[0];
+    }
+
+    /* Scale the chart to its surface area, align it to its principal axes
+     * with the longest side along u and move it to the origin; returns its
+     * size and fills its stretch statistics.
+     */
+    static Point2x Normalize(VoroMesh &rm, ChartStat &stat)
+    {
+        float area3D = 0, areaUV = 0;
+        for (int i = 0; i < rm.fn; ++i)
+        {
+            area3D += vcg::DoubleArea(rm.face[i]) / 2;
+            areaUV += UVDoubleArea(rm.face[i]) / 2;
+        }
+        const float s = (areaUV > 0 && area3D > 0) ? std::sqrt(area3D / areaUV) : 1.0f;
+
+        // principal direction of the wedge coords
+        Point2x bar(0, 0);
+        for (int i = 0; i < rm.fn; ++i)
+            for (int j = 0; j < 3; ++j)
+                bar += rm.face[i].cWT(j).P();
+        bar /= float(3 * rm.fn);
+        float cxx = 0, cxy = 0, cyy = 0;
+        for (int i = 0; i < rm.fn; ++i)
+            for (int j = 0; j < 3; ++j)
+            {
+                const Point2x d = rm.face[i].cWT(j).P() - bar;
+                cxx += d[0] * d[0];
+                cxy += d[0] * d[1];
+                cyy += d[1] * d[1];
+            }
+        const float angle = 0.5f * std::atan2(2 * cxy, cxx - cyy);
+        const float ca = std::cos(angle) * s, sa = std::sin(angle) * s;
+
+        vcg::Box2f bb;
+        for (int i = 0; i < rm.fn; ++i)
+            for (int j = 0; j < 3; ++j)
+            {
+                const Point2x d = rm.face[i].cWT(j).P() - bar;
+                rm.face[i].WT(j).P() = Point2x(ca * d[0] + sa * d[1], -sa * d[0] + ca * d[1]);
+                bb.Add(rm.face[i].cWT(j).P());
+            }
+        // longest side along u, keeping the orientation of the faces
+        const bool swap = bb.DimY() > bb.DimX();
+        for (int i = 0; i < rm.fn; ++i)
+            for (int j = 0; j < 3; ++j)
+            {
+                const Point2x p = rm.face[i].cWT(j).P();
+                rm.face[i].WT(j).P() = swap ? Point2x(bb.max[1] - p[1], p[0] - bb.min[0]) : p - bb.min;
+            }
+
+        stat.faceNum = rm.fn;
+        stat.area = area3D;
+        Stretch(rm, stat);
+        return swap ? Point2x(bb.DimY(), bb.DimX()) : Point2x(bb.DimX(), bb.DimY());
+    }
+
+    static void Stretch(const VoroMesh &rm, ChartStat &stat)
+    {
+        double l2 = 0, weight = 0;
+        float maxStretch = 0;
+        for (int i = 0; i < rm.fn; ++i)
+        {
+            const VoroFace &f = rm.face[i];
+            const float a = UVDoubleArea(f);
+            if (a <= 0) continue;
+            const float s1 = f.cWT(0).U(), s2 = f.cWT(1).U(), s3 = f.cWT(2).U();
+            const float t1 = f.cWT(0).V(), t2 = f.cWT(1).V(), t3 = f.cWT(2).V();
+            const vcg::Point3f Ss = (f.cP(0) * (t2 - t3) + f.cP(1) * (t3 - t1) + f.cP(2) * (t1 - t2)) / a;
+            const vcg::Point3f St = (f.cP(0) * (s3 - s2) + f.cP(1) * (s1 - s3) + f.cP(2) * (s2 - s1)) / a;
+            const float ss = Ss * Ss, st = Ss * St, tt = St * St;
+            const float w = vcg::DoubleArea(f);
+            l2 += 0.5 * (ss + tt) * w;
+            weight += w;
+            maxStretch = std::max(maxStretch, std::sqrt(0.5f * (ss + tt + std::sqrt((ss - tt) * (ss - tt) + 4 * st * st))));
+        }
+        stat.l2Stretch = weight > 0 ? float(std::sqrt(l2 / weight)) : 1.0f;
+        stat.maxStretch = maxStretch;
+    }
+};
+
+#endif
@@ -24,6 +24,8 @@
 #ifndef _PUSHPULL_H
 #define _PUSHPULL_H
 
+#include <vector>
+
 typedef unsigned char byte;
 
 
@@ -49,26 +51,41 @@ namespace vcg
 
     }
 
+    // The mipmaps are built and refilled one row per thread, reading and
+    // writing the ARGB32 texels directly through the scanline pointers.
+    inline std::vector<QRgb *> PullPushRows( QImage & img )
+    {
+        assert(img.format()==QImage::Format_ARGB32);
+        std::vector<QRgb *> rows(img.height());
+        for(int y=0;y<img.height();++y)
+            rows[y] = reinterpret_cast<QRgb *>(img.scanLine(y));
+        return rows;
+    }
+
     // Genera una mipmap pesata
     void PullPushMip( QImage & p, QImage & mip, QRgb  bkcolor )
     {
         assert(p.width()/2==mip.width());
         assert(p.height()/2==mip.height());
-        byte w1,w2,w3,w4;
-        int x,y;
-        for(y=0;y<mip.height();++y)
-            for(x=0;x<mip.width();++x)
+        const std::vector<QRgb *> pr = PullPushRows(p);
+        const std::vector<QRgb *> mr = PullPushRows(mip);
+        const int mw = mip.width();
+        const int mh = mip.height();
+#pragma omp parallel for schedule(static)
+        for(int y=0;y<mh;++y)
+            for(int x=0;x<mw;++x)
             {
-                if(p.pixel(x*2  ,y*2  )==bkcolor) w1=0; else w1=255;
-                if(p.pixel(x*2+1,y*2  )==bkcolor) w2=0; else w2=255;
-                if(p.pixel(x*2  ,y*2+1)==bkcolor) w3=0; else w3=255;
-                if(p.pixel(x*2+1,y*2+1)==bkcolor) w4=0; else w4=255;
+                byte w1,w2,w3,w4;
+                const QRgb p1 = pr[y*2  ][x*2  ];
+                const QRgb p2 = pr[y*2  ][x*2+1];
+                const QRgb p3 = pr[y*2+1][x*2  ];
+                const QRgb p4 = pr[y*2+1][x*2+1];
+                if(p1==bkcolor) w1=0; else w1=255;
+                if(p2==bkcolor) w2=0; else w2=255;
+                if(p3==bkcolor) w3=0; else w3=255;
+                if(p4==bkcolor) w4=0; else w4=255;
                 if(w1+w2+w3+w4>0        )
-                    mip.setPixel(x, y, mean4Pixelw(
-                                                   p.pixel(x*2  ,y*2  ),w1,
-                                                   p.pixel(x*2+1,y*2  ),w2,
-                                                   p.pixel(x*2  ,y*2+1),w3,
-                                                   p.pixel(x*2+1,y*2+1),w4 ));
+                    mr[y][x] = mean4Pixelw(p1,w1,p2,w2,p3,w3,p4,w4);
             }
     }
 
@@ -77,31 +94,34 @@ namespace vcg
     {
         assert(p.width()/2==mip.width());
         assert(p.height()/2==mip.height());
-        //      byte w1,w2,w3,w4;
-        int x,y;
-        for(y=0;y<mip.height();++y)
-            for(x=0;x<mip.width();++x)
+        const std::vector<QRgb *> pr = PullPushRows(p);
+        const std::vector<QRgb *> mr = PullPushRows(mip);
+        const int mw = mip.width();
+        const int mh = mip.height();
+#pragma omp parallel for schedule(static)
+        for(int y=0;y<mh;++y)
+            for(int x=0;x<mw;++x)
             {
-                if(p.pixel(x*2 ,y*2)==bkg)
-                    p.setPixel(x*2 ,y*2 ,mean4Pixelw( mip.pixel(x  ,y  ) ,  byte(144),
-                                                     (x>0 ? mip.pixel(x-1,y  ) : bkg),  (x>0 ? byte( 48) : 0),
-                                                     (y>0 ? mip.pixel(x  ,y-1) : bkg),  (y>0 ? byte( 48) : 0),
-                                                     ((x>0 && y>0 )? mip.pixel(x-1,y-1) : bkg), ((x>0 && y>0 )? byte( 16) : 0)));
-                if(p.pixel(x*2+1,y*2  )==bkg)
-                    p.setPixel(x*2+1,y*2  ,mean4Pixelw(mip.pixel(x  ,y  ) ,byte(144),
-                                                       (x<mip.width()-1 ? mip.pixel(x+1,y) : bkg),  (x<mip.width()-1 ? byte( 48) : 0),
-                                                       (y>0  ? mip.pixel(x  ,y-1) : bkg),  (y>0  ? byte( 48) : 0),
-                                                       ((x<mip.width()-1 && y>0) ? mip.pixel(x+1,y-1) : bkg), ((x<mip.width()-1 && y>0) ? byte( 16) : 0)));
-                if(p.pixel(x*2  ,y*2+1)==bkg)
-                    p.setPixel(x*2  ,y*2+1, mean4Pixelw( mip.pixel(x  ,y  ), byte(144),
-                                                        (x>0 ? mip.pixel(x-1,y  ) : bkg),  (x>0 ? byte( 48) : 0),
-                                                        (y<mip.height()-1  ? mip.pixel(x  ,y+1) : bkg),  (y<mip.height()-1  ? byte( 48) : 0),
-                                                        ((x>0 && y<mip.height()-1) ? mip.pixel(x-1,y+1) : bkg), ((x>0 && y<mip.height()-1 )? byte( 16) : 0)));
-                if(p.pixel(x*2+1,y*2+1)==bkg)
-                    p.setPixel(x*2+1,y*2+1, mean4Pixelw(mip.pixel(x  ,y  ), byte(144),
-                                                        (x<mip.width()-1 ? mip.pixel(x+1,y  ) : bkg), (x<mip.width()-1 ? byte( 48) : 0),
-                                                        (y<mip.height()-1  ? mip.pixel(x  ,y+1) : bkg), ( y<mip.height()-1  ? byte( 48) : 0),
-                                                        ((x<mip.width()-1  && y<mip.height()-1) ? mip.pixel(x+1,y+1) : bkg), ((x<mip.width()-1  && y<mip.height()-1) ? byte( 16) : 0)));
+                if(pr[y*2  ][x*2  ]==bkg)
+                    pr[y*2  ][x*2  ] = mean4Pixelw( mr[y][x] ,  byte(144),
+                                                     (x>0 ? mr[y][x-1] : bkg),  (x>0 ? byte( 48) : 0),
+                                                     (y>0 ? mr[y-1][x] : bkg),  (y>0 ? byte( 48) : 0),
+                                                     ((x>0 && y>0 )? mr[y-1][x-1] : bkg), ((x>0 && y>0 )? byte( 16) : 0));
+                if(pr[y*2  ][x*2+1]==bkg)
+                    pr[y*2  ][x*2+1] = mean4Pixelw(mr[y][x] ,byte(144),
+                                                       (x<mw-1 ? mr[y][x+1] : bkg),  (x<mw-1 ? byte( 48) : 0),
+                                                       (y>0  ? mr[y-1][x] : bkg),  (y>0  ? byte( 48) : 0),
+                                                       ((x<mw-1 && y>0) ? mr[y-1][x+1] : bkg), ((x<mw-1 && y>0) ? byte( 16) : 0));
+                if(pr[y*2+1][x*2  ]==bkg)
+                    pr[y*2+1][x*2  ] = mean4Pixelw( mr[y][x], byte(144),
+                                                        (x>0 ? mr[y][x-1] : bkg),  (x>0 ? byte( 48) : 0),
+                                                        (y<mh-1  ? mr[y+1][x] : bkg),  (y<mh-1  ? byte( 48) : 0),
+                                                        ((x>0 && y<mh-1) ? mr[y+1][x-1] : bkg), ((x>0 && y<mh-1 )? byte( 16) : 0));
+                if(pr[y*2+1][x*2+1]==bkg)
+                    pr[y*2+1][x*2+1] = mean4Pixelw(mr[y][x], byte(144),
+                                                        (x<mw-1 ? mr[y][x+1] : bkg), (x<mw-1 ? byte( 48) : 0),
+                                                        (y<mh-1  ? mr[y+1][x] : bkg), ( y<mh-1  ? byte( 48) : 0),
+                                                        ((x<mw-1  && y<mh-1) ? mr[y+1][x+1] : bkg), ((x<mw-1  && y<mh-1) ? byte( 16) : 0));
 
             }
     }
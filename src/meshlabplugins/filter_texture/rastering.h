@@ -28,46 +28,68 @@
 #include <vcg/complex/algorithms/point_sampling.h>
 #include <vcg/space/triangle2.h>
 
+/*
+  Direct access to the texels of a set of images. The scanline pointers are
+  taken once, so that the samplers can read and write the texels from many
+  threads without going through QImage::pixel()/setPixel(), which are neither
+  cheap nor safe to be called concurrently. The images are converted to
+  ARGB32 if needed and must not be touched while the TexelBuffer is in use.
+*/
+class TexelBuffer
+{
+    vector< vector<QRgb *> > rows;
+
+public:
+    TexelBuffer() {}
+    TexelBuffer(vector<QImage> &imgs) : rows(imgs.size())
+    {
+        for (size_t i = 0; i < imgs.size(); ++i)
+        {
+            if (imgs[i].format() != QImage::Format_ARGB32)
+                imgs[i] = imgs[i].convertToFormat(QImage::Format_ARGB32);
+            rows[i].resize(imgs[i].height());
+            for (int y = 0; y < imgs[i].height(); ++y)
+                rows[i][y] = reinterpret_cast<QRgb *>(imgs[i].scanLine(y));
+        }
+    }
+
+    int size() const { return int(rows.size()); }
+    int Height(int i) const { return int(rows[i].size()); }
+
+    QRgb &Texel(int i, int x, int y) { return rows[i][y][x]; }
+    QRgb Texel(int i, int x, int y) const { return rows[i][y][x]; }
+};
+
+/*
+  The samplers below are fed by TextureBaker (texture_baker.h) from many
+  threads at the same time: all their state is read only after construction,
+  the closest point queries use an empty marker instead of the (shared) per
+  face marks, and each texel is written by a single thread.
+*/
 class VertexSampler
 {
     typedef vcg::GridStaticPtr<CMeshO::FaceType, CMeshO::ScalarType > MetroMeshGrid;
-    typedef vcg::tri::FaceTmark<CMeshO> MarkerFace;
+    typedef vcg::tri::EmptyTMark<CMeshO> MarkerFace;
 
     CMeshO &srcMesh;
     vector <QImage> &srcImgs;
+    TexelBuffer srcTexels;
     float dist_upper_bound;
 
     MetroMeshGrid unifGridFace;
-    MarkerFace markerFunctor;
     vcg::face::PointDistanceBaseFunctor<CMeshO::ScalarType> PDistFunct;
 
-    // Callback stuff
-    vcg::CallBackPos *cb;
-    int vertexNo, vertexCnt, start, offset;
-
 public:
 	VertexSampler(CMeshO &_srcMesh, vector <QImage> &_srcImg, float upperBound) :
-    srcMesh(_srcMesh), srcImgs(_srcImg), dist_upper_bound(upperBound)
+    srcMesh(_srcMesh), srcImgs(_srcImg), srcTexels(_srcImg), dist_upper_bound(upperBound)
     {
         unifGridFace.Set(_srcMesh.face.begin(),_srcMesh.face.end());
-        markerFunctor.SetMesh(&_srcMesh);
-    }
-
-    void InitCallback(vcg::CallBackPos *_cb, int _vertexNo, int _start=0, int _offset=100)
-    {
-        assert(_vertexNo > 0);
-        assert(_start>=0);
-        assert(_offset>=0 && _offset <= 100-_start);
-        cb = _cb;
-        vertexNo = _vertexNo;
-        vertexCnt = 0;
-        start = _start;
-        offset = _offset;
     }
 
     void AddVert(CMeshO::VertexType &v)
     {
         // Get Closest point
+        MarkerFace markerFunctor;
         CMeshO::CoordType closestPt;
         CMeshO::ScalarType dist=dist_upper_bound;
         CMeshO::FaceType *nearestF;
@@ -91,7 +113,7 @@ public:
                 // repeat mode
                 x = (x%w + w) % w;
                 y = (y%h + h) % h;
-                QRgb px = srcImgs[tIndex].pixel(x, y);
+                QRgb px = srcTexels.Texel(tIndex, x, y);
                 v.C() = CMeshO::VertexType::ColorType(qRed(px), qGreen(px), qBlue(px), 255);
             }
             else
@@ -104,51 +126,25 @@ public:
 
 class RasterSampler
 {
-    vector<QImage> &trgImgs;
-
-    // Callback stuff
-    vcg::CallBackPos *cb;
-    const CMeshO::FaceType *currFace;
-    int faceNo, faceCnt, start, offset;
+    TexelBuffer trgTexels;
 
 public:
-	RasterSampler(vector<QImage> &_imgs) : trgImgs(_imgs) {}
-
-    void InitCallback(vcg::CallBackPos *_cb, int _faceNo, int _start=0, int _offset=100)
-    {
-        assert(_faceNo > 0);
-        assert(_start>=0);
-        assert(_offset>=0 && _offset <= 100-_start);
-        cb = _cb;
-        faceNo = _faceNo;
-        faceCnt = 0;
-        start = _start;
-        offset = _offset;
-        currFace = NULL;
-    }
+	RasterSampler(vector<QImage> &_imgs) : trgTexels(_imgs) {}
 
         // expects points outside face (affecting face color) with edge distance > 0
     void AddTextureSample(const CMeshO::FaceType &f, const CMeshO::CoordType &p, const vcg::Point2i &tp, float edgeDist= 0.0)
     {
         CMeshO::VertexType::ColorType c;
-        /*int alpha = 255;
-        if (fabs(p[0]+p[1]+p[2]-1)>=0.00001)
-            if (p[0] <.0) {alpha = 254+p[0]*128; bary[0] = 0.;} else
-                if (p[1] <.0) {alpha = 254+p[1]*128; bary[1] = 0.;} else
-                    if (p[2] <.0) {alpha = 254+p[2]*128; bary[2] = 0.;}*/
         int alpha = 255;
         if (edgeDist != 0.0)
             alpha=254-edgeDist*128;
 
-		if (alpha == 255 || qAlpha(trgImgs[f.cWT(0).N()].pixel(tp.X(), trgImgs[f.cWT(0).N()].height() - 1 - tp.Y())) < alpha)
+        const int ti = f.cWT(0).N();
+        QRgb &texel = trgTexels.Texel(ti, tp.X(), trgTexels.Height(ti) - 1 - tp.Y());
+        if (alpha == 255 || qAlpha(texel) < alpha)
         {
             c.lerp(f.cV(0)->cC(), f.cV(1)->cC(), f.cV(2)->cC(), p);
-			trgImgs[f.cWT(0).N()].setPixel(tp.X(), trgImgs[f.cWT(0).N()].height() - 1 - tp.Y(), qRgba(c[0], c[1], c[2], alpha));
-        }
-        if (cb)
-        {
-            if (&f != currFace) {currFace = &f; ++faceCnt;}
-            cb(start + faceCnt*offset/faceNo, "Rasterizing faces ...");
+            texel = qRgba(c[0], c[1], c[2], alpha);
         }
     }
 };
@@ -158,63 +154,26 @@ class TransferColorSampler
     typedef vcg::GridStaticPtr<CMeshO::FaceType, CMeshO::ScalarType > MetroMeshGrid;
     typedef vcg::GridStaticPtr<CMeshO::VertexType, CMeshO::ScalarType > VertexMeshGrid;
 
-    vector <QImage> &trgImgs;
+    TexelBuffer trgTexels;
 	vector <QImage> *srcImgs;
+    TexelBuffer srcTexels;
     float dist_upper_bound;
     bool fromTexture;
     MetroMeshGrid unifGridFace;
     VertexMeshGrid   unifGridVert;
     bool usePointCloudSampling;
 
-    // Callback stuff
-    vcg::CallBackPos *cb;
-    const CMeshO::FaceType *currFace;
-    CMeshO *srcMesh;
-    int faceNo, faceCnt, start, offset;
     int vertexMode;
     float minQ,maxQ;
-    typedef vcg::tri::FaceTmark<CMeshO> MarkerFace;
-    MarkerFace markerFunctor;
-
-    /*QRgb GetBilinearPixelColor(float _u, float _v, int alpha)
-    {
-        int w = srcImg->width();
-        int h = srcImg->height();
-        QRgb p00, p01, p10, p11;
-        float u = _u * w -0.5;
-        float v = _v * h -0.5;
-        int x = floor(u);
-        int y = floor(v);
-        float u_ratio = u - x;
-        float v_ratio = v - y;
-        x = (x%w + w)%w;
-        y = (y%h + h)%h;
-        float u_opposite = 1 - u_ratio;
-        float v_opposite = 1 - v_ratio;
-
-        p00 = srcImg->pixel(x,y);
-        p01 = srcImg->pixel(x, (y+1)%h);
-        p10 = srcImg->pixel((x+1)%w, y);
-        p11 = srcImg->pixel((x+1)%w, (y+1)%h);
-        int r,g,b;
-        r = (qRed(p00)*u_opposite+qRed(p01)*u_ratio)*v_opposite +
-            (qRed(p01)*u_opposite+qRed(p11)*u_ratio)*v_ratio;
-        g = (qGreen(p00)*u_opposite+qGreen(p01)*u_ratio)*v_opposite +
-            (qGreen(p01)*u_opposite+qGreen(p11)*u_ratio)*v_ratio;
-        b = (qBlue(p00)*u_opposite+qBlue(p01)*u_ratio)*v_opposite +
-            (qBlue(p01)*u_opposite+qBlue(p11)*u_ratio)*v_ratio;
-        return qRgba(r,g,b, alpha);
-    }*/
+    typedef vcg::tri::EmptyTMark<CMeshO> MarkerFace;
 
 public:
     TransferColorSampler(CMeshO &_srcMesh, vector <QImage> &_trgImgs, float upperBound, int _vertexMode)
-    : trgImgs(_trgImgs), dist_upper_bound(upperBound)
+    : trgTexels(_trgImgs), srcImgs(NULL), dist_upper_bound(upperBound)
     {
-        srcMesh=&_srcMesh;
         usePointCloudSampling = _srcMesh.face.empty();
         if(usePointCloudSampling) unifGridVert.Set(_srcMesh.vert.begin(),_srcMesh.vert.end());
                         else  unifGridFace.Set(_srcMesh.face.begin(),_srcMesh.face.end());
-        markerFunctor.SetMesh(&_srcMesh);
         fromTexture = false;
         vertexMode=_vertexMode;
         if(vertexMode==2)
@@ -226,42 +185,25 @@ public:
     }
 
 	TransferColorSampler(CMeshO &_srcMesh, vector <QImage> &_trgImgs, vector <QImage> *_srcImgs, float upperBound)
-		: trgImgs(_trgImgs), srcImgs(_srcImgs), dist_upper_bound(upperBound)
+		: trgTexels(_trgImgs), srcImgs(_srcImgs), srcTexels(*_srcImgs), dist_upper_bound(upperBound)
     {
         unifGridFace.Set(_srcMesh.face.begin(),_srcMesh.face.end());
-        markerFunctor.SetMesh(&_srcMesh);
         fromTexture = true;
         usePointCloudSampling=false;
         vertexMode=-1;
     }
-    void InitCallback(vcg::CallBackPos *_cb, int _faceNo, int _start=0, int _offset=100)
-    {
-        assert(_faceNo > 0);
-        assert(_start>=0);
-        assert(_offset>=0 && _offset <= 100-_start);
-        cb = _cb;
-        faceNo = _faceNo;
-        faceCnt = 0;
-        start = _start;
-        offset = _offset;
-        currFace = NULL;
-    }
 
     void AddTextureSample(const CMeshO::FaceType &f, const CMeshO::CoordType &p, const vcg::Point2i &tp, float edgeDist=0.0)
     {
-        // Calculate correct barycentric coords
-        /*CMeshO::CoordType bary = p;
-        int alpha = 255;
-        if (fabs(p[0]+p[1]+p[2]-1)>=0.00001)
-            if (p[0] <.0) {alpha = 254+p[0]*128; bary[0] = 0.;} else
-                if (p[1] <.0) {alpha = 254+p[1]*128; bary[1] = 0.;} else
-                    if (p[2] <.0) {alpha = 254+p[2]*128; bary[2] = 0.;}*/
         int rr=0,gg=0,bb=0;
         CMeshO::CoordType bary = p;
         int alpha = 255;
         if (edgeDist != 0.0)
             alpha=254-edgeDist*128;
 
+        const int ti = f.cWT(0).N();
+        QRgb &texel = trgTexels.Texel(ti, tp.X(), trgTexels.Height(ti) - 1 - tp.Y());
+
         // Get point on face
         CMeshO::CoordType startPt;
         startPt[0] = bary[0]*f.cV(0)->cP().X()+bary[1]*f.cV(1)->cP().X()+bary[2]*f.cV(2)->cP().X();
@@ -269,14 +211,15 @@ public:
         startPt[2] = bary[0]*f.cV(0)->cP().Z()+bary[1]*f.cV(1)->cP().Z()+bary[2]*f.cV(2)->cP().Z();
 
         // Retrieve closest point on source mesh
+        MarkerFace markerFunctor;
 
         if(usePointCloudSampling)
         {
             CMeshO::VertexType   *nearestV=0;
+            vcg::vertex::PointDistanceFunctor<CMeshO::ScalarType> VDistFunct;
+            CMeshO::CoordType closestPt;
             CMeshO::ScalarType dist=dist_upper_bound;
-            nearestV =  vcg::tri::GetClosestVertex<CMeshO,VertexMeshGrid>(*srcMesh,unifGridVert,startPt,dist_upper_bound,dist); //(PDistFunct,markerFunctor,startPt,dist_upper_bound,dist,closestPt);
-        //if(cb) cb(sampleCnt++*100/sampleNum,"Resampling Vertex attributes");
-            //if(storeDistanceAsQualityFlag)  p.Q() = dist;
+            nearestV =  unifGridVert.GetClosest(VDistFunct, markerFunctor, startPt, dist_upper_bound, dist, closestPt);
             if(dist == dist_upper_bound) return ;
 
             switch(vertexMode)
@@ -299,7 +242,7 @@ public:
                     rr = gg = bb = q;
                 } break;
             }
-			trgImgs[f.cWT(0).N()].setPixel(tp.X(), trgImgs[f.cWT(0).N()].height() - 1 - tp.Y(), qRgba(rr, gg, bb, 255));
+            texel = qRgba(rr, gg, bb, 255);
         }
         else // sampling from a mesh
         {
@@ -331,7 +274,7 @@ public:
               interp[2]=1.0-interp[1]-interp[0];
             }
 
-		if (alpha == 255 || qAlpha(trgImgs[f.cWT(0).N()].pixel(tp.X(), trgImgs[f.cWT(0).N()].height() - 1 - tp.Y())) < alpha)
+		if (alpha == 255 || qAlpha(texel) < alpha)
         {
             if (fromTexture)
             {
@@ -342,8 +285,8 @@ public:
                 // texture repeat mode
                 x = (x%w + w)%w;
                 y = (y%h + h)%h;
-				QRgb px = (*srcImgs)[nearestF->cWT(0).N()].pixel(x, y);
-				trgImgs[f.cWT(0).N()].setPixel(tp.X(), trgImgs[f.cWT(0).N()].height() - 1 - tp.Y(), qRgba(qRed(px), qGreen(px), qBlue(px), alpha));
+				QRgb px = srcTexels.Texel(nearestF->cWT(0).N(), x, y);
+				texel = qRgba(qRed(px), qGreen(px), qBlue(px), alpha);
             }
             else
             {
@@ -370,14 +313,9 @@ public:
                 } break;
                 default: assert(0);
                 }
-				trgImgs[f.cWT(0).N()].setPixel(tp.X(), trgImgs[f.cWT(0).N()].height() - 1 - tp.Y(), qRgba(c[0], c[1], c[2], alpha));
+				texel = qRgba(c[0], c[1], c[2], alpha);
             }
         }
-            if (cb)
-            {
-                if (&f != currFace) {currFace = &f; ++faceCnt;}
-                cb(start + faceCnt*offset/faceNo, "Rasterizing faces ...");
-            }
         }
     }
 };
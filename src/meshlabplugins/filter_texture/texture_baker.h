@@ -0,0 +1,309 @@
+/****************************************************************************
+* MeshLab                                                           o o     *
+* A versatile mesh processing toolbox                             o     o   *
+*                                                                _   O  _   *
+* Copyright(C) 2005                                                \/)\/    *
+* Visual Computing Lab                                            /\/|      *
+* ISTI - Italian National Research Council                           |      *
+*                                                                    \      *
+* All rights reserved.                                                      *
+*                                                                           *
+* This program is free software; you can redistribute it and/or modify      *
+* it under the terms of the GNU General Public License as published by      *
+* the Free Software Foundation; either version 2 of the License, or         *
+* (at your option) any later version.                                       *
+*                                                                           *
+* This program is distributed in the hope that it will be useful,           *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+* GNU General Public License (http://www.gnu.org/licenses/gpl.txt)          *
+* for more details.                                                         *
+*                                                                           *
+****************************************************************************/
+
+#ifndef _TEXTURE_BAKER_H
+#define _TEXTURE_BAKER_H
+
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <common/ml_parallel_utils.h>
+#include <vcg/space/segment2.h>
+#include <vcg/space/distance2.h>
+#include "rastering.h"
+
+/*
+  Multithreaded replacement of tri::SurfaceSampling<>::Texture() and
+  tri::SurfaceSampling<>::AllVertex() for the samplers of rastering.h.
+
+  The texture space is split in square tiles of TileSize texels and the faces
+  are binned in the tiles their (enlarged) texel bounding box overlaps. Each
+  tile is then rasterized by a single thread, clipping the faces to the tile,
+  so every texel is written by one thread only, and always by the faces in
+  increasing index order, as in the serial rasterization. Faces larger than a
+  tile are simply rasterized a piece at a time by many threads.
+*/
+class TextureBaker
+{
+public:
+    typedef CMeshO::ScalarType ScalarType;
+    typedef vcg::Point2<ScalarType> Point2x;
+
+    static const int TileSize = 128;
+
+    /** Rasterize all the faces of m on the textures m.textures, as
+     * SurfaceSampling<>::Texture does. Faces whose texture index does not refer
+     * to one of the textures of the mesh are skipped. The sampler is shared by
+     * all the threads.
+     */
+    template <class Sampler>
+    static void Texture(CMeshO &m, Sampler &ps, int textureWidth, int textureHeight, bool correctSafePointsBaryCoords = true,
+                        vcg::CallBackPos *cb = 0, int start = 0, int offset = 100)
+    {
+        const int texNum = int(m.textures.size());
+        const int tilesX = (textureWidth + TileSize - 1) / TileSize;
+        const int tilesY = (textureHeight + TileSize - 1) / TileSize;
+        const int tilesPerTex = tilesX * tilesY;
+        const int tileNum = texNum * tilesPerTex;
+        const int faceNum = int(m.face.size());
+        if (tileNum == 0) return;
+
+        // Binning: a counting sort where each chunk of faces gets its own slots
+        // in every tile, so that the faces of a tile stay sorted by index.
+        const int chunkNum = (faceNum < MLParallel::MinParallelSize) ? 1 : MLParallel::ThreadNum();
+        const std::vector<int> bnd = MLParallel::Chunks(faceNum, chunkNum);
+        std::vector<int> slot(size_t(chunkNum) * tileNum, 0);
+#pragma omp parallel for schedule(static, 1)
+        for (int c = 0; c < chunkNum; ++c)
+        {
+            int *cnt = &slot[size_t(c) * tileNum];
+            for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+            {
+                vcg::Box2i r;
+                if (!TexelRange(m.face[i], texNum, textureWidth, textureHeight, r)) continue;
+                const int base = m.face[i].cWT(0).N() * tilesPerTex;
+                for (int ty = r.min[1] / TileSize; ty <= r.max[1] / TileSize; ++ty)
+                    for (int tx = r.min[0] / TileSize; tx <= r.max[0] / TileSize; ++tx)
+                        ++cnt[base + ty * tilesX + tx];
+            }
+        }
+        std::vector<int> tileOffset(tileNum + 1);
+        int total = 0;
+        for (int t = 0; t < tileNum; ++t)
+        {
+            tileOffset[t] = total;
+            for (int c = 0; c < chunkNum; ++c)
+            {
+                const int n = slot[size_t(c) * tileNum + t];
+                slot[size_t(c) * tileNum + t] = total;
+                total += n;
+            }
+        }
+        tileOffset[tileNum] = total;
+        std::vector<int> tileFace(total);
+#pragma omp parallel for schedule(static, 1)
+        for (int c = 0; c < chunkNum; ++c)
+        {
+            int *cursor = &slot[size_t(c) * tileNum];
+            for (int i = bnd[c]; i < bnd[c + 1]; ++i)
+            {
+                vcg::Box2i r;
+                if (!TexelRange(m.face[i], texNum, textureWidth, textureHeight, r)) continue;
+                const int base = m.face[i].cWT(0).N() * tilesPerTex;
+                for (int ty = r.min[1] / TileSize; ty <= r.max[1] / TileSize; ++ty)
+                    for (int tx = r.min[0] / TileSize; tx <= r.max[0] / TileSize; ++tx)
+                        tileFace[cursor[base + ty * tilesX + tx]++] = i;
+            }
+        }
+
+        std::atomic<int> tileDone(0);
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int t = 0; t < tileNum; ++t)
+        {
+            if (tileOffset[t] < tileOffset[t + 1])
+            {
+                const int tx = (t % tilesPerTex) % tilesX;
+                const int ty = (t % tilesPerTex) / tilesX;
+                vcg::Box2i clip;
+                clip.min = vcg::Point2i(tx * TileSize, ty * TileSize);
+                clip.max = vcg::Point2i(std::min(clip.min[0] + TileSize, textureWidth) - 1,
+                                        std::min(clip.min[1] + TileSize, textureHeight) - 1);
+                for (int k = tileOffset[t]; k < tileOffset[t + 1]; ++k)
+                {
+                    const CMeshO::FaceType &f = m.face[tileFace[k]];
+                    Point2x ti[3];
+                    for (int i = 0; i < 3; ++i)
+                        ti[i] = TexelCoord(f, i, textureWidth, textureHeight);
+                    SingleFaceRaster(f, ps, ti[0], ti[1], ti[2], correctSafePointsBaryCoords, clip);
+                }
+            }
+            const int done = ++tileDone;
+            if (cb && MLParallel::ThreadId() == 0)
+                cb(start + int((long long)(done) * offset / tileNum), "Rasterizing faces ...");
+        }
+    }
+
+    /// Same as SurfaceSampling<>::AllVertex; the sampler is shared by all the threads.
+    template <class Sampler>
+    static void AllVertex(CMeshO &m, Sampler &ps, vcg::CallBackPos *cb = 0)
+    {
+        const int vertNum = int(m.vert.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (int i = 0; i < vertNum; ++i)
+        {
+            if (!m.vert[i].IsD())
+                ps.AddVert(m.vert[i]);
+            if (cb && (i % 1024) == 0 && MLParallel::ThreadId() == 0)
+                cb(int((long long)(i) * 100 / vertNum), "Sampling vertices ...");
+        }
+    }
+
+    /** Set to opaque the semi-transparent texels written by the samples outside
+     * the border edges. When keepEmpty is true the fully transparent texels
+     * are left untouched, so that they can be filled by the pull-push.
+     */
+    static void MakeOpaque(QImage &img, bool keepEmpty)
+    {
+        assert(img.format() == QImage::Format_ARGB32);
+        const int h = img.height();
+        const int w = img.width();
+        // take the scanline pointers here: scanLine() may detach the image
+        std::vector<QRgb *> rows(h);
+        for (int y = 0; y < h; ++y)
+            rows[y] = reinterpret_cast<QRgb *>(img.scanLine(y));
+#pragma omp parallel for schedule(static)
+        for (int y = 0; y < h; ++y)
+        {
+            QRgb *row = rows[y];
+            for (int x = 0; x < w; ++x)
+                if (qAlpha(row[x]) < 255 && (!keepEmpty || qAlpha(row[x]) > 0))
+                    row[x] |= 0xff000000;
+        }
+    }
+
+private:
+    static Point2x TexelCoord(const CMeshO::FaceType &f, int i, int textureWidth, int textureHeight)
+    {
+        // - 0.5 constants are used to obtain correct texture mapping
+        return Point2x(f.cWT(i).U() * textureWidth - 0.5, f.cWT(i).V() * textureHeight - 0.5);
+    }
+
+    // The texels touched by SingleFaceRaster on face f, clipped to the texture.
+    static bool TexelRange(const CMeshO::FaceType &f, int texNum, int textureWidth, int textureHeight, vcg::Box2i &r)
+    {
+        if (f.IsD() || f.cWT(0).N() < 0 || f.cWT(0).N() >= texNum) return false;
+        vcg::Box2<ScalarType> bboxf;
+        for (int i = 0; i < 3; ++i)
+            bboxf.Add(TexelCoord(f, i, textureWidth, textureHeight));
+        r.min[0] = std::max(int(floor(bboxf.min[0])) - 1, 0);
+        r.min[1] = std::max(int(floor(bboxf.min[1])) - 1, 0);
+        r.max[0] = std::min(int(ceil(bboxf.max[0])) + 1, textureWidth - 1);
+        r.max[1] = std::min(int(ceil(bboxf.max[1])) + 1, textureHeight - 1);
+        return r.min[0] <= r.max[0] && r.min[1] <= r.max[1];
+    }
+
+    /* SurfaceSampling<>::SingleFaceRaster restricted to the texels of clip.
+     * The edge functions are evaluated directly at each texel rather than
+     * incrementally, so that their value does not depend on where the clipped
+     * scan starts.
+     */
+    template <class Sampler>
+    static void SingleFaceRaster(const CMeshO::FaceType &f, Sampler &ps,
+                                 const Point2x &v0, const Point2x &v1, const Point2x &v2,
+                                 bool correctSafePointsBaryCoords, const vcg::Box2i &clip)
+    {
+        typedef ScalarType S;
+        vcg::Box2<S> bboxf;
+        bboxf.Add(v0);
+        bboxf.Add(v1);
+        bboxf.Add(v2);
+        const int x0 = std::max(int(floor(bboxf.min[0])) - 1, clip.min[0]);
+        const int y0 = std::max(int(floor(bboxf.min[1])) - 1, clip.min[1]);
+        const int x1 = std::min(int(ceil(bboxf.max[0])) + 1, clip.max[0]);
+        const int y1 = std::min(int(ceil(bboxf.max[1])) + 1, clip.max[1]);
+        if (x0 > x1 || y0 > y1) return;
+
+        const Point2x v[3] = { v0, v1, v2 };
+        const Point2x d[3] = { v1 - v0, v2 - v1, v0 - v2 };
+
+        // Calculating orientation
+        const bool flipped = !(d[2] * Point2x(-d[0][1], d[0][0]) >= 0);
+
+        // Calculating border edges
+        vcg::Segment2<S> borderEdges[3];
+        S edgeLength[3] = { 0, 0, 0 };
+        unsigned char edgeMask = 0;
+        for (int i = 0; i < 3; ++i)
+            if (f.IsB(i))
+            {
+                borderEdges[i] = vcg::Segment2<S>(v[i], v[(i + 1) % 3]);
+                edgeLength[i] = borderEdges[i].Length();
+                edgeMask |= (1 << i);
+            }
+
+        const double de = v0[0]*v1[1]-v0[0]*v2[1]-v1[0]*v0[1]+v1[0]*v2[1]-v2[0]*v1[1]+v2[0]*v0[1];
+
+        for (int x = x0; x <= x1; ++x)
+            for (int y = y0; y <= y1; ++y)
+            {
+                S n[3];
+                for (int i = 0; i < 3; ++i)
+                    n[i] = (x - v[i][0]) * d[i][1] - (y - v[i][1]) * d[i][0];
+
+                if (((n[0] >= 0 && n[1] >= 0 && n[2] >= 0) || (n[0] <= 0 && n[1] <= 0 && n[2] <= 0)) && (de != 0))
+                {
+                    CMeshO::CoordType baryCoord;
+                    baryCoord[0] =  double(-y*v1[0]+v2[0]*y+v1[1]*x-v2[0]*v1[1]+v1[0]*v2[1]-x*v2[1])/de;
+                    baryCoord[1] = -double( x*v0[1]-x*v2[1]-v0[0]*y+v0[0]*v2[1]-v2[0]*v0[1]+v2[0]*y)/de;
+                    baryCoord[2] = 1-baryCoord[0]-baryCoord[1];
+                    ps.AddTextureSample(f, baryCoord, vcg::Point2i(x, y), 0);
+                }
+                else if (edgeMask)
+                {
+                    // Check whether a pixel outside (on a border edge side) triangle affects color inside it
+                    const Point2x px(x, y);
+                    Point2x closePoint;
+                    int closeEdge = -1;
+                    S minDst = FLT_MAX;
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        if (!(edgeMask & (1 << i))) continue;
+                        if ((!flipped && n[i] < 0) || (flipped && n[i] > 0))
+                        {
+                            const Point2x close = vcg::ClosestPoint(borderEdges[i], px);
+                            const S dst = (close - px).Norm();
+                            if (dst < minDst &&
+                                close.X() > px.X() - 1 && close.X() < px.X() + 1 &&
+                                close.Y() > px.Y() - 1 && close.Y() < px.Y() + 1)
+                            {
+                                minDst = dst;
+                                closePoint = close;
+                                closeEdge = i;
+                            }
+                        }
+                    }
+                    if (closeEdge >= 0)
+                    {
+                        CMeshO::CoordType baryCoord;
+                        if (correctSafePointsBaryCoords)
+                        {
+                            // Add x,y sample with closePoint barycentric coords (on edge)
+                            baryCoord[closeEdge] = (closePoint - borderEdges[closeEdge].P(1)).Norm() / edgeLength[closeEdge];
+                            baryCoord[(closeEdge + 1) % 3] = 1 - baryCoord[closeEdge];
+                            baryCoord[(closeEdge + 2) % 3] = 0;
+                        }
+                        else
+                        {
+                            // Add x,y sample with his own barycentric coords (off edge)
+                            baryCoord[0] =  double(-y*v1[0]+v2[0]*y+v1[1]*x-v2[0]*v1[1]+v1[0]*v2[1]-x*v2[1])/de;
+                            baryCoord[1] = -double( x*v0[1]-x*v2[1]-v0[0]*y+v0[0]*v2[1]-v2[0]*v0[1]+v2[0]*y)/de;
+                            baryCoord[2] = 1-baryCoord[0]-baryCoord[1];
+                        }
+                        ps.AddTextureSample(f, baryCoord, vcg::Point2i(x, y), minDst);
+                    }
+                }
+            }
+    }
+};
+
+#endif
@@ -26,6 +26,7 @@
 #include <vcg/complex/algorithms/smooth.h>
 #include <vcg/complex/algorithms/crease_cut.h>
 #include <vcg/complex/algorithms/harmonic.h>
+#include <common/ml_parallel_smooth.h>
 
 using namespace vcg;
 using namespace std;
@@ -279,8 +280,6 @@ int FilterUnsharp::postCondition(QAction *a) const
 {
   switch(ID(action))
   {
-    case FP_TWO_STEP_SMOOTH:      return MeshModel::MM_VERTFACETOPO;
-
     case FP_CREASE_CUT :
     case FP_UNSHARP_NORMAL:
     case FP_RECOMPUTE_QUADFACE_NORMAL :
@@ -293,6 +292,7 @@ int FilterUnsharp::postCondition(QAction *a) const
     case FP_DIRECTIONAL_PRESERVATION:
     case FP_LINEAR_MORPH :
     case FP_HC_LAPLACIAN_SMOOTH:
+    case FP_TWO_STEP_SMOOTH:
     case FP_SD_LAPLACIAN_SMOOTH:
     case FP_TAUBIN_SMOOTH:
     case FP_DEPTH_SMOOTH:
@@ -439,7 +439,7 @@ bool FilterUnsharp::applyFilter(QAction *filter, MeshDocument &md, RichParameter
       bool cotangentWeight = par.getBool("cotangentWeight");
       if(!boundarySmooth) tri::UpdateFlags<CMeshO>::FaceClearB(m.cm);
 
-      tri::Smooth<CMeshO>::VertexCoordLaplacian(m.cm,stepSmoothNum,Selected,cotangentWeight,cb);
+      tri::ParallelSmooth<CMeshO>::VertexCoordLaplacian(m.cm,stepSmoothNum,Selected,cotangentWeight,cb);
       Log( "Smoothed %d vertices", Selected ? m.cm.svn : m.cm.vn);
       m.UpdateBoxAndNormals();
       }
@@ -509,7 +509,7 @@ bool FilterUnsharp::applyFilter(QAction *filter, MeshDocument &md, RichParameter
             // Small hack
             tri::UpdateFlags<CMeshO>::FaceClearB(m.cm);
             float delta = par.getAbsPerc("delta");
-            tri::Smooth<CMeshO>::VertexCoordScaleDependentLaplacian_Fujiwara(m.cm,stepSmoothNum,delta);
+            tri::ParallelSmooth<CMeshO>::VertexCoordScaleDependentLaplacian_Fujiwara(m.cm,stepSmoothNum,delta);
             Log( "Smoothed %d vertices", cnt>0 ? cnt : m.cm.vn);
             m.UpdateBoxAndNormals();
       }
@@ -518,7 +518,7 @@ bool FilterUnsharp::applyFilter(QAction *filter, MeshDocument &md, RichParameter
       {
             tri::UpdateFlags<CMeshO>::FaceBorderFromNone(m.cm);
             size_t cnt=tri::UpdateSelection<CMeshO>::VertexFromFaceStrict(m.cm);
-            tri::Smooth<CMeshO>::VertexCoordLaplacianHC(m.cm,1,cnt>0);
+            tri::ParallelSmooth<CMeshO>::VertexCoordLaplacianHC(m.cm,1,cnt>0);
             m.UpdateBoxAndNormals();
       }
         break;
@@ -538,7 +538,7 @@ bool FilterUnsharp::applyFilter(QAction *filter, MeshDocument &md, RichParameter
       for(int i=0;i<stepSmoothNum;++i)
       {
         tri::UpdateNormal<CMeshO>::PerFaceNormalized(m.cm);
-        tri::Smooth<CMeshO>::VertexCoordPasoDoble(m.cm, stepNormalNum, sigma, stepFitNum,selectedFlag);
+        tri::ParallelSmooth<CMeshO>::VertexCoordPasoDoble(m.cm, stepNormalNum, sigma, stepFitNum,selectedFlag);
       }
       m.UpdateBoxAndNormals();
     }
@@ -551,7 +551,7 @@ bool FilterUnsharp::applyFilter(QAction *filter, MeshDocument &md, RichParameter
             float mu=par.getFloat("mu");
 
             size_t cnt=tri::UpdateSelection<CMeshO>::VertexFromFaceStrict(m.cm);
-      tri::Smooth<CMeshO>::VertexCoordTaubin(m.cm,stepSmoothNum,lambda,mu,cnt>0,cb);
+      tri::ParallelSmooth<CMeshO>::VertexCoordTaubin(m.cm,stepSmoothNum,lambda,mu,cnt>0,cb);
             Log( "Smoothed %d vertices", cnt>0 ? cnt : m.cm.vn);
             m.UpdateBoxAndNormals();
       }
@@ -629,7 +629,7 @@ bool FilterUnsharp::applyFilter(QAction *filter, MeshDocument &md, RichParameter
                 for(int i=0;i<m.cm.vn;++i)
                     geomOrig[i]=m.cm.vert[i].P();
 
-                tri::Smooth<CMeshO>::VertexCoordLaplacian(m.cm,smoothIter);
+                tri::ParallelSmooth<CMeshO>::VertexCoordLaplacian(m.cm,smoothIter);
 
                 for(int i=0;i<m.cm.vn;++i)
                     m.cm.vert[i].P()=geomOrig[i]*alphaorig + (geomOrig[i] - m.cm.vert[i].P())*alpha;
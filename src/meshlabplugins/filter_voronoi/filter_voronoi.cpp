@@ -24,6 +24,7 @@
 #include "filter_voronoi.h"
 
 #include<vcg/complex/algorithms/voronoi_processing.h>
+#include <common/ml_parallel_geodesic.h>
 #include<vcg/complex/algorithms/update/curvature.h>
 #include<vcg/complex/algorithms/update/curvature_fitting.h>
 #include<vcg/complex/algorithms/update/quality.h>
@@ -334,7 +335,7 @@ bool FilterVoronoiPlugin::voronoiSampling(
 			if(relaxType==2) {
 				tri::VoronoiProcessing<CMeshO, EuclideanDistance<CMeshO> >::RestrictedVoronoiRelaxing(m.cm, pointVec, fixedVec, 10,vpp);
 				tri::VoronoiProcessing<CMeshO>::SeedToVertexConversion(m.cm,pointVec,seedVec);
-				tri::VoronoiProcessing<CMeshO>::ComputePerVertexSources(m.cm,seedVec,dd);
+				tri::ParallelGeodesic<CMeshO>::ComputePerVertexSources(m.cm,seedVec,dd);
 			}
 			else {
 				tri::VoronoiProcessing<CMeshO, EuclideanDistance<CMeshO> >::VoronoiRelaxing(m.cm, seedVec, 1,dd,vpp);
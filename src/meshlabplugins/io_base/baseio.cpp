@@ -22,6 +22,7 @@
 ****************************************************************************/
 
 #include "baseio.h"
+#include <common/ml_parallel_clean.h>
 
 #include <wrap/io_trimesh/import_ply.h>
 #include <wrap/io_trimesh/import_stl.h>
@@ -138,7 +139,7 @@ bool BaseMeshIOPlugin::open(const QString &formatName, const QString &fileName,
 		RichParameter* stlunif = parlst.findParameter(stlUnifyParName());
 		if ((stlunif != NULL) && (stlunif->val->getBool()))
 		{
-			tri::Clean<CMeshO>::RemoveDuplicateVertex(m.cm);
+			tri::ParallelClean<CMeshO>::RemoveDuplicateVertex(m.cm);
 			tri::Allocator<CMeshO>::CompactEveryVector(m.cm);
 		}
 
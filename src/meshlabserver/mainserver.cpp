@@ -31,6 +31,7 @@
 #include <common/meshlabdocumentbundler.h>
 #include <common/mlexception.h>
 #include <common/filterparameter.h>
+#include <common/ml_parallel_update.h>
 #include <wrap/qt/qt_thread_safe_memory_info.h>
 #include <wrap/io_trimesh/alnParser.h>
 
@@ -80,7 +81,7 @@ public:
 
     void loadPlugins()
     {
-        PM.loadPlugins(defaultGlobal);
+        PM.loadPlugins(defaultGlobal, false);
 
         printf("Total %i filtering actions\n", PM.actionFilterMap.size());
         printf("Total %i io plugins\n", PM.meshIOPlugins().size());
@@ -185,7 +186,7 @@ public:
             if( mask & vcg::tri::io::Mask::IOM_VERTNORMAL) // the mesh already has its per vertex normals (point clouds)
             {
                 vcg::tri::UpdateNormal<CMeshO>::PerFace(mm.cm);
-                vcg::tri::UpdateBounding<CMeshO>::Box(mm.cm);					// updates bounding box
+                vcg::tri::ParallelUpdateBounding<CMeshO>::Box(mm.cm);					// updates bounding box
             }
             else mm.UpdateBoxAndNormals(); // the very standard case
         }
@@ -329,12 +330,12 @@ public:
         } // standard case
         else
         {
-            vcg::tri::UpdateNormal<CMeshO>::PerFaceNormalized(mm->cm);
+            vcg::tri::ParallelUpdateNormal<CMeshO>::PerFaceNormalized(mm->cm);
             if(!( mask & vcg::tri::io::Mask::IOM_VERTNORMAL) )
-                vcg::tri::UpdateNormal<CMeshO>::PerVertexAngleWeighted(mm->cm);
+                vcg::tri::ParallelUpdateNormal<CMeshO>::PerVertexAngleWeighted(mm->cm);
         }
 
-        vcg::tri::UpdateBounding<CMeshO>::Box(mm->cm);					// updates bounding box
+        vcg::tri::ParallelUpdateBounding<CMeshO>::Box(mm->cm);					// updates bounding box
         if(mm->cm.fn==0 && mm->cm.en==0)
         {
             if(mask & vcg::tri::io::Mask::IOM_VERTNORMAL)
@@ -691,6 +692,9 @@ public:
             meshDocument.setBusy(true);
             ret = iFilter->applyFilter( action, meshDocument, pairold->pair.second, filterCallBack);
             meshDocument.setBusy(false);
+            const int postCondMask = iFilter->postCondition(action);
+            for(MeshModel* mm = meshDocument.nextMesh();mm != NULL;mm = meshDocument.nextMesh(mm))
+                mm->clearKNNGraph(postCondMask);
             if (shared != NULL)
                 delete iFilter->glContext;
             delete wid;
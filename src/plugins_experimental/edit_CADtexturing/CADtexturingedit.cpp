@@ -291,9 +291,7 @@ void CADtexturingEditPlugin::renderEdges(GLArea * gla){
 		/*save edges of the raster*/
 		Plane * pl = gla->mvc()->meshDoc.rm()->currentPlane;
 
-		if (!pl->IsInCore()) pl->Load();
-
-		detect_edges(pl->image,"imageedges.jpg");
+		detect_edges(pl->image(),"imageedges.jpg");
 		/**************************/
 
 		saveRenderingTrigger = false;
@@ -33,6 +33,12 @@ target_link_libraries({{name}}
     external-glew
     PRIVATE
     external-jhead)
+
+# The parallel algorithms in ml_parallel_*.h are header only templates:
+# make OpenMP available to every target that links to common.
+if(OpenMP_CXX_FOUND)
+    target_link_libraries({{name}} PUBLIC OpenMP::OpenMP_CXX)
+endif()
 {% endblock %}
 
 {% block output_dir %}{% endblock %}
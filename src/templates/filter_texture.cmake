@@ -10,6 +10,8 @@ ${VCGDIR}/wrap/qt/outline2_rasterizer.cpp
 rastering.h
 filter_texture.h
 pushpull.h
+texture_baker.h
+parallel_atlas.h
 ${VCGDIR}/vcg/complex/algorithms/parametrization/voronoi_atlas.h
 {% endblock headers %}
 